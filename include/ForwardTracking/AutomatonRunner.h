@@ -0,0 +1,200 @@
+#ifndef AutomatonRunner_h
+#define AutomatonRunner_h
+
+#include <vector>
+
+#include "marlin/VerbosityLevels.h"
+
+#include "KiTrack/Automaton.h"
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/IHit.h"
+#include "Tools/KiTrackMarlinCEDTools.h"
+
+#include "BatchedCriteria.h"
+#include "EventContext.h"
+#include "FlatAutomaton.h"
+#include "StageTimer.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** How runCellularAutomaton() ended */
+   enum AutomatonResult{
+
+      AUTOMATON_DONE,                 ///< the 3-hit segments are done, the tracks are theirs
+      AUTOMATON_STOPPED_OVER_TIME,    ///< the event ran out of time after the 2-hit segments, the tracks are theirs
+      AUTOMATON_TOO_MANY_CONNECTIONS  ///< the automaton has to be redone with tighter cuts, there are no tracks
+
+   };
+
+
+   /** The settings of runCellularAutomaton(), the same for all automata of an event */
+   struct AutomatonSettings{
+
+      AutomatonSettings(): maxConnections( 0 ), drawSegments( false ), stopOverTime( false ), stage2Hit( 0 ), stage3Hit( 0 ){}
+
+      /** more connections after a step and the automaton is redone with tighter cuts */
+      unsigned maxConnections;
+
+      /** whether the 1-hit segments get drawn with CED */
+      bool drawSegments;
+
+      /** whether the 3-hit segments are skipped when the event is over time */
+      bool stopOverTime;
+
+      /** the stages of the EventContext's StageTimer::EventTimes for the 2-hit and the 3-hit segments */
+      unsigned stage2Hit;
+      unsigned stage3Hit;
+
+   };
+
+
+   // CED only knows the segments of the KiTrack automaton
+   inline void drawAutomaton( KiTrack::Automaton& automaton ){ drawAutomatonSegments( automaton ); }
+
+   inline void drawAutomaton( FlatAutomaton& ){
+
+      streamlog_out( DEBUG4 ) << "The segments of the flat automaton are not drawn\n";
+
+   }
+
+   // The KiTrack automaton only takes the criteria one by one
+   inline void addAutomatonCriteria( KiTrack::Automaton& automaton, const std::vector< KiTrack::ICriterion* >& criteria,
+                                     const BatchedCriteria* ){
+
+      automaton.addCriteria( criteria );
+
+   }
+
+   inline void addAutomatonCriteria( FlatAutomaton& automaton, const std::vector< KiTrack::ICriterion* >& criteria,
+                                     const BatchedCriteria* batchedCriteria ){
+
+      if( batchedCriteria != NULL ) automaton.addCriteria( *batchedCriteria );
+      else automaton.addCriteria( criteria );
+
+   }
+
+
+   /** @return whether the automaton has more connections than allowed (and says so) */
+   template< class AutomatonType >
+   bool hasTooManyConnections( AutomatonType& automaton, unsigned maxConnections ){
+
+      if( automaton.getNumberOfConnections() <= maxConnections ) return false;
+
+      streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
+      << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << maxConnections << " )\n";
+
+      return true;
+
+   }
+
+
+   /** Lengthens the 1-hit segments of the automaton to 2- and 3-hit segments and runs the Cellular Automaton on them.
+    * Works with the KiTrack::Automaton and the FlatAutomaton, for the ForwardTracking and the SiliconEndcapTracking.
+    *
+    * @param crit3Batch, crit4Batch the criteria as batched criteria, used instead of the vectors by the FlatAutomaton. May be NULL.
+    *
+    * @param rawTracks set to the tracks of the automaton, unless it has too many connections
+    */
+   template< class AutomatonType >
+   AutomatonResult runCellularAutomaton( AutomatonType& automaton,
+                                         const std::vector< KiTrack::ICriterion* >& crit3Vec,
+                                         const std::vector< KiTrack::ICriterion* >& crit4Vec,
+                                         const BatchedCriteria* crit3Batch,
+                                         const BatchedCriteria* crit4Batch,
+                                         const AutomatonSettings& settings,
+                                         EventContext& ctx,
+                                         std::vector< std::vector< KiTrack::IHit* > >& rawTracks ){
+
+
+      // Check if there are not too many connections
+      if( hasTooManyConnections( automaton, settings.maxConnections ) ) return AUTOMATON_TOO_MANY_CONNECTIONS;
+
+
+      streamlog_out( DEBUG4 ) << "\t\t---Automaton---\n" ;
+
+      if( settings.drawSegments ) drawAutomaton( automaton ); // draws the 1-segments (i.e. hits)
+
+
+      /*******************************/
+      /*      2-hit segments         */
+      /*******************************/
+
+      streamlog_out( DEBUG4 ) << "\t\t--2-hit-Segments--\n" ;
+
+      StageTimer::Scope timeAutomaton2Hit( ctx.getStageTimes(), settings.stage2Hit );
+
+      streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
+
+      automaton.clearCriteria();
+      addAutomatonCriteria( automaton, crit3Vec, crit3Batch );  // Add the criteria for 3 hits (i.e. 2 2-hit segments )
+
+      // Let the automaton lengthen its 1-hit-segments to 2-hit-segments
+      automaton.lengthenSegments();
+
+      // So now we have 2-hit-segments and are ready to perform the Cellular Automaton.
+      automaton.doAutomaton();
+
+      // Clean segments with bad states
+      automaton.cleanBadStates();
+
+      // Reset the states of all segments
+      automaton.resetStates();
+
+      streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
+
+      if( hasTooManyConnections( automaton, settings.maxConnections ) ) return AUTOMATON_TOO_MANY_CONNECTIONS;
+
+
+      /*******************************/
+      /*      3-hit segments         */
+      /*******************************/
+
+      streamlog_out( DEBUG4 ) << "\t\t--3-hit-Segments--\n" ;
+
+      timeAutomaton2Hit.stop();
+
+      // Without time for the 3-hit segments, take the tracks as they are after the 2-hit segments
+      if( settings.stopOverTime && ctx.isOverTime() ){
+
+         streamlog_out( DEBUG4 ) << "Out of time: the 3-hit segments are skipped\n";
+
+         rawTracks = automaton.getTracks( 3 );
+         return AUTOMATON_STOPPED_OVER_TIME;
+
+      }
+
+      StageTimer::Scope timeAutomaton3Hit( ctx.getStageTimes(), settings.stage3Hit );
+
+      automaton.clearCriteria();
+      addAutomatonCriteria( automaton, crit4Vec, crit4Batch );
+
+      // Lengthen the 2-hit-segments to 3-hits-segments
+      automaton.lengthenSegments();
+
+      // Perform the Cellular Automaton
+      automaton.doAutomaton();
+
+      //Clean segments with bad states
+      automaton.cleanBadStates();
+
+      //Reset the states of all segments
+      automaton.resetStates();
+
+      streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
+
+      if( hasTooManyConnections( automaton, settings.maxConnections ) ) return AUTOMATON_TOO_MANY_CONNECTIONS;
+
+      // get the raw tracks (raw track = just a vector of hits, the most rudimentary form of a track)
+      rawTracks = automaton.getTracks( 3 );
+
+      return AUTOMATON_DONE;
+
+   }
+
+
+}
+
+
+#endif
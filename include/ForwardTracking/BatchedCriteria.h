@@ -0,0 +1,126 @@
+#ifndef BatchedCriteria_h
+#define BatchedCriteria_h
+
+#include <string>
+#include <vector>
+
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/IHit.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Pairs of segments (a parent and a child) to be checked by criteria, as structure of arrays.
+    *
+    * The two segments of a pair overlap in all hits but one, so a pair has one hit more than a segment.
+    * The hits are numbered from the inner to the outer one: the child has the hits 0 ... n-2, the parent 1 ... n-1.
+    * The coordinates of the same hit of all pairs are contiguous.
+    */
+   class SegmentPairBatch{
+
+
+   public:
+
+      /** @param nHits the number of hits of a pair (2 for pairs of 1-hit segments) */
+      explicit SegmentPairBatch( unsigned nHits );
+
+      /** @return the number of hits of a pair */
+      unsigned getNumberOfHits() const { return _x.size(); }
+
+      /** @return the number of pairs */
+      unsigned size() const { return _x[0].size(); }
+
+      void clear();
+
+      /** Adds a pair.
+       *
+       * @param hits the hits of the pair, from the inner to the outer one
+       */
+      void add( KiTrack::IHit* const* hits );
+
+      /** @return the x coordinates of hit k of all pairs */
+      const float* getX( unsigned k ) const { return _x[k].data(); }
+      const float* getY( unsigned k ) const { return _y[k].data(); }
+      const float* getZ( unsigned k ) const { return _z[k].data(); }
+
+
+   private:
+
+      std::vector< std::vector< float > > _x;
+      std::vector< std::vector< float > > _y;
+      std::vector< std::vector< float > > _z;
+
+   };
+
+
+   /** Criteria of one type (2, 3 or 4 hits) that check many segment pairs at once.
+    *
+    * For some criteria there is a kernel: a loop over the coordinates of all pairs of a SegmentPairBatch, without
+    * virtual calls and branches, so the compiler can vectorise it. The kernels use the cuts of CriterionCuts.h and make
+    * the same decision as the KiTrack criterion of the same name (see test_batched_criteria). All other criteria are only kept and have to be
+    * checked with ICriterion::areCompatible() on the pairs the kernels accept. As the cheap kernels go first, the
+    * other criteria get far fewer pairs.
+    *
+    * Kernels exist for Crit2_RZRatio, Crit2_StraightTrackRatio and Crit3_3DAngle.
+    */
+   class BatchedCriteria{
+
+
+   public:
+
+      /** Only the other criteria, without kernels (the cut off values of the criteria are not known) */
+      explicit BatchedCriteria( const std::vector< KiTrack::ICriterion* >& criteria );
+
+      /**
+       * @param criteria the criteria, not owned. All of the same type.
+       *
+       * @param minima, maxima the cut off values the criteria were created with
+       */
+      BatchedCriteria( const std::vector< KiTrack::ICriterion* >& criteria,
+                       const std::vector< float >& minima,
+                       const std::vector< float >& maxima );
+
+      /** Checks the pairs with all kernels.
+       *
+       * @param batch the pairs, with as many hits as the criteria are made for
+       *
+       * @param accepted one entry per pair, set to 0 for every pair that fails a kernel
+       */
+      void evaluateKernels( const SegmentPairBatch& batch, std::vector< unsigned char >& accepted ) const;
+
+      unsigned getNumberOfKernels() const { return _kernels.size(); }
+
+      /** @return the criteria without a kernel */
+      const std::vector< KiTrack::ICriterion* >& getOtherCriteria() const { return _otherCriteria; }
+
+      /** @return whether the other criteria accept the pair */
+      bool areCompatible( KiTrack::Segment* parent, KiTrack::Segment* child ) const;
+
+      /** @return whether there is a kernel for the criterion of this name */
+      static bool hasKernel( const std::string& name );
+
+
+   private:
+
+      enum KernelType{ KERNEL_RZ_RATIO, KERNEL_STRAIGHT_TRACK_RATIO, KERNEL_3D_ANGLE };
+
+      struct Kernel{
+
+         KernelType type;
+         float min;
+         float max;
+
+      };
+
+      std::vector< Kernel > _kernels;
+
+      std::vector< KiTrack::ICriterion* > _otherCriteria;
+
+   };
+
+
+}
+
+
+#endif
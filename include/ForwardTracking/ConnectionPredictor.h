@@ -0,0 +1,83 @@
+#ifndef ConnectionPredictor_h
+#define ConnectionPredictor_h
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "KiTrack/IHit.h"
+#include "KiTrack/ISectorConnector.h"
+
+#include "SectorHitStore.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Predicts the number of connections of the 1-segment automaton for the rounds of criteria, so that the reconstruction
+    * can start in the first round that is expected to have not too many connections.
+    *
+    * The estimate is the number of hit pairs the sector connector allows (this only needs the number of hits per sector)
+    * times the fraction of these pairs the 2-hit criteria of the round accepted in the previous events. This fraction
+    * is a moving average, updated after every round that was really done. A round is only skipped, if there is already
+    * a fraction known for it.
+    *
+    * The methods can be called from several threads at once.
+    */
+   class ConnectionPredictor{
+
+
+   public:
+
+      /**
+       * @param nRounds the number of rounds of criteria
+       *
+       * @param weight the weight of a new event in the moving average of the accepted fraction
+       */
+      ConnectionPredictor( unsigned nRounds, double weight = 0.2 );
+
+      /** @return the number of hit pairs the sector connector allows between the hits of the passed sectors
+       * (the hits of other sectors are left out) */
+      static double countHitPairs( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                                   KiTrack::ISectorConnector* sectorConnector );
+
+      /** @return the predicted number of connections in a round or a negative value if nothing is known about the round yet */
+      double predict( unsigned round, double nHitPairs ) const;
+
+      /** @return the first round, that is not predicted to have more than maxConnections connections */
+      unsigned getStartRound( double nHitPairs, unsigned maxConnections ) const;
+
+      /** Tells the predictor how many connections a round really had */
+      void update( unsigned round, double nHitPairs, unsigned nConnections );
+
+      /** Tells the predictor, that an event started in a later round than round 0 */
+      void countSkippedRounds( unsigned nSkipped );
+
+      /** Prints how well the predictions matched the real number of connections */
+      void printSummary() const;
+
+
+   private:
+
+      unsigned _nRounds;
+      double _weight;
+
+      mutable std::mutex _mutex;
+
+      /** the moving average of the fraction of hit pairs that became connections, per round. Negative = unknown */
+      std::vector< double > _acceptance;
+
+      /** per round: the number of predictions compared to the real number of connections and the sum of the relative errors */
+      std::vector< unsigned > _nComparisons;
+      std::vector< double > _sumRelativeError;
+
+      unsigned _nEventsSkipping;
+      unsigned _nRoundsSkipped;
+
+   };
+
+
+}
+
+
+#endif
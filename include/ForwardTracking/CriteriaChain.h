@@ -0,0 +1,249 @@
+#ifndef CriteriaChain_h
+#define CriteriaChain_h
+
+#include <string>
+#include <vector>
+#include <sstream>
+
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/IHit.h"
+#include "KiTrack/Segment.h"
+#include "KiTrack/KiTrackExceptions.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** The standard sets of criteria, for which there is a compiled CriteriaChain */
+   enum CriteriaChainSet{ CRITERIA_CHAIN_NONE, CRITERIA_CHAIN_FTD, CRITERIA_CHAIN_ENDCAP };
+
+
+   /** @return a CriteriaChain for the criteria, if they are (in any order) the criteria of the standard set for their
+    * number of hits. Else NULL, and the criteria have to be used one by one.
+    *
+    * @param criteria the criteria, all of the same type. Not owned by the chain, they must live longer than it.
+    *
+    * @param minima, maxima the cut off values the criteria were created with
+    */
+   KiTrack::ICriterion* createCriteriaChain( CriteriaChainSet set,
+                                             const std::vector< KiTrack::ICriterion* >& criteria,
+                                             const std::vector< float >& minima,
+                                             const std::vector< float >& maxima );
+
+
+   /** An element of a CriteriaChain for a criterion that has a cut in CriterionCuts.h: it is checked inline on the coordinates of the hits */
+   template< class CutType >
+   class CutElement{
+
+
+   public:
+
+      static const bool needsCoordinates = true;
+
+      static const char* getName(){ return CutType::getName(); }
+
+      CutElement( KiTrack::ICriterion*, float min, float max ): _cut( min, max ){}
+
+      bool accept( KiTrack::Segment*, KiTrack::Segment*, const float* x, const float* y, const float* z ) const {
+
+         return _cut.accept( x, y, z );
+
+      }
+
+
+   private:
+
+      CutType _cut;
+
+   };
+
+
+   /** An element of a CriteriaChain for any other KiTrack criterion. It calls the areCompatible() of the known
+    * class of the criterion directly, without the virtual call.
+    *
+    * CriterionTraits has the class of the criterion as typedef Criterion and its name as getName().
+    */
+   template< class CriterionTraits >
+   class KiTrackElement{
+
+
+   public:
+
+      typedef typename CriterionTraits::Criterion Criterion;
+
+      static const bool needsCoordinates = false;
+
+      static const char* getName(){ return CriterionTraits::getName(); }
+
+      KiTrackElement( KiTrack::ICriterion* criterion, float, float ): _criterion( static_cast< Criterion* >( criterion ) ){}
+
+      bool accept( KiTrack::Segment* parent, KiTrack::Segment* child, const float*, const float*, const float* ) const {
+
+         return _criterion->Criterion::areCompatible( parent, child );
+
+      }
+
+
+   private:
+
+      Criterion* _criterion;
+
+   };
+
+
+   /** The elements of a CriteriaChain, checked one after the other until one rejects the pair */
+   template< class... Elements >
+   class ElementChain;
+
+   template<>
+   class ElementChain<>{
+
+
+   public:
+
+      static const bool needsCoordinates = false;
+
+      static void getNames( std::vector< std::string >& ){}
+
+      ElementChain( const std::vector< KiTrack::ICriterion* >&, const std::vector< float >&, const std::vector< float >& ){}
+
+      bool accept( KiTrack::Segment*, KiTrack::Segment*, const float*, const float*, const float* ) const { return true; }
+
+   };
+
+   template< class First, class... Rest >
+   class ElementChain< First, Rest... >{
+
+
+   public:
+
+      static const bool needsCoordinates = First::needsCoordinates || ElementChain< Rest... >::needsCoordinates;
+
+      static void getNames( std::vector< std::string >& names ){
+
+         names.push_back( First::getName() );
+         ElementChain< Rest... >::getNames( names );
+
+      }
+
+      /** Every element takes the criterion with its name */
+      ElementChain( const std::vector< KiTrack::ICriterion* >& criteria, const std::vector< float >& minima, const std::vector< float >& maxima ):
+      _first( criteria[ find( criteria ) ], minima[ find( criteria ) ], maxima[ find( criteria ) ] ),
+      _rest( criteria, minima, maxima ){}
+
+      bool accept( KiTrack::Segment* parent, KiTrack::Segment* child, const float* x, const float* y, const float* z ) const {
+
+         return _first.accept( parent, child, x, y, z ) && _rest.accept( parent, child, x, y, z );
+
+      }
+
+
+   private:
+
+      /** @return the index of the criterion of the first element. Throws, if there is none, as an element must not
+       * take (and cast) a criterion of another class. */
+      static unsigned find( const std::vector< KiTrack::ICriterion* >& criteria ){
+
+         for( unsigned i=0; i < criteria.size(); i++ ){
+
+            if( criteria[i]->getName() == First::getName() ) return i;
+
+         }
+
+         std::stringstream s;
+         s << "CriteriaChain: there is no criterion " << First::getName() << " for the chain";
+         throw KiTrack::KiTrackException( s.str() );
+
+      }
+
+      First _first;
+
+      ElementChain< Rest... > _rest;
+
+   };
+
+
+   /** A fixed set of criteria for segment pairs of nHits hits, compiled into one criterion.
+    *
+    * The criteria from the steering are ICriterion objects in a vector, so every check of a pair is a virtual call per
+    * criterion, and every criterion gets the hits from the segments again. The chain is one criterion for all of them:
+    * the hits are read once, the elements are checked in the order of the template arguments (the cheap inline cuts
+    * first) and the first one that rejects the pair ends the check. The decisions are the ones of the single criteria
+    * (the inline cuts are in float, so pairs right at a cut off value may differ).
+    */
+   template< unsigned nHits, class... Elements >
+   class CriteriaChain : public KiTrack::ICriterion{
+
+
+   public:
+
+      /**
+       * @param criteria the criteria, one for each element (found by name). Not owned.
+       *
+       * @param minima, maxima the cut off values the criteria were created with
+       */
+      CriteriaChain( const std::vector< KiTrack::ICriterion* >& criteria, const std::vector< float >& minima, const std::vector< float >& maxima ):
+      _elements( criteria, minima, maxima ){
+
+
+         _name = "CriteriaChain";
+         _type = criteria.front()->getType();
+
+         _saveValues = false;
+
+      }
+
+      /** @param names the names of the criteria of the elements are added to it */
+      static void getNames( std::vector< std::string >& names ){ ElementChain< Elements... >::getNames( names ); }
+
+      virtual bool areCompatible( KiTrack::Segment* parent , KiTrack::Segment* child ){
+
+
+         if( !ElementChain< Elements... >::needsCoordinates ) return _elements.accept( parent, child, NULL, NULL, NULL );
+
+         // the hits of the child and the outer hit of the parent, from the inner to the outer one
+         const std::vector< KiTrack::IHit* >& childHits = child->getHits();
+         const std::vector< KiTrack::IHit* >& parentHits = parent->getHits();
+
+         if( childHits.size() + 1 != nHits || parentHits.empty() ){
+
+            std::stringstream s;
+            s << "CriteriaChain: the child has " << childHits.size() << " hits instead of " << nHits - 1;
+            throw KiTrack::BadSegmentLength( s.str() );
+
+         }
+
+         float x[nHits];
+         float y[nHits];
+         float z[nHits];
+
+         for( unsigned k=0; k + 1 < nHits; k++ ){
+
+            x[k] = childHits[k]->getX();
+            y[k] = childHits[k]->getY();
+            z[k] = childHits[k]->getZ();
+
+         }
+
+         const KiTrack::IHit* outerHit = parentHits.back();
+
+         x[nHits-1] = outerHit->getX();
+         y[nHits-1] = outerHit->getY();
+         z[nHits-1] = outerHit->getZ();
+
+         return _elements.accept( parent, child, x, y, z );
+
+      }
+
+
+   private:
+
+      ElementChain< Elements... > _elements;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,134 @@
+#ifndef CriteriaRounds_h
+#define CriteriaRounds_h
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "KiTrack/ICriterion.h"
+
+#include "BatchedCriteria.h"
+#include "CriteriaChain.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** The criteria for all rounds of cut off values of the Cellular Automaton, created once.
+    *
+    * For every criterion a list of minima and maxima is given. Round i uses the i-th values, a criterion that has no
+    * i-th value keeps its last one. There are as many rounds as the longest list has values.
+    *
+    * The criteria are created once (when the processor is initialised) and afterwards only read, so all events and
+    * threads can share them. (They must not save their values, which KiTrack criteria only do after setSaveValues( true ).)
+    *
+    * After monitorCriteria() the order of the criteria of a type is learned while running: every criterion is wrapped
+    * in a MonitoredCriterion and every few events the criteria are sorted by their time per rejected pair, so that the
+    * cheap criteria that reject much come first. All rounds keep the same order.
+    */
+   class CriteriaRounds{
+
+
+   public:
+
+      /**
+       * @param criteriaNames the names of the criteria. Every one must exist and have at least one minimum and maximum.
+       *
+       * @param critMinima, critMaxima the cut off values of the criteria for all the rounds
+       *
+       * @param chainSet the standard set of criteria to compile: if the criteria of a type are the ones of this set,
+       * the vector of the type holds only their CriteriaChain. The batched criteria always get the single criteria.
+       */
+      CriteriaRounds( const std::vector< std::string >& criteriaNames,
+                      const std::map< std::string , std::vector< float > >& critMinima,
+                      const std::map< std::string , std::vector< float > >& critMaxima,
+                      CriteriaChainSet chainSet = CRITERIA_CHAIN_NONE );
+
+      ~CriteriaRounds();
+
+      CriteriaRounds( const CriteriaRounds& ) = delete;
+      CriteriaRounds& operator=( const CriteriaRounds& ) = delete;
+
+      unsigned getNumberOfRounds() const { return _crit2Vecs.size(); }
+
+      /** @return the criteria for 2 hits (2 1-hit segments) of a round. A copy, as the order may change. */
+      std::vector< KiTrack::ICriterion* > getCrit2Vec( unsigned round ) const;
+
+      /** @return the criteria for 3 hits (2 2-hit segments) of a round */
+      std::vector< KiTrack::ICriterion* > getCrit3Vec( unsigned round ) const;
+
+      /** @return the criteria for 4 hits (2 3-hit segments) of a round */
+      std::vector< KiTrack::ICriterion* > getCrit4Vec( unsigned round ) const;
+
+      /** @return the criteria for 2 hits of a round, for checking many pairs at once */
+      const BatchedCriteria* getCrit2Batch( unsigned round ) const { return _crit2Batches[round]; }
+
+      /** @return the criteria for 3 hits of a round, for checking many pairs at once */
+      const BatchedCriteria* getCrit3Batch( unsigned round ) const { return _crit3Batches[round]; }
+
+      /** @return the criteria for 4 hits of a round, for checking many pairs at once */
+      const BatchedCriteria* getCrit4Batch( unsigned round ) const { return _crit4Batches[round]; }
+
+      /** Starts measuring the criteria, to reorder them. Call before the criteria are used.
+       *
+       * @param reorderInterval the criteria are reordered every reorderInterval events
+       */
+      void monitorCriteria( unsigned reorderInterval );
+
+      /** Counts an event, the criteria get reordered after every reorderInterval events. Does nothing, if the criteria
+       * are not monitored.
+       */
+      void countEvent();
+
+      /** Sorts the criteria of every type by their measured time per rejected pair */
+      void reorderCriteria();
+
+      /** Prints the learned order of the criteria with their time and rejection rate, and an estimate of the time
+       * saved compared to the order of the steering. Does nothing, if the criteria are not monitored.
+       */
+      void printCriteriaOrder( const std::string& name ) const;
+
+
+   private:
+
+      /** Sorts the criteria of all rounds of one type by their time per rejected pair */
+      static void reorder( std::vector< std::vector< KiTrack::ICriterion* > >& critVecs );
+
+      /** Prints the order of the criteria of one type */
+      static void printOrder( const std::string& name, const std::string& type,
+                              const std::vector< std::vector< KiTrack::ICriterion* > >& critVecs,
+                              const std::vector< std::string >& steeringOrder );
+
+      std::vector< std::vector< KiTrack::ICriterion* > > _crit2Vecs;
+      std::vector< std::vector< KiTrack::ICriterion* > > _crit3Vecs;
+      std::vector< std::vector< KiTrack::ICriterion* > > _crit4Vecs;
+
+      std::vector< BatchedCriteria* > _crit2Batches;
+      std::vector< BatchedCriteria* > _crit3Batches;
+      std::vector< BatchedCriteria* > _crit4Batches;
+
+      /** all criteria and chains that were created */
+      std::vector< KiTrack::ICriterion* > _ownedCriteria;
+
+      /** the names of the criteria of every type in the order of the steering, for comparing with the learned order */
+      std::vector< std::string > _crit2SteeringOrder;
+      std::vector< std::string > _crit3SteeringOrder;
+      std::vector< std::string > _crit4SteeringOrder;
+
+      /** 0, if the criteria are not monitored */
+      unsigned _reorderInterval;
+
+      std::atomic< unsigned > _nEvents;
+
+      /** guards the order of the criteria */
+      mutable std::mutex _mutex;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,149 @@
+#ifndef CriterionCuts_h
+#define CriterionCuts_h
+
+#include <algorithm>
+#include <cmath>
+
+
+namespace KiTrackMarlin{
+
+
+   /** The cuts of the KiTrack criteria that are simple enough to be done inline, on the coordinates of the hits
+    * of a segment pair. They make the same decision as the KiTrack criterion of the same name (but in float).
+    *
+    * The hits are numbered from the inner to the outer one (like in a SegmentPairBatch). The values derived from
+    * the cut off values are calculated once in the constructor, so a check has no branches and no function calls.
+    */
+
+
+   /** The distance of the two hits over their distance in z (as squares), see KiTrack::Crit2_RZRatio */
+   class RZRatioCut{
+
+
+   public:
+
+      static const char* getName(){ return "Crit2_RZRatio"; }
+
+      RZRatioCut( float min, float max ): _min2( min*min ), _max2( max*max ){}
+
+      /** @param ax, ay, az the outer hit, bx, by, bz the inner one */
+      bool accept( float ax, float ay, float az, float bx, float by, float bz ) const {
+
+         float dx = ax - bx;
+         float dy = ay - by;
+         float dz = az - bz;
+
+         float dz2 = dz*dz;
+         float ratioSquared = dz2 != 0.f ? ( dx*dx + dy*dy + dz2 ) / dz2 : 0.f;
+
+         return ( ratioSquared <= _max2 ) & ( ratioSquared >= _min2 );
+
+      }
+
+      /** @param x, y, z the coordinates of the 2 hits */
+      bool accept( const float* x, const float* y, const float* z ) const { return accept( x[1], y[1], z[1], x[0], y[0], z[0] ); }
+
+
+   private:
+
+      float _min2;
+      float _max2;
+
+   };
+
+
+   /** The ratio of rho/z of the outer and the inner hit (as squares), see KiTrack::Crit2_StraightTrackRatio.
+    * Pairs with the inner hit on the z axis or a hit at z = 0 are accepted. */
+   class StraightTrackRatioCut{
+
+
+   public:
+
+      static const char* getName(){ return "Crit2_StraightTrackRatio"; }
+
+      StraightTrackRatioCut( float min, float max ): _min2( min*min ), _max2( max*max ){}
+
+      /** @param ax, ay, az the outer hit, bx, by, bz the inner one */
+      bool accept( float ax, float ay, float az, float bx, float by, float bz ) const {
+
+         float rhoParent = ax*ax + ay*ay;
+         float rhoChild = bx*bx + by*by;
+
+         float numerator = rhoParent * bz * bz;
+         float denominator = rhoChild * az * az;
+
+         bool check = ( rhoChild > 0.f ) & ( bz != 0.f ) & ( az != 0.f );
+
+         float ratioSquared = check ? numerator / denominator : 1.f;
+
+         return ( !check ) | ( ( ratioSquared <= _max2 ) & ( ratioSquared >= _min2 ) );
+
+      }
+
+      /** @param x, y, z the coordinates of the 2 hits */
+      bool accept( const float* x, const float* y, const float* z ) const { return accept( x[1], y[1], z[1], x[0], y[0], z[0] ); }
+
+
+   private:
+
+      float _min2;
+      float _max2;
+
+   };
+
+
+   /** The angle in degrees between the two 2-hit segments, see KiTrack::Crit3_3DAngle.
+    * The cosine is compared instead of the angle, so no acos is needed. */
+   class AngleCut3D{
+
+
+   public:
+
+      static const char* getName(){ return "Crit3_3DAngle"; }
+
+      // angle <= max  <=>  cos( angle ) >= cos( max ), for angles between 0 and 180 degrees
+      AngleCut3D( float min, float max ):
+      _cosMax( max >= 180.f ? -1.f : std::cos( max * float( M_PI ) / 180.f ) ),
+      _cosMin( min <= 0.f ? 1.f : std::cos( min * float( M_PI ) / 180.f ) ){}
+
+      /** @param ax, ay, az the inner hit, bx, by, bz the middle one and cx, cy, cz the outer one */
+      bool accept( float ax, float ay, float az, float bx, float by, float bz, float cx, float cy, float cz ) const {
+
+         float ux = bx - ax;
+         float uy = by - ay;
+         float uz = bz - az;
+
+         float vx = cx - bx;
+         float vy = cy - by;
+         float vz = cz - bz;
+
+         float denomSquared = ( ux*ux + uy*uy + uz*uz ) * ( vx*vx + vy*vy + vz*vz );
+
+         // without a direction the angle is 0
+         float angleCos = denomSquared > 0.f ? ( ux*vx + uy*vy + uz*vz ) / std::sqrt( denomSquared ) : 1.f;
+         angleCos = std::min( angleCos, 1.f );
+
+         return ( angleCos >= _cosMax ) & ( angleCos <= _cosMin );
+
+      }
+
+      /** @param x, y, z the coordinates of the 3 hits */
+      bool accept( const float* x, const float* y, const float* z ) const {
+
+         return accept( x[0], y[0], z[0], x[1], y[1], z[1], x[2], y[2], z[2] );
+
+      }
+
+
+   private:
+
+      float _cosMax;
+      float _cosMin;
+
+   };
+
+
+}
+
+
+#endif
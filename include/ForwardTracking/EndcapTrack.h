@@ -5,6 +5,7 @@
 #include "MarlinTrk/IMarlinTrkSystem.h"
 #include "MarlinTrk/IMarlinTrack.h"
 
+#include <memory>
 #include <vector>
 
 #include "IEndcapHit.h"
@@ -39,6 +40,7 @@ namespace KiTrackMarlin{
       TrackImpl* getLcioTrack(){ return ( _lcioTrack );}
       
     
+      /** Adds a hit. The Fitter of an earlier fit doesn't belong to the new hits, so it is released. */
       void addHit( IEndcapHit* hit );
       
       virtual double getNdf() const { return _lcioTrack->getNdf(); }
@@ -60,9 +62,21 @@ namespace KiTrackMarlin{
       
       
       /** Fits the track and sets chi2, Ndf etc.
+       * The Fitter is kept, so the final track states can be taken from the same fit.
        */
       virtual void fit() ;
       
+      /** @return the Fitter of the last fit, NULL if the track wasn't fitted yet or the Fitter was released.
+       * Copies of the track share it.
+       */
+      Fitter* getFitter() const { return _fitter.get(); }
+      
+      /** Releases the Fitter (and the fitted track it holds), once it is clear that it won't be needed anymore */
+      void releaseFitter(){ _fitter.reset(); }
+      
+      /** @return the track system the track gets fitted with, the Fitter needs it as long as it is used */
+      MarlinTrk::IMarlinTrkSystem* getTrkSystem() const { return _trkSystem; }
+      
       virtual ~EndcapTrack(){ delete _lcioTrack; }
       
 
@@ -82,6 +96,9 @@ namespace KiTrackMarlin{
       
       double _chi2Prob;
       
+      /** the Fitter of the last fit */
+      std::shared_ptr< Fitter > _fitter;
+      
       
    };
 
@@ -0,0 +1,118 @@
+#ifndef EventArena_h
+#define EventArena_h
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+
+namespace KiTrackMarlin{
+
+
+   /** A monotonic memory arena for objects that live for one event only.
+    *
+    * Objects are placed one after the other into big memory blocks, which makes creating them about as cheap as
+    * incrementing a pointer. There is no way to delete single objects: at the end of the event reset() calls the
+    * destructors of all objects (in reverse order of creation) and rewinds the arena. The memory blocks are
+    * kept and reused for the next event, so after the first few events no more memory is requested from the system.
+    *
+    * An arena is not thread safe, every thread needs its own one.
+    */
+   class EventArena{
+
+   public:
+
+      /** @param blockSize the size of the memory blocks in bytes */
+      explicit EventArena( std::size_t blockSize = 1 << 16 );
+
+      ~EventArena();
+
+      EventArena( const EventArena& ) = delete;
+      EventArena& operator=( const EventArena& ) = delete;
+
+      /** Creates an object of type T in the arena.
+       *
+       * @return a pointer to the object. It must not be deleted, it gets destroyed by reset().
+       */
+      template< class T, class... Args >
+      T* create( Args&&... args ){
+
+         void* memory = allocate( sizeof( T ), alignof( T ) );
+         T* object = new( memory ) T( std::forward< Args >( args )... );
+
+         if( !std::is_trivially_destructible< T >::value ){
+
+            Destructor destructor;
+            destructor.destroy = &destroyObject< T >;
+            destructor.object = object;
+            _destructors.push_back( destructor );
+
+         }
+
+         _nObjects++;
+
+         return object;
+
+      }
+
+      /** Destroys all objects in the arena and makes its memory available again */
+      void reset();
+
+      /** @return the number of bytes currently used by objects */
+      std::size_t getBytesUsed() const { return _bytesUsed; }
+
+      /** @return the number of bytes in all memory blocks of the arena */
+      std::size_t getBytesReserved() const;
+
+      /** @return the number of objects currently in the arena */
+      unsigned getNumberOfObjects() const { return _nObjects; }
+
+      /** @return the highest number of bytes that was used at once since the arena was created */
+      std::size_t getHighWaterMark() const { return _highWaterMark; }
+
+
+   private:
+
+      struct Block{
+
+         char* data;
+         std::size_t size;
+
+      };
+
+      struct Destructor{
+
+         void (*destroy)( void* );
+         void* object;
+
+      };
+
+      template< class T >
+      static void destroyObject( void* object ){ static_cast< T* >( object )->~T(); }
+
+      /** @return aligned memory of the requested size */
+      void* allocate( std::size_t size, std::size_t alignment );
+
+      std::size_t _blockSize;
+
+      std::vector< Block > _blocks;
+
+      /** the block we are currently allocating from and the offset in it */
+      unsigned _currentBlock;
+      std::size_t _offset;
+
+      std::vector< Destructor > _destructors;
+
+      std::size_t _bytesUsed;
+      std::size_t _highWaterMark;
+      unsigned _nObjects;
+
+   };
+
+
+}
+
+
+#endif
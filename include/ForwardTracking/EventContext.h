@@ -0,0 +1,191 @@
+#ifndef EventContext_h
+#define EventContext_h
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "EventArena.h"
+#include "SectorHitStore.h"
+#include "StageTimer.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Everything that changes while one event is reconstructed.
+    *
+    * The processors keep only their settings and things that are read during the events as members. All the state of an
+    * event lives in an EventContext checked out of an EventContextPool for it, so one processor can work on several
+    * events at once. All the threads working on the event may use the EventContext at the same time.
+    *
+    * A context is reused for many events: the arenas and the arrays of the hit store keep their memory, only the
+    * objects in the arenas get destroyed by reset().
+    */
+   class EventContext{
+
+
+   public:
+
+      /** @param nStages the number of stages that get timed, 0 if the stages are not timed */
+      explicit EventContext( unsigned nStages );
+
+      EventContext( const EventContext& ) = delete;
+      EventContext& operator=( const EventContext& ) = delete;
+
+      /** Starts a new event.
+       *
+       * @param quality the quality the event starts with. It can only get worse, see degradeQuality().
+       *
+       * @param maxTimeMs the time in ms the event may take, 0 means no limit
+       */
+      void start( int quality, double maxTimeMs );
+
+      /** Destroys the objects in the arenas, after the event is done. The memory of the arenas is kept. */
+      void reset();
+
+      /** @return the hits of the event sorted by their sectors */
+      SectorHitStore& getSectorHitStore(){ return _sectorHitStore; }
+
+      /** @return the arena of the calling thread for the objects of this event. The objects live until reset().
+       *
+       * A thread gets its arena once per event (under a lock), after that it is remembered by the thread itself,
+       * so creating objects needs no lock.
+       */
+      EventArena& getArena();
+
+      /** @return the bytes used in the arenas of all threads */
+      std::size_t getArenaBytesUsed() const;
+
+      /** @return the number of objects in the arenas of all threads */
+      unsigned getArenaObjects() const;
+
+      /** Lowers the quality to the passed one (never raises it). Higher values are worse. Thread safe. */
+      void degradeQuality( int quality );
+
+      int getQuality() const { return _quality; }
+
+      /** @return whether the event took already longer than factor * maxTimeMs. Always false, if there is no limit. */
+      bool isOverTime( double factor = 1. );
+
+      /** @return whether isOverTime() returned true at least once */
+      bool wasOverTime() const { return _overTime; }
+
+      /** @return the times of the stages of this event, NULL if the stages are not timed */
+      StageTimer::EventTimes* getStageTimes(){ return _stageTimes.get(); }
+
+      /** @return the sectors with too many hits that keep their hits but get tighter cuts */
+      std::vector< int >& getHotSectors(){ return _hotSectors; }
+
+      /** Remembers a sector whose hits were dropped from the track search. Thread safe. */
+      void addDroppedSector( int sector );
+
+      /** @return the sectors passed to addDroppedSector() */
+      std::vector< int > getDroppedSectors() const;
+
+
+   private:
+
+      SectorHitStore _sectorHitStore;
+
+      mutable std::mutex _arenaMutex;
+
+      /** the arenas, kept for the next events. The first _nArenasUsed ones are handed to threads in this event. */
+      std::vector< std::unique_ptr< EventArena > > _arenas;
+
+      unsigned _nArenasUsed;
+
+      /** the arena of every thread that created objects in this event */
+      std::map< std::thread::id , EventArena* > _threadArenas;
+
+      /** the number of the event, unique over all contexts, so a thread can tell whether it remembers the arena of this event */
+      unsigned long _eventId;
+
+      std::atomic< int > _quality;
+
+      std::chrono::steady_clock::time_point _start;
+
+      double _maxTimeMs;
+
+      std::atomic< bool > _overTime;
+
+      std::unique_ptr< StageTimer::EventTimes > _stageTimes;
+
+      std::vector< int > _hotSectors;
+
+      mutable std::mutex _droppedSectorsMutex;
+
+      std::vector< int > _droppedSectors;
+
+   };
+
+
+   /** Hands out the EventContexts for the events, every one to only one event at a time.
+    *
+    * The contexts of finished events are kept and reused, so their arenas and hit store don't have to allocate their
+    * memory again. If none is free, a new one is created: there are as many contexts as events processed at once.
+    *
+    * The easiest way to check out a context is an EventContextPool::Lease.
+    */
+   class EventContextPool{
+
+
+   public:
+
+      /** @param nStages the number of stages that get timed, 0 if the stages are not timed */
+      explicit EventContextPool( unsigned nStages );
+
+      EventContextPool( const EventContextPool& ) = delete;
+      EventContextPool& operator=( const EventContextPool& ) = delete;
+
+      /** @return a context started for a new event, see EventContext::start() */
+      EventContext* checkout( int quality, double maxTimeMs );
+
+      /** Resets a checked out context and gives it back */
+      void giveBack( EventContext* ctx );
+
+
+      /** Checks out a context for its lifetime */
+      class Lease{
+
+      public:
+
+         Lease( EventContextPool& pool, int quality, double maxTimeMs ): _pool( pool ), _ctx( pool.checkout( quality, maxTimeMs ) ){}
+
+         ~Lease(){ _pool.giveBack( _ctx ); }
+
+         Lease( const Lease& ) = delete;
+         Lease& operator=( const Lease& ) = delete;
+
+         EventContext& get() const { return *_ctx; }
+
+      private:
+
+         EventContextPool& _pool;
+         EventContext* _ctx;
+
+      };
+
+
+   private:
+
+      unsigned _nStages;
+
+      std::mutex _mutex;
+
+      /** all contexts created so far */
+      std::vector< std::unique_ptr< EventContext > > _contexts;
+
+      std::vector< EventContext* > _freeContexts;
+
+   };
+
+
+}
+
+
+#endif
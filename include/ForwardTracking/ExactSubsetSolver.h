@@ -0,0 +1,61 @@
+#ifndef ExactSubsetSolver_h
+#define ExactSubsetSolver_h
+
+#include <vector>
+
+
+namespace KiTrackMarlin{
+
+
+   /** Finds the best subset of a small group of tracks exactly: the set of tracks without conflicts with the highest
+    * sum of qualities (a maximum weight independent set).
+    *
+    * It is a branch and bound search. The tracks are taken in the order of their quality, every track is either
+    * taken (and the tracks in conflict with it dropped) or not. A branch is cut, when even taking all remaining tracks
+    * could not beat the best set found so far. The number of nodes of the search is limited, if it is used up, no
+    * result is given (the group should then be solved in another way).
+    *
+    * The found set is made maximal at the end: tracks in conflict with none of the set are added (this only changes
+    * anything for tracks with a quality of 0).
+    */
+   class ExactSubsetSolver{
+
+
+   public:
+
+      /**
+       * @param maxSize the most tracks a group may have to be solved, at most 64
+       *
+       * @param maxNodes the most nodes the search may visit
+       */
+      ExactSubsetSolver( unsigned maxSize, unsigned long maxNodes );
+
+      unsigned getMaxSize() const { return _maxSize; }
+
+      /**
+       * @param conflicts for every track the indices of the tracks it is in conflict with
+       *
+       * @param QIs the quality of every track, must not be negative
+       *
+       * @param accepted set to whether every track is in the best subset
+       *
+       * @return false, if there are more than maxSize tracks or the search needed more than maxNodes nodes.
+       * accepted is then not set.
+       */
+      bool calculateBestSet( const std::vector< std::vector< unsigned > >& conflicts,
+                             const std::vector< double >& QIs,
+                             std::vector< bool >& accepted ) const;
+
+
+   private:
+
+      unsigned _maxSize;
+      unsigned long _maxNodes;
+
+   };
+
+
+}
+
+
+#endif
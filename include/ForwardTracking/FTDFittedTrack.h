@@ -0,0 +1,74 @@
+#ifndef FTDFittedTrack_h
+#define FTDFittedTrack_h
+
+#include <memory>
+#include <vector>
+
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include "ILDImpl/FTDTrack.h"
+#include "ILDImpl/IFTDHit.h"
+#include "Tools/Fitter.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** An FTDTrack that keeps its Kalman fit.
+    *
+    * FTDTrack::fit() throws the Fitter (and with it the fitted IMarlinTrack) away after reading chi2 and the state at the IP.
+    * This one keeps it, so that the track states of the final track can be taken from the same fit instead of fitting
+    * the track a second time. Copies share the Fitter.
+    */
+   class FTDFittedTrack : public FTDTrack{
+
+
+   public:
+
+      /** @param trkSystem An IMarlinTrkSystem, which is needed for fitting of the tracks */
+      FTDFittedTrack( MarlinTrk::IMarlinTrkSystem* trkSystem ): FTDTrack( trkSystem ), _helixChi2Prob( 0. ){}
+
+      /** @param hits The hits the track consists of
+       * @param trkSystem An IMarlinTrkSystem, which is needed for fitting of the tracks
+       */
+      FTDFittedTrack( std::vector< IFTDHit* > hits , MarlinTrk::IMarlinTrkSystem* trkSystem ): FTDTrack( hits, trkSystem ), _helixChi2Prob( 0. ){}
+
+      /** Adds a hit like FTDTrack::addHit(). The Fitter of an earlier fit doesn't belong to the new hits, so it is released.
+       * (FTDTrack::addHit() is not virtual, so this only works when called on an FTDFittedTrack) */
+      void addHit( IFTDHit* hit ){ _fitter.reset(); FTDTrack::addHit( hit ); }
+
+      /** Fits the track and sets chi2, Ndf etc. like FTDTrack::fit(), but keeps the Fitter */
+      virtual void fit();
+
+      /** @return the Fitter of the last fit, NULL if the track wasn't fitted yet or the Fitter was released */
+      Fitter* getFitter() const { return _fitter.get(); }
+
+      /** Releases the Fitter (and the fitted track it holds), once it is clear that the track won't be in the output */
+      void releaseFitter(){ _fitter.reset(); }
+
+      /** @return the track system the track gets fitted with, the Fitter needs it as long as it is used */
+      MarlinTrk::IMarlinTrkSystem* getTrkSystem() const { return _trkSystem; }
+
+      /** @return the number of hits, without copying them like getHits() */
+      unsigned getNumberOfHits() const { return _hits.size(); }
+
+      /** Sets the chi2 probability of the helix fit of the track, for the quality before the Kalman fit */
+      void setHelixChi2Prob( double helixChi2Prob ){ _helixChi2Prob = helixChi2Prob; }
+
+      /** @return the chi2 probability of the helix fit, 0 if it was not set */
+      double getHelixChi2Prob() const { return _helixChi2Prob; }
+
+
+   private:
+
+      std::shared_ptr< Fitter > _fitter;
+
+      double _helixChi2Prob;
+
+   };
+
+
+}
+
+
+#endif
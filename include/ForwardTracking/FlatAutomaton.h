@@ -0,0 +1,148 @@
+#ifndef FlatAutomaton_h
+#define FlatAutomaton_h
+
+#include <vector>
+
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/IHit.h"
+#include "KiTrack/Segment.h"
+
+#include "BatchedCriteria.h"
+#include "HitConnectionGraph.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** A Cellular Automaton for the FTD and the endcaps, with the same steps as the KiTrack::Automaton
+    * (lengthenSegments, doAutomaton, cleanBadStates, resetStates, getTracks), but a flat segment graph.
+    *
+    * The segments are not linked objects but indices: their hits, layers and states are kept in arrays
+    * (one entry per segment, the hits as indices into the hits of the event) and the parent and child connections
+    * in compressed sparse rows (the connections of segment i are entries offsets[i] to offsets[i+1]).
+    * So a pass of the automaton walks through contiguous memory instead of following pointers over the heap.
+    *
+    * All segments have the same number of hits, ordered from the inner to the outer one, and are on the layer of their
+    * inner hit. The state of a segment counts the layers down to the end of its longest chain of children, so after doAutomaton()
+    * a segment whose children reach the IP (layer 0) has a state equal to its layer. cleanBadStates() keeps only those.
+    *
+    * The criteria are KiTrack criteria and need KiTrack::Segment objects. Those are only made for the segments
+    * that actually get checked.
+    */
+   class FlatAutomaton{
+
+
+   public:
+
+      /** Creates a 1-hit segment for every hit of the graph, connected like the hits in the graph */
+      explicit FlatAutomaton( const HitConnectionGraph& hitConnectionGraph );
+
+      ~FlatAutomaton();
+
+      FlatAutomaton( const FlatAutomaton& ) = delete;
+      FlatAutomaton& operator=( const FlatAutomaton& ) = delete;
+
+      /** Adds criteria for the next lengthenSegments(). They are not owned. */
+      void addCriteria( const std::vector< KiTrack::ICriterion* >& criteria );
+
+      /** Adds criteria for the next lengthenSegments(), which check all pairs of new segments at once. Not owned. */
+      void addCriteria( const BatchedCriteria& criteria );
+
+      void clearCriteria();
+
+      /** Makes a segment one hit longer out of every connection (the child and the outer hit of the parent).
+       * Two new segments get connected, if they come from connections over the same segment and all criteria
+       * accept them.
+       */
+      void lengthenSegments();
+
+      /** Raises the states of the segments, until no state changes any more */
+      void doAutomaton();
+
+      /** Removes the segments that don't have a chain of children to the IP, together with their connections */
+      void cleanBadStates();
+
+      void resetStates();
+
+      unsigned getNumberOfSegments() const { return _layers.size(); }
+
+      unsigned getNumberOfConnections() const { return _children.size(); }
+
+      /** @return the number of hits every segment has */
+      unsigned getSegmentLength() const { return _segmentLength; }
+
+      /** @return the hits of segment i, from the inner to the outer one */
+      std::vector< KiTrack::IHit* > getSegmentHits( unsigned i ) const;
+
+      unsigned getLayer( unsigned i ) const { return _layers[i]; }
+
+      int getState( unsigned i ) const { return _states[i]; }
+
+      /** @return the tracks: the hits of every path from a segment without parents to a segment without children.
+       * Virtual hits are left out.
+       *
+       * @param minHits the minimum number of (real) hits a track needs
+       */
+      std::vector< std::vector< KiTrack::IHit* > > getTracks( unsigned minHits = 3 ) const;
+
+      /** Adds the number of children of every segment to the sectors of its real hits.
+       *
+       * @param sectorConnections the connections per sector (index = sector). Sectors outside of it are not counted.
+       */
+      void countConnectionsPerSector( std::vector< unsigned >& sectorConnections ) const;
+
+
+   private:
+
+      /** Sets the connections (parent, child) as compressed sparse rows of both directions */
+      void setConnections( const std::vector< unsigned >& parents, const std::vector< unsigned >& children );
+
+      /** @return the KiTrack segment of segment i for the criteria, made when first needed */
+      KiTrack::Segment* getCriterionSegment( unsigned i );
+
+      /** @return whether the criteria without kernel accept the pair */
+      bool areCompatible( unsigned parent, unsigned child );
+
+      /** Checks the pairs of segments with all criteria, the kernels of the batched criteria first.
+       *
+       * @param accepted set to 1 for every accepted pair, 0 else
+       */
+      void checkCriteria( const std::vector< unsigned >& parents, const std::vector< unsigned >& children,
+                          std::vector< unsigned char >& accepted );
+
+      void deleteCriterionSegments();
+
+      /** the hits of the event, the segments point into it */
+      std::vector< KiTrack::IHit* > _hits;
+
+      unsigned _segmentLength;
+
+      /** the hit indices of the segments, _segmentLength per segment, from the inner to the outer hit */
+      std::vector< unsigned > _segmentHits;
+
+      std::vector< unsigned > _layers;
+
+      std::vector< int > _states;
+
+      /** the children of segment i are _children[ _childOffsets[i] ] to _children[ _childOffsets[i+1] - 1 ] */
+      std::vector< unsigned > _childOffsets;
+      std::vector< unsigned > _children;
+
+      /** the parents, the same way. _parentConnections holds the index of each connection in _children. */
+      std::vector< unsigned > _parentOffsets;
+      std::vector< unsigned > _parents;
+      std::vector< unsigned > _parentConnections;
+
+      std::vector< KiTrack::ICriterion* > _criteria;
+
+      std::vector< const BatchedCriteria* > _batchedCriteria;
+
+      std::vector< KiTrack::Segment* > _criterionSegments;
+
+   };
+
+
+}
+
+
+#endif
@@ -1,35 +1,31 @@
 #ifndef ForwardTracking_h
 #define ForwardTracking_h 1
 
+#include <atomic>
 #include <string>
+#include <vector>
 
 #include "marlin/Processor.h"
 #include "lcio.h"
-#include "EVENT/TrackerHit.h"
-#include "EVENT/Track.h"
-#include "IMPL/TrackImpl.h"
 #include "MarlinTrk/IMarlinTrkSystem.h"
-#include "gear/BField.h"
 
-#include "KiTrack/Segment.h"
-#include "KiTrack/ITrack.h"
-#include "Criteria/Criteria.h"
 #include "ILDImpl/SectorSystemFTD.h"
 
+#include "ForwardTrackingEngine.h"
+
 using namespace lcio ;
 using namespace marlin ;
 using namespace KiTrack;
 using namespace KiTrackMarlin;
 
-/** a simple typedef, making writing shorter. And it makes sense: a track consists of hits. But as a real track
- * has more information, a vector of hits can be considered as a "raw track". */
-typedef std::vector< IHit* > RawTrack;
-
 
 /**  Standallone Forward Tracking Processor for Marlin.<br>
  * 
  * Reconstructs the tracks through the FTD <br>
  * 
+ * The reconstruction itself is done by a ForwardTrackingEngine, the processor reads the hits from the event,
+ * passes the steering parameters on and writes the output collection.
+ * 
  * For a summary of what happens during each event see the method processEvent
  * 
  *  <h4>Input - Prerequisites</h4>
@@ -59,14 +55,30 @@ typedef std::vector< IHit* > RawTrack;
  * @param HelixFitMax the maximum chi2/Ndf that is allowed as result of a helix fit
  * (default value 500 )
  * 
+ * @param IncrementalHelixFit Whether the helix fit of the versions of a track (with hits from overlapping petals added) is
+ * done with an IncrementalHelixFitter: the raw track is fitted once and only the added hits are added to the fit.
+ * Its chi2 is close to, but not the same as the one of the default helix fit, so HelixFitMax might need to be adjusted.<br>
+ * (default value false )
+ * 
  * @param OverlappingHitsDistMax The maximum distance of hits from overlapping petals belonging to one track<br>
  * (default value 3.5 )
  * 
+ * @param OverlappingHitsAssignment How hits from overlapping petals are added to a track. "Combinations": every combination
+ * of them is tried as an own version of the track. "HelixPrediction": the track is fitted with a helix and behind every hit
+ * only the overlapping hit closest to the predicted position is added, so there are at most two versions of the track.<br>
+ * (default value Combinations )
+ * 
+ * @param OverlappingHitsChi2Max For OverlappingHitsAssignment HelixPrediction: the maximum chi2 of an overlapping hit with
+ * respect to the predicted position, for it to be added<br>
+ * (default value 9 )
+ * 
  * @param HitsPerTrackMin The minimum number of hits to create a track<br>
  * (default value 3 )
  * 
- * @param BestSubsetFinder The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN, SubsetSimple and None.
- * None means, that no final search for the best subset is done and overlapping tracks are possible. <br>
+ * @param BestSubsetFinder The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN,
+ * SubsetHopfieldNNComponents, SubsetExactHybrid, SubsetSimple and None. SubsetHopfieldNNComponents splits the tracks into groups linked
+ * by shared hits, accepts tracks without conflicts right away and solves every group with its own Hopfield Neural Network (in parallel, if
+ * NumberOfThreads > 1). SubsetExactHybrid does the same, but solves the small groups exactly. None means, that no final search for the best subset is done and overlapping tracks are possible. <br>
  * (default value TrackSubsetHopfieldNN )
  * 
  * @param Criteria A vector of the criteria that are going to be used by the Cellular Automaton. <br>
@@ -91,16 +103,109 @@ typedef std::vector< IHit* > RawTrack;
  * @param HNN_TInf The temperature limit of the Hopfield Neural Network<br>
  * (default value 0.1)
  * 
+ * @param SubsetExactMaxTracks For SubsetExactHybrid: the components with at most this many tracks are solved exactly (at most 64)<br>
+ * (default value 32)
+ * 
+ * @param SubsetExactMaxNodes For SubsetExactHybrid: the most nodes the exact search may visit in a component. If it needs more, the
+ * component is solved with the Hopfield Neural Network.<br>
+ * (default value 100000)
+ * 
+ * @param SubsetExactCompareHNN For SubsetExactHybrid: whether the exactly solved components are also solved with the Hopfield Neural Network,
+ * to compare time and quality in the summary at the end. The result is the one of the exact solver.<br>
+ * (default value false)
+ * 
  * @param MaxConnectionsAutomaton If the automaton has more connections than this it will be redone with the next cut off values for the criteria.<br>
  * If there are no further new values for the criteria, the event will be skipped.<br>
  * (default value 100000 )
  * 
+ * @param ReuseHitConnections Whether a rerun with the next cut off values keeps the connections between single hits (the 1-hit
+ * segments) that survived the round before and only checks them with the new 2-hit criteria, instead of building all of them again.
+ * The longer segments and their connections are still built anew in every round, no results of the criteria are cached.
+ * This gives the same result as long as the cuts of the later rounds are tighter than the ones before.<br>
+ * (default value false )
+ * 
+ * @param FlatAutomaton Whether to use the FlatAutomaton of this package instead of the KiTrack automaton. It does the same steps,
+ * but keeps the segments and their connections in flat arrays instead of linked objects.<br>
+ * (default value false )
+ * 
+ * @param BatchedCriteria Whether the criteria check all candidate segment pairs of a hit or segment at once. For Crit2_RZRatio,
+ * Crit2_StraightTrackRatio and Crit3_3DAngle there are kernels, that go over the coordinates of all pairs in one loop. The other criteria
+ * only check the pairs the kernels accepted. The 2 hit criteria are batched for the connections of the hits, the 3 and 4 hit criteria only
+ * with the FlatAutomaton. Not used with LocalCutTightening.<br>
+ * (default value false )
+ * 
+ * @param CriteriaChains Whether the criteria of a type (2, 3 or 4 hits) are replaced by one compiled criterion, when they are
+ * the standard set of the FTD (Crit2_RZRatio and Crit2_StraightTrackRatio; Crit3_3DAngle, Crit3_ChangeRZRatio and Crit3_IPCircleDist;
+ * Crit4_3DAngleChange and Crit4_DistToExtrapolation, in any order). It reads the hits once, checks the simple criteria inline
+ * and calls the others without virtual call. The decisions are those of the single criteria, up to rounding at the cut off
+ * values. Other sets are checked one by one as before.
+ * Not used with LocalCutTightening.<br>
+ * (default value false )
+ * 
+ * @param CriteriaReorderInterval If larger than 0, the time and the rejection rate of every criterion are measured on a sample of
+ * the checks, and after every this many events the criteria of each type (2, 3 and 4 hits) are sorted by their time per rejected
+ * pair, so the cheap criteria that reject much come first. The decisions stay the same. The learned order and an estimate of the
+ * time saved against the order of the steering are printed at the end. Not used with LocalCutTightening.<br>
+ * (default value 0 )
+ * 
+ * @param PredictStartRound Whether to start directly in the round of cut off values that is expected to have not more connections than
+ * MaxConnectionsAutomaton, instead of always starting in round 0. The number of connections of a round is predicted from the number of
+ * hit pairs the sector connector allows and the fraction of them that became connections in that round in the previous events.
+ * How well the predictions matched is printed at the end.<br>
+ * (default value false )
+ * 
+ * @param TimeStages Whether to measure the time spent in the stages of the reconstruction (reading the hits, overlap map, SegmentBuilder,
+ * automaton for 2-hit and 3-hit segments, helix fit, Kalman fit, best subset and finalising the tracks). At the end the mean, median,
+ * 95% and 99% quantiles and the maximum time per event are printed for every stage. Times of stages running in several threads
+ * are summed over the threads.<br>
+ * (default value false )
+ * 
+ * @param TimeStagesInCollection Whether to store the times of the stages of every event in the parameters "StageNames" and "StageTimesMs"
+ * of the output track collection. Needs TimeStages.<br>
+ * (default value false )
+ * 
+ * @param MaxEventTimeMs The time in ms an event may take, 0 means no limit. The time is checked between the stages of the
+ * reconstruction and while fitting the track candidates. When it is used up, no further rounds of the automaton are done (the first one is always done, but its 3-hit
+ * step may be skipped), only the raw tracks without hits from overlapping petals are fitted and SubsetSimple is used instead of the
+ * Hopfield Neural Network. At twice the time no more track candidates are fitted at all. The QualityCode of the output collection is then
+ * set to "Fair" (if only overlapping hits or the subset were affected) or "Poor". The number of events over time is printed at the end.<br>
+ * (default value 0 )
+ * 
+ * @param LocalCutTightening Whether too many connections or hits only lead to tighter cuts where they are. Every sector then has
+ * its own round of cut off values for the criteria. A segment is checked with the tightest cuts of the sectors of its hits.
+ * If the automaton has too many connections, only the sectors with the most connections get the cut off values of the
+ * next round. Sectors with more than MaxHitsPerSector hits are not dropped, but start with the cut off values of the second round
+ * and the QualityCode is set to "Fair". They are only dropped (as without LocalCutTightening), if there is just one round of cut off
+ * values, or if they already have the last round and there are still too many connections. PredictStartRound has no effect with this.<br>
+ * (default value false )
+ * 
+ * @param HelixQIPreselection Whether the Kalman fit is only done for the tracks that matter. The best subset is first searched
+ * with the quality from the chi2 probability of the helix fit (with the chi2 divided by HelixFitMax, as the helix chi2/ndf is much
+ * larger than 1 even for good tracks). Only the tracks of this subset and the ones in conflict with them get a Kalman fit, then the best
+ * subset is searched again with the Kalman fits. The number of Kalman fits done is printed at the end (at the debug level).<br>
+ * (default value false )
+ * 
  * @param MaxHitsPerSector If on any single sector there are more hits than this, all the hits in the sector get dropped.
  * This is to prevent combinatorial breakdown (It is a second safety mechanism, the first one being MaxConnectionsAutomaton.
  * But if there are soooo many hits, that already the first round of the Cellular Automaton would take forever, this mechanism
  * prevents it) <br>
  * (default value 1000)
  * 
+ * @param SplitSides Whether the forward and the backward half of the FTD are reconstructed independently of each other. 
+ * As no track can have hits on both sides, this gives the same track candidates, but the problems for the Cellular Automaton 
+ * are only half as big. With more than one thread the two halves are reconstructed in parallel.<br>
+ * (default value false)
+ * 
+ * @param NumberOfThreads The number of threads used for fitting the track candidates (and for connecting the hits of the sectors and
+ * SubsetHopfieldNNComponents). Every thread gets its own
+ * track fitting system, so more than one thread is only possible with the TrackSystemName DDKalTest (else 1 is used).
+ * With other track systems than DDKalTest the fits use the shared instance of the MarlinTrk::Factory, so events must
+ * then be processed one after the other. With more than one thread ROOT::EnableThreadSafety() is called in init(), as
+ * KalTest creates ROOT objects while fitting.
+ * 1 means everything is done serially in the calling thread. The results do not depend on
+ * this number.<br>
+ * (default value 1)
+ * 
  * @author Robin Glattauer HEPHY, Wien
  *
  */
@@ -129,8 +234,9 @@ class ForwardTracking : public Processor {
    *    -# Read in all collections of hits on the FTD that are passed as steering parameters
    *    -# From every hit in these collections an FTDHit01 is created. This is, because the SegmentBuilder and the Automaton
    * need their own hit classes.
-   *    -# The hits are stored in the map _map_sector_hits. The keys in this map are the sectors and the values of the map are vectors
-   * of the hits within those sectors. Sector here means an integer somehow representing a place in the detector.
+   *    -# The hits are stored sorted by their sectors in the SectorHitStore of the event's EventContext, which the
+   * ForwardTrackingEngine checks out of its EventContextPool. It is a flat array where the hits of every sector
+   * are contiguous. Sector here means an integer somehow representing a place in the detector.
    * (For using this numbers and getting things like layer or side the class SectorSystemFTD is used.)
    *    -# Make a safety check to ensure no single sector is overflowing with hits. This could give a combinatorial
    * disaster leading to endless calculation times.
@@ -190,59 +296,12 @@ class ForwardTracking : public Processor {
   
  protected:
    
-   /**
-   * @return a map that links hits with overlapping hits on the petals behind
-   * 
-   * @param map_sector_hits a map with first= the sector number. second = the hits in the sector. 
-   * 
-   * @param secSysFTD the SectorSystemFTD that is used
-   * 
-   * @param distMax the maximum distance of two hits. If two hits are on the right petals and their distance is smaller
-   * than this, the connection will be saved in the returned map.
-   */
-   std::map< IHit* , std::vector< IHit* > > getOverlapConnectionMap( const std::map< int , std::vector< IHit* > > & map_sector_hits, 
-                                                                     const SectorSystemFTD* secSysFTD,
-                                                                     float distMax);
-   
-   /** Adds hits from overlapping areas to a RawTrack in every possible combination.
-   * 
-   * @return all of the resulting RawTracks
-   * 
-   * @param rawTrack a RawTrack (vector of IHit* ), we want to add hits from overlapping regions
-   * 
-   * @param map_hitFront_hitsBack a map, where IHit* are the keys and the values are vectors of hits that
-   * are in an overlapping region behind them.
-   */
-   std::vector < RawTrack > getRawTracksPlusOverlappingHits( RawTrack rawTrack , std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack );
-   
-   /** Finalises the track: fits it and adds TrackStates at IP, Calorimeter Face, inner- and outermost hit.
-   * Sets the subdetector hit numbers and the radius of the innermost hit.
-   * Also sets chi2 and Ndf.
-   */
-   void finaliseTrack( TrackImpl* trackImpl );
-   
-   /** Sets the cut off values for all the criteria
-    * 
-    * This method is necessary for cases where the CA just finds too much.
-    * Therefore it is possible to enter a whole list of cut off values for every criterion (for every min and every max to be more precise),
-    * that are then used one after the other. 
-    * If the CA finds way too many connections, we can thus make the cuts tighter and rerun it. If there are still too many
-    * connections, just tighten them again.
-    * 
-    * This method will set the according values. It will read the passed (as steering parameter) cut off values, create
-    * criteria from them and store them in the corresponding vectors.
-    * 
-    * If there are no new cut off values for a criterion, the last one remains.
+   /** @return a new DDKalTest track system, initialised and with the options of the steering set.
     * 
-    * @return whether any new cut off value was set. false == there are no new cutoff values anymore
-    * 
-    * @param round The number of the round we are in. I.e. the nth time we run the Cellular Automaton.
+    * Used for the fits. The MarlinTrk::Factory hands out only one (shared) instance per type, so we create our own
+    * ones here. This is only done for DDKalTest, for other types the fits use the shared instance and one thread.
     */
-   bool setCriteria( unsigned round );
-   
-   
-   /** @return Info on the content of _map_sector_hits. Says how many hits are in each sector */
-   std::string getInfo_map_sector_hits();
+   MarlinTrk::IMarlinTrkSystem* createTrkSystem();
    
    
    /** Input collection names */
@@ -253,168 +312,43 @@ class ForwardTracking : public Processor {
 
 
    int _nRun ;
-   int _nEvt ;
+   std::atomic< int > _nEvt ;
 
    /** B field in z direction */
    double _Bz;
 
-   /** Cut for the Kalman Fit (the chi squared probability) */
-   double _chi2ProbCut; 
-   
-   /** Cut for the Helix fit ( chi squared / degrees of freedom ) */
-   double _helixFitMax; 
-
    // Properties of the Kalman Fit
    bool _MSOn ;
    bool _ElossOn ;
    bool _SmoothOn ;
    
-   /** If this number of hits in a sector is surpassed for any sector, the hits in the sector will be dropped
-    * and the quality of the output track collection will be set to poor */
-   int _maxHitsPerSector;
-   
-   
-   // Properties for the Hopfield Neural Network
-   double _HNN_Omega;
-   double _HNN_ActivationThreshold;
-   double _HNN_TInf;
-   
-   /** A map to store the hits according to their sectors */
-   std::map< int , std::vector< IHit* > > _map_sector_hits;
-   
-   /** Names of the used criteria */
-   std::vector< std::string > _criteriaNames;
-   
-   /** Map containing the name of a criterion and a vector of the minimum cut offs for it */
-   std::map< std::string , std::vector<float> > _critMinima;
-   
-   /** Map containing the name of a criterion and a vector of the maximum cut offs for it */
-   std::map< std::string , std::vector<float> > _critMaxima;
-   
-   /** Minimum number of hits a track has to have in order to be stored */
-   int _hitsPerTrackMin;
+   /** The settings of the reconstruction, filled from the steering parameters */
+   ForwardTrackingEngine::Config _config;
    
-   /** A vector of criteria for 2 hits (2 1-hit segments) */
-   std::vector <ICriterion*> _crit2Vec;
-   
-   /** A vector of criteria for 3 hits (2 2-hit segments) */
-   std::vector <ICriterion*> _crit3Vec;
-   
-   /** A vector of criteria for 4 hits (2 3-hit segments) */
-   std::vector <ICriterion*> _crit4Vec;
+   /** Does the reconstruction, created in init() */
+   ForwardTrackingEngine* _engine;
    
+   /** The number of sectors of _sectorSystemFTD */
+   unsigned _nSectors;
    
    const SectorSystemFTD* _sectorSystemFTD;
    
-   
-   bool _useCED;
-   
-   /** the maximum distance of two hits from overlapping petals to be considered as possible part of one track */
-   double _overlappingHitsDistMax;
-   
-   /** true = when adding hits from overlapping petals, store only the best track; <br>
-    * false = store all tracksS
-    */
-   bool _takeBestVersionOfTrack;
-   
-   /** the maximum number of connections that are allowed in the automaton, if this value is surpassed, rerun
-    * the automaton with tighter cuts or stop it entirely. */
-   int _maxConnectionsAutomaton;
-   
-   /** The method used to find the best subset of tracks */
-   std::string _bestSubsetFinder;
-   
-   unsigned _nTrackCandidates;
-   unsigned _nTrackCandidatesPlus;
-
+   /** Whether to store the times of the stages in the output track collection */
+   bool _timeStagesInCollection;
    
    
    MarlinTrk::IMarlinTrkSystem* _trkSystem;
 
    std::string _trkSystemName ;
-
-  bool _getTrackStateAtCaloFace ;
-
-   /** The quality of the output track collection */
-   int _output_track_col_quality ; 
-  
-   static const int _output_track_col_quality_GOOD;
-   static const int _output_track_col_quality_FAIR;
-   static const int _output_track_col_quality_POOR;
-  
-   
-} ;
-
-
-/** A functor to return whether two tracks are compatible: The criterion is if they share a Hit or more */
-class TrackCompatibilityShare1SP{
-  
-public:
-   
-   inline bool operator()( ITrack* trackA, ITrack* trackB ){
-      
-      
-      std::vector< IHit* > hitsA = trackA->getHits();
-      std::vector< IHit* > hitsB = trackB->getHits();
-      
-      
-      for( unsigned i=0; i < hitsA.size(); i++){
-         
-         for( unsigned j=0; j < hitsB.size(); j++){
-            
-            if ( hitsA[i] == hitsB[j] ) return false;      // a hit is shared -> incompatible
-            
-         }
-         
-      }
-      
-      return true;      
-      
-   }
    
-};
-
-
-/** A functor to return the quality of a track, which is currently the chi2 probability. */
-class TrackQIChi2Prob{
+   /** The number of threads used for fitting the track candidates */
+   int _nThreads;
    
-public:
+   /** One track system per thread of the engine. For DDKalTest they are created and owned by this processor, else
+    * this is only _trkSystem, the shared instance of the factory. */
+   std::vector< MarlinTrk::IMarlinTrkSystem* > _trkSystems;
    
-   inline double operator()( ITrack* track ){ return track->getChi2Prob(); }
-  
-   
-};
-
-/** A functor to return the quality of a track.
- * 
- * For tracks with 4 hits or more the chi2prob is mapped to* 0.5-1, with p' = p/2 + 0.5.
- * Tracks with 3 hits get the chi2prob mapped to 0-0.5 by p' = p/2.
- * This way short 3-hit-tracks rank lower than 4-hit tracks.
-*/
-class TrackQIChi2ProbSpecial{
-   
-public:
-   
-   inline double operator()( ITrack* track ){ 
-      
-      if( track->getHits().size() > 3 ){
-         
-         return track->getChi2Prob()/2. +0.5; 
-         
-      }
-      else{
-         
-         return track->getChi2Prob()/2.;
-         
-      }
-      
-   }
-   
-   
-};
+} ;
 
 
 #endif
-
-
-
@@ -0,0 +1,585 @@
+#ifndef ForwardTrackingEngine_h
+#define ForwardTrackingEngine_h 1
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "EVENT/TrackerHit.h"
+#include "IMPL/TrackImpl.h"
+#include "IMPL/TrackerHitImpl.h"
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+#include "KiTrack/Automaton.h"
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/IHit.h"
+#include "KiTrack/ITrack.h"
+#include "Tools/Fitter.h"
+#include "ILDImpl/SectorSystemFTD.h"
+#include "ILDImpl/FTDTrack.h"
+
+#include "ConnectionPredictor.h"
+#include "CriteriaRounds.h"
+#include "EventArena.h"
+#include "EventContext.h"
+#include "FTDFittedTrack.h"
+#include "FlatAutomaton.h"
+#include "IncrementalHelixFitter.h"
+#include "OverlapHitFinder.h"
+#include "SectorHitStore.h"
+#include "StageTimer.h"
+#include "SubsetExactHybrid.h"
+#include "TrackConflictGraph.h"
+#include "TrkSystemPool.h"
+#include "WorkStealingThreadPool.h"
+
+
+/** a simple typedef, making writing shorter. And it makes sense: a track consists of hits. But as a real track
+ * has more information, a vector of hits can be considered as a "raw track". */
+typedef std::vector< KiTrack::IHit* > RawTrack;
+
+
+namespace KiTrackMarlin{
+
+
+   /** The track reconstruction of the ForwardTracking processor, without Marlin around it.
+    *
+    * It gets the hits of an event as plain structs and returns the reconstructed and finalised tracks. Reading the
+    * collections, the steering parameters, CED and writing the output collection are left to the caller (in Marlin
+    * the ForwardTracking processor). So the reconstruction can be run from any program that provides the geometry
+    * (a SectorSystemFTD) and the track fitting systems.
+    *
+    * The tracks and the hits they point to are still LCIO objects and the fits are done with MarlinTrk.
+    *
+    * For what happens in reconstruct() see ForwardTracking::processEvent().
+    *
+    * The engine is thread safe: reconstruct() may be called for several events at the same time. Everything belonging
+    * to an event lives in an EventContext or is a local of reconstruct() (like the OverlapHitFinder with its buffers),
+    * the members are only settings, things made once and read during the events (like the criteria), statistics
+    * guarded by a mutex and the things checked out for an event or a fit: the EventContexts out of an EventContextPool
+    * (so their arenas and hit store are reused by the next events) and the track systems out of a TrkSystemPool.
+    */
+   class ForwardTrackingEngine{
+
+
+   public:
+
+      /** The settings of the reconstruction. They have the meaning of the steering parameters of the same name
+       * of the ForwardTracking processor, the defaults are the same as there. */
+      struct Config{
+
+         double chi2ProbCut = 0.005;
+         double helixFitMax = 500.;
+         bool incrementalHelixFit = false;
+
+         double overlappingHitsDistMax = 3.5;
+         std::string overlappingHitsAssignment = "Combinations";
+         double overlappingHitsChi2Max = 9.;
+
+         int hitsPerTrackMin = 4;
+         std::string bestSubsetFinder = "SubsetHopfieldNN";
+         bool takeBestVersionOfTrack = true;
+
+         double HNN_Omega = 0.75;
+         double HNN_ActivationThreshold = 0.5;
+         double HNN_TInf = 0.1;
+
+         int subsetExactMaxTracks = 32;
+         int subsetExactMaxNodes = 100000;
+         bool subsetExactCompareHNN = false;
+
+         int maxConnectionsAutomaton = 100000;
+         bool reuseHitConnections = false;
+         bool flatAutomaton = false;
+         bool batchedCriteria = false;
+         bool criteriaChains = false;
+         int criteriaReorderInterval = 0;
+         bool predictStartRound = false;
+         bool timeStages = false;
+         double maxEventTimeMs = 0.;
+         bool localCutTightening = false;
+         bool helixQIPreselection = false;
+         int maxHitsPerSector = 1000;
+         bool getTrackStateAtCaloFace = true;
+         bool splitSides = false;
+
+         /** Whether an event is spread over the threads of the engine (one per track system). Not needed, if the
+          * caller already reconstructs as many events at the same time as there are track systems. */
+         bool threadsWithinEvent = true;
+
+         /** Whether the segments of the automaton are drawn with CED. CED has to be set up by the caller. */
+         bool useCED = false;
+
+         /** The names of the criteria, for every one of them at least one minimum and maximum must be given */
+         std::vector< std::string > criteriaNames;
+         std::map< std::string , std::vector< float > > critMinima;
+         std::map< std::string , std::vector< float > > critMaxima;
+
+      };
+
+      /** A hit on the FTD.
+       *
+       * If trackerHit is set, the hit is taken from it and the other values are not used. Else an LCIO hit is created
+       * from the values, which belongs to the Result (the tracks point to it). The Kalman fit needs hits on planar sensors
+       * as TrackerHitPlane, so for those (du > 0) a TrackerHitPlaneImpl is created, for the others a TrackerHitImpl.
+       */
+      struct Hit{
+
+         double position[3] = { 0., 0., 0. };
+
+         /** the lower triangle of the covariance matrix of the position (xx, yx, yy, zx, zy, zz), not used for planar hits */
+         float covMatrix[6] = { 0., 0., 0., 0., 0., 0. };
+
+         /** for hits on planar sensors: the directions (theta, phi) of the measurement axes u and v and their resolutions */
+         float u[2] = { 0., 0. };
+         float v[2] = { 0., 0. };
+         float du = 0.;
+         float dv = 0.;
+
+         int type = 0;
+
+         int cellID0 = 0;
+
+         EVENT::TrackerHit* trackerHit = NULL;
+
+      };
+
+      /** The quality of the result of an event. The higher the value, the worse the quality. */
+      enum Quality{ QUALITY_GOOD = 1, QUALITY_FAIR = 2, QUALITY_POOR = 3 };
+
+      /** The result of an event */
+      struct Result{
+
+         /** The reconstructed tracks, owned by the caller */
+         std::vector< IMPL::TrackImpl* > tracks;
+
+         Quality quality = QUALITY_GOOD;
+
+         /** The sectors whose hits were dropped, because they had more than maxHitsPerSector hits */
+         std::vector< int > droppedSectors;
+
+         /** Whether the event took longer than maxEventTimeMs and its reconstruction was cut short */
+         bool isOverTime = false;
+
+         /** The time of every stage in ms (the names are in the StageTimer), only filled if timeStages is set */
+         std::vector< float > stageTimesMs;
+
+         /** The TrackerHits created for the hits passed without one. They must live as long as the tracks are used. */
+         std::vector< std::unique_ptr< EVENT::TrackerHit > > trackerHits;
+
+      };
+
+
+      /**
+       * @param config the settings. The criteria are checked and the ones not existing throw an exception.
+       *
+       * @param sectorSystemFTD the geometry of the FTD, not owned
+       *
+       * @param nSectors the number of sectors of sectorSystemFTD (the highest sector number + 1)
+       *
+       * @param trkSystems one initialised track system for every thread the engine shall use (at least one), not owned.
+       * They are shared by all events, a fit waits if all of them are in use.
+       */
+      ForwardTrackingEngine( const Config& config, const SectorSystemFTD* sectorSystemFTD, unsigned nSectors,
+                             const std::vector< MarlinTrk::IMarlinTrkSystem* >& trkSystems );
+
+      ~ForwardTrackingEngine();
+
+      ForwardTrackingEngine( const ForwardTrackingEngine& ) = delete;
+      ForwardTrackingEngine& operator=( const ForwardTrackingEngine& ) = delete;
+
+      /** Reconstructs the tracks of one event.
+       *
+       * Thread safe: several events can be reconstructed at the same time, they share the threads of the engine.
+       *
+       * @param hits the hits of the event
+       *
+       * @param result the tracks and the quality of the event, what was in it before gets replaced
+       */
+      void reconstruct( const std::vector< Hit >& hits, Result& result );
+
+      /** Prints the statistics collected over all events */
+      void printSummary( const std::string& name ) const;
+
+      /** @return the timer of the stages, NULL if timeStages is not set */
+      const StageTimer* getStageTimer() const { return _stageTimer; }
+
+      const Config& getConfig() const { return _config; }
+
+      /** @return the chi2 of a residual in x and y of a hit with the covariance matrix cov (xx, yx, yy, ...).
+       *
+       * If the covariance matrix can't be inverted, the bigger of the two variances is used for both directions.
+       * If there is no positive variance at all, the largest double is returned, so that the hit is never chosen.
+       */
+      static double getChi2XY( const EVENT::FloatVec& cov, double dx, double dy );
+
+
+   protected:
+
+      /**
+      * @return a map that links hits with overlapping hits on the petals behind. Virtual hits are ignored.
+      *
+      * @param sectorHitStore the hits sorted by sector
+      *
+      * @param secSysFTD the SectorSystemFTD that is used
+      *
+      * @param overlapHitFinder finds the close hits on two neighbouring petals. If two hits are on the right petals and
+      * their distance is smaller than its distMax, the connection will be saved in the returned map.
+      */
+      std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > > getOverlapConnectionMap( const SectorHitStore& sectorHitStore,
+                                                                                         const SectorSystemFTD* secSysFTD,
+                                                                                         OverlapHitFinder& overlapHitFinder);
+
+      /** Adds hits from overlapping areas to a RawTrack in every possible combination.
+      *
+      * @return all of the resulting RawTracks
+      *
+      * @param rawTrack a RawTrack (vector of IHit* ), we want to add hits from overlapping regions
+      *
+      * @param map_hitFront_hitsBack a map, where IHit* are the keys and the values are vectors of hits that
+      * are in an overlapping region behind them.
+      */
+      std::vector < RawTrack > getRawTracksPlusOverlappingHits( RawTrack rawTrack , std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > >& map_hitFront_hitsBack );
+
+      /** Adds hits from overlapping areas to a RawTrack using a helix prediction: the raw track is fitted with a helix once
+       * and for every hit only the hit behind it that is closest to the predicted position is added (if its chi2 is
+       * below overlappingHitsChi2Max).
+       *
+       * @return the raw track and, if any hits were added, the raw track with the added hits
+       *
+       * @param rawTrack a RawTrack (vector of IHit* ), we want to add hits from overlapping regions
+       *
+       * @param map_hitFront_hitsBack a map, where IHit* are the keys and the values are vectors of hits that
+       * are in an overlapping region behind them.
+       */
+      std::vector < RawTrack > getRawTracksPlusPredictedOverlappingHits( const RawTrack& rawTrack , std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > >& map_hitFront_hitsBack );
+
+      /** Adds the TrackerHit of an IFTDHit to a helix fitter. Virtual hits and hits without TrackerHit are skipped. */
+      static void addToHelixFitter( IncrementalHelixFitter& helixFitter, KiTrack::IHit* hit );
+
+      /** @return the chi2 of a residual in x and y of a hit, using the covariance matrix of the hit (see the public
+       * getChi2XY()) */
+      static double getChi2XY( KiTrack::IHit* hit, double dx, double dy );
+
+      /** Makes track candidates from all versions of a raw track (with hits from overlapping petals added),
+       * fits them with the helix and Kalman fit and applies the cuts.
+       *
+       * Only uses the passed track system for fitting and changes nothing but the event context and the atomic
+       * counters, so it can be called for different raw tracks in parallel.
+       *
+       * @return the accepted track candidates: only the best one if takeBestVersionOfTrack is set, else all of them
+       *
+       * @param rawTrack the raw track from the automaton
+       *
+       * @param map_hitFront_hitsBack the hits on overlapping petals, see getOverlapConnectionMap()
+       *
+       * @param trkSystem the track system to use for the Kalman fit
+       *
+       * @param nVersions set to the number of versions of the track that got created
+       *
+       * @param ctx the event, the track candidates are created in its arena
+       */
+      std::vector< KiTrack::ITrack* > fitRawTrack( const RawTrack& rawTrack,
+                                                   std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > >& map_hitFront_hitsBack,
+                                                   MarlinTrk::IMarlinTrkSystem* trkSystem,
+                                                   unsigned& nVersions,
+                                                   EventContext& ctx );
+
+      /** Fits the track candidate with the Kalman fit and applies the cut on the chi2 probability.
+       *
+       * @return whether the track candidate is accepted
+       */
+      bool kalmanFit( FTDFittedTrack* trackCand, EventContext& ctx );
+
+      /** Finds the best subset of the track candidates with the passed method ("SubsetHopfieldNN", "SubsetSimple",
+       * anything else keeps all tracks).
+       *
+       * @param conflictGraph the track candidates and their conflicts
+       */
+      template< class TrackQI >
+      void getBestSubset( const TrackConflictGraph& conflictGraph,
+                          TrackQI& trackQI,
+                          const std::string& bestSubsetFinder,
+                          std::vector< KiTrack::ITrack* >& tracks,
+                          std::vector< KiTrack::ITrack* >& rejected ) const;
+
+      /** Finalises the track: fits it and adds TrackStates at IP, Calorimeter Face, inner- and outermost hit.
+      * Sets the subdetector hit numbers and the radius of the innermost hit.
+      * Also sets chi2 and Ndf.
+      *
+      * @param fitter the Kalman fit of the track candidate. If given, the track states are taken from it and the track
+      * isn't fitted again.
+      *
+      * @param trkSystem the track system the fitter was made with. It is checked out while the fitter is used.
+      */
+      void finaliseTrack( IMPL::TrackImpl* trackImpl, Fitter* fitter, MarlinTrk::IMarlinTrkSystem* trkSystem );
+
+      /** Gets the criteria of a round of cut off values.
+       *
+       * This method is necessary for cases where the CA just finds too much.
+       * Therefore it is possible to enter a whole list of cut off values for every criterion (for every min and every max to be more precise),
+       * that are then used one after the other.
+       * If the CA finds way too many connections, we can thus make the cuts tighter and rerun it. If there are still too many
+       * connections, just tighten them again.
+       *
+       * The criteria of all rounds are made once (see CriteriaRounds), this method puts the ones of the round
+       * into the passed vectors. They still belong to _criteriaRounds.
+       *
+       * @return false, if there are no new cutoff values anymore for this round
+       *
+       * @param round The number of the round we are in. I.e. the nth time we run the Cellular Automaton.
+       *
+       * @param crit2Vec, crit3Vec, crit4Vec the vectors for the criteria for 2, 3 and 4 hits
+       */
+      bool getCriteria( unsigned round,
+                        std::vector< KiTrack::ICriterion* >& crit2Vec,
+                        std::vector< KiTrack::ICriterion* >& crit3Vec,
+                        std::vector< KiTrack::ICriterion* >& crit4Vec ) const;
+
+      /** Runs SegmentBuilder, Cellular Automaton, fitting and best subset selection on the passed hits.
+       *
+       * Can be called for several sets of hits of the same event at the same time.
+       *
+       * @return the tracks of the best subset. They live in the event arenas of ctx.
+       *
+       * @param sectorHitStore the hits (including the virtual IP hits) sorted by sector
+       *
+       * @param sectors the sectors of sectorHitStore whose hits are used, in ascending order
+       *
+       * @param map_hitFront_hitsBack the hits on overlapping petals, see getOverlapConnectionMap()
+       *
+       * @param ctx the event
+       */
+      std::vector< KiTrack::ITrack* > reconstructTracks( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                                                         std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > >& map_hitFront_hitsBack,
+                                                         EventContext& ctx );
+
+
+      /** Creates the criteria for local cut tightening: every criterion is a SectorLocalCriterion, holding the versions of the
+       * criterion for all rounds of cut off values (from _criteriaRounds, not owned). The caller owns the created criteria.
+       *
+       * @param sectorLevels the round of cut off values of every sector
+       *
+       * @return the number of rounds of cut off values
+       */
+      unsigned createLocalCriteria( const std::vector< unsigned >* sectorLevels,
+                                    std::vector< KiTrack::ICriterion* >& crit2Vec,
+                                    std::vector< KiTrack::ICriterion* >& crit3Vec,
+                                    std::vector< KiTrack::ICriterion* >& crit4Vec ) const;
+
+      /** Lengthens the 1-hit segments of the automaton to 2- and 3-hit segments and runs the Cellular Automaton on them
+       * with runCellularAutomaton(). Works with the KiTrack::Automaton and the FlatAutomaton.
+       *
+       * @param crit3Batch, crit4Batch the criteria as batched criteria, used instead of the vectors by the FlatAutomaton. May be NULL.
+       *
+       * @return true, if the automaton is done and rawTracks are its tracks. False, if it has too many connections
+       * and has to be redone with tighter cuts (with local cut tightening sectorConnections and nConnectionsTooMany are then set).
+       */
+      template< class AutomatonType >
+      bool runAutomaton( AutomatonType& automaton,
+                         const std::vector< KiTrack::ICriterion* >& crit3Vec,
+                         const std::vector< KiTrack::ICriterion* >& crit4Vec,
+                         const BatchedCriteria* crit3Batch,
+                         const BatchedCriteria* crit4Batch,
+                         std::vector< RawTrack >& rawTracks,
+                         std::vector< unsigned >& sectorConnections,
+                         unsigned& nConnectionsTooMany,
+                         EventContext& ctx );
+
+      /** Counts the connections of the segments of the automaton per sector. The connections of a segment count for the
+       * sectors of all of its hits, virtual hits are left out.
+       *
+       * @return the number of connections of the automaton
+       */
+      unsigned countConnectionsPerSector( KiTrack::Automaton& automaton, std::vector< unsigned >& sectorConnections ) const;
+      unsigned countConnectionsPerSector( FlatAutomaton& automaton, std::vector< unsigned >& sectorConnections ) const;
+
+      /** Gives the next round of cut off values to the sectors with the most connections. Sectors are taken until they have
+       * at least the share of connections that has to go to get below maxConnectionsAutomaton.
+       *
+       * @return false, if no sector can get tighter cuts anymore
+       */
+      bool tightenHotSectors( const std::vector< unsigned >& sectorConnections, unsigned nConnections,
+                              std::vector< unsigned >& sectorLevels, unsigned nLevels ) const;
+
+      /** Drops the hits of the sectors with too many hits (see EventContext::getHotSectors()), that already have the last
+       * round of cut off values, from the sectors of the track search. Used, when no sector can get tighter cuts anymore.
+       *
+       * @return false, if there was no such sector left to drop
+       */
+      bool dropHotSectors( const std::vector< unsigned >& sectorLevels, unsigned nLevels,
+                           std::vector< int >& sectors, EventContext& ctx ) const;
+
+      /** @return a virtual hit in the place of the IP on the given side of the FTD (from KiTrackMarlin::createVirtualIPHit),
+       * owned by the passed arena */
+      KiTrack::IHit* createVirtualIPHit( int side , EventArena& eventArena );
+
+      /** @return Info on the content of a SectorHitStore. Says how many hits are in each sector */
+      std::string getInfo_map_sector_hits( const SectorHitStore& sectorHitStore ) const;
+
+
+      Config _config;
+
+      const SectorSystemFTD* _sectorSystemFTD;
+
+      /** The number of sectors of _sectorSystemFTD */
+      unsigned _nSectors;
+
+      /** One track system per thread, not owned */
+      std::vector< MarlinTrk::IMarlinTrkSystem* > _trkSystems;
+
+      /** Hands out the track systems to the fits */
+      TrkSystemPool* _trkSystemPool;
+
+      /** The thread pool for fitting track candidates, NULL if running serially */
+      WorkStealingThreadPool* _threadPool;
+
+      /** The criteria of all rounds of cut off values */
+      CriteriaRounds* _criteriaRounds;
+
+      /** Finds the best subset for SubsetExactHybrid, NULL if another method is used */
+      SubsetExactHybrid* _subsetExactHybrid;
+
+      /** Predicts the connections for the rounds of criteria, NULL if predictStartRound is false */
+      ConnectionPredictor* _connectionPredictor;
+
+      /** The stages of the reconstruction that get timed */
+      enum Stage{ STAGE_READ_HITS, STAGE_OVERLAP_MAP, STAGE_SEGMENT_BUILDER, STAGE_AUTOMATON_2HIT, STAGE_AUTOMATON_3HIT,
+                  STAGE_HELIX_FIT, STAGE_KALMAN_FIT, STAGE_BEST_SUBSET, STAGE_FINALISE };
+
+      /** Times the stages, NULL if timeStages is false */
+      StageTimer* _stageTimer;
+
+      /** The contexts of the events, kept for the next events */
+      EventContextPool* _eventContextPool;
+
+      /** The number of events reconstructed */
+      std::atomic< unsigned > _nEvents;
+
+      // Counters of what got left out, because events ran out of time
+      std::atomic< unsigned > _nEventsOverTime;
+      std::atomic< unsigned > _nAutomatonStoppedOverTime;
+      std::atomic< unsigned > _nVersionsSkippedOverTime;
+      std::atomic< unsigned > _nRawTracksSkippedOverTime;
+      std::atomic< unsigned > _nSubsetsSimplifiedOverTime;
+
+      /** The number of track candidates that passed the helix fit */
+      std::atomic< unsigned > _nHelixAccepted;
+
+      /** The number of Kalman fits done */
+      std::atomic< unsigned > _nKalmanFits;
+
+      std::atomic< unsigned > _nTrackCandidates;
+      std::atomic< unsigned > _nTrackCandidatesPlus;
+
+      /** The most bytes used in the event arenas in a single event */
+      std::atomic< std::size_t > _arenaBytesMax;
+
+      /** The sum of bytes used in the event arenas over all events */
+      std::atomic< std::size_t > _arenaBytesSum;
+
+   };
+
+
+}
+
+
+/** A functor to return whether two tracks are compatible: The criterion is if they share a Hit or more */
+class TrackCompatibilityShare1SP{
+
+public:
+
+   inline bool operator()( KiTrack::ITrack* trackA, KiTrack::ITrack* trackB ){
+
+
+      std::vector< KiTrack::IHit* > hitsA = trackA->getHits();
+      std::vector< KiTrack::IHit* > hitsB = trackB->getHits();
+
+
+      for( unsigned i=0; i < hitsA.size(); i++){
+
+         for( unsigned j=0; j < hitsB.size(); j++){
+
+            if ( hitsA[i] == hitsB[j] ) return false;      // a hit is shared -> incompatible
+
+         }
+
+      }
+
+      return true;
+
+   }
+
+};
+
+
+/** A functor to return the quality of a track, which is currently the chi2 probability. */
+class TrackQIChi2Prob{
+
+public:
+
+   inline double operator()( KiTrack::ITrack* track ){ return track->getChi2Prob(); }
+
+
+};
+
+/** A functor to return the quality of a track.
+ *
+ * For tracks with 4 hits or more the chi2prob is mapped to* 0.5-1, with p' = p/2 + 0.5.
+ * Tracks with 3 hits get the chi2prob mapped to 0-0.5 by p' = p/2.
+ * This way short 3-hit-tracks rank lower than 4-hit tracks.
+*/
+class TrackQIChi2ProbSpecial{
+
+public:
+
+   inline double operator()( KiTrack::ITrack* track ){
+
+      if( track->getHits().size() > 3 ){
+
+         return track->getChi2Prob()/2. +0.5;
+
+      }
+      else{
+
+         return track->getChi2Prob()/2.;
+
+      }
+
+   }
+
+
+};
+
+
+/** A functor to return the quality of a track from the chi2prob of its helix fit, for tracks without a Kalman fit.
+ *
+ * The tracks must be FTDFittedTracks, their helix chi2probs are mapped like in TrackQIChi2ProbSpecial.
+ */
+class TrackQIHelixChi2ProbSpecial{
+
+public:
+
+   inline double operator()( KiTrack::ITrack* track ){
+
+      const KiTrackMarlin::FTDFittedTrack* fittedTrack = static_cast< const KiTrackMarlin::FTDFittedTrack* >( track );
+
+      if( fittedTrack->getNumberOfHits() > 3 ){
+
+         return fittedTrack->getHelixChi2Prob()/2. +0.5;
+
+      }
+      else{
+
+         return fittedTrack->getHelixChi2Prob()/2.;
+
+      }
+
+   }
+
+};
+
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef HitConnectionGraph_h
+#define HitConnectionGraph_h
+
+#include <map>
+#include <vector>
+
+#include "KiTrack/Automaton.h"
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/IHit.h"
+#include "KiTrack/ISectorConnector.h"
+#include "KiTrack/Segment.h"
+
+#include "BatchedCriteria.h"
+#include "SectorHitStore.h"
+#include "WorkStealingThreadPool.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** The connections between hits that make up the 1-segment automaton, kept outside of the automaton.
+    *
+    * build() does the same as the KiTrack::SegmentBuilder: every hit is connected to the hits in the sectors the
+    * sector connector allows, if all 2-hit criteria accept the connection. The difference is that the graph survives
+    * the automaton: when the automaton has too many connections and gets redone with tighter cuts, filter() only
+    * checks the connections that are already there, instead of building everything again from all hit pairs.
+    *
+    * This is only the same as a rebuild, if the cuts of the later rounds are really tighter (i.e. a connection
+    * that fails the old cuts would also fail the new ones).
+    *
+    * build() can split the work by the sector of the outer hit and spread it over a thread pool.
+    */
+   class HitConnectionGraph{
+
+
+   public:
+
+      HitConnectionGraph();
+
+      ~HitConnectionGraph();
+
+      HitConnectionGraph( const HitConnectionGraph& ) = delete;
+      HitConnectionGraph& operator=( const HitConnectionGraph& ) = delete;
+
+      /** Connects the hits.
+       *
+       * @param sectorHitStore the hits sorted by sector. They are read from there directly, without copying.
+       *
+       * @param sectors the sectors whose hits get connected, in ascending order (like SectorHitStore::getOccupiedSectors()).
+       * The hits of other sectors are left out, also as the inner hits of the connections.
+       *
+       * @param sectorConnector tells which sectors the hits of a sector may be connected to
+       *
+       * @param criteria the 2-hit criteria a connection has to fulfil. With a thread pool they are used by several threads
+       * at the same time.
+       *
+       * @param threadPool the sectors get connected in parallel on it. If NULL, they get connected serially.
+       * The result does not depend on it.
+       */
+      void build( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                  KiTrack::ISectorConnector* sectorConnector,
+                  const std::vector< KiTrack::ICriterion* >& criteria,
+                  WorkStealingThreadPool* threadPool = NULL );
+
+      /** The same, with the criteria checking the possible children of a hit all at once */
+      void build( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                  KiTrack::ISectorConnector* sectorConnector,
+                  const BatchedCriteria& criteria,
+                  WorkStealingThreadPool* threadPool = NULL );
+
+      /** Removes all connections that don't fulfil the criteria.
+       *
+       * @return the number of removed connections
+       */
+      unsigned filter( const std::vector< KiTrack::ICriterion* >& criteria );
+
+      /** The same, with the criteria checking all connections at once */
+      unsigned filter( const BatchedCriteria& criteria );
+
+      /** @return whether build() was called since the last clear() */
+      bool isBuilt() const { return _isBuilt; }
+
+      unsigned getNumberOfHits() const { return _segments.size(); }
+
+      unsigned getNumberOfConnections() const { return _parents.size(); }
+
+      /** @return the hit with index i (the hits are numbered sector by sector) */
+      KiTrack::IHit* getHit( unsigned i ) const { return _hits[i]; }
+
+      unsigned getLayer( unsigned i ) const { return _layers[i]; }
+
+      /** @return the parent (outer) hit of every connection */
+      const std::vector< unsigned >& getParents() const { return _parents; }
+
+      /** @return the child (inner) hit of every connection */
+      const std::vector< unsigned >& getChildren() const { return _children; }
+
+      /** Adds a 1-hit segment for every hit with the connections of the graph to the automaton.
+       * The automaton takes ownership of the segments.
+       */
+      void fillAutomaton( KiTrack::Automaton& automaton ) const;
+
+      /** Removes all hits and connections */
+      void clear();
+
+
+   private:
+
+      /** one 1-hit segment per hit, used for checking the criteria */
+      std::vector< KiTrack::Segment* > _segments;
+      std::vector< KiTrack::IHit* > _hits;
+      std::vector< unsigned > _layers;
+
+      /** the connections as indices of the parent (outer) and the child (inner) hit */
+      std::vector< unsigned > _parents;
+      std::vector< unsigned > _children;
+
+      bool _isBuilt;
+
+   };
+
+
+}
+
+
+#endif
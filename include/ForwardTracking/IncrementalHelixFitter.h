@@ -0,0 +1,151 @@
+#ifndef IncrementalHelixFitter_h
+#define IncrementalHelixFitter_h
+
+#include <exception>
+#include <string>
+
+#include "EVENT/TrackerHit.h"
+
+#include "lcio.h"
+
+
+using namespace lcio;
+
+
+namespace KiTrackMarlin{
+
+
+   class IncrementalHelixFitterException : public std::exception {
+
+
+   protected:
+      std::string message{} ;
+
+   public:
+
+      IncrementalHelixFitterException( const std::string& text ){
+         message = "IncrementalHelixFitterException: " + text ;
+      }
+
+      virtual const char* what() const noexcept { return  message.c_str() ; }
+
+   };
+
+
+   /** A helix fit that can be updated hit by hit.
+    *
+    * The fit only keeps weighted sums (moments) of the hit coordinates, so adding or removing a hit is O(1) and
+    * copying the fitter is cheap. This makes it possible to fit a raw track once and then get the fit of every
+    * version of it (with some hits from overlapping petals added) by copying the fitter and adding the extra hits.
+    *
+    * In xy a circle is fitted with the algebraic (Kasa) method, the chi2 is the algebraic one divided by (2R)^2,
+    * which is close to the chi2 of the distances to the circle. In z a straight line in the path length s is fitted,
+    * where s is approximated from the distance rho to the z axis as rho + rho^3/(24R^2). This assumes the track comes
+    * from close to the IP and doesn't curl up within the fitted hits. The chi2 is therefore not exactly the same as the
+    * one of the FTDHelixFitter or EndcapHelixFitter.
+    *
+    * The errors of the hits are taken like in the EndcapHelixFitter: from the covariance matrix for composite
+    * spacepoints and from du and dv for planar hits.
+    *
+    * The sums for the circle are calculated relative to the first hit added, to keep the numbers small.
+    */
+   class IncrementalHelixFitter{
+
+
+   public:
+
+      IncrementalHelixFitter();
+
+      /** Adds the hit to the fit */
+      void addHit( TrackerHit* hit );
+
+      /** Removes a hit from the fit, that was added before */
+      void removeHit( TrackerHit* hit );
+
+      /** Adds a point to the fit
+       *
+       * @param sigmaRPhi2 the squared error in the xy plane
+       *
+       * @param sigmaZ2 the squared error in z
+       */
+      void addPoint( double x, double y, double z, double sigmaRPhi2, double sigmaZ2 ){ add( x, y, z, sigmaRPhi2, sigmaZ2, 1. ); }
+
+      /** Removes a point from the fit, that was added before with the same values */
+      void removePoint( double x, double y, double z, double sigmaRPhi2, double sigmaZ2 ){ add( x, y, z, sigmaRPhi2, sigmaZ2, -1. ); }
+
+      unsigned getNumberOfHits() const { return _nHits; }
+
+      /** Calculates the fit from the hits added so far. Throws an IncrementalHelixFitterException if there are
+       * less than 3 hits or if they don't define a circle. */
+      void fit();
+
+      double getChi2() const { return _chi2; }
+      int getNdf() const { return _Ndf; }
+
+      double getChi2Circle() const { return _chi2Circle; }
+      double getChi2Z() const { return _chi2Z; }
+
+      double getRadius() const { return _radius; }
+      double getCentreX() const { return _centreX; }
+      double getCentreY() const { return _centreY; }
+
+      /** @return the slope dz/ds of the fit in z */
+      double getTanLambda() const { return _tanLambda; }
+
+
+   private:
+
+      void add( double x, double y, double z, double sigmaRPhi2, double sigmaZ2, double sign );
+
+      /** Gets the position and the squared errors of a hit */
+      static void getPointOfHit( TrackerHit* hit, double& x, double& y, double& z, double& sigmaRPhi2, double& sigmaZ2 );
+
+      unsigned _nHits;
+
+      /** the reference point (the first hit added): x, y and z in the sums are relative to it */
+      bool _hasReference;
+      double _x0;
+      double _y0;
+      double _z0;
+
+      /** sums for the circle fit with w = 1/sigmaRPhi2, u,v = the coordinates and q = u^2 + v^2 */
+      double _sw;
+      double _su;
+      double _sv;
+      double _suu;
+      double _suv;
+      double _svv;
+      double _sq;
+      double _suq;
+      double _svq;
+      double _sqq;
+
+      /** sums for the line fit in z with w = 1/sigmaZ2, r = rho */
+      double _szw;
+      double _sr;
+      double _sr2;
+      double _sr3;
+      double _sr4;
+      double _sr6;
+      double _sz;
+      double _srz;
+      double _sr3z;
+      double _szz;
+
+      /** the results of fit() */
+      double _chi2;
+      int _Ndf;
+      double _chi2Circle;
+      double _chi2Z;
+      double _radius;
+      double _centreX;
+      double _centreY;
+      double _tanLambda;
+
+   };
+
+
+}
+
+
+#endif
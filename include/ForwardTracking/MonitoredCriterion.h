@@ -0,0 +1,61 @@
+#ifndef MonitoredCriterion_h
+#define MonitoredCriterion_h
+
+#include <atomic>
+
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/Segment.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** A criterion that measures how often another criterion rejects a pair and how long it takes.
+    *
+    * Only a random sample of the checks (one in SAMPLING) is timed and counted, so the other checks cost no more
+    * than a call of the criterion. The counts are atomic, so the criterion can be shared by the threads like the
+    * one it monitors.
+    */
+   class MonitoredCriterion : public KiTrack::ICriterion{
+
+
+   public:
+
+      /** One check in SAMPLING is measured */
+      static const unsigned SAMPLING = 64;
+
+      /** @param criterion the criterion to monitor, not owned */
+      explicit MonitoredCriterion( KiTrack::ICriterion* criterion );
+
+      MonitoredCriterion( const MonitoredCriterion& ) = delete;
+      MonitoredCriterion& operator=( const MonitoredCriterion& ) = delete;
+
+      virtual bool areCompatible( KiTrack::Segment* parent , KiTrack::Segment* child );
+
+      KiTrack::ICriterion* getCriterion() const { return _criterion; }
+
+      /** @return the number of measured checks */
+      unsigned long getNumberOfSamples() const { return _nSamples; }
+
+      /** @return the number of measured checks that rejected the pair */
+      unsigned long getNumberOfRejected() const { return _nRejected; }
+
+      /** @return the time of all measured checks in ns */
+      unsigned long getTimeNs() const { return _timeNs; }
+
+
+   private:
+
+      KiTrack::ICriterion* _criterion;
+
+      std::atomic< unsigned long > _nSamples;
+      std::atomic< unsigned long > _nRejected;
+      std::atomic< unsigned long > _timeNs;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,96 @@
+#ifndef OverlapHitFinder_h
+#define OverlapHitFinder_h
+
+#include <map>
+#include <vector>
+
+#include "KiTrack/IHit.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Finds pairs of close hits on two overlapping petals.
+    *
+    * A hit A on the front petal gets connected to a hit B on the petal behind, if their distance is smaller than
+    * distMax and B is further away from the IP in z than A.
+    *
+    * Instead of comparing every hit of the front petal with every hit of the petal behind, the hits behind are put
+    * into a grid in x and y with a cell size of at least distMax. A hit in front then only has to be compared with
+    * the hits in its own and the 8 surrounding cells. The coordinates of the hits behind are stored as arrays
+    * (sorted by cell), so the distance calculation for a row of cells runs over contiguous memory and can be
+    * vectorised by the compiler.
+    *
+    * The internal buffers are kept between calls, so one OverlapHitFinder should be reused for all petal pairs
+    * of an event. As connect() writes to the buffers, an OverlapHitFinder must not be shared by events running
+    * at the same time.
+    */
+   class OverlapHitFinder{
+
+   public:
+
+      /** @param distMax the maximum distance of two hits to be connected */
+      explicit OverlapHitFinder( float distMax );
+
+      /** Connects hits on the front petal with the close hits on the petal behind. Virtual hits are ignored.
+       *
+       * @param hitsFront the hits on the front petal
+       *
+       * @param hitsBack the hits on the petal behind
+       *
+       * @param map_hitFront_hitsBack the found connections are appended here. For every front hit the hits behind
+       * are added in the same order as they are in hitsBack.
+       *
+       * @return the number of found connections
+       */
+      unsigned connect( KiTrack::IHit* const* hitsFront, unsigned nHitsFront,
+                        KiTrack::IHit* const* hitsBack, unsigned nHitsBack,
+                        std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > >& map_hitFront_hitsBack );
+
+      /** The same as connect(), but comparing every pair of hits. Used by connect() for very few hits and as a
+       * reference. */
+      unsigned connectAllPairs( KiTrack::IHit* const* hitsFront, unsigned nHitsFront,
+                                KiTrack::IHit* const* hitsBack, unsigned nHitsBack,
+                                std::map< KiTrack::IHit* , std::vector< KiTrack::IHit* > >& map_hitFront_hitsBack ) const;
+
+      float getDistMax() const { return _distMax; }
+
+
+   private:
+
+      /** Puts the hits behind into the grid */
+      void fillGrid( KiTrack::IHit* const* hitsBack, unsigned nHitsBack );
+
+      /** Compares a hit with the hits behind from begin to end (indices in the sorted arrays) and stores the
+       * indices in hitsBack of the matching ones in _matches */
+      void compare( float x, float y, float z, float absZ, unsigned begin, unsigned end );
+
+      float _distMax;
+
+      /** the hits behind, sorted by grid cell */
+      std::vector< float > _x;
+      std::vector< float > _y;
+      std::vector< float > _z;
+      std::vector< float > _absZ;
+      std::vector< unsigned > _index;
+
+      /** the grid: the hits of cell c are _cellStart[c] ... _cellStart[c+1]-1 */
+      std::vector< unsigned > _cellStart;
+      float _xMin;
+      float _yMin;
+      float _cellSize;
+      int _nCellsX;
+      int _nCellsY;
+
+      /** scratch buffers */
+      std::vector< unsigned > _cellOfHit;
+      std::vector< unsigned char > _pass;
+      std::vector< unsigned > _matches;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,114 @@
+#ifndef SectorHitStore_h
+#define SectorHitStore_h
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include "KiTrack/IHit.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** A flat store of the hits of an event, sorted by their sectors.
+    *
+    * Sector numbers are dense and bounded, so instead of a map from sector to a vector of hits, all hits are kept
+    * in one contiguous array ordered by sector (compressed sparse row layout): the hits of sector s are
+    * getHits( s ) ... getHits( s ) + getNumberOfHits( s ). Which sectors hold any hits is additionally stored in
+    * a bitmap.
+    *
+    * Usage per event:
+    *    -# reset() with the number of sectors
+    *    -# addHit() for every hit
+    *    -# build()
+    *    -# read the hits (optionally drop whole sectors with clearSector())
+    *
+    * The arrays are kept between events, so after the first events no more memory gets allocated.
+    * Within a sector the hits keep the order in which they were added.
+    */
+   class SectorHitStore{
+
+   public:
+
+      SectorHitStore();
+
+      /** Empties the store.
+       *
+       * @param nSectors the sectors will be numbered 0 ... nSectors - 1. Hits with higher sector numbers can
+       * still be added, the store grows then.
+       */
+      void reset( unsigned nSectors );
+
+      /** Adds a hit to the sector it is on. Only possible before build(). */
+      void addHit( KiTrack::IHit* hit );
+
+      /** Sorts the added hits into their sectors */
+      void build();
+
+      /** @return the number of sector numbers the store is set up for */
+      unsigned getNumberOfSectors() const { return _counts.size(); }
+
+      /** @return the total number of hits in the store */
+      unsigned getNumberOfHits() const { return _hits.size(); }
+
+      /** @return the number of hits in the sector */
+      unsigned getNumberOfHits( int sector ) const {
+         return isInRange( sector ) ? _counts[sector] : 0;
+      }
+
+      /** @return a pointer to the first hit of the sector. The hits of a sector are contiguous. */
+      KiTrack::IHit* const* getHits( int sector ) const {
+         return isInRange( sector ) ? _hits.data() + _offsets[sector] : nullptr;
+      }
+
+      /** @return whether there are any hits in the sector */
+      bool isOccupied( int sector ) const {
+         return isInRange( sector ) && ( ( _occupied[ sector / 64 ] >> ( sector % 64 ) ) & 1 );
+      }
+
+      /** @return the numbers of all sectors that held hits after build(), in ascending order.
+       * Sectors cleared later on are still in here, but have 0 hits. */
+      const std::vector< int >& getOccupiedSectors() const { return _occupiedSectors; }
+
+      /** Drops all hits in a sector */
+      void clearSector( int sector );
+
+      /** @return whether there are no hits at all */
+      bool empty() const { return _hits.empty(); }
+
+      /** @return the content as a map from sector to hits, as needed by the KiTrack::SegmentBuilder.
+       * Only sectors holding hits are in the map. This copies all hits, so it is only meant for the KiTrack classes.
+       */
+      std::map< int , std::vector< KiTrack::IHit* > > getMap() const { return getMap( _occupiedSectors ); }
+
+      /** @return the hits of the passed sectors as a map from sector to hits, like getMap() */
+      std::map< int , std::vector< KiTrack::IHit* > > getMap( const std::vector< int >& sectors ) const;
+
+
+   private:
+
+      bool isInRange( int sector ) const { return sector >= 0 && unsigned( sector ) < _counts.size(); }
+
+      /** the hits sorted by sector */
+      std::vector< KiTrack::IHit* > _hits;
+
+      /** the hits added so far together with their sector, before build() */
+      std::vector< std::pair< int , KiTrack::IHit* > > _staged;
+
+      /** per sector: where its hits start in _hits and how many there are */
+      std::vector< unsigned > _offsets;
+      std::vector< unsigned > _counts;
+
+      /** one bit per sector, set if the sector has hits */
+      std::vector< std::uint64_t > _occupied;
+
+      std::vector< int > _occupiedSectors;
+
+   };
+
+
+}
+
+
+#endif
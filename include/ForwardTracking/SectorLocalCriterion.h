@@ -0,0 +1,61 @@
+#ifndef SectorLocalCriterion_h
+#define SectorLocalCriterion_h
+
+#include <vector>
+
+#include "KiTrack/ICriterion.h"
+#include "KiTrack/Segment.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** A criterion that uses different cut off values in different sectors.
+    *
+    * It holds one version of a criterion for every round of cut off values (level 0 = the loosest, the first round).
+    * Every sector has a level. Two segments are checked with the criterion of the highest level of all the sectors
+    * their hits are in. So only segments touching sectors with a raised level get the tighter cuts, everywhere else
+    * the loose ones stay.
+    */
+   class SectorLocalCriterion : public KiTrack::ICriterion{
+
+
+   public:
+
+      /**
+       * @param levels the criterion for every level. Must not be empty, all have the same name and type.
+       *
+       * @param sectorLevels the level of every sector (index = sector). Not owned, read on every check,
+       * so it can be changed between the uses of the criterion. Sectors not in the vector are on level 0.
+       *
+       * @param ownsLevels whether the SectorLocalCriterion takes ownership of the criteria of the levels
+       */
+      SectorLocalCriterion( const std::vector< KiTrack::ICriterion* >& levels, const std::vector< unsigned >* sectorLevels,
+                            bool ownsLevels = true );
+
+      virtual ~SectorLocalCriterion();
+
+      SectorLocalCriterion( const SectorLocalCriterion& ) = delete;
+      SectorLocalCriterion& operator=( const SectorLocalCriterion& ) = delete;
+
+      virtual bool areCompatible( KiTrack::Segment* parent , KiTrack::Segment* child );
+
+
+   private:
+
+      /** @return the highest level of the sectors of the hits of the segment */
+      unsigned getLevel( KiTrack::Segment* segment ) const;
+
+      std::vector< KiTrack::ICriterion* > _levels;
+
+      const std::vector< unsigned >* _sectorLevels;
+
+      bool _ownsLevels;
+
+   };
+
+
+}
+
+
+#endif
@@ -1,6 +1,7 @@
 #ifndef SiliconEndcapTracking_h
 #define SiliconEndcapTracking_h 1
 
+#include <atomic>
 #include <string>
 
 #include "marlin/Processor.h"
@@ -12,11 +13,24 @@
 
 #include "KiTrack/Segment.h"
 #include "KiTrack/ITrack.h"
+#include "Tools/Fitter.h"
 #include "Criteria/Criteria.h"
 #include "ILDImpl/SectorSystemFTD.h"
 #include "ILDImpl/SectorSystemVXD.h"
 #include "SectorSystemEndcap.h"
+#include "CriteriaRounds.h"
 #include "EndcapHitSimple.h"
+#include "EventArena.h"
+#include "EventContext.h"
+#include "FlatAutomaton.h"
+#include "HitConnectionGraph.h"
+#include "IncrementalHelixFitter.h"
+#include "SectorHitStore.h"
+#include "SparseHopfieldNN.h"
+#include "StageTimer.h"
+#include "SubsetExactHybrid.h"
+#include "TrkSystemPool.h"
+#include "WorkStealingThreadPool.h"
 
 
 using namespace lcio ;
@@ -62,14 +76,21 @@ typedef std::vector< IHit* > RawTrack;
  * @param HelixFitMax the maximum chi2/Ndf that is allowed as result of a helix fit
  * (default value 500 )
  * 
+ * @param IncrementalHelixFit Whether the helix fit of the versions of a track (with hits from overlapping petals added) is
+ * done with an IncrementalHelixFitter: the raw track is fitted once and only the added hits are added to the fit.
+ * Its chi2 is close to, but not the same as the one of the default helix fit, so HelixFitMax might need to be adjusted.<br>
+ * (default value false )
+ * 
  * @param OverlappingHitsDistMax The maximum distance of hits from overlapping petals belonging to one track<br>
  * (default value 3.5 )
  * 
  * @param HitsPerTrackMin The minimum number of hits to create a track<br>
  * (default value 3 )
  * 
- * @param BestSubsetFinder The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN, SubsetSimple and None.
- * None means, that no final search for the best subset is done and overlapping tracks are possible. <br>
+ * @param BestSubsetFinder The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN,
+ * SubsetHopfieldNNComponents, SubsetExactHybrid, SubsetSimple and None. SubsetHopfieldNNComponents splits the tracks into groups linked
+ * by shared hits, accepts tracks without conflicts right away and solves every group with its own Hopfield Neural Network (in parallel, if
+ * NumberOfThreads > 1). SubsetExactHybrid does the same, but solves the small groups exactly. None means, that no final search for the best subset is done and overlapping tracks are possible. <br>
  * (default value TrackSubsetHopfieldNN )
  * 
  * @param Criteria A vector of the criteria that are going to be used by the Cellular Automaton. <br>
@@ -94,16 +115,75 @@ typedef std::vector< IHit* > RawTrack;
  * @param HNN_TInf The temperature limit of the Hopfield Neural Network<br>
  * (default value 0.1)
  * 
+ * @param SubsetExactMaxTracks For SubsetExactHybrid: the components with at most this many tracks are solved exactly (at most 64)<br>
+ * (default value 32)
+ * 
+ * @param SubsetExactMaxNodes For SubsetExactHybrid: the most nodes the exact search may visit in a component. If it needs more, the
+ * component is solved with the Hopfield Neural Network.<br>
+ * (default value 100000)
+ * 
+ * @param SubsetExactCompareHNN For SubsetExactHybrid: whether the exactly solved components are also solved with the Hopfield Neural Network,
+ * to compare time and quality in the summary at the end. The result is the one of the exact solver.<br>
+ * (default value false)
+ * 
  * @param MaxConnectionsAutomaton If the automaton has more connections than this it will be redone with the next cut off values for the criteria.<br>
  * If there are no further new values for the criteria, the event will be skipped.<br>
  * (default value 100000 )
  * 
+ * @param ReuseHitConnections Whether a rerun with the next cut off values keeps the connections between single hits (the 1-hit
+ * segments) that survived the round before and only checks them with the new 2-hit criteria, instead of building all of them again.
+ * The longer segments and their connections are still built anew in every round, no results of the criteria are cached.
+ * This gives the same result as long as the cuts of the later rounds are tighter than the ones before.<br>
+ * (default value false )
+ * 
+ * @param FlatAutomaton Whether to use the FlatAutomaton of this package instead of the KiTrack automaton. It does the same steps,
+ * but keeps the segments and their connections in flat arrays instead of linked objects.<br>
+ * (default value false )
+ * 
+ * @param BatchedCriteria Whether the criteria check all candidate segment pairs of a hit or segment at once. For Crit2_RZRatio,
+ * Crit2_StraightTrackRatio and Crit3_3DAngle there are kernels, that go over the coordinates of all pairs in one loop. The other criteria
+ * only check the pairs the kernels accepted. The 2 hit criteria are batched for the connections of the hits, the 3 and 4 hit criteria only
+ * with the FlatAutomaton.<br>
+ * (default value false )
+ * 
+ * @param CriteriaChains Whether the criteria of a type (2, 3 or 4 hits) are replaced by one compiled criterion, when they are
+ * the standard set of the endcaps (Crit2_RZRatio and Crit2_StraightTrackRatio; Crit3_3DAngle and Crit3_ChangeRZRatio;
+ * Crit4_3DAngleChange, in any order). It reads the hits once, checks the simple criteria inline and calls the others
+ * without virtual call. The decisions are those of the single criteria, up to rounding at the cut off values. Other sets are
+ * checked one by one as before.<br>
+ * (default value false )
+ * 
+ * @param CriteriaReorderInterval If larger than 0, the time and the rejection rate of every criterion are measured on a sample of
+ * the checks, and after every this many events the criteria of each type (2, 3 and 4 hits) are sorted by their time per rejected
+ * pair, so the cheap criteria that reject much come first. The decisions stay the same. The learned order and an estimate of the
+ * time saved against the order of the steering are printed at the end.<br>
+ * (default value 0 )
+ * 
+ * @param TimeStages Whether to measure the time spent in the stages of the reconstruction (reading the hits, overlap map, SegmentBuilder,
+ * automaton for 2-hit and 3-hit segments, helix fit, Kalman fit, best subset and finalising the tracks). At the end the mean, median,
+ * 95% and 99% quantiles and the maximum time per event are printed for every stage.<br>
+ * (default value false )
+ * 
+ * @param TimeStagesInCollection Whether to store the times of the stages of every event in the parameters "StageNames" and "StageTimesMs"
+ * of the output track collection. Needs TimeStages.<br>
+ * (default value false )
+ * 
+ * @param NumberOfThreads The number of threads used for SubsetHopfieldNNComponents. 1 means everything is done serially.
+ * The results do not depend on this number. (With other track systems than DDKalTest the fits use the shared instance
+ * of the MarlinTrk::Factory, so events must then be processed one after the other.)<br>
+ * (default value 1)
+ * 
  * @param MaxHitsPerSector If on any single sector there are more hits than this, all the hits in the sector get dropped.
  * This is to prevent combinatorial breakdown (It is a second safety mechanism, the first one being MaxConnectionsAutomaton.
  * But if there are soooo many hits, that already the first round of the Cellular Automaton would take forever, this mechanism
  * prevents it) <br>
  * (default value 1000)
  * 
+ * @param ReuseCandidateFit Whether the track states of the output tracks are taken from the Kalman fit of the track candidates
+ * instead of fitting the tracks again. The candidates are fitted with the VXD flag of the Fitter set, the final fit without it,
+ * so the track states differ slightly.<br>
+ * (default value false)
+ * 
  * @author Robin Glattauer HEPHY, Wien
  *
  */
@@ -134,8 +214,8 @@ class SiliconEndcapTracking : public Processor {
    *    -# Read in all collections of hits on the FTD that are passed as steering parameters
    *    -# From every hit in these collections an FTDHit01 is created. This is, because the SegmentBuilder and the Automaton
    * need their own hit classes.
-   *    -# The hits are stored in the map _map_sector_hits. The keys in this map are the sectors and the values of the map are vectors
-   * of the hits within those sectors. Sector here means an integer somehow representing a place in the detector.
+   *    -# The hits are stored sorted by their sectors in the SectorHitStore of the event, a flat array where the hits of every sector
+   * are contiguous. Sector here means an integer somehow representing a place in the detector.
    * (For using this numbers and getting things like layer or side the class SectorSystemFTD is used.)
    *    -# Make a safety check to ensure no single sector is overflowing with hits. This could give a combinatorial
    * disaster leading to endless calculation times.
@@ -195,9 +275,9 @@ class SiliconEndcapTracking : public Processor {
  protected:
    
    /**
-   * @return a map that links hits with overlapping hits on the petals behind
+   * @return a map that links hits with overlapping hits on the petals behind. Virtual hits are ignored.
    * 
-   * @param map_sector_hits a map with first= the sector number. second = the hits in the sector. 
+   * @param sectorHitStore the hits sorted by sector
    * 
    * @param secSysFTD the SectorSystemFTD that is used
    * 
@@ -208,7 +288,7 @@ class SiliconEndcapTracking : public Processor {
    /*                                                                   const SectorSystemFTD* secSysFTD, */
    /*                                                                   float distMax); */
 
-   std::map< IHit* , std::vector< IHit* > > getOverlapConnectionMap( const std::map< int , std::vector< IHit* > > & map_sector_hits, 
+   std::map< IHit* , std::vector< IHit* > > getOverlapConnectionMap( const SectorHitStore& sectorHitStore, 
                                                                      const SectorSystemEndcap* secSysEndcap,
                                                                      float distMax);
    
@@ -226,27 +306,13 @@ class SiliconEndcapTracking : public Processor {
    /** Finalises the track: fits it and adds TrackStates at IP, Calorimeter Face, inner- and outermost hit.
    * Sets the subdetector hit numbers and the radius of the innermost hit.
    * Also sets chi2 and Ndf.
+   * 
+   * @param fitter the Kalman fit of the track candidate (with ReuseCandidateFit). If given, the track states are taken from it
+   * and the track isn't fitted again.
+   *
+   * @param trkSystem the track system the fitter was made with. It is checked out while the fitter is used.
    */
-   void finaliseTrack( TrackImpl* trackImpl );
-   
-   /** Sets the cut off values for all the criteria
-    * 
-    * This method is necessary for cases where the CA just finds too much.
-    * Therefore it is possible to enter a whole list of cut off values for every criterion (for every min and every max to be more precise),
-    * that are then used one after the other. 
-    * If the CA finds way too many connections, we can thus make the cuts tighter and rerun it. If there are still too many
-    * connections, just tighten them again.
-    * 
-    * This method will set the according values. It will read the passed (as steering parameter) cut off values, create
-    * criteria from them and store them in the corresponding vectors.
-    * 
-    * If there are no new cut off values for a criterion, the last one remains.
-    * 
-    * @return whether any new cut off value was set. false == there are no new cutoff values anymore
-    * 
-    * @param round The number of the round we are in. I.e. the nth time we run the Cellular Automaton.
-    */
-   bool setCriteria( unsigned round );
+   void finaliseTrack( TrackImpl* trackImpl, Fitter* fitter, MarlinTrk::IMarlinTrkSystem* trkSystem );
   
    // void getCellID0Info(TrackerHit*& trackerHit );
    void getCellID0Info(LCCollection*& col );
@@ -255,11 +321,14 @@ class SiliconEndcapTracking : public Processor {
    /* void getCellID0AndPositionInfo(TrackerHit*& trackerHit ); */
 
 
-   EndcapHitSimple* createVirtualIPHit( const SectorSystemEndcap* sectorSystemEndcap );
-
+   /** @return a virtual hit in the place of the IP. It is created in the passed arena and must not be deleted. */
+   EndcapHitSimple* createVirtualIPHit( const SectorSystemEndcap* sectorSystemEndcap, EventArena& eventArena );
+   
+   /** Adds the TrackerHit of an IEndcapHit to a helix fitter. Virtual hits and hits without TrackerHit are skipped. */
+   static void addToHelixFitter( IncrementalHelixFitter& helixFitter, IHit* hit );
 
-   /** @return Info on the content of _map_sector_hits. Says how many hits are in each sector */
-   std::string getInfo_map_sector_hits();
+   /** @return Info on the content of a SectorHitStore. Says how many hits are in each sector */
+   std::string getInfo_map_sector_hits( const SectorHitStore& sectorHitStore ) const;
    
    
    /** Input collection names */
@@ -276,7 +345,7 @@ class SiliconEndcapTracking : public Processor {
 
 
    int _nRun=-1;
-   int _nEvt=-1;
+   std::atomic< int > _nEvt{-1};
 
    /** B field in z direction */
    double _Bz=0;
@@ -286,6 +355,9 @@ class SiliconEndcapTracking : public Processor {
    
    /** Cut for the Helix fit ( chi squared / degrees of freedom ) */
    double _helixFitMax=0;
+   
+   /** Whether the helix fit of the versions of a track is done with an IncrementalHelixFitter */
+   bool _incrementalHelixFit=false;
 
    // Properties of the Kalman Fit
    bool _MSOn = false;
@@ -302,8 +374,22 @@ class SiliconEndcapTracking : public Processor {
    double _HNN_ActivationThreshold=0.0;
    double _HNN_TInf=0.0;
    
-   /** A map to store the hits according to their sectors */
-   std::map< int , std::vector< IHit* > > _map_sector_hits{};
+   // Properties for SubsetExactHybrid
+   int _subsetExactMaxTracks=0;
+   int _subsetExactMaxNodes=0;
+   bool _subsetExactCompareHNN=false;
+   
+   /** Finds the best subset for SubsetExactHybrid, NULL if another method is used */
+   SubsetExactHybrid* _subsetExactHybrid=NULL;
+   
+   /** The number of sectors of _sectorSystemEndcap */
+   unsigned _nSectors=0;
+   
+   /** The most bytes used in the event arena in a single event */
+   std::atomic< std::size_t > _arenaBytesMax{0};
+   
+   /** The sum of bytes used in the event arena over all events */
+   std::atomic< std::size_t > _arenaBytesSum{0};
    
    /** Names of the used criteria */
    std::vector< std::string > _criteriaNames{};
@@ -317,14 +403,8 @@ class SiliconEndcapTracking : public Processor {
    /** Minimum number of hits a track has to have in order to be stored */
    int _hitsPerTrackMin{};
    
-   /** A vector of criteria for 2 hits (2 1-hit segments) */
-   std::vector <ICriterion*> _crit2Vec{};
-   
-   /** A vector of criteria for 3 hits (2 2-hit segments) */
-   std::vector <ICriterion*> _crit3Vec{};
-   
-   /** A vector of criteria for 4 hits (2 3-hit segments) */
-  std::vector <ICriterion*> _crit4Vec{};
+   /** The criteria for all rounds of cut off values, made in init() */
+   CriteriaRounds* _criteriaRounds=NULL;
    
    
    // const SectorSystemFTD* _sectorSystemFTD;
@@ -345,22 +425,66 @@ class SiliconEndcapTracking : public Processor {
     * the automaton with tighter cuts or stop it entirely. */
    int _maxConnectionsAutomaton=0.0;
    
+   /** Whether the connections between single hits are kept over the rounds and only checked again with the tighter 2-hit cuts */
+   bool _reuseHitConnections=false;
+   
+   /** Whether the FlatAutomaton is used instead of the KiTrack automaton */
+   bool _flatAutomaton=false;
+   
+   /** Whether the criteria check many segment pairs at once */
+   bool _batchedCriteria=false;
+   
+   /** Whether the standard criteria sets are checked by a compiled chain */
+   bool _criteriaChains=false;
+   
+   /** After how many events the criteria are reordered by their measured time and rejection rate (0 = never) */
+   int _criteriaReorderInterval=0;
+   
+   /** The stages of the reconstruction that get timed */
+   enum Stage{ STAGE_READ_HITS, STAGE_OVERLAP_MAP, STAGE_SEGMENT_BUILDER, STAGE_AUTOMATON_2HIT, STAGE_AUTOMATON_3HIT,
+               STAGE_HELIX_FIT, STAGE_KALMAN_FIT, STAGE_BEST_SUBSET, STAGE_FINALISE };
+   
+   /** Whether to time the stages of the reconstruction */
+   bool _timeStages=false;
+   
+   /** Whether to store the times of the stages in the output track collection */
+   bool _timeStagesInCollection=false;
+   
+   /** Times the stages, NULL if _timeStages is false */
+   StageTimer* _stageTimer=NULL;
+   
+   /** The contexts of the events, kept for the next events */
+   EventContextPool* _eventContextPool=NULL;
+   
    /** The method used to find the best subset of tracks */
    std::string _bestSubsetFinder{};
    
-   unsigned _nTrackCandidates=0;
-   unsigned _nTrackCandidatesPlus=0;
+   /** The number of threads used for finding the best subset */
+   int _nThreads=1;
+   
+   /** The thread pool for finding the best subset, NULL if running serially */
+   WorkStealingThreadPool* _threadPool=NULL;
+   
+   std::atomic< unsigned > _nTrackCandidates{0};
+   std::atomic< unsigned > _nTrackCandidatesPlus{0};
 
    
    
+   /** The shared instance of the MarlinTrk::Factory, its options are set for every event */
    MarlinTrk::IMarlinTrkSystem* _trkSystem=NULL;
+   
+   /** The track system of the fits: for DDKalTest a private one owned by this processor, else _trkSystem */
+   MarlinTrk::IMarlinTrkSystem* _fitTrkSystem=NULL;
+   
+   /** Hands out _fitTrkSystem to one fit at a time, so events can be processed at the same time */
+   TrkSystemPool* _trkSystemPool=NULL;
 
    std::string _trkSystemName{};
 
    bool _getTrackStateAtCaloFace=false;
-
-   /** The quality of the output track collection */
-   int _output_track_col_quality=0;
+   
+   /** Whether the output tracks take their states from the Kalman fit of the track candidates */
+   bool _reuseCandidateFit=false;
   
    static const int _output_track_col_quality_GOOD;
    static const int _output_track_col_quality_FAIR;
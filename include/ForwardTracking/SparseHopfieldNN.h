@@ -0,0 +1,82 @@
+#ifndef SparseHopfieldNN_h
+#define SparseHopfieldNN_h
+
+#include <vector>
+
+#include "TrackConflictGraph.h"
+#include "WorkStealingThreadPool.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** A Hopfield Neural Network for finding the best subset of tracks, working on the conflicts as adjacency lists.
+    *
+    * It does the same as the KiTrack::SubsetHopfieldNN, but the net is not stored as a full matrix: every neuron
+    * (track) only sums over the neurons it is in conflict with. Every neuron i gets updated with
+    *
+    *    y_i = omega * QI_i - ( 1 - omega ) * sum_( j in conflict with i ) S_j
+    *
+    *    S_i = 1/2 * ( 1 + tanh( y_i / T ) )
+    *
+    * starting from S = 0. After every iteration the temperature goes towards TInf ( T = (T + TInf) / 2 ). The net is
+    * stable when no state changed more than the limit for convergence in an iteration. The tracks with a state above
+    * the activation threshold are accepted.
+    *
+    * The neurons are updated in a fixed order (and not a random one), so the result is always the same.
+    *
+    * calculateBestSet() with a TrackConflictGraph splits the conflicts into connected components first: tracks
+    * without any conflict are accepted right away and every other component is solved as a net of its own.
+    */
+   class SparseHopfieldNN{
+
+
+   public:
+
+      SparseHopfieldNN( double omega, double activationThreshold, double TInf );
+
+      void setT( double T ){ _T = T; }
+      void setLimitForConvergence( double limitForConvergence ){ _limitForConvergence = limitForConvergence; }
+      void setMaxIterations( unsigned maxIterations ){ _maxIterations = maxIterations; }
+
+      /** Solves one net.
+       *
+       * @param conflicts for every neuron the indices of the neurons it is in conflict with
+       *
+       * @param QIs the quality of every neuron (the higher the better)
+       *
+       * @return whether every neuron is accepted
+       */
+      std::vector< bool > calculateBestSet( const std::vector< std::vector< unsigned > >& conflicts,
+                                            const std::vector< double >& QIs ) const;
+
+      /** Solves every connected component of the graph as a net of its own.
+       *
+       * @param QIs the quality of every track of the graph (the higher the better)
+       *
+       * @param threadPool the components get solved in parallel on it. If NULL, they get solved serially.
+       * The result does not depend on it.
+       *
+       * @return whether every track of the graph is accepted
+       */
+      std::vector< bool > calculateBestSet( const TrackConflictGraph& conflictGraph,
+                                            const std::vector< double >& QIs,
+                                            WorkStealingThreadPool* threadPool ) const;
+
+
+   private:
+
+      double _omega;
+      double _activationThreshold;
+      double _TInf;
+      double _T;
+      double _limitForConvergence;
+      unsigned _maxIterations;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef StageTimer_h
+#define StageTimer_h
+
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace KiTrackMarlin{
+
+
+   /** Measures how much time the stages of the reconstruction take per event.
+    *
+    * The times of an event are collected in a StageTimer::EventTimes, which belongs to the event, and stored with
+    * addEvent() once the event is done. So several events can be timed at once. When several threads work in the
+    * same stage of an event, the time of the stage is the CPU time summed over the threads and not the wall clock time.
+    *
+    * The time of every stage in every event is kept, so that printSummary() can give exact percentiles.
+    *
+    * The easiest way to time a part of the code is a StageTimer::Scope.
+    */
+   class StageTimer{
+
+
+   public:
+
+      /** The times of the stages in one event. Any thread working on the event may add to it. */
+      class EventTimes{
+
+      public:
+
+         explicit EventTimes( unsigned nStages ): _times( nStages, 0. ){}
+
+         /** Adds time to a stage. Thread safe. */
+         void add( unsigned stage, double milliseconds );
+
+         /** @return the time in milliseconds spent in a stage so far */
+         double get( unsigned stage ) const;
+
+         /** Sets the times of all stages back to 0, for the next event */
+         void reset();
+
+         unsigned getNumberOfStages() const { return _times.size(); }
+
+      private:
+
+         mutable std::mutex _mutex;
+         std::vector< double > _times;
+
+      };
+
+
+      /**
+       * @param stageNames the names of the stages, the index of a name is the index of the stage
+       */
+      explicit StageTimer( const std::vector< std::string >& stageNames );
+
+      /** Stores the times of a finished event. Thread safe. */
+      void addEvent( const EventTimes& eventTimes );
+
+      unsigned getNumberOfStages() const { return _stageNames.size(); }
+
+      const std::string& getStageName( unsigned stage ) const { return _stageNames[stage]; }
+
+      /** Prints mean, median, 95%, 99% quantiles and maximum of the time per event for every stage */
+      void printSummary( const std::string& name ) const;
+
+
+      /** Adds the time from its creation to its destruction to a stage. Does nothing, if the EventTimes are NULL. */
+      class Scope{
+
+      public:
+
+         Scope( EventTimes* eventTimes, unsigned stage );
+
+         ~Scope();
+
+         /** Stops the timing before the end of the scope */
+         void stop();
+
+         Scope( const Scope& ) = delete;
+         Scope& operator=( const Scope& ) = delete;
+
+      private:
+
+         EventTimes* _eventTimes;
+         unsigned _stage;
+         std::chrono::steady_clock::time_point _start;
+
+      };
+
+
+   private:
+
+      std::vector< std::string > _stageNames;
+
+      mutable std::mutex _mutex;
+
+      /** the times of all finished events: one vector of event times per stage */
+      std::vector< std::vector< float > > _eventTimes;
+
+   };
+
+
+}
+
+
+#endif
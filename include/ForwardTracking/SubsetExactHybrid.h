@@ -0,0 +1,87 @@
+#ifndef SubsetExactHybrid_h
+#define SubsetExactHybrid_h
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "ExactSubsetSolver.h"
+#include "SparseHopfieldNN.h"
+#include "TrackConflictGraph.h"
+#include "WorkStealingThreadPool.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Finds the best subset of tracks per connected component of the conflicts: small components exactly with the
+    * ExactSubsetSolver, large ones (and the ones where the exact search runs out of nodes) with the SparseHopfieldNN.
+    * Tracks without conflicts are accepted right away.
+    *
+    * It keeps statistics over all calls: how many components got solved in which way, how long it took and the
+    * summed quality of the accepted tracks. If the comparison is switched on, the exactly solved components are also
+    * solved with the Hopfield Neural Network, to see how much quality the network loses and how much time it takes.
+    */
+   class SubsetExactHybrid{
+
+
+   public:
+
+      /**
+       * @param compareHopfield whether to solve the exactly solved components also with the Hopfield Neural Network
+       * for the statistics (the result is the one of the exact solver)
+       */
+      SubsetExactHybrid( const ExactSubsetSolver& exactSolver, const SparseHopfieldNN& hopfieldNN, bool compareHopfield );
+
+      /**
+       * @param QIs the quality of every track of the graph, must not be negative
+       *
+       * @param threadPool the components get solved in parallel on it. If NULL, they get solved serially.
+       *
+       * @return whether every track of the graph is accepted
+       */
+      std::vector< bool > calculateBestSet( const TrackConflictGraph& conflictGraph,
+                                            const std::vector< double >& QIs,
+                                            WorkStealingThreadPool* threadPool );
+
+      /** Prints the statistics of all calls so far */
+      void printSummary( const std::string& name ) const;
+
+
+   private:
+
+      /** The statistics of the components solved in one way */
+      struct Statistics{
+
+         unsigned nComponents = 0;
+         unsigned nTracks = 0;
+         double timeMs = 0.;
+         double quality = 0.;
+
+         void add( const Statistics& statistics );
+
+      };
+
+      /** @return the summed quality of the accepted tracks */
+      static double getQuality( const std::vector< double >& QIs, const std::vector< bool >& accepted );
+
+      ExactSubsetSolver _exactSolver;
+      SparseHopfieldNN _hopfieldNN;
+      bool _compareHopfield;
+
+      mutable std::mutex _mutex;
+
+      Statistics _exact;
+      Statistics _hopfield;
+      Statistics _hopfieldOnExact;
+
+      /** components small enough for the exact solver, where the search ran out of nodes */
+      unsigned _nOutOfNodes;
+
+   };
+
+
+}
+
+
+#endif
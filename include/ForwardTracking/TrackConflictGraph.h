@@ -0,0 +1,112 @@
+#ifndef TrackConflictGraph_h
+#define TrackConflictGraph_h
+
+#include <unordered_map>
+#include <vector>
+
+#include "KiTrack/ITrack.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Which track candidates of an event are in conflict, i.e. share a hit.
+    *
+    * Instead of comparing the hits of every pair of tracks, an index from every hit to the tracks using it is built
+    * once. Only tracks that are listed together at some hit are in conflict, so building the graph takes
+    * O( number of hits of all tracks + number of conflicts ). The conflicts of every track are kept as a sorted list
+    * of track indices (the index of a track is its position in the vector passed to the constructor).
+    */
+   class TrackConflictGraph{
+
+
+   public:
+
+      TrackConflictGraph( const std::vector< KiTrack::ITrack* >& tracks );
+
+      /** The part of another graph with only some of its tracks, without looking at the hits again.
+       *
+       * @param graph the graph to take the conflicts from
+       *
+       * @param indices the indices in graph of the tracks to keep, in any order
+       *
+       * @param tracks the tracks that take the places of the kept ones (e.g. refitted copies with the same hits),
+       * in the order of indices
+       */
+      TrackConflictGraph( const TrackConflictGraph& graph, const std::vector< unsigned >& indices,
+                          const std::vector< KiTrack::ITrack* >& tracks );
+
+      unsigned getNumberOfTracks() const { return _tracks.size(); }
+
+      /** @return the tracks, in the order of their indices */
+      const std::vector< KiTrack::ITrack* >& getTracks() const { return _tracks; }
+
+      /** @return the number of pairs of tracks in conflict */
+      unsigned getNumberOfConflicts() const { return _nConflicts; }
+
+      KiTrack::ITrack* getTrack( unsigned index ) const { return _tracks[index]; }
+
+      /** @return the index of the track, -1 if it is not in the graph */
+      int getIndex( KiTrack::ITrack* track ) const;
+
+      /** @return the indices of the tracks in conflict with the track, sorted */
+      const std::vector< unsigned >& getConflicts( unsigned index ) const { return _conflicts[index]; }
+
+      bool areInConflict( unsigned indexA, unsigned indexB ) const;
+
+      /** @return the connected components of the graph: groups of tracks (as indices) that are linked by conflicts.
+       * Tracks in different components can be decided on independently. The components are ordered by their
+       * smallest index, the indices within a component are sorted. Tracks without conflicts form components of size 1.
+       */
+      std::vector< std::vector< unsigned > > getComponents() const;
+
+      /** Gets the conflicts within a component, with the positions in the component as indices.
+       *
+       * @param component sorted track indices, as from getComponents()
+       *
+       * @param conflicts set to the conflicts of every track of the component
+       */
+      void getComponentConflicts( const std::vector< unsigned >& component, std::vector< std::vector< unsigned > >& conflicts ) const;
+
+      /** @return whether the two tracks share no hit (a track is not compatible with itself). Tracks not in the graph
+       * are compatible with everything.
+       */
+      bool areCompatible( KiTrack::ITrack* trackA, KiTrack::ITrack* trackB ) const;
+
+
+   private:
+
+      std::vector< KiTrack::ITrack* > _tracks;
+
+      std::unordered_map< KiTrack::ITrack* , unsigned > _map_track_index;
+
+      std::vector< std::vector< unsigned > > _conflicts;
+
+      unsigned _nConflicts;
+
+   };
+
+
+   /** A functor to return whether two tracks are compatible, looked up in a TrackConflictGraph.
+    *
+    * Gives the same as TrackCompatibilityShare1SP for the tracks of the graph, but without copying and comparing the hits.
+    */
+   class TrackCompatibilityConflictGraph{
+
+   public:
+
+      TrackCompatibilityConflictGraph( const TrackConflictGraph* conflictGraph ): _conflictGraph( conflictGraph ){}
+
+      inline bool operator()( KiTrack::ITrack* trackA, KiTrack::ITrack* trackB ){ return _conflictGraph->areCompatible( trackA, trackB ); }
+
+   private:
+
+      const TrackConflictGraph* _conflictGraph;
+
+   };
+
+
+}
+
+
+#endif
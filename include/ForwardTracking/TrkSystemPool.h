@@ -0,0 +1,90 @@
+#ifndef TrkSystemPool_h
+#define TrkSystemPool_h
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+#include "MarlinTrk/IMarlinTrkSystem.h"
+
+
+namespace KiTrackMarlin{
+
+
+   /** Hands out track systems, every one to only one thread at a time.
+    *
+    * An IMarlinTrkSystem must not be used by several threads at once. Instead of giving every thread its own one,
+    * the track systems are checked out for as long as a fit needs them and given back afterwards. So any number of
+    * threads, also the ones of several events reconstructed at the same time, can share a fixed set of track systems.
+    * If none is free, checkout() waits until one is given back.
+    *
+    * The easiest way to check out a track system is a TrkSystemPool::Lease.
+    */
+   class TrkSystemPool{
+
+
+   public:
+
+      /** @param trkSystems the track systems to hand out, not owned. Must not be empty. */
+      explicit TrkSystemPool( const std::vector< MarlinTrk::IMarlinTrkSystem* >& trkSystems );
+
+      TrkSystemPool( const TrkSystemPool& ) = delete;
+      TrkSystemPool& operator=( const TrkSystemPool& ) = delete;
+
+      /** @return a free track system, waits if there is none */
+      MarlinTrk::IMarlinTrkSystem* checkout();
+
+      /** Waits until the passed track system is free and checks it out. Needed for using a fit that was done with it.
+       * A track system not belonging to the pool is returned right away.
+       */
+      MarlinTrk::IMarlinTrkSystem* checkout( MarlinTrk::IMarlinTrkSystem* trkSystem );
+
+      /** Gives a checked out track system back */
+      void giveBack( MarlinTrk::IMarlinTrkSystem* trkSystem );
+
+      unsigned getNumberOfTrkSystems() const { return _trkSystems.size(); }
+
+
+      /** Checks out a track system for its lifetime */
+      class Lease{
+
+      public:
+
+         /** Checks out any free track system */
+         explicit Lease( TrkSystemPool& pool ): _pool( pool ), _trkSystem( pool.checkout() ){}
+
+         /** Checks out the passed track system */
+         Lease( TrkSystemPool& pool, MarlinTrk::IMarlinTrkSystem* trkSystem ): _pool( pool ), _trkSystem( pool.checkout( trkSystem ) ){}
+
+         ~Lease(){ _pool.giveBack( _trkSystem ); }
+
+         Lease( const Lease& ) = delete;
+         Lease& operator=( const Lease& ) = delete;
+
+         MarlinTrk::IMarlinTrkSystem* get() const { return _trkSystem; }
+
+      private:
+
+         TrkSystemPool& _pool;
+         MarlinTrk::IMarlinTrkSystem* _trkSystem;
+
+      };
+
+
+   private:
+
+      std::vector< MarlinTrk::IMarlinTrkSystem* > _trkSystems;
+
+      /** whether the track system with the same index is free */
+      std::vector< bool > _isFree;
+
+      std::mutex _mutex;
+      std::condition_variable _givenBack;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef WorkStealingThreadPool_h
+#define WorkStealingThreadPool_h
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace KiTrackMarlin{
+
+
+   /** A small thread pool with one task queue per thread and work stealing.
+    *
+    * The thread calling parallelFor() takes part in the work as thread 0, the pool itself starts
+    * nThreads - 1 additional workers. A thread first works off its own queue (newest task first) and only
+    * when it is empty it steals the oldest task from the queue of another thread. This way big chunks of work
+    * get redistributed while the tasks a thread created itself stay on it.
+    *
+    * Calls to parallelFor() may be nested: a thread waiting for its tasks to finish keeps on executing
+    * (or stealing) tasks as long as there are any. Only when there is none left to take, it sleeps until
+    * its last task is done or new tasks come.
+    */
+   class WorkStealingThreadPool{
+
+   public:
+
+      /** @param nThreads the total number of threads working, including the calling one.
+       * 0 and 1 both mean, that no additional threads are started and everything runs serially.
+       */
+      explicit WorkStealingThreadPool( unsigned nThreads );
+
+      ~WorkStealingThreadPool();
+
+      WorkStealingThreadPool( const WorkStealingThreadPool& ) = delete;
+      WorkStealingThreadPool& operator=( const WorkStealingThreadPool& ) = delete;
+
+      /** @return the number of threads working, including the calling one */
+      unsigned getNumberOfThreads() const { return _queues.size(); }
+
+      /** Calls body( i ) for every i in [0,n) distributed over the threads of the pool and returns once
+       * all of them are done. If any of the calls throws, the first exception is rethrown here after all
+       * other calls have finished.
+       */
+      void parallelFor( unsigned n, const std::function< void( unsigned ) >& body );
+
+
+   private:
+
+      struct Task{
+
+         std::function< void() > work;
+
+      };
+
+      struct TaskQueue{
+
+         std::mutex mutex;
+         std::deque< Task > tasks;
+
+      };
+
+      /** the loop the additional worker threads are running */
+      void workerLoop( unsigned index );
+
+      /** Runs one task, either from the own queue or stolen from another one.
+       * @return whether a task was run */
+      bool runOneTask( unsigned index );
+
+      bool popOwn( unsigned index, Task& task );
+      bool steal( unsigned index, Task& task );
+
+      std::vector< std::unique_ptr< TaskQueue > > _queues;
+      std::vector< std::thread > _workers;
+
+      /** the number of tasks sitting in any of the queues */
+      std::atomic< unsigned > _nQueued;
+      std::atomic< bool > _stop;
+
+      std::mutex _sleepMutex;
+      std::condition_variable _wakeUp;
+
+   };
+
+
+}
+
+
+#endif
@@ -0,0 +1,268 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
+
+#include "KiTrack/Automaton.h"
+#include "KiTrack/SegmentBuilder.h"
+#include "Criteria/Criteria.h"
+#include "ILDImpl/FTDHitSimple.h"
+#include "ILDImpl/FTDSectorConnector.h"
+#include "ILDImpl/SectorSystemFTD.h"
+
+#include "FlatAutomaton.h"
+#include "HitConnectionGraph.h"
+#include "SectorHitStore.h"
+
+
+using namespace KiTrack;
+using namespace KiTrackMarlin;
+
+
+typedef std::vector< IHit* > RawTrack;
+
+
+/** the z positions of the FTD disks (layer 1 to 7) in mm */
+const float diskZ[] = { 220., 371., 645., 1020., 1350., 1686., 2000. };
+const unsigned nDisks = sizeof( diskZ ) / sizeof( diskZ[0] );
+
+const unsigned nPetals = 16;
+
+const float rMin = 40.;
+const float rMax = 300.;
+
+
+IHit* createHit( float r, float phi, unsigned layer, const SectorSystemFTD* secSys ){
+
+   if( phi < 0. ) phi += 2*M_PI;
+
+   unsigned module = unsigned( phi / ( 2*M_PI ) * nPetals ) % nPetals;
+
+   return new FTDHitSimple( r*cos( phi ), r*sin( phi ), diskZ[ layer - 1 ], 1, layer, module, 0, secSys );
+
+}
+
+
+/** Creates the hits of an event on the forward side of the FTD: straight tracks from the IP, slightly smeared,
+ * and uniformly distributed noise hits. The virtual IP hit comes first.
+ */
+std::vector< IHit* > createEvent( unsigned nTracks, unsigned nNoiseHits, const SectorSystemFTD* secSys, std::mt19937& random ){
+
+
+   std::vector< IHit* > hits;
+
+   IHit* virtualIPHit = new FTDHitSimple( 0., 0., 0., 1, 0, 0, 0, secSys );
+   virtualIPHit->setIsVirtual( true );
+   hits.push_back( virtualIPHit );
+
+   std::uniform_real_distribution< float > slope( rMin / diskZ[0], rMax / diskZ[ nDisks - 1 ] * 3. );
+   std::uniform_real_distribution< float > phi( 0., 2*M_PI );
+   std::normal_distribution< float > smear( 0., 0.002 );
+
+   for( unsigned i=0; i < nTracks; i++ ){
+
+      float s = slope( random );
+      float p = phi( random );
+
+      for( unsigned layer=1; layer <= nDisks; layer++ ){
+
+         float r = s * diskZ[ layer - 1 ] * ( 1. + smear( random ) );
+
+         if( r >= rMin && r <= rMax ) hits.push_back( createHit( r, p + smear( random ), layer, secSys ) );
+
+      }
+
+   }
+
+   std::uniform_real_distribution< float > radius( rMin, rMax );
+   std::uniform_int_distribution< unsigned > layer( 1, nDisks );
+
+   for( unsigned i=0; i < nNoiseHits; i++ ) hits.push_back( createHit( radius( random ), phi( random ), layer( random ), secSys ) );
+
+   return hits;
+
+}
+
+
+/** @return the tracks with their hits sorted, in a sorted order, so tracks of different automata can be compared */
+std::vector< RawTrack > normalise( std::vector< RawTrack > tracks ){
+
+   for( unsigned i=0; i < tracks.size(); i++ ) std::sort( tracks[i].begin(), tracks[i].end() );
+
+   std::sort( tracks.begin(), tracks.end() );
+
+   return tracks;
+
+}
+
+
+/** Runs the KiTrack automaton from the SegmentBuilder to the tracks */
+std::vector< RawTrack > runKiTrack( const std::map< int , std::vector< IHit* > >& map_sector_hits, ISectorConnector* secCon,
+                                    const std::vector< ICriterion* >& crit2Vec,
+                                    const std::vector< ICriterion* >& crit3Vec,
+                                    const std::vector< ICriterion* >& crit4Vec ){
+
+   SegmentBuilder segBuilder( map_sector_hits );
+   segBuilder.addCriteria( crit2Vec );
+   segBuilder.addSectorConnector( secCon );
+
+   Automaton automaton = segBuilder.get1SegAutomaton();
+
+   automaton.addCriteria( crit3Vec );
+   automaton.lengthenSegments();
+   automaton.doAutomaton();
+   automaton.cleanBadStates();
+   automaton.resetStates();
+
+   automaton.clearCriteria();
+   automaton.addCriteria( crit4Vec );
+   automaton.lengthenSegments();
+   automaton.doAutomaton();
+   automaton.cleanBadStates();
+   automaton.resetStates();
+
+   return automaton.getTracks( 3 );
+
+}
+
+
+/** Runs the FlatAutomaton from the HitConnectionGraph to the tracks */
+std::vector< RawTrack > runFlat( const SectorHitStore& sectorHitStore, ISectorConnector* secCon,
+                                 const std::vector< ICriterion* >& crit2Vec,
+                                 const std::vector< ICriterion* >& crit3Vec,
+                                 const std::vector< ICriterion* >& crit4Vec ){
+
+   HitConnectionGraph hitConnectionGraph;
+   hitConnectionGraph.build( sectorHitStore, sectorHitStore.getOccupiedSectors(), secCon, crit2Vec );
+
+   FlatAutomaton automaton( hitConnectionGraph );
+
+   automaton.addCriteria( crit3Vec );
+   automaton.lengthenSegments();
+   automaton.doAutomaton();
+   automaton.cleanBadStates();
+   automaton.resetStates();
+
+   automaton.clearCriteria();
+   automaton.addCriteria( crit4Vec );
+   automaton.lengthenSegments();
+   automaton.doAutomaton();
+   automaton.cleanBadStates();
+   automaton.resetStates();
+
+   return automaton.getTracks( 3 );
+
+}
+
+
+/** Compares the FlatAutomaton with the KiTrack automaton on the same generated FTD events, for an increasing number
+ * of tracks per event: both must find the same tracks, and the time per event of both is printed.
+ *
+ * @param argv[1] the number of events per occupancy (default 20)
+ *
+ * @param argv[2] the number of noise hits per track (default 2)
+ *
+ * @param argv[3] the random seed (default 1)
+ */
+int main(int argc,char *argv[]){
+
+
+   unsigned nEvents = 20;
+   if( argc >= 2 ) nEvents = atoi( argv[1] );
+
+   float noisePerTrack = 2.;
+   if( argc >= 3 ) noisePerTrack = atof( argv[2] );
+
+   unsigned seed = 1;
+   if( argc >= 4 ) seed = atoi( argv[3] );
+
+   std::mt19937 random( seed );
+
+   SectorSystemFTD secSys( nDisks + 1, nPetals, 1 );
+   FTDSectorConnector secCon( &secSys, 1, 1, 5 );
+
+   // loose cuts for straight tracks from the IP
+   std::vector< ICriterion* > crit2Vec;
+   std::vector< ICriterion* > crit3Vec;
+   std::vector< ICriterion* > crit4Vec;
+
+   crit2Vec.push_back( Criteria::createCriterion( "Crit2_RZRatio", 0.9, 1.1 ) );
+   crit2Vec.push_back( Criteria::createCriterion( "Crit2_StraightTrackRatio", 0.9, 1.1 ) );
+   crit3Vec.push_back( Criteria::createCriterion( "Crit3_3DAngle", 0., 10. ) );
+   crit4Vec.push_back( Criteria::createCriterion( "Crit4_3DAngleChange", 0.5, 2. ) );
+
+   const unsigned occupancies[] = { 10, 30, 100, 300 };
+
+   std::cout << "events per occupancy = " << nEvents << ", noise hits per track = " << noisePerTrack << "\n";
+   std::cout << "tracks/event\ttracks found\tKiTrack [ms]\tflat [ms]\tspeedup\n";
+
+   bool allOK = true;
+
+   for( unsigned iOcc=0; iOcc < sizeof( occupancies ) / sizeof( occupancies[0] ); iOcc++ ){
+
+
+      unsigned nTracks = occupancies[iOcc];
+
+      double timeKiTrack = 0.;
+      double timeFlat = 0.;
+      unsigned nTracksFound = 0;
+
+      for( unsigned iEvent=0; iEvent < nEvents; iEvent++ ){
+
+
+         std::vector< IHit* > hits = createEvent( nTracks, unsigned( noisePerTrack*nTracks ), &secSys, random );
+
+         // the store makes room for the sectors of the hits
+         SectorHitStore sectorHitStore;
+         sectorHitStore.reset( 0 );
+         for( unsigned i=0; i < hits.size(); i++ ) sectorHitStore.addHit( hits[i] );
+         sectorHitStore.build();
+
+         // the KiTrack::SegmentBuilder takes the hits as a map
+         std::map< int , std::vector< IHit* > > map_sector_hits = sectorHitStore.getMap();
+
+
+         std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+         std::vector< RawTrack > tracksKiTrack = runKiTrack( map_sector_hits, &secCon, crit2Vec, crit3Vec, crit4Vec );
+
+         std::chrono::steady_clock::time_point middle = std::chrono::steady_clock::now();
+
+         std::vector< RawTrack > tracksFlat = runFlat( sectorHitStore, &secCon, crit2Vec, crit3Vec, crit4Vec );
+
+         std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+         timeKiTrack += std::chrono::duration< double, std::milli >( middle - start ).count();
+         timeFlat += std::chrono::duration< double, std::milli >( end - middle ).count();
+
+         nTracksFound += tracksFlat.size();
+
+         if( normalise( tracksKiTrack ) != normalise( tracksFlat ) ){
+
+            std::cout << "ERROR: event " << iEvent << " with " << nTracks << " tracks: KiTrack found " << tracksKiTrack.size()
+                      << " tracks, the flat automaton " << tracksFlat.size() << "\n";
+            allOK = false;
+
+         }
+
+         for( unsigned i=0; i < hits.size(); i++ ) delete hits[i];
+
+      }
+
+      std::cout << nTracks << "\t\t" << double( nTracksFound ) / nEvents << "\t\t" << timeKiTrack / nEvents << "\t\t"
+                << timeFlat / nEvents << "\t\t" << timeKiTrack / timeFlat << "\n";
+
+   }
+
+   for( unsigned i=0; i < crit2Vec.size(); i++ ) delete crit2Vec[i];
+   for( unsigned i=0; i < crit3Vec.size(); i++ ) delete crit3Vec[i];
+   for( unsigned i=0; i < crit4Vec.size(); i++ ) delete crit4Vec[i];
+
+
+   return allOK ? 0 : 1;
+
+}
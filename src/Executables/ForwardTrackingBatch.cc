@@ -0,0 +1,657 @@
+/** Executable, that runs the forward tracking on an LCIO file without Marlin, on several events at the same time.
+ *
+ * A reader thread reads the events ahead into a bounded queue, a number of worker threads take them from there and
+ * reconstruct them with one shared ForwardTrackingEngine, and the main thread writes the events with the track
+ * collection added in the order they were read. So the output is the same as from a sequential Marlin job with the
+ * ForwardTracking processor, only faster on a full node.
+ *
+ * Sharing the engine is safe, because reconstruct() keeps all the state of an event to itself (see
+ * ForwardTrackingEngine) and every worker fits with a track system of its own out of the engine's pool, whose options
+ * are set once before the first event. With more than one thread ROOT::EnableThreadSafety() is called first, as KalTest
+ * creates ROOT objects while fitting.
+ *
+ * The settings are read from a plain text file with one parameter per line: the name of the steering parameter of
+ * the ForwardTracking processor, followed by its values, separated by spaces. Lines starting with # are ignored.
+ * For example:
+ *
+ *    FTDHitCollections FTDPixelTrackerHits FTDSpacePoints
+ *    BestSubsetFinder SubsetHopfieldNN
+ *    Crit2_RZRatio_min 0.9
+ *    Crit2_RZRatio_max 1.02 1.01
+ *
+ * Parameters not given keep the defaults of the processor. Only DDKalTest is supported as track system.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <sstream>
+#include <thread>
+
+#include "lcio.h"
+#include "EVENT/LCCollection.h"
+#include "EVENT/TrackerHit.h"
+#include "IMPL/LCCollectionVec.h"
+#include "IMPL/LCFlagImpl.h"
+#include "IO/LCWriter.h"
+#include "IOIMPL/LCFactory.h"
+#include "MT/LCReader.h"
+
+#include "DD4hep/Detector.h"
+#include "DDRec/DetectorData.h"
+
+#include "TROOT.h"
+
+#include "MarlinTrk/MarlinDDKalTest.h"
+
+#include "Criteria/Criteria.h"
+#include "ILDImpl/SectorSystemFTD.h"
+
+#include "ForwardTrackingEngine.h"
+
+
+using namespace lcio;
+using namespace KiTrack;
+using namespace KiTrackMarlin;
+
+
+/** A queue with a maximum size. push() waits while the queue is full, pop() while it is empty.
+ * After close() no more elements come: pop() returns false, once the queue is empty.
+ */
+template< class T >
+class BoundedQueue{
+
+
+public:
+
+   explicit BoundedQueue( unsigned maxSize ): _maxSize( maxSize ), _isClosed( false ){}
+
+   void push( T value ){
+
+      std::unique_lock< std::mutex > lock( _mutex );
+      _notFull.wait( lock, [this](){ return _queue.size() < _maxSize; } );
+
+      _queue.push( std::move( value ) );
+      _notEmpty.notify_one();
+
+   }
+
+   bool pop( T& value ){
+
+      std::unique_lock< std::mutex > lock( _mutex );
+      _notEmpty.wait( lock, [this](){ return !_queue.empty() || _isClosed; } );
+
+      if( _queue.empty() ) return false;
+
+      value = std::move( _queue.front() );
+      _queue.pop();
+      _notFull.notify_one();
+
+      return true;
+
+   }
+
+   void close(){
+
+      std::lock_guard< std::mutex > lock( _mutex );
+      _isClosed = true;
+      _notEmpty.notify_all();
+
+   }
+
+
+private:
+
+   unsigned _maxSize;
+   bool _isClosed;
+   std::queue< T > _queue;
+   std::mutex _mutex;
+   std::condition_variable _notEmpty;
+   std::condition_variable _notFull;
+
+};
+
+
+/** Brings the events back into the order they were read in.
+ *
+ * The workers put() the events with their number in any order, the writer gets them with takeNext() one after the
+ * other. An event more than maxAhead after the next one to write waits in put(), so a slow event can't let the
+ * events finished after it pile up.
+ */
+class EventReorderer{
+
+
+public:
+
+   explicit EventReorderer( unsigned maxAhead ): _maxAhead( maxAhead ), _next( 0 ), _isClosed( false ){}
+
+   void put( unsigned number, std::unique_ptr< EVENT::LCEvent > evt ){
+
+      std::unique_lock< std::mutex > lock( _mutex );
+      _changed.wait( lock, [&](){ return number < _next + _maxAhead; } );
+
+      _events[ number ] = std::move( evt );
+      _changed.notify_all();
+
+   }
+
+   /** @return false, if there are no more events */
+   bool takeNext( std::unique_ptr< EVENT::LCEvent >& evt ){
+
+      std::unique_lock< std::mutex > lock( _mutex );
+      _changed.wait( lock, [this](){ return _events.count( _next ) > 0 || _isClosed; } );
+
+      std::map< unsigned , std::unique_ptr< EVENT::LCEvent > >::iterator it = _events.find( _next );
+      if( it == _events.end() ) return false;
+
+      evt = std::move( it->second );
+      _events.erase( it );
+
+      _next++;
+      _changed.notify_all();
+
+      return true;
+
+   }
+
+   /** Called, when all events are put */
+   void close(){
+
+      std::lock_guard< std::mutex > lock( _mutex );
+      _isClosed = true;
+      _changed.notify_all();
+
+   }
+
+
+private:
+
+   unsigned _maxAhead;
+   unsigned _next;
+   bool _isClosed;
+   std::map< unsigned , std::unique_ptr< EVENT::LCEvent > > _events;
+   std::mutex _mutex;
+   std::condition_variable _changed;
+
+};
+
+
+/** The values of the parameters by their names */
+typedef std::map< std::string , std::vector< std::string > > Parameters;
+
+
+/** Reads the parameters from a file with one parameter per line: name value value ... */
+Parameters readParameters( const std::string& fileName ){
+
+
+   Parameters parameters;
+
+   std::ifstream file( fileName.c_str() );
+
+   if( !file.is_open() ) throw std::runtime_error( "Cannot open the parameter file " + fileName );
+
+   std::string line;
+
+   while( std::getline( file, line ) ){
+
+      std::istringstream words( line );
+
+      std::string name;
+      if( !( words >> name ) || name[0] == '#' ) continue;
+
+      std::vector< std::string >& values = parameters[ name ];
+      values.clear();
+
+      std::string value;
+      while( words >> value ) values.push_back( value );
+
+   }
+
+   return parameters;
+
+}
+
+
+/** Sets value to the first value of the parameter, if it is given. Booleans are written as true or false. */
+template< class T >
+void getParameter( const Parameters& parameters, const std::string& name, T& value ){
+
+   Parameters::const_iterator it = parameters.find( name );
+   if( it == parameters.end() || it->second.empty() ) return;
+
+   std::istringstream s( it->second.front() );
+   s >> std::boolalpha >> value;
+
+}
+
+
+/** Sets the values to the ones of the parameter, if it is given */
+template< class T >
+void getParameter( const Parameters& parameters, const std::string& name, std::vector< T >& values ){
+
+   Parameters::const_iterator it = parameters.find( name );
+   if( it == parameters.end() ) return;
+
+   values.clear();
+
+   for( unsigned i=0; i < it->second.size(); i++ ){
+
+      T value;
+      std::istringstream s( it->second[i] );
+      s >> std::boolalpha >> value;
+
+      values.push_back( value );
+
+   }
+
+}
+
+
+/** Reads the settings of the engine, under the names of the steering parameters of the ForwardTracking processor */
+ForwardTrackingEngine::Config getConfig( const Parameters& parameters ){
+
+
+   ForwardTrackingEngine::Config config;
+
+   getParameter( parameters, "Chi2ProbCut", config.chi2ProbCut );
+   getParameter( parameters, "HelixFitMax", config.helixFitMax );
+   getParameter( parameters, "IncrementalHelixFit", config.incrementalHelixFit );
+   getParameter( parameters, "OverlappingHitsDistMax", config.overlappingHitsDistMax );
+   getParameter( parameters, "OverlappingHitsAssignment", config.overlappingHitsAssignment );
+   getParameter( parameters, "OverlappingHitsChi2Max", config.overlappingHitsChi2Max );
+   getParameter( parameters, "HitsPerTrackMin", config.hitsPerTrackMin );
+   getParameter( parameters, "BestSubsetFinder", config.bestSubsetFinder );
+   getParameter( parameters, "TakeBestVersionOfTrack", config.takeBestVersionOfTrack );
+   getParameter( parameters, "HNN_Omega", config.HNN_Omega );
+   getParameter( parameters, "HNN_Activation_Threshold", config.HNN_ActivationThreshold );
+   getParameter( parameters, "HNN_TInf", config.HNN_TInf );
+   getParameter( parameters, "SubsetExactMaxTracks", config.subsetExactMaxTracks );
+   getParameter( parameters, "SubsetExactMaxNodes", config.subsetExactMaxNodes );
+   getParameter( parameters, "SubsetExactCompareHNN", config.subsetExactCompareHNN );
+   getParameter( parameters, "MaxConnectionsAutomaton", config.maxConnectionsAutomaton );
+   getParameter( parameters, "ReuseHitConnections", config.reuseHitConnections );
+   getParameter( parameters, "FlatAutomaton", config.flatAutomaton );
+   getParameter( parameters, "BatchedCriteria", config.batchedCriteria );
+   getParameter( parameters, "CriteriaChains", config.criteriaChains );
+   getParameter( parameters, "CriteriaReorderInterval", config.criteriaReorderInterval );
+   getParameter( parameters, "PredictStartRound", config.predictStartRound );
+   getParameter( parameters, "TimeStages", config.timeStages );
+   getParameter( parameters, "MaxEventTimeMs", config.maxEventTimeMs );
+   getParameter( parameters, "LocalCutTightening", config.localCutTightening );
+   getParameter( parameters, "HelixQIPreselection", config.helixQIPreselection );
+   getParameter( parameters, "MaxHitsPerSector", config.maxHitsPerSector );
+   getParameter( parameters, "GetTrackStateAtCaloFace", config.getTrackStateAtCaloFace );
+   getParameter( parameters, "SplitSides", config.splitSides );
+
+   config.criteriaNames = Criteria::getAllCriteriaNamesVec();
+   getParameter( parameters, "Criteria", config.criteriaNames );
+
+   for( unsigned i=0; i < config.criteriaNames.size(); i++ ){
+
+      std::string critName = config.criteriaNames[i];
+
+      getParameter( parameters, critName + "_min", config.critMinima[ critName ] );
+      getParameter( parameters, critName + "_max", config.critMaxima[ critName ] );
+
+      if( config.critMinima[ critName ].empty() || config.critMaxima[ critName ].empty() ){
+
+         throw std::runtime_error( "No " + critName + "_min or " + critName + "_max given for the criterion " + critName );
+
+      }
+
+   }
+
+   return config;
+
+}
+
+
+/** Makes the SectorSystemFTD from the FTD of the loaded geometry, the same way as the ForwardTracking processor
+ *
+ * @param nSectors set to the number of sectors (the highest sector number + 1)
+ */
+SectorSystemFTD* createSectorSystemFTD( unsigned& nSectors ){
+
+
+   dd4hep::Detector& lcdd = dd4hep::Detector::getInstance();
+   dd4hep::DetElement ftdDE = lcdd.detector("FTD") ;
+   dd4hep::rec::ZDiskPetalsData* ftd = ftdDE.extension<dd4hep::rec::ZDiskPetalsData>() ;
+
+   int nLayers = ftd->layers.size() + 1; // we add one layer for the IP
+
+   int nModules(0),nSensors(0) ;
+
+   // make sure we take the highest number of modules / sensors available
+   for(unsigned i=0,n=ftd->layers.size() ; i<n; ++i){
+
+      const dd4hep::rec::ZDiskPetalsData::LayerLayout& l = ftd->layers[i] ;
+
+      if( l.petalNumber > nModules ) nModules = l.petalNumber ;
+      if( l.sensorsPerPetal > nSensors ) nSensors = l.sensorsPerPetal ;
+   }
+
+   SectorSystemFTD* sectorSystemFTD = new SectorSystemFTD( nLayers, nModules , nSensors );
+
+   nSectors = 0;
+   for( int side=-1; side <= 1; side += 2 ){
+
+      int sectorMax = sectorSystemFTD->getSector( side, nLayers - 1, nModules - 1, nSensors - 1 );
+      if( sectorMax + 1 > int( nSectors ) ) nSectors = sectorMax + 1;
+
+   }
+
+   return sectorSystemFTD;
+
+}
+
+
+/** Reconstructs the tracks of an event and adds them as collection, like ForwardTracking::processEvent()
+ *
+ * @return the result of the engine (without the tracks, they belong to the event now)
+ */
+ForwardTrackingEngine::Result processEvent( ForwardTrackingEngine& engine, EVENT::LCEvent* evt,
+                                            const std::vector< std::string >& hitCollections, const std::string& trackCollection ){
+
+
+   std::vector< ForwardTrackingEngine::Hit > hits;
+
+   for( unsigned iCol=0; iCol < hitCollections.size(); iCol++ ){
+
+
+      LCCollection* col;
+
+      try {
+
+         col = evt->getCollection( hitCollections[iCol] ) ;
+
+      }
+      catch( DataNotAvailableException& ){
+
+         continue;
+
+      }
+
+      for( int i=0; i < col->getNumberOfElements(); i++ ){
+
+         ForwardTrackingEngine::Hit hit;
+         hit.trackerHit = dynamic_cast< TrackerHit* >( col->getElementAt( i ) );
+
+         if( hit.trackerHit != NULL ) hits.push_back( hit );
+
+      }
+
+   }
+
+   ForwardTrackingEngine::Result result;
+
+   engine.reconstruct( hits, result );
+
+   if( !hits.empty() ){
+
+      LCCollectionVec* trkCol = new LCCollectionVec( LCIO::TRACK );
+
+      // Set the flags
+      LCFlagImpl hitFlag(0) ;
+      hitFlag.setBit( LCIO::TRBIT_HITS ) ;
+      trkCol->setFlag( hitFlag.getFlag()  ) ;
+
+      for( unsigned i=0; i < result.tracks.size(); i++ ) trkCol->addElement( result.tracks[i] );
+
+      switch ( result.quality ) {
+
+         case ForwardTrackingEngine::QUALITY_FAIR:
+            trkCol->parameters().setValue( "QualityCode" , "Fair"  ) ;
+            break;
+
+         case ForwardTrackingEngine::QUALITY_POOR:
+            trkCol->parameters().setValue( "QualityCode" , "Poor"  ) ;
+            break;
+
+         default:
+            trkCol->parameters().setValue( "QualityCode" , "Good"  ) ;
+            break;
+      }
+
+      evt->addCollection( trkCol, trackCollection );
+
+   }
+
+   result.tracks.clear();
+
+   return result;
+
+}
+
+
+/** Runs the forward tracking on an LCIO file with several threads.
+ *
+ * @param argv[1] the compact file of the DD4hep geometry
+ *
+ * @param argv[2] the parameter file (see above)
+ *
+ * @param argv[3] the input LCIO file
+ *
+ * @param argv[4] the output LCIO file
+ *
+ * @param argv[5] the number of events reconstructed at the same time (default: the number of cores)
+ *
+ * @param argv[6] the maximum number of events to process (default: all)
+ */
+int main(int argc,char *argv[]){
+
+
+   if( argc < 5 ){
+
+      std::cout << "Usage: " << argv[0] << " compact.xml parameters.txt input.slcio output.slcio [nThreads] [maxEvents]\n";
+      return 1;
+
+   }
+
+   std::string compactFile = argv[1];
+   std::string parameterFile = argv[2];
+   std::string inputFile = argv[3];
+   std::string outputFile = argv[4];
+
+   unsigned nThreads = std::max( 1u, std::thread::hardware_concurrency() );
+   if( argc >= 6 ) nThreads = std::max( 1, atoi( argv[5] ) );
+
+   int maxEvents = -1;
+   if( argc >= 7 ) maxEvents = atoi( argv[6] );
+
+   // KalTest creates ROOT objects, so the global state of ROOT must be guarded, before the threads fit at the same time
+   if( nThreads > 1 ) ROOT::EnableThreadSafety();
+
+
+   /**********************************************************************************************/
+   /*       The settings, the geometry and the track systems                                     */
+   /**********************************************************************************************/
+
+   Parameters parameters = readParameters( parameterFile );
+
+   ForwardTrackingEngine::Config config = getConfig( parameters );
+
+   // the events are already spread over the threads
+   config.threadsWithinEvent = false;
+
+   std::vector< std::string > hitCollections;
+   hitCollections.push_back( "FTDTrackerHits" );
+   hitCollections.push_back( "FTDSpacePoints" );
+   getParameter( parameters, "FTDHitCollections", hitCollections );
+
+   std::string trackCollection = "ForwardTracks";
+   getParameter( parameters, "ForwardTrackCollection", trackCollection );
+
+   bool MSOn = true;
+   bool ElossOn = true;
+   bool SmoothOn = false;
+   getParameter( parameters, "MultipleScatteringOn", MSOn );
+   getParameter( parameters, "EnergyLossOn", ElossOn );
+   getParameter( parameters, "SmoothOn", SmoothOn );
+
+   dd4hep::Detector::getInstance().fromCompact( compactFile );
+
+   unsigned nSectors = 0;
+   std::unique_ptr< SectorSystemFTD > sectorSystemFTD( createSectorSystemFTD( nSectors ) );
+
+   // one track system for every thread, their options are set once and never changed
+   std::vector< std::unique_ptr< MarlinTrk::IMarlinTrkSystem > > ownedTrkSystems;
+   std::vector< MarlinTrk::IMarlinTrkSystem* > trkSystems;
+
+   for( unsigned i=0; i < nThreads; i++ ){
+
+      MarlinTrk::IMarlinTrkSystem* trkSystem = new MarlinTrk::MarlinDDKalTest();
+
+      trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useQMS,        MSOn ) ;       //multiple scattering
+      trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::usedEdx,       ElossOn) ;     //energy loss
+      trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing,  SmoothOn) ;    //smoothing
+
+      trkSystem->init() ;
+
+      ownedTrkSystems.push_back( std::unique_ptr< MarlinTrk::IMarlinTrkSystem >( trkSystem ) );
+      trkSystems.push_back( trkSystem );
+
+   }
+
+   ForwardTrackingEngine engine( config, sectorSystemFTD.get(), nSectors, trkSystems );
+
+
+   /**********************************************************************************************/
+   /*       Output file: the run headers first                                                   */
+   /**********************************************************************************************/
+
+   std::unique_ptr< IO::LCWriter > writer( IOIMPL::LCFactory::getInstance()->createLCWriter() );
+   writer->open( outputFile, LCIO::WRITE_NEW );
+
+   // (the events are read by a reader of their own, which skips the run headers)
+   {
+
+      MT::LCReader runHeaderReader( 0 );
+      runHeaderReader.open( inputFile );
+
+      std::unique_ptr< EVENT::LCRunHeader > runHeader;
+      while( ( runHeader = runHeaderReader.readNextRunHeader() ) ) writer->writeRunHeader( runHeader.get() );
+
+      runHeaderReader.close();
+
+   }
+
+
+   /**********************************************************************************************/
+   /*       Read, reconstruct and write the events                                               */
+   /**********************************************************************************************/
+
+   std::cout << "Reconstructing " << inputFile << " with " << nThreads << " threads\n";
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   typedef std::pair< unsigned , std::unique_ptr< EVENT::LCEvent > > NumberedEvent;
+
+   // enough events ahead, that no worker has to wait for the reader
+   BoundedQueue< NumberedEvent > eventsToReconstruct( 2*nThreads );
+   EventReorderer eventsToWrite( 4*nThreads );
+
+   std::thread reader( [&](){
+
+      MT::LCReader lcReader( 0 );
+      lcReader.open( inputFile );
+
+      std::unique_ptr< EVENT::LCEvent > evt;
+
+      for( unsigned number=0; maxEvents < 0 || int( number ) < maxEvents; number++ ){
+
+         evt = lcReader.readNextEvent( LCIO::UPDATE );
+         if( !evt ) break;
+
+         eventsToReconstruct.push( NumberedEvent( number, std::move( evt ) ) );
+
+      }
+
+      lcReader.close();
+      eventsToReconstruct.close();
+
+   } );
+
+   std::atomic< unsigned > nWorkersRunning( nThreads );
+   std::atomic< unsigned > nEventsPoor( 0 );
+   std::atomic< unsigned > nEventsOverTime( 0 );
+   std::atomic< unsigned > nEventsFailed( 0 );
+
+   std::vector< std::thread > workers;
+
+   for( unsigned i=0; i < nThreads; i++ ){
+
+      workers.push_back( std::thread( [&](){
+
+         NumberedEvent numberedEvent;
+
+         while( eventsToReconstruct.pop( numberedEvent ) ){
+
+            try{
+
+               ForwardTrackingEngine::Result result = processEvent( engine, numberedEvent.second.get(), hitCollections, trackCollection );
+
+               if( result.quality == ForwardTrackingEngine::QUALITY_POOR ) nEventsPoor++;
+               if( result.isOverTime ) nEventsOverTime++;
+
+            }
+            catch( std::exception& e ){
+
+               // the event is still written, only without tracks
+               std::cerr << "ERROR: event " << numberedEvent.second->getEventNumber() << " of run " << numberedEvent.second->getRunNumber()
+                         << " could not be reconstructed: " << e.what() << "\n";
+               nEventsFailed++;
+
+            }
+
+            eventsToWrite.put( numberedEvent.first, std::move( numberedEvent.second ) );
+
+         }
+
+         if( --nWorkersRunning == 0 ) eventsToWrite.close();
+
+      } ) );
+
+   }
+
+   unsigned nEvents = 0;
+   std::unique_ptr< EVENT::LCEvent > evt;
+
+   while( eventsToWrite.takeNext( evt ) ){
+
+      writer->writeEvent( evt.get() );
+      evt.reset();
+
+      nEvents++;
+
+   }
+
+   reader.join();
+   for( unsigned i=0; i < workers.size(); i++ ) workers[i].join();
+
+   writer->close();
+
+   std::chrono::duration< double > duration = std::chrono::steady_clock::now() - start;
+
+
+   /**********************************************************************************************/
+   /*       Summary                                                                              */
+   /**********************************************************************************************/
+
+   std::cout << nEvents << " events in " << duration.count() << " s: " << nEvents / duration.count() << " events per second\n";
+   std::cout << nEventsPoor << " events with QualityCode \"Poor\", " << nEventsOverTime << " events longer than MaxEventTimeMs, "
+             << nEventsFailed << " events failed\n";
+
+   engine.printSummary( "ForwardTrackingBatch" );
+
+
+   return nEventsFailed > 0 ? 1 : 0;
+
+}
@@ -0,0 +1,138 @@
+#include <iostream>
+#include <vector>
+#include <map>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <random>
+#include <algorithm>
+
+#include "ILDImpl/FTDHitSimple.h"
+#include "ILDImpl/SectorSystemFTD.h"
+
+#include "OverlapHitFinder.h"
+
+
+using namespace KiTrack;
+using namespace KiTrackMarlin;
+
+
+
+/** Creates random hits on a petal: uniform in r and phi within the petal, at the z of the petal.
+ */
+std::vector< IHit* > createPetalHits( unsigned nHits, float z, float phiCentre, int module,
+                                      const SectorSystemFTD* secSys, std::mt19937& random ){
+
+   std::uniform_real_distribution< float > radius( 40., 300. );
+   std::uniform_real_distribution< float > phi( phiCentre - 0.2, phiCentre + 0.2 );
+
+   std::vector< IHit* > hits;
+
+   for( unsigned i=0; i < nHits; i++ ){
+
+      float r = radius( random );
+      float p = phi( random );
+
+      hits.push_back( new FTDHitSimple( r*cos( p ), r*sin( p ), z, 1, 1, module, 0, secSys ) );
+
+   }
+
+   return hits;
+
+}
+
+
+/** @return the time per call in microseconds */
+template< class Function >
+double timeIt( Function function, unsigned nRepetitions ){
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   for( unsigned i=0; i < nRepetitions; i++ ) function();
+
+   std::chrono::duration< double, std::micro > duration = std::chrono::steady_clock::now() - start;
+
+   return duration.count() / nRepetitions;
+
+}
+
+
+/** Compares the grid search of the OverlapHitFinder with checking all pairs of hits on two overlapping petals,
+ * for an increasing number of hits per petal.
+ *
+ * @param argv[1] the maximum distance of overlapping hits in mm (default 3.5)
+ *
+ * @param argv[2] the random seed (default 1)
+ */
+int main(int argc,char *argv[]){
+
+
+   float distMax = 3.5;
+   if( argc >= 2 ) distMax = atof( argv[1] );
+
+   unsigned seed = 1;
+   if( argc >= 3 ) seed = atoi( argv[2] );
+
+   std::mt19937 random( seed );
+
+   SectorSystemFTD secSys( 8, 16, 2 );
+
+   OverlapHitFinder overlapHitFinder( distMax );
+
+   const unsigned occupancies[] = { 10, 30, 100, 300, 1000, 3000, 10000 };
+
+   std::cout << "distMax = " << distMax << " mm\n";
+   std::cout << "hits/petal\tconnections\tall pairs [us]\tgrid [us]\tspeedup\n";
+
+   bool allOK = true;
+
+   for( unsigned iOcc=0; iOcc < sizeof( occupancies ) / sizeof( occupancies[0] ); iOcc++ ){
+
+
+      unsigned nHits = occupancies[iOcc];
+
+      // two petals that overlap in about half of their area
+      std::vector< IHit* > hitsFront = createPetalHits( nHits, 220., 0.0, 0, &secSys, random );
+      std::vector< IHit* > hitsBack = createPetalHits( nHits, 222., 0.2, 1, &secSys, random );
+
+      std::map< IHit* , std::vector< IHit* > > connectionsAllPairs;
+      std::map< IHit* , std::vector< IHit* > > connectionsGrid;
+
+      unsigned nConnections = overlapHitFinder.connectAllPairs( &hitsFront[0], nHits, &hitsBack[0], nHits, connectionsAllPairs );
+      overlapHitFinder.connect( &hitsFront[0], nHits, &hitsBack[0], nHits, connectionsGrid );
+
+      if( connectionsGrid != connectionsAllPairs ){
+
+         std::cout << "ERROR: the grid search found different connections for " << nHits << " hits per petal\n";
+         allOK = false;
+
+      }
+
+      // enough repetitions for a stable measurement
+      unsigned nRepetitions = std::max( 1u, 2000000u / ( nHits*nHits ) );
+
+      double timeAllPairs = timeIt( [&](){
+         std::map< IHit* , std::vector< IHit* > > connections;
+         overlapHitFinder.connectAllPairs( &hitsFront[0], nHits, &hitsBack[0], nHits, connections );
+      }, nRepetitions );
+
+      double timeGrid = timeIt( [&](){
+         std::map< IHit* , std::vector< IHit* > > connections;
+         overlapHitFinder.connect( &hitsFront[0], nHits, &hitsBack[0], nHits, connections );
+      }, nRepetitions );
+
+      std::cout << nHits << "\t\t" << nConnections << "\t\t" << timeAllPairs << "\t\t" << timeGrid << "\t\t" << timeAllPairs / timeGrid << "\n";
+
+      for( unsigned i=0; i < nHits; i++ ){
+
+         delete hitsFront[i];
+         delete hitsBack[i];
+
+      }
+
+   }
+
+
+   return allOK ? 0 : 1;
+
+}
@@ -0,0 +1,175 @@
+#include "BatchedCriteria.h"
+
+#include "marlin/VerbosityLevels.h"
+
+#include "CriterionCuts.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+namespace{
+
+
+   /** Checks all pairs of a batch of 2 hits with a cut from CriterionCuts.h */
+   template< class CutType >
+   void kernel2Hits( const SegmentPairBatch& batch, const CutType& cut, unsigned char* accepted ){
+
+
+      const float* ax = batch.getX( 1 );
+      const float* ay = batch.getY( 1 );
+      const float* az = batch.getZ( 1 );
+      const float* bx = batch.getX( 0 );
+      const float* by = batch.getY( 0 );
+      const float* bz = batch.getZ( 0 );
+
+      unsigned n = batch.size();
+
+      for( unsigned i=0; i < n; i++ ) accepted[i] &= cut.accept( ax[i], ay[i], az[i], bx[i], by[i], bz[i] );
+
+   }
+
+
+   /** Checks all pairs of a batch of 3 hits with a cut from CriterionCuts.h */
+   template< class CutType >
+   void kernel3Hits( const SegmentPairBatch& batch, const CutType& cut, unsigned char* accepted ){
+
+
+      const float* ax = batch.getX( 0 );
+      const float* ay = batch.getY( 0 );
+      const float* az = batch.getZ( 0 );
+      const float* bx = batch.getX( 1 );
+      const float* by = batch.getY( 1 );
+      const float* bz = batch.getZ( 1 );
+      const float* cx = batch.getX( 2 );
+      const float* cy = batch.getY( 2 );
+      const float* cz = batch.getZ( 2 );
+
+      unsigned n = batch.size();
+
+      for( unsigned i=0; i < n; i++ ) accepted[i] &= cut.accept( ax[i], ay[i], az[i], bx[i], by[i], bz[i], cx[i], cy[i], cz[i] );
+
+   }
+
+
+}
+
+
+SegmentPairBatch::SegmentPairBatch( unsigned nHits ):
+_x( nHits ),
+_y( nHits ),
+_z( nHits ){}
+
+
+void SegmentPairBatch::clear(){
+
+
+   for( unsigned k=0; k < _x.size(); k++ ){
+
+      _x[k].clear();
+      _y[k].clear();
+      _z[k].clear();
+
+   }
+
+}
+
+
+void SegmentPairBatch::add( IHit* const* hits ){
+
+
+   for( unsigned k=0; k < _x.size(); k++ ){
+
+      _x[k].push_back( hits[k]->getX() );
+      _y[k].push_back( hits[k]->getY() );
+      _z[k].push_back( hits[k]->getZ() );
+
+   }
+
+}
+
+
+BatchedCriteria::BatchedCriteria( const std::vector< ICriterion* >& criteria ):
+_otherCriteria( criteria ){}
+
+
+BatchedCriteria::BatchedCriteria( const std::vector< ICriterion* >& criteria,
+                                  const std::vector< float >& minima,
+                                  const std::vector< float >& maxima ){
+
+
+   for( unsigned i=0; i < criteria.size(); i++ ){
+
+
+      std::string name = criteria[i]->getName();
+
+      Kernel kernel;
+      kernel.min = minima[i];
+      kernel.max = maxima[i];
+
+      if( name == RZRatioCut::getName() ) kernel.type = KERNEL_RZ_RATIO;
+      else if( name == StraightTrackRatioCut::getName() ) kernel.type = KERNEL_STRAIGHT_TRACK_RATIO;
+      else if( name == AngleCut3D::getName() ) kernel.type = KERNEL_3D_ANGLE;
+      else{
+
+         _otherCriteria.push_back( criteria[i] );
+         continue;
+
+      }
+
+      _kernels.push_back( kernel );
+
+      streamlog_out( DEBUG2 ) << "BatchedCriteria: " << name << " is checked with a kernel\n";
+
+   }
+
+}
+
+
+bool BatchedCriteria::hasKernel( const std::string& name ){
+
+   return name == RZRatioCut::getName() || name == StraightTrackRatioCut::getName() || name == AngleCut3D::getName();
+
+}
+
+
+void BatchedCriteria::evaluateKernels( const SegmentPairBatch& batch, std::vector< unsigned char >& accepted ) const {
+
+
+   if( batch.size() == 0 ) return;
+
+   for( unsigned i=0; i < _kernels.size(); i++ ){
+
+
+      const Kernel& kernel = _kernels[i];
+
+      switch( kernel.type ){
+
+         case KERNEL_RZ_RATIO:
+            kernel2Hits( batch, RZRatioCut( kernel.min, kernel.max ), &accepted[0] );
+            break;
+
+         case KERNEL_STRAIGHT_TRACK_RATIO:
+            kernel2Hits( batch, StraightTrackRatioCut( kernel.min, kernel.max ), &accepted[0] );
+            break;
+
+         case KERNEL_3D_ANGLE:
+            kernel3Hits( batch, AngleCut3D( kernel.min, kernel.max ), &accepted[0] );
+            break;
+
+      }
+
+   }
+
+}
+
+
+bool BatchedCriteria::areCompatible( Segment* parent, Segment* child ) const {
+
+
+   for( unsigned i=0; i < _otherCriteria.size(); i++ ) if( !_otherCriteria[i]->areCompatible( parent, child ) ) return false;
+
+   return true;
+
+}
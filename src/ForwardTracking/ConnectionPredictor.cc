@@ -0,0 +1,148 @@
+#include "ConnectionPredictor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+ConnectionPredictor::ConnectionPredictor( unsigned nRounds, double weight ):
+_nRounds( nRounds ),
+_weight( weight ),
+_acceptance( nRounds, -1. ),
+_nComparisons( nRounds, 0 ),
+_sumRelativeError( nRounds, 0. ),
+_nEventsSkipping( 0 ),
+_nRoundsSkipped( 0 ){}
+
+
+double ConnectionPredictor::countHitPairs( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                                           ISectorConnector* sectorConnector ){
+
+
+   double nHitPairs = 0.;
+
+   // which sectors take part
+   std::vector< bool > isSelected( sectorHitStore.getNumberOfSectors(), false );
+   for( unsigned i=0; i < sectors.size(); i++ ) if( sectorHitStore.getNumberOfHits( sectors[i] ) > 0 ) isSelected[ sectors[i] ] = true;
+
+   for( unsigned i=0; i < sectors.size(); i++ ){
+
+
+      unsigned nHits = sectorHitStore.getNumberOfHits( sectors[i] );
+      if( nHits == 0 ) continue;
+
+      std::set< int > targetSectors = sectorConnector->getTargetSectors( sectors[i] );
+
+      unsigned nHitsTarget = 0;
+
+      for( std::set< int >::const_iterator itTarg = targetSectors.begin(); itTarg != targetSectors.end(); itTarg++ ){
+
+         if( *itTarg >= 0 && unsigned( *itTarg ) < isSelected.size() && isSelected[ *itTarg ] ) nHitsTarget += sectorHitStore.getNumberOfHits( *itTarg );
+
+      }
+
+      nHitPairs += double( nHits ) * nHitsTarget;
+
+   }
+
+   return nHitPairs;
+
+}
+
+
+double ConnectionPredictor::predict( unsigned round, double nHitPairs ) const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   if( round >= _nRounds || _acceptance[round] < 0. ) return -1.;
+
+   return _acceptance[round] * nHitPairs;
+
+}
+
+
+unsigned ConnectionPredictor::getStartRound( double nHitPairs, unsigned maxConnections ) const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   // the last round is never skipped: if it is too much, the event can't be done anyway
+   for( unsigned round=0; round + 1 < _nRounds; round++ ){
+
+      if( _acceptance[round] < 0. ) return round;
+
+      if( _acceptance[round] * nHitPairs <= maxConnections ) return round;
+
+   }
+
+   return _nRounds > 0 ? _nRounds - 1 : 0;
+
+}
+
+
+void ConnectionPredictor::update( unsigned round, double nHitPairs, unsigned nConnections ){
+
+
+   if( round >= _nRounds || nHitPairs <= 0. ) return;
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   double acceptance = nConnections / nHitPairs;
+
+   if( _acceptance[round] >= 0. ){
+
+      double predicted = _acceptance[round] * nHitPairs;
+
+      streamlog_out( DEBUG4 ) << "ConnectionPredictor: round " << round << ": predicted " << predicted
+                              << " connections, there are " << nConnections << "\n";
+
+      _nComparisons[round]++;
+      _sumRelativeError[round] += std::fabs( predicted - nConnections ) / std::max( double( nConnections ), 1. );
+
+      _acceptance[round] = ( 1. - _weight ) * _acceptance[round] + _weight * acceptance;
+
+   }
+   else _acceptance[round] = acceptance;
+
+}
+
+
+void ConnectionPredictor::countSkippedRounds( unsigned nSkipped ){
+
+
+   if( nSkipped == 0 ) return;
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   _nEventsSkipping++;
+   _nRoundsSkipped += nSkipped;
+
+}
+
+
+void ConnectionPredictor::printSummary() const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   streamlog_out( MESSAGE ) << "ConnectionPredictor: " << _nEventsSkipping << " times started in a later round, skipping "
+                            << _nRoundsSkipped << " rounds in total\n";
+
+   for( unsigned round=0; round < _nRounds; round++ ){
+
+      if( _nComparisons[round] == 0 ) continue;
+
+      streamlog_out( MESSAGE ) << "ConnectionPredictor: round " << round << ": " << _nComparisons[round]
+                               << " predictions, mean relative error " << _sumRelativeError[round] / _nComparisons[round]
+                               << ", accepted fraction of hit pairs " << _acceptance[round] << "\n";
+
+   }
+
+}
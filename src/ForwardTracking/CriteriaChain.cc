@@ -0,0 +1,132 @@
+#include "CriteriaChain.h"
+
+#include <algorithm>
+
+#include "marlin/VerbosityLevels.h"
+
+#include "Criteria/Crit3_ChangeRZRatio.h"
+#include "Criteria/Crit3_IPCircleDist.h"
+#include "Criteria/Crit4_3DAngleChange.h"
+#include "Criteria/Crit4_DistToExtrapolation.h"
+
+#include "CriterionCuts.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+namespace{
+
+
+   // The criteria without an inline cut, for KiTrackElement
+
+   struct ChangeRZRatio{
+
+      typedef Crit3_ChangeRZRatio Criterion;
+      static const char* getName(){ return "Crit3_ChangeRZRatio"; }
+
+   };
+
+   struct IPCircleDist{
+
+      typedef Crit3_IPCircleDist Criterion;
+      static const char* getName(){ return "Crit3_IPCircleDist"; }
+
+   };
+
+   struct AngleChange3D{
+
+      typedef Crit4_3DAngleChange Criterion;
+      static const char* getName(){ return "Crit4_3DAngleChange"; }
+
+   };
+
+   struct DistToExtrapolation{
+
+      typedef Crit4_DistToExtrapolation Criterion;
+      static const char* getName(){ return "Crit4_DistToExtrapolation"; }
+
+   };
+
+
+   // The standard sets: the criteria of the production steering of the FTD and the endcaps
+
+   typedef CriteriaChain< 2, CutElement< RZRatioCut >, CutElement< StraightTrackRatioCut > > Crit2ChainFTD;
+
+   typedef CriteriaChain< 3, CutElement< AngleCut3D >, KiTrackElement< ChangeRZRatio >, KiTrackElement< IPCircleDist > > Crit3ChainFTD;
+
+   typedef CriteriaChain< 4, KiTrackElement< AngleChange3D >, KiTrackElement< DistToExtrapolation > > Crit4ChainFTD;
+
+   typedef Crit2ChainFTD Crit2ChainEndcap;
+
+   typedef CriteriaChain< 3, CutElement< AngleCut3D >, KiTrackElement< ChangeRZRatio > > Crit3ChainEndcap;
+
+   typedef CriteriaChain< 4, KiTrackElement< AngleChange3D > > Crit4ChainEndcap;
+
+
+   /** @return whether the criteria are the ones of the chain (in any order) */
+   template< class ChainType >
+   bool matches( const std::vector< ICriterion* >& criteria ){
+
+
+      std::vector< std::string > chainNames;
+      ChainType::getNames( chainNames );
+
+      std::vector< std::string > names;
+      for( unsigned i=0; i < criteria.size(); i++ ) names.push_back( criteria[i]->getName() );
+
+      std::sort( chainNames.begin(), chainNames.end() );
+      std::sort( names.begin(), names.end() );
+
+      return names == chainNames;
+
+   }
+
+
+   /** @return the first of the chains (for 2, 3 and 4 hits) that matches the criteria, or NULL */
+   template< class Chain2Type, class Chain3Type, class Chain4Type >
+   ICriterion* createChain( const std::vector< ICriterion* >& criteria, const std::vector< float >& minima, const std::vector< float >& maxima ){
+
+
+      if( matches< Chain2Type >( criteria ) ) return new Chain2Type( criteria, minima, maxima );
+      if( matches< Chain3Type >( criteria ) ) return new Chain3Type( criteria, minima, maxima );
+      if( matches< Chain4Type >( criteria ) ) return new Chain4Type( criteria, minima, maxima );
+
+      return NULL;
+
+   }
+
+
+}
+
+
+ICriterion* KiTrackMarlin::createCriteriaChain( CriteriaChainSet set,
+                                                const std::vector< ICriterion* >& criteria,
+                                                const std::vector< float >& minima,
+                                                const std::vector< float >& maxima ){
+
+
+   if( criteria.empty() ) return NULL;
+
+   ICriterion* chain = NULL;
+
+   if( set == CRITERIA_CHAIN_FTD ) chain = createChain< Crit2ChainFTD, Crit3ChainFTD, Crit4ChainFTD >( criteria, minima, maxima );
+   else if( set == CRITERIA_CHAIN_ENDCAP ) chain = createChain< Crit2ChainEndcap, Crit3ChainEndcap, Crit4ChainEndcap >( criteria, minima, maxima );
+
+   if( chain != NULL ){
+
+      streamlog_out( DEBUG3 ) << "The " << criteria.size() << " criteria of type " << criteria.front()->getType()
+      << " are the standard set and are checked by a compiled chain\n";
+
+   }
+   else{
+
+      streamlog_out( DEBUG3 ) << "The " << criteria.size() << " criteria of type " << criteria.front()->getType()
+      << " are not a standard set, they are checked one by one\n";
+
+   }
+
+   return chain;
+
+}
@@ -0,0 +1,389 @@
+#include "CriteriaRounds.h"
+
+#include <algorithm>
+#include <limits>
+
+#include "marlin/VerbosityLevels.h"
+
+#include "Criteria/Criteria.h"
+
+#include "MonitoredCriterion.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+CriteriaRounds::CriteriaRounds( const std::vector< std::string >& criteriaNames,
+                                const std::map< std::string , std::vector< float > >& critMinima,
+                                const std::map< std::string , std::vector< float > >& critMaxima,
+                                CriteriaChainSet chainSet ):
+_reorderInterval( 0 ),
+_nEvents( 0 ){
+
+
+   // the number of rounds is the longest list of values of a criterion
+   unsigned nRounds = 0;
+
+   for( unsigned i=0; i < criteriaNames.size(); i++ ){
+
+      nRounds = std::max( nRounds, unsigned( critMinima.at( criteriaNames[i] ).size() ) );
+      nRounds = std::max( nRounds, unsigned( critMaxima.at( criteriaNames[i] ).size() ) );
+
+   }
+
+   _crit2Vecs.resize( nRounds );
+   _crit3Vecs.resize( nRounds );
+   _crit4Vecs.resize( nRounds );
+
+   for( unsigned round=0; round < nRounds; round++ ){
+
+
+      // the cut off values of the criteria in the vectors, for the batched criteria
+      std::vector< float > crit2Minima, crit2Maxima;
+      std::vector< float > crit3Minima, crit3Maxima;
+      std::vector< float > crit4Minima, crit4Maxima;
+
+      for( unsigned i=0; i < criteriaNames.size(); i++ ){
+
+         std::string critName = criteriaNames[i];
+
+         const std::vector< float >& minima = critMinima.at( critName );
+         const std::vector< float >& maxima = critMaxima.at( critName );
+
+         // use the value corresponding to the round, if there are no new ones for this criterion the last one stays
+         float min = round < minima.size() ? minima[round] : minima.back();
+         float max = round < maxima.size() ? maxima[round] : maxima.back();
+
+         ICriterion* crit = Criteria::createCriterion( critName, min , max );
+         _ownedCriteria.push_back( crit );
+
+         std::string type = crit->getType();
+
+         streamlog_out( DEBUG3 ) <<  "Added: Criterion " << critName << " (type =  " << type
+         << " ). Min = " << min
+         << ", Max = " << max
+         << ", round " << round << "\n";
+
+         // Add the new criterion to the corresponding vector
+         if( type == "2Hit" ){
+
+            _crit2Vecs[round].push_back( crit );
+            crit2Minima.push_back( min );
+            crit2Maxima.push_back( max );
+
+         }
+         else if( type == "3Hit" ){
+
+            _crit3Vecs[round].push_back( crit );
+            crit3Minima.push_back( min );
+            crit3Maxima.push_back( max );
+
+         }
+         else if( type == "4Hit" ){
+
+            _crit4Vecs[round].push_back( crit );
+            crit4Minima.push_back( min );
+            crit4Maxima.push_back( max );
+
+         }
+
+      }
+
+      _crit2Batches.push_back( new BatchedCriteria( _crit2Vecs[round], crit2Minima, crit2Maxima ) );
+      _crit3Batches.push_back( new BatchedCriteria( _crit3Vecs[round], crit3Minima, crit3Maxima ) );
+      _crit4Batches.push_back( new BatchedCriteria( _crit4Vecs[round], crit4Minima, crit4Maxima ) );
+
+      // Replace the criteria of a type by their chain, if they are a standard set
+      ICriterion* crit2Chain = createCriteriaChain( chainSet, _crit2Vecs[round], crit2Minima, crit2Maxima );
+      ICriterion* crit3Chain = createCriteriaChain( chainSet, _crit3Vecs[round], crit3Minima, crit3Maxima );
+      ICriterion* crit4Chain = createCriteriaChain( chainSet, _crit4Vecs[round], crit4Minima, crit4Maxima );
+
+      if( crit2Chain != NULL ) _crit2Vecs[round].assign( 1, crit2Chain );
+      if( crit3Chain != NULL ) _crit3Vecs[round].assign( 1, crit3Chain );
+      if( crit4Chain != NULL ) _crit4Vecs[round].assign( 1, crit4Chain );
+
+      if( crit2Chain != NULL ) _ownedCriteria.push_back( crit2Chain );
+      if( crit3Chain != NULL ) _ownedCriteria.push_back( crit3Chain );
+      if( crit4Chain != NULL ) _ownedCriteria.push_back( crit4Chain );
+
+   }
+
+}
+
+
+CriteriaRounds::~CriteriaRounds(){
+
+
+   for( unsigned i=0; i < _ownedCriteria.size(); i++ ) delete _ownedCriteria[i];
+
+   for( unsigned round=0; round < _crit2Vecs.size(); round++ ){
+
+      delete _crit2Batches[round];
+      delete _crit3Batches[round];
+      delete _crit4Batches[round];
+
+   }
+
+}
+
+
+std::vector< ICriterion* > CriteriaRounds::getCrit2Vec( unsigned round ) const {
+
+   std::lock_guard< std::mutex > lock( _mutex );
+   return _crit2Vecs[round];
+
+}
+
+
+std::vector< ICriterion* > CriteriaRounds::getCrit3Vec( unsigned round ) const {
+
+   std::lock_guard< std::mutex > lock( _mutex );
+   return _crit3Vecs[round];
+
+}
+
+
+std::vector< ICriterion* > CriteriaRounds::getCrit4Vec( unsigned round ) const {
+
+   std::lock_guard< std::mutex > lock( _mutex );
+   return _crit4Vecs[round];
+
+}
+
+
+namespace{
+
+
+   /** What was measured of a criterion, summed over all rounds */
+   struct CriterionStatistics{
+
+      CriterionStatistics(): nSamples( 0 ), nRejected( 0 ), timeNs( 0 ){}
+
+      unsigned long nSamples;
+      unsigned long nRejected;
+      unsigned long timeNs;
+
+      /** @return the mean time of a check in ns */
+      double getTime() const { return nSamples > 0 ? double( timeNs ) / nSamples : 0.; }
+
+      /** @return the fraction of the checks that reject the pair */
+      double getRejection() const { return nSamples > 0 ? double( nRejected ) / nSamples : 0.; }
+
+      /** @return the time per rejected pair: the lower, the earlier the criterion should come. Criteria that never
+       * rejected anything come last. */
+      double getRank() const { return nRejected > 0 ? double( timeNs ) / nRejected : std::numeric_limits< double >::max(); }
+
+   };
+
+
+   /** @return the statistics of the monitored criteria by name, summed over the rounds */
+   std::map< std::string , CriterionStatistics > getStatistics( const std::vector< std::vector< ICriterion* > >& critVecs ){
+
+
+      std::map< std::string , CriterionStatistics > statistics;
+
+      for( unsigned round=0; round < critVecs.size(); round++ ){
+
+         for( unsigned i=0; i < critVecs[round].size(); i++ ){
+
+            MonitoredCriterion* crit = static_cast< MonitoredCriterion* >( critVecs[round][i] );
+
+            CriterionStatistics& stats = statistics[ crit->getName() ];
+            stats.nSamples += crit->getNumberOfSamples();
+            stats.nRejected += crit->getNumberOfRejected();
+            stats.timeNs += crit->getTimeNs();
+
+         }
+
+      }
+
+      return statistics;
+
+   }
+
+
+   /** @return the expected time in ns to check a pair with the criteria in this order (until the first one rejects it),
+    * if the criteria are independent.
+    *
+    * @param nChecks set to the expected number of criteria checked per pair
+    */
+   double getTimePerPair( const std::vector< std::string >& order, const std::map< std::string , CriterionStatistics >& statistics,
+                          double& nChecks ){
+
+
+      double time = 0.;
+      double passed = 1.;
+
+      nChecks = 0.;
+
+      for( unsigned i=0; i < order.size(); i++ ){
+
+         const CriterionStatistics& stats = statistics.at( order[i] );
+
+         time += passed * stats.getTime();
+         nChecks += passed;
+
+         passed *= 1. - stats.getRejection();
+
+      }
+
+      return time;
+
+   }
+
+
+   /** Sorts criteria by the rank of their statistics */
+   struct ByRank{
+
+      ByRank( const std::map< std::string , CriterionStatistics >& statistics ): _statistics( statistics ){}
+
+      bool operator()( ICriterion* a, ICriterion* b ) const {
+
+         return _statistics.at( a->getName() ).getRank() < _statistics.at( b->getName() ).getRank();
+
+      }
+
+      const std::map< std::string , CriterionStatistics >& _statistics;
+
+   };
+
+
+}
+
+
+void CriteriaRounds::monitorCriteria( unsigned reorderInterval ){
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   if( _reorderInterval > 0 || reorderInterval == 0 ) return;
+
+   _reorderInterval = reorderInterval;
+
+   std::vector< std::vector< ICriterion* > >* critVecs[] = { &_crit2Vecs, &_crit3Vecs, &_crit4Vecs };
+
+   for( unsigned type=0; type < 3; type++ ){
+
+      for( unsigned round=0; round < critVecs[type]->size(); round++ ){
+
+         std::vector< ICriterion* >& critVec = (*critVecs[type])[round];
+
+         for( unsigned i=0; i < critVec.size(); i++ ){
+
+            critVec[i] = new MonitoredCriterion( critVec[i] );
+            _ownedCriteria.push_back( critVec[i] );
+
+         }
+
+      }
+
+   }
+
+   if( !_crit2Vecs.empty() ){
+
+      for( unsigned i=0; i < _crit2Vecs[0].size(); i++ ) _crit2SteeringOrder.push_back( _crit2Vecs[0][i]->getName() );
+      for( unsigned i=0; i < _crit3Vecs[0].size(); i++ ) _crit3SteeringOrder.push_back( _crit3Vecs[0][i]->getName() );
+      for( unsigned i=0; i < _crit4Vecs[0].size(); i++ ) _crit4SteeringOrder.push_back( _crit4Vecs[0][i]->getName() );
+
+   }
+
+}
+
+
+void CriteriaRounds::countEvent(){
+
+
+   if( _reorderInterval == 0 ) return;
+
+   unsigned nEvents = ++_nEvents;
+
+   if( nEvents % _reorderInterval == 0 ) reorderCriteria();
+
+}
+
+
+void CriteriaRounds::reorderCriteria(){
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   if( _reorderInterval == 0 ) return;
+
+   reorder( _crit2Vecs );
+   reorder( _crit3Vecs );
+   reorder( _crit4Vecs );
+
+}
+
+
+void CriteriaRounds::reorder( std::vector< std::vector< ICriterion* > >& critVecs ){
+
+
+   std::map< std::string , CriterionStatistics > statistics = getStatistics( critVecs );
+
+   // the same criteria with the same statistics in every round, so all rounds get the same order
+   for( unsigned round=0; round < critVecs.size(); round++ ){
+
+      std::stable_sort( critVecs[round].begin(), critVecs[round].end(), ByRank( statistics ) );
+
+   }
+
+}
+
+
+void CriteriaRounds::printCriteriaOrder( const std::string& name ) const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   if( _reorderInterval == 0 || _crit2Vecs.empty() ) return;
+
+   printOrder( name, "2Hit", _crit2Vecs, _crit2SteeringOrder );
+   printOrder( name, "3Hit", _crit3Vecs, _crit3SteeringOrder );
+   printOrder( name, "4Hit", _crit4Vecs, _crit4SteeringOrder );
+
+}
+
+
+void CriteriaRounds::printOrder( const std::string& name, const std::string& type,
+                                 const std::vector< std::vector< ICriterion* > >& critVecs,
+                                 const std::vector< std::string >& steeringOrder ){
+
+
+   if( steeringOrder.empty() ) return;
+
+   std::map< std::string , CriterionStatistics > statistics = getStatistics( critVecs );
+
+   std::vector< std::string > learnedOrder;
+
+   streamlog_out( MESSAGE ) << name << ": learned order of the " << type << " criteria:\n";
+
+   unsigned long nSamples = 0;
+
+   for( unsigned i=0; i < critVecs[0].size(); i++ ){
+
+      std::string critName = critVecs[0][i]->getName();
+      const CriterionStatistics& stats = statistics[ critName ];
+
+      learnedOrder.push_back( critName );
+      nSamples += stats.nSamples;
+
+      streamlog_out( MESSAGE ) << "\t" << critName << ": " << stats.getTime() << " ns per check, rejects "
+                               << 100. * stats.getRejection() << "%\n";
+
+   }
+
+   // The number of pairs is estimated from the number of checks (all of them, not only the measured ones)
+   double nChecksLearned = 0.;
+   double nChecksSteering = 0.;
+   double timeLearned = getTimePerPair( learnedOrder, statistics, nChecksLearned );
+   double timeSteering = getTimePerPair( steeringOrder, statistics, nChecksSteering );
+
+   double nPairs = nChecksLearned > 0. ? nSamples * double( MonitoredCriterion::SAMPLING ) / nChecksLearned : 0.;
+
+   streamlog_out( MESSAGE ) << name << ": about " << nPairs << " pairs checked, " << timeLearned << " ns per pair instead of "
+                            << timeSteering << " ns in the order of the steering: estimated " << nPairs * ( timeSteering - timeLearned ) * 1e-6
+                            << " ms saved\n";
+
+}
@@ -66,6 +66,7 @@ EndcapTrack::EndcapTrack( const EndcapTrack& f ){
    _hits = f._hits;
    _chi2Prob = f._chi2Prob;
    _trkSystem = f._trkSystem;
+   _fitter = f._fitter;
 
 }
 
@@ -80,6 +81,7 @@ EndcapTrack & EndcapTrack::operator= (const EndcapTrack & f){
    _hits = f._hits;
    _chi2Prob = f._chi2Prob;
    _trkSystem = f._trkSystem;
+   _fitter = f._fitter;
    
    return *this;
    
@@ -93,6 +95,8 @@ void EndcapTrack::addHit( IEndcapHit* hit ){
    
    if ( hit != NULL ){
       
+      _fitter.reset();
+      
       _hits.push_back( hit );
       
       // and sort the track again
@@ -113,17 +117,22 @@ void EndcapTrack::addHit( IEndcapHit* hit ){
 void EndcapTrack::fit() {
    
    
-  Fitter fitter( _lcioTrack , _trkSystem , 1 );
+   _fitter.reset();
+   
+   std::shared_ptr< Fitter > fitter( new Fitter( _lcioTrack , _trkSystem , 1 ) );
    
    
-   _lcioTrack->setChi2( fitter.getChi2( lcio::TrackState::AtIP ) );
-   _lcioTrack->setNdf( fitter.getNdf( lcio::TrackState::AtIP ) );
-   _chi2Prob = fitter.getChi2Prob( lcio::TrackState::AtIP );
+   _lcioTrack->setChi2( fitter->getChi2( lcio::TrackState::AtIP ) );
+   _lcioTrack->setNdf( fitter->getNdf( lcio::TrackState::AtIP ) );
+   _chi2Prob = fitter->getChi2Prob( lcio::TrackState::AtIP );
    
-   TrackStateImpl* trkState = new TrackStateImpl( *fitter.getTrackState( lcio::TrackState::AtIP ) ) ;
+   TrackStateImpl* trkState = new TrackStateImpl( *fitter->getTrackState( lcio::TrackState::AtIP ) ) ;
    trkState->setLocation( TrackState::AtIP ) ;
    _lcioTrack->addTrackState( trkState );
    
+   // kept for the track states of the final track
+   _fitter = fitter;
+   
    
 }
 
@@ -0,0 +1,88 @@
+#include "EventArena.h"
+
+#include <cstdint>
+
+
+using namespace KiTrackMarlin;
+
+
+EventArena::EventArena( std::size_t blockSize ):
+_blockSize( blockSize ),
+_currentBlock( 0 ),
+_offset( 0 ),
+_bytesUsed( 0 ),
+_highWaterMark( 0 ),
+_nObjects( 0 ){}
+
+
+EventArena::~EventArena(){
+
+   reset();
+
+   for( unsigned i=0; i < _blocks.size(); i++ ) ::operator delete( _blocks[i].data );
+
+}
+
+
+void EventArena::reset(){
+
+
+   for( unsigned i=_destructors.size(); i > 0; i-- ) _destructors[i-1].destroy( _destructors[i-1].object );
+
+   _destructors.clear();
+
+   _currentBlock = 0;
+   _offset = 0;
+   _bytesUsed = 0;
+   _nObjects = 0;
+
+}
+
+
+std::size_t EventArena::getBytesReserved() const {
+
+
+   std::size_t bytes = 0;
+
+   for( unsigned i=0; i < _blocks.size(); i++ ) bytes += _blocks[i].size;
+
+   return bytes;
+
+}
+
+
+void* EventArena::allocate( std::size_t size, std::size_t alignment ){
+
+
+   // look for the first block (starting with the current one) that still has room
+   while( _currentBlock < _blocks.size() ){
+
+      Block& block = _blocks[ _currentBlock ];
+
+      std::uintptr_t address = reinterpret_cast< std::uintptr_t >( block.data ) + _offset;
+      std::size_t padding = ( alignment - address % alignment ) % alignment;
+
+      if( _offset + padding + size <= block.size ){
+
+         _offset += padding + size;
+         _bytesUsed += size;
+         if( _bytesUsed > _highWaterMark ) _highWaterMark = _bytesUsed;
+
+         return block.data + ( _offset - size );
+
+      }
+
+      _currentBlock++;
+      _offset = 0;
+
+   }
+
+   // No room left: get a new block. Objects bigger than the block size get a block of their own size.
+   Block block;
+   block.size = ( size + alignment > _blockSize ) ? size + alignment : _blockSize;
+   block.data = static_cast< char* >( ::operator new( block.size ) );
+   _blocks.push_back( block );
+
+   return allocate( size, alignment );
+
+}
@@ -0,0 +1,213 @@
+#include "EventContext.h"
+
+
+using namespace KiTrackMarlin;
+
+
+namespace{
+
+
+   /** the number of the next event started in any context (0 is no event) */
+   std::atomic< unsigned long > nextEventId( 1 );
+
+
+}
+
+
+EventContext::EventContext( unsigned nStages ):
+_nArenasUsed( 0 ),
+_eventId( 0 ),
+_quality( 0 ),
+_start( std::chrono::steady_clock::now() ),
+_maxTimeMs( 0. ),
+_overTime( false ){
+
+   if( nStages > 0 ) _stageTimes.reset( new StageTimer::EventTimes( nStages ) );
+
+}
+
+
+void EventContext::start( int quality, double maxTimeMs ){
+
+
+   _eventId = nextEventId++;
+
+   _quality = quality;
+   _start = std::chrono::steady_clock::now();
+   _maxTimeMs = maxTimeMs;
+   _overTime = false;
+
+   if( _stageTimes ) _stageTimes->reset();
+
+   _hotSectors.clear();
+
+   std::lock_guard< std::mutex > lock( _droppedSectorsMutex );
+   _droppedSectors.clear();
+
+}
+
+
+void EventContext::reset(){
+
+
+   std::lock_guard< std::mutex > lock( _arenaMutex );
+
+   for( unsigned i=0; i < _nArenasUsed; i++ ) _arenas[i]->reset();
+
+   _nArenasUsed = 0;
+   _threadArenas.clear();
+
+   // the threads must not take the arenas they remember for this event anymore
+   _eventId = 0;
+
+}
+
+
+EventArena& EventContext::getArena(){
+
+
+   // the arena this thread got last and the event it got it for
+   static thread_local unsigned long threadEventId = 0;
+   static thread_local EventArena* threadArena = NULL;
+
+   if( threadEventId == _eventId && threadArena != NULL ) return *threadArena;
+
+   std::lock_guard< std::mutex > lock( _arenaMutex );
+
+   // (a thread working on several events at once may have had an arena of this event already)
+   EventArena*& arena = _threadArenas[ std::this_thread::get_id() ];
+
+   if( arena == NULL ){
+
+      if( _nArenasUsed == _arenas.size() ) _arenas.push_back( std::unique_ptr< EventArena >( new EventArena() ) );
+
+      arena = _arenas[ _nArenasUsed++ ].get();
+
+   }
+
+   threadEventId = _eventId;
+   threadArena = arena;
+
+   return *arena;
+
+}
+
+
+std::size_t EventContext::getArenaBytesUsed() const {
+
+
+   std::lock_guard< std::mutex > lock( _arenaMutex );
+
+   std::size_t bytes = 0;
+
+   for( unsigned i=0; i < _nArenasUsed; i++ ) bytes += _arenas[i]->getBytesUsed();
+
+   return bytes;
+
+}
+
+
+unsigned EventContext::getArenaObjects() const {
+
+
+   std::lock_guard< std::mutex > lock( _arenaMutex );
+
+   unsigned nObjects = 0;
+
+   for( unsigned i=0; i < _nArenasUsed; i++ ) nObjects += _arenas[i]->getNumberOfObjects();
+
+   return nObjects;
+
+}
+
+
+void EventContext::degradeQuality( int quality ){
+
+
+   // the qualities are ordered: the higher the value, the worse the quality
+   int current = _quality;
+
+   while( quality > current && !_quality.compare_exchange_weak( current, quality ) ){}
+
+}
+
+
+void EventContext::addDroppedSector( int sector ){
+
+
+   std::lock_guard< std::mutex > lock( _droppedSectorsMutex );
+
+   _droppedSectors.push_back( sector );
+
+}
+
+
+std::vector< int > EventContext::getDroppedSectors() const {
+
+
+   std::lock_guard< std::mutex > lock( _droppedSectorsMutex );
+
+   return _droppedSectors;
+
+}
+
+
+bool EventContext::isOverTime( double factor ){
+
+
+   if( _maxTimeMs <= 0. ) return false;
+
+   std::chrono::duration< double, std::milli > time = std::chrono::steady_clock::now() - _start;
+
+   if( time.count() <= factor*_maxTimeMs ) return false;
+
+   _overTime = true;
+
+   return true;
+
+}
+
+
+EventContextPool::EventContextPool( unsigned nStages ):
+_nStages( nStages ){}
+
+
+EventContext* EventContextPool::checkout( int quality, double maxTimeMs ){
+
+
+   EventContext* ctx = NULL;
+
+   {
+      std::lock_guard< std::mutex > lock( _mutex );
+
+      if( _freeContexts.empty() ){
+
+         _contexts.push_back( std::unique_ptr< EventContext >( new EventContext( _nStages ) ) );
+         ctx = _contexts.back().get();
+
+      }
+      else{
+
+         ctx = _freeContexts.back();
+         _freeContexts.pop_back();
+
+      }
+   }
+
+   ctx->start( quality, maxTimeMs );
+
+   return ctx;
+
+}
+
+
+void EventContextPool::giveBack( EventContext* ctx ){
+
+
+   ctx->reset();
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   _freeContexts.push_back( ctx );
+
+}
@@ -0,0 +1,133 @@
+#include "ExactSubsetSolver.h"
+
+#include <algorithm>
+#include <cstdint>
+
+
+using namespace KiTrackMarlin;
+
+
+namespace{
+
+
+   /** The state of the branch and bound search. The tracks are sorted by quality, bit i of a mask is the i-th best track. */
+   struct Search{
+
+      std::vector< double > weights;
+      std::vector< std::uint64_t > conflicts;
+
+      unsigned long maxNodes;
+      unsigned long nNodes;
+
+      double bestWeight;
+      std::uint64_t bestSet;
+
+      /** @return false, if the node budget is used up */
+      bool branch( std::uint64_t candidates, double weight, std::uint64_t set ){
+
+
+         if( ++nNodes > maxNodes ) return false;
+
+         if( candidates == 0 ){
+
+            if( weight > bestWeight ){
+
+               bestWeight = weight;
+               bestSet = set;
+
+            }
+
+            return true;
+
+         }
+
+         // the bound: all candidates taken
+         double bound = weight;
+         for( unsigned i=0; i < weights.size(); i++ ) if( candidates & ( std::uint64_t( 1 ) << i ) ) bound += weights[i];
+
+         if( bound <= bestWeight ) return true;
+
+         // the best candidate left
+         unsigned i = 0;
+         while( !( candidates & ( std::uint64_t( 1 ) << i ) ) ) i++;
+
+         std::uint64_t bit = std::uint64_t( 1 ) << i;
+
+         // take it
+         if( !branch( candidates & ~bit & ~conflicts[i], weight + weights[i], set | bit ) ) return false;
+
+         // or leave it
+         return branch( candidates & ~bit, weight, set );
+
+      }
+
+   };
+
+
+}
+
+
+ExactSubsetSolver::ExactSubsetSolver( unsigned maxSize, unsigned long maxNodes ):
+_maxSize( std::min( maxSize, 64u ) ),
+_maxNodes( maxNodes ){}
+
+
+bool ExactSubsetSolver::calculateBestSet( const std::vector< std::vector< unsigned > >& conflicts,
+                                          const std::vector< double >& QIs,
+                                          std::vector< bool >& accepted ) const {
+
+
+   unsigned n = QIs.size();
+
+   if( n > _maxSize ) return false;
+
+
+   // sort by quality, so the good tracks get decided on first and the bound gets tight early
+   std::vector< unsigned > order( n );
+   for( unsigned i=0; i < n; i++ ) order[i] = i;
+
+   std::stable_sort( order.begin(), order.end(), [&]( unsigned a, unsigned b ){ return QIs[a] > QIs[b]; } );
+
+   std::vector< unsigned > position( n );
+   for( unsigned i=0; i < n; i++ ) position[ order[i] ] = i;
+
+
+   Search search;
+   search.weights.resize( n );
+   search.conflicts.assign( n, 0 );
+   search.maxNodes = _maxNodes;
+   search.nNodes = 0;
+   search.bestWeight = -1.;
+   search.bestSet = 0;
+
+   for( unsigned i=0; i < n; i++ ){
+
+      search.weights[i] = QIs[ order[i] ];
+
+      const std::vector< unsigned >& trackConflicts = conflicts[ order[i] ];
+      for( unsigned j=0; j < trackConflicts.size(); j++ ) search.conflicts[i] |= std::uint64_t( 1 ) << position[ trackConflicts[j] ];
+
+   }
+
+   std::uint64_t all = ( n == 64 ) ? ~std::uint64_t( 0 ) : ( std::uint64_t( 1 ) << n ) - 1;
+
+   if( !search.branch( all, 0., 0 ) ) return false;
+
+
+   // make the set maximal
+   std::uint64_t set = search.bestSet;
+
+   for( unsigned i=0; i < n; i++ ){
+
+      std::uint64_t bit = std::uint64_t( 1 ) << i;
+
+      if( !( set & bit ) && !( set & search.conflicts[i] ) ) set |= bit;
+
+   }
+
+   accepted.assign( n, false );
+   for( unsigned i=0; i < n; i++ ) accepted[ order[i] ] = ( set & ( std::uint64_t( 1 ) << i ) ) != 0;
+
+   return true;
+
+}
@@ -0,0 +1,26 @@
+#include "FTDFittedTrack.h"
+
+#include "IMPL/TrackStateImpl.h"
+
+
+using namespace KiTrackMarlin;
+
+
+void FTDFittedTrack::fit(){
+
+
+   _fitter.reset();
+
+   std::shared_ptr< Fitter > fitter( new Fitter( _lcioTrack , _trkSystem ) );
+
+   _lcioTrack->setChi2( fitter->getChi2( lcio::TrackState::AtIP ) );
+   _lcioTrack->setNdf( fitter->getNdf( lcio::TrackState::AtIP ) );
+   _chi2Prob = fitter->getChi2Prob( lcio::TrackState::AtIP );
+
+   IMPL::TrackStateImpl* trkState = new IMPL::TrackStateImpl( *fitter->getTrackState( lcio::TrackState::AtIP ) ) ;
+   trkState->setLocation( lcio::TrackState::AtIP ) ;
+   _lcioTrack->addTrackState( trkState );
+
+   _fitter = fitter;
+
+}
@@ -0,0 +1,551 @@
+#include "FlatAutomaton.h"
+
+#include <algorithm>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+FlatAutomaton::FlatAutomaton( const HitConnectionGraph& hitConnectionGraph ):
+_segmentLength( 1 ){
+
+
+   unsigned nHits = hitConnectionGraph.getNumberOfHits();
+
+   _hits.resize( nHits );
+   _segmentHits.resize( nHits );
+   _layers.resize( nHits );
+
+   for( unsigned i=0; i < nHits; i++ ){
+
+      _hits[i] = hitConnectionGraph.getHit( i );
+      _segmentHits[i] = i;
+      _layers[i] = hitConnectionGraph.getLayer( i );
+
+   }
+
+   _states.assign( nHits, 0 );
+   _criterionSegments.assign( nHits, NULL );
+
+   setConnections( hitConnectionGraph.getParents(), hitConnectionGraph.getChildren() );
+
+}
+
+
+FlatAutomaton::~FlatAutomaton(){
+
+   deleteCriterionSegments();
+
+}
+
+
+void FlatAutomaton::deleteCriterionSegments(){
+
+
+   for( unsigned i=0; i < _criterionSegments.size(); i++ ) delete _criterionSegments[i];
+
+   _criterionSegments.clear();
+
+}
+
+
+void FlatAutomaton::addCriteria( const std::vector< ICriterion* >& criteria ){
+
+   _criteria.insert( _criteria.end(), criteria.begin(), criteria.end() );
+
+}
+
+
+void FlatAutomaton::setConnections( const std::vector< unsigned >& parents, const std::vector< unsigned >& children ){
+
+
+   unsigned nSegments = _layers.size();
+   unsigned nConnections = parents.size();
+
+   // count the connections of every segment and sum them up to the offsets
+   _childOffsets.assign( nSegments + 1, 0 );
+   _parentOffsets.assign( nSegments + 1, 0 );
+
+   for( unsigned k=0; k < nConnections; k++ ){
+
+      _childOffsets[ parents[k] + 1 ]++;
+      _parentOffsets[ children[k] + 1 ]++;
+
+   }
+
+   for( unsigned i=0; i < nSegments; i++ ){
+
+      _childOffsets[i+1] += _childOffsets[i];
+      _parentOffsets[i+1] += _parentOffsets[i];
+
+   }
+
+   _children.resize( nConnections );
+   _parents.resize( nConnections );
+   _parentConnections.resize( nConnections );
+
+   std::vector< unsigned > childPos( _childOffsets.begin(), _childOffsets.end() - 1 );
+   std::vector< unsigned > parentPos( _parentOffsets.begin(), _parentOffsets.end() - 1 );
+
+   for( unsigned k=0; k < nConnections; k++ ){
+
+      unsigned connection = childPos[ parents[k] ]++;
+      _children[connection] = children[k];
+
+      unsigned p = parentPos[ children[k] ]++;
+      _parents[p] = parents[k];
+      _parentConnections[p] = connection;
+
+   }
+
+}
+
+
+Segment* FlatAutomaton::getCriterionSegment( unsigned i ){
+
+
+   if( _criterionSegments[i] == NULL ){
+
+      _criterionSegments[i] = new Segment( getSegmentHits( i ) );
+      _criterionSegments[i]->setLayer( _layers[i] );
+
+   }
+
+   return _criterionSegments[i];
+
+}
+
+
+void FlatAutomaton::addCriteria( const BatchedCriteria& criteria ){
+
+   _batchedCriteria.push_back( &criteria );
+
+}
+
+
+void FlatAutomaton::clearCriteria(){
+
+   _criteria.clear();
+   _batchedCriteria.clear();
+
+}
+
+
+bool FlatAutomaton::areCompatible( unsigned parent, unsigned child ){
+
+
+   Segment* parentSegment = NULL;
+   Segment* childSegment = NULL;
+
+   for( unsigned i=0; i < _batchedCriteria.size(); i++ ){
+
+      if( _batchedCriteria[i]->getOtherCriteria().empty() ) continue;
+
+      if( parentSegment == NULL ){
+
+         parentSegment = getCriterionSegment( parent );
+         childSegment = getCriterionSegment( child );
+
+      }
+
+      if( !_batchedCriteria[i]->areCompatible( parentSegment, childSegment ) ) return false;
+
+   }
+
+   if( _criteria.empty() ) return true;
+
+   if( parentSegment == NULL ){
+
+      parentSegment = getCriterionSegment( parent );
+      childSegment = getCriterionSegment( child );
+
+   }
+
+   for( unsigned i=0; i < _criteria.size(); i++ ) if( !_criteria[i]->areCompatible( parentSegment, childSegment ) ) return false;
+
+   return true;
+
+}
+
+
+void FlatAutomaton::checkCriteria( const std::vector< unsigned >& parents, const std::vector< unsigned >& children,
+                                   std::vector< unsigned char >& accepted ){
+
+
+   unsigned nPairs = parents.size();
+
+   accepted.assign( nPairs, 1 );
+
+   // the kernels first, on all pairs at once
+   SegmentPairBatch batch( _segmentLength + 1 );
+   std::vector< IHit* > pairHits( _segmentLength + 1 );
+
+   for( unsigned i=0; i < _batchedCriteria.size(); i++ ){
+
+
+      if( _batchedCriteria[i]->getNumberOfKernels() == 0 ) continue;
+
+      if( batch.size() == 0 ){
+
+         // the hits of the child and the outer hit of the parent
+         for( unsigned k=0; k < nPairs; k++ ){
+
+            for( unsigned j=0; j < _segmentLength; j++ ) pairHits[j] = _hits[ _segmentHits[ children[k]*_segmentLength + j ] ];
+            pairHits[_segmentLength] = _hits[ _segmentHits[ parents[k]*_segmentLength + _segmentLength - 1 ] ];
+
+            batch.add( &pairHits[0] );
+
+         }
+
+      }
+
+      _batchedCriteria[i]->evaluateKernels( batch, accepted );
+
+   }
+
+   // and the other criteria only on the pairs that are left
+   for( unsigned k=0; k < nPairs; k++ ) if( accepted[k] && !areCompatible( parents[k], children[k] ) ) accepted[k] = 0;
+
+}
+
+
+void FlatAutomaton::lengthenSegments(){
+
+
+   unsigned nSegments = _layers.size();
+   unsigned nConnections = _children.size();
+   unsigned length = _segmentLength;
+
+
+   // A new segment for every connection, numbered like the connections: the hits of the child and the outer hit of the parent
+   std::vector< unsigned > segmentHits;
+   segmentHits.reserve( nConnections * ( length + 1 ) );
+
+   std::vector< unsigned > layers( nConnections );
+
+   for( unsigned i=0; i < nSegments; i++ ){
+
+      for( unsigned k = _childOffsets[i]; k < _childOffsets[i+1]; k++ ){
+
+         unsigned child = _children[k];
+
+         segmentHits.insert( segmentHits.end(), _segmentHits.begin() + child*length, _segmentHits.begin() + ( child + 1 )*length );
+         segmentHits.push_back( _segmentHits[ i*length + length - 1 ] );
+
+         layers[k] = _layers[child];
+
+      }
+
+   }
+
+
+   // The old connections tell which new segments overlap, keep them while the new segments take over
+   std::vector< unsigned > childOffsets;
+   std::vector< unsigned > parentOffsets;
+   std::vector< unsigned > parentConnections;
+
+   childOffsets.swap( _childOffsets );
+   parentOffsets.swap( _parentOffsets );
+   parentConnections.swap( _parentConnections );
+
+   deleteCriterionSegments();
+
+   _segmentHits.swap( segmentHits );
+   _layers.swap( layers );
+   _segmentLength = length + 1;
+   _states.assign( nConnections, 0 );
+   _criterionSegments.assign( nConnections, NULL );
+
+
+   // The new segments of the connections into a segment are the parents of the new segments of the connections out of it
+   std::vector< unsigned > parents;
+   std::vector< unsigned > children;
+
+   for( unsigned middle=0; middle < nSegments; middle++ ){
+
+      for( unsigned j = parentOffsets[middle]; j < parentOffsets[middle+1]; j++ ){
+
+         unsigned parent = parentConnections[j];
+
+         for( unsigned child = childOffsets[middle]; child < childOffsets[middle+1]; child++ ){
+
+            parents.push_back( parent );
+            children.push_back( child );
+
+         }
+
+      }
+
+   }
+
+   // keep the pairs the criteria accept
+   std::vector< unsigned char > accepted;
+   checkCriteria( parents, children, accepted );
+
+   unsigned nAccepted = 0;
+
+   for( unsigned k=0; k < parents.size(); k++ ){
+
+      if( !accepted[k] ) continue;
+
+      parents[nAccepted] = parents[k];
+      children[nAccepted] = children[k];
+      nAccepted++;
+
+   }
+
+   parents.resize( nAccepted );
+   children.resize( nAccepted );
+
+   setConnections( parents, children );
+
+   streamlog_out( DEBUG3 ) << "FlatAutomaton: " << nConnections << " " << _segmentLength << "-hit segments with "
+                           << _children.size() << " connections\n";
+
+}
+
+
+void FlatAutomaton::doAutomaton(){
+
+
+   unsigned nSegments = _layers.size();
+
+   // The children are normally on lower layers, so going from the inner layers outwards sets most states in the first pass
+   std::vector< unsigned > order( nSegments );
+   for( unsigned i=0; i < nSegments; i++ ) order[i] = i;
+
+   std::stable_sort( order.begin(), order.end(), [this]( unsigned a, unsigned b ){ return _layers[a] < _layers[b]; } );
+
+   bool hasChanged = true;
+   unsigned nPasses = 0;
+
+   while( hasChanged ){
+
+
+      hasChanged = false;
+      nPasses++;
+
+      for( unsigned k=0; k < nSegments; k++ ){
+
+
+         unsigned i = order[k];
+
+         int state = _states[i];
+
+         // the state of a child plus the layers between the two
+         for( unsigned j = _childOffsets[i]; j < _childOffsets[i+1]; j++ ){
+
+            unsigned child = _children[j];
+
+            state = std::max( state, _states[child] + int( _layers[i] ) - int( _layers[child] ) );
+
+         }
+
+         if( state != _states[i] ){
+
+            _states[i] = state;
+            hasChanged = true;
+
+         }
+
+      }
+
+      // Without cycles every pass fixes at least one more segment
+      if( hasChanged && nPasses > nSegments ){
+
+         streamlog_out( ERROR ) << "FlatAutomaton: the states don't converge after " << nPasses << " passes, the segments have cycles\n";
+         break;
+
+      }
+
+   }
+
+   streamlog_out( DEBUG3 ) << "FlatAutomaton: states done after " << nPasses << " passes\n";
+
+}
+
+
+void FlatAutomaton::cleanBadStates(){
+
+
+   unsigned nSegments = _layers.size();
+   unsigned length = _segmentLength;
+
+   // keep the good segments (in their order) and remember their new index
+   std::vector< int > newIndex( nSegments, -1 );
+   unsigned nKept = 0;
+
+   for( unsigned i=0; i < nSegments; i++ ){
+
+      if( _states[i] != int( _layers[i] ) ){
+
+         delete _criterionSegments[i];
+         continue;
+
+      }
+
+      newIndex[i] = nKept;
+
+      std::copy( _segmentHits.begin() + i*length, _segmentHits.begin() + ( i + 1 )*length, _segmentHits.begin() + nKept*length );
+      _layers[nKept] = _layers[i];
+      _states[nKept] = _states[i];
+      _criterionSegments[nKept] = _criterionSegments[i];
+
+      nKept++;
+
+   }
+
+   // and the connections between them
+   std::vector< unsigned > parents;
+   std::vector< unsigned > children;
+
+   for( unsigned i=0; i < nSegments; i++ ){
+
+      if( newIndex[i] < 0 ) continue;
+
+      for( unsigned j = _childOffsets[i]; j < _childOffsets[i+1]; j++ ){
+
+         int child = newIndex[ _children[j] ];
+         if( child < 0 ) continue;
+
+         parents.push_back( newIndex[i] );
+         children.push_back( child );
+
+      }
+
+   }
+
+   _segmentHits.resize( nKept*length );
+   _layers.resize( nKept );
+   _states.resize( nKept );
+   _criterionSegments.resize( nKept );
+
+   setConnections( parents, children );
+
+   streamlog_out( DEBUG3 ) << "FlatAutomaton: removed " << nSegments - nKept << " segments with bad states, "
+                           << nKept << " are left\n";
+
+}
+
+
+void FlatAutomaton::resetStates(){
+
+   std::fill( _states.begin(), _states.end(), 0 );
+
+}
+
+
+std::vector< IHit* > FlatAutomaton::getSegmentHits( unsigned i ) const {
+
+
+   std::vector< IHit* > hits( _segmentLength );
+
+   for( unsigned k=0; k < _segmentLength; k++ ) hits[k] = _hits[ _segmentHits[ i*_segmentLength + k ] ];
+
+   return hits;
+
+}
+
+
+std::vector< std::vector< IHit* > > FlatAutomaton::getTracks( unsigned minHits ) const {
+
+
+   std::vector< std::vector< IHit* > > tracks;
+
+   unsigned nSegments = _layers.size();
+   unsigned length = _segmentLength;
+
+   // the segments of the path from the top down, and for each the next connection to follow
+   std::vector< unsigned > path;
+   std::vector< unsigned > nextConnection;
+
+   for( unsigned top=0; top < nSegments; top++ ){
+
+
+      if( _parentOffsets[top] != _parentOffsets[top+1] ) continue;
+
+      path.assign( 1, top );
+      nextConnection.assign( 1, _childOffsets[top] );
+
+      while( !path.empty() ){
+
+
+         unsigned segment = path.back();
+
+         if( _childOffsets[segment] == _childOffsets[segment+1] ){
+
+
+            // the end of a path: all hits of the last segment and the outer hit of the ones above
+            std::vector< IHit* > hits;
+
+            for( unsigned j=0; j < length; j++ ){
+
+               IHit* hit = _hits[ _segmentHits[ segment*length + j ] ];
+               if( !hit->isVirtual() ) hits.push_back( hit );
+
+            }
+
+            for( int d = int( path.size() ) - 2; d >= 0; d-- ){
+
+               IHit* hit = _hits[ _segmentHits[ path[d]*length + length - 1 ] ];
+               if( !hit->isVirtual() ) hits.push_back( hit );
+
+            }
+
+            if( hits.size() >= minHits ) tracks.push_back( hits );
+
+            path.pop_back();
+            nextConnection.pop_back();
+
+         }
+         else if( nextConnection.back() == _childOffsets[segment+1] ){
+
+            path.pop_back();
+            nextConnection.pop_back();
+
+         }
+         else{
+
+            unsigned child = _children[ nextConnection.back()++ ];
+
+            path.push_back( child );
+            nextConnection.push_back( _childOffsets[child] );
+
+         }
+
+      }
+
+   }
+
+   return tracks;
+
+}
+
+
+void FlatAutomaton::countConnectionsPerSector( std::vector< unsigned >& sectorConnections ) const {
+
+
+   unsigned nSegments = _layers.size();
+
+   for( unsigned i=0; i < nSegments; i++ ){
+
+      unsigned nChildren = _childOffsets[i+1] - _childOffsets[i];
+      if( nChildren == 0 ) continue;
+
+      for( unsigned j=0; j < _segmentLength; j++ ){
+
+         IHit* hit = _hits[ _segmentHits[ i*_segmentLength + j ] ];
+
+         if( hit->isVirtual() ) continue;
+
+         int sector = hit->getSector();
+         if( sector >= 0 && unsigned( sector ) < sectorConnections.size() ) sectorConnections[sector] += nChildren;
+
+      }
+
+   }
+
+}
@@ -7,44 +7,31 @@
 #include "EVENT/LCCollection.h"
 #include "IMPL/LCCollectionVec.h"
 #include "IMPL/LCFlagImpl.h"
-#include "UTIL/LCTrackerConf.h"
-#include <UTIL/ILDConf.h>
 
 #include "marlin/VerbosityLevels.h"
 #include "marlin/Exceptions.h"
 
 #include "MarlinCED.h"
 
+#include "TROOT.h"
+
 //----From DD4Hep-----------------------------
 #include "DD4hep/Detector.h"
 #include "DD4hep/DD4hepUnits.h"
 #include "DDRec/DetectorData.h"
 
-//----From KiTrack-----------------------------
-#include "KiTrack/SubsetHopfieldNN.h"
-#include "KiTrack/SubsetSimple.h"
-#include "KiTrack/SegmentBuilder.h"
-#include "KiTrack/Automaton.h"
+//----From MarlinTrk---------------------------
+#include "MarlinTrk/Factory.h"
+#include "MarlinTrk/MarlinDDKalTest.h"
 
 //----From KiTrackMarlin-----------------------
-#include "ILDImpl/FTDTrack.h"
-#include "ILDImpl/FTDHit01.h"
-#include "ILDImpl/FTDNeighborPetalSecCon.h"
-#include "ILDImpl/FTDSectorConnector.h"
-#include "Tools/KiTrackMarlinTools.h"
-#include "Tools/KiTrackMarlinCEDTools.h"
-#include "Tools/FTDHelixFitter.h"
+#include "Criteria/Criteria.h"
 
 
 using namespace lcio ;
 using namespace marlin ;
 using namespace MarlinTrk ;
 
-// Used to fedine the quality of the track output collection
-const int ForwardTracking::_output_track_col_quality_GOOD = 1;
-const int ForwardTracking::_output_track_col_quality_FAIR = 2;
-const int ForwardTracking::_output_track_col_quality_POOR = 3;
-
 
 ForwardTracking aForwardTracking ;
 
@@ -73,37 +60,52 @@ ForwardTracking::ForwardTracking() : Processor("ForwardTracking") {
    
    registerProcessorParameter("Chi2ProbCut",
                               "Tracks with a chi2 probability below this will get sorted out",
-                              _chi2ProbCut,
+                              _config.chi2ProbCut,
                               double(0.005));
    
    
    registerProcessorParameter("HelixFitMax",
                               "The maximum chi2/Ndf that is allowed as result of a helix fit",
-                              _helixFitMax,
+                              _config.helixFitMax,
                               double( 500 ) );
    
+   registerProcessorParameter("IncrementalHelixFit",
+                              "Whether the helix fit of all versions of a track is done incrementally from the fit of the raw track",
+                              _config.incrementalHelixFit,
+                              bool( false ) );
+   
 
    registerProcessorParameter("OverlappingHitsDistMax",
                               "The maximum distance of hits from overlapping petals belonging to one track",
-                              _overlappingHitsDistMax,
+                              _config.overlappingHitsDistMax,
                               double(3.5));
    
+   registerProcessorParameter("OverlappingHitsAssignment",
+                              "How hits from overlapping petals are added to a track. Combinations: every combination is tried. HelixPrediction: only the best matching hit behind every hit, predicted from a helix fit",
+                              _config.overlappingHitsAssignment,
+                              std::string("Combinations"));
+   
+   registerProcessorParameter("OverlappingHitsChi2Max",
+                              "For OverlappingHitsAssignment HelixPrediction: the maximum chi2 of a hit from an overlapping petal with respect to the predicted position",
+                              _config.overlappingHitsChi2Max,
+                              double(9.));
+   
    
    registerProcessorParameter( "HitsPerTrackMin",
                                "The minimum number of hits to create a track",
-                               _hitsPerTrackMin,
+                               _config.hitsPerTrackMin,
                                int( 4 ) );
    
    
    registerProcessorParameter( "BestSubsetFinder",
-                               "The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN, SubsetSimple and None",
-                               _bestSubsetFinder,
+                               "The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN, SubsetHopfieldNNComponents, SubsetExactHybrid, SubsetSimple and None",
+                               _config.bestSubsetFinder,
                                std::string( "SubsetHopfieldNN" ) );
    
    
    registerProcessorParameter( "TakeBestVersionOfTrack",
                                "Whether when adding hits to a track only the track with highest quality should be further processed",
-                               _takeBestVersionOfTrack,
+                               _config.takeBestVersionOfTrack,
                                bool( true ) );
 
    
@@ -111,32 +113,108 @@ ForwardTracking::ForwardTracking() : Processor("ForwardTracking") {
    
    registerProcessorParameter("HNN_Omega",
                               "Omega for the Hopfield Neural Network; the higher omega the higher the influence of the quality indicator",
-                              _HNN_Omega,
+                              _config.HNN_Omega,
                               double( 0.75 ) );
    
    registerProcessorParameter("HNN_Activation_Threshold",
                               "The activation threshold for the Hopfield Neural Network",
-                              _HNN_ActivationThreshold,
+                              _config.HNN_ActivationThreshold,
                               double( 0.5 ) );
    
    registerProcessorParameter("HNN_TInf",
                               "The temperature limit of the Hopfield Neural Network",
-                              _HNN_TInf,
+                              _config.HNN_TInf,
                               double( 0.1 ) );
    
+   registerProcessorParameter("SubsetExactMaxTracks",
+                              "For SubsetExactHybrid: the components with at most this many tracks are solved exactly (at most 64)",
+                              _config.subsetExactMaxTracks,
+                              int( 32 ) );
+   
+   registerProcessorParameter("SubsetExactMaxNodes",
+                              "For SubsetExactHybrid: the most nodes the exact search may visit in a component, else the Hopfield Neural Network is used",
+                              _config.subsetExactMaxNodes,
+                              int( 100000 ) );
+   
+   registerProcessorParameter("SubsetExactCompareHNN",
+                              "For SubsetExactHybrid: whether to solve the exactly solved components also with the Hopfield Neural Network to compare time and quality",
+                              _config.subsetExactCompareHNN,
+                              bool( false ) );
+   
    
    
    // Security checks to prevent combinatorial disasters
    
    registerProcessorParameter( "MaxConnectionsAutomaton",
                                "If the automaton has more connections than this it will be redone with the next set of cut off parameters",
-                               _maxConnectionsAutomaton,
+                               _config.maxConnectionsAutomaton,
                                int( 100000 ) );
    
+   registerProcessorParameter( "ReuseHitConnections",
+                               "Whether on a rerun of the automaton the connections between single hits of the round before are kept and only checked with the new 2-hit cut off parameters",
+                               _config.reuseHitConnections,
+                               bool( false ) );
+   
+   
+   registerProcessorParameter( "FlatAutomaton",
+                               "Whether to use the automaton of this package with a flat segment graph instead of the one of KiTrack",
+                               _config.flatAutomaton,
+                               bool( false ) );
+   
+   registerProcessorParameter( "BatchedCriteria",
+                               "Whether the criteria check many segment pairs at once, with vectorised kernels for the simple criteria (needs the FlatAutomaton for the 3 and 4 hit criteria)",
+                               _config.batchedCriteria,
+                               bool( false ) );
+   
+   registerProcessorParameter( "CriteriaChains",
+                               "Whether the criteria of a type are checked by one compiled chain, if they are the standard set",
+                               _config.criteriaChains,
+                               bool( false ) );
+   
+   registerProcessorParameter( "CriteriaReorderInterval",
+                               "After how many events the criteria are reordered by their measured time and rejection rate (0 = keep the order of the steering)",
+                               _config.criteriaReorderInterval,
+                               int( 0 ) );
+   
+   
+   registerProcessorParameter( "PredictStartRound",
+                               "Whether to start directly in the round of cut off parameters that is predicted to have not too many connections (from the number of hits per sector)",
+                               _config.predictStartRound,
+                               bool( false ) );
+   
+   
+   registerProcessorParameter( "TimeStages",
+                               "Whether to measure the time of the stages of the reconstruction (summary at the end)",
+                               _config.timeStages,
+                               bool( false ) );
+   
+   registerProcessorParameter( "TimeStagesInCollection",
+                               "Whether to store the times of the stages of every event as parameters of the output track collection (needs TimeStages)",
+                               _timeStagesInCollection,
+                               bool( false ) );
+   
+   
+   registerProcessorParameter( "MaxEventTimeMs",
+                               "The time in ms an event may take before the reconstruction starts leaving things out (0 = no limit)",
+                               _config.maxEventTimeMs,
+                               double( 0. ) );
+   
+   
+   registerProcessorParameter( "LocalCutTightening",
+                               "Whether too many connections or hits only lead to tighter cuts in the sectors responsible, instead of everywhere",
+                               _config.localCutTightening,
+                               bool( false ) );
+   
+   
+   registerProcessorParameter( "HelixQIPreselection",
+                               "Whether the best subset is first searched with the quality from the helix fit, and only the tracks of this subset (and the ones in conflict with them) get a Kalman fit",
+                               _config.helixQIPreselection,
+                               bool( false ) );
+   
    
    registerProcessorParameter("MaxHitsPerSector",
                               "Maximal number of hits allowed on a sector. More will cause drop of hits in sector",
-                              _maxHitsPerSector,
+                              _config.maxHitsPerSector,
                               int(1000));
    
    
@@ -166,8 +244,18 @@ ForwardTracking::ForwardTracking() : Processor("ForwardTracking") {
 
    registerProcessorParameter("GetTrackStateAtCaloFace",
                               "Set to false if no track state at the calorimeter is needed",
-                              _getTrackStateAtCaloFace,
+                              _config.getTrackStateAtCaloFace,
                               bool(true));
+   
+   registerProcessorParameter("SplitSides",
+                              "Whether to reconstruct the forward and the backward half of the FTD independently (and in parallel if NumberOfThreads > 1)",
+                              _config.splitSides,
+                              bool(false));
+   
+   registerProcessorParameter("NumberOfThreads",
+                              "The number of threads used for fitting the track candidates (and for the two halves of the FTD if SplitSides is set and for SubsetHopfieldNNComponents). 1 = serial",
+                              _nThreads,
+                              int(1));
   
 
    // The Criteria for the Cellular Automaton:
@@ -177,28 +265,28 @@ ForwardTracking::ForwardTracking() : Processor("ForwardTracking") {
    
    registerProcessorParameter( "Criteria",
                                "A vector of the criteria that are going to be used. For every criterion a min and max needs to be set!!!",
-                               _criteriaNames,
+                               _config.criteriaNames,
                                allCriteria);
    
    
    // Now set min and max values for all the criteria
-   for( unsigned i=0; i < _criteriaNames.size(); i++ ){
+   for( unsigned i=0; i < _config.criteriaNames.size(); i++ ){
     
       std::vector< float > emptyVec;
      
-      std::string critMinString = _criteriaNames[i] + "_min";
+      std::string critMinString = _config.criteriaNames[i] + "_min";
       
       registerProcessorParameter( critMinString,
-                                  "The minimum of " + _criteriaNames[i],
-                                  _critMinima[ _criteriaNames[i] ],
+                                  "The minimum of " + _config.criteriaNames[i],
+                                  _config.critMinima[ _config.criteriaNames[i] ],
                                   emptyVec);
       
       
-      std::string critMaxString = _criteriaNames[i] + "_max";
+      std::string critMaxString = _config.criteriaNames[i] + "_max";
       
       registerProcessorParameter( critMaxString,
-                                  "The maximum of " + _criteriaNames[i],
-                                  _critMaxima[ _criteriaNames[i] ],
+                                  "The maximum of " + _config.criteriaNames[i],
+                                  _config.critMaxima[ _config.criteriaNames[i] ],
                                   emptyVec);
       
       
@@ -220,10 +308,12 @@ void ForwardTracking::init() {
 
    _nRun = 0 ;
    _nEvt = 0 ;
-
-   _useCED = false; // Setting this to on will initialise CED in the processor and tracks or segments (from the CA)
-                    // can be printed. As this is mainly used for debugging it is not a steerable parameter.
-   if( _useCED )MarlinCED::init(this) ;    //CED
+   
+   _engine = NULL;
+   
+   _config.useCED = false; // Setting this to on will initialise CED in the processor and tracks or segments (from the CA)
+                           // can be printed. As this is mainly used for debugging it is not a steerable parameter.
+   if( _config.useCED )MarlinCED::init(this) ;    //CED
    
    
    /**********************************************************************************************/
@@ -252,6 +342,15 @@ void ForwardTracking::init() {
    
    _sectorSystemFTD = new SectorSystemFTD( nLayers, nModules , nSensors );
    
+   // the number of sectors is needed for storing the hits by sector: take the highest possible sector number
+   _nSectors = 0;
+   for( int side=-1; side <= 1; side += 2 ){
+      
+      int sectorMax = _sectorSystemFTD->getSector( side, nLayers - 1, nModules - 1, nSensors - 1 );
+      if( sectorMax + 1 > int( _nSectors ) ) _nSectors = sectorMax + 1;
+      
+   }
+   
    
    // Get the B Field in z direction
 
@@ -282,34 +381,56 @@ void ForwardTracking::init() {
    _trkSystem->init() ;
    
    
-   
    /**********************************************************************************************/
-   /*       Do a few checks, if the set parameters are right                                     */
+   /*       Threads for fitting the track candidates                                             */
    /**********************************************************************************************/
-
-   
-   // Only use allowed methods to find subsets. 
-   assert( ( _bestSubsetFinder == "None" ) || ( _bestSubsetFinder == "SubsetHopfieldNN" ) || ( _bestSubsetFinder == "SubsetSimple" ) );
    
-   // Use a sensible chi2prob cut. (chi squared probability, like any probability must range from 0 to 1)
-   assert( _chi2ProbCut >= 0. );
-   assert( _chi2ProbCut <= 1. );
+   if( _nThreads < 1 ) _nThreads = 1;
    
+   // The MarlinTrk::Factory hands out one shared instance per type, which the other processors use as well and whose
+   // options get set for every event in processEvent(). The fits (of this event and of any other one processed at 
+   // the same time) therefore use private track systems, with the options of this processor set once. Only for
+   // DDKalTest we can create them ourselves, for other types the fits use the shared instance, one after the other.
+   _trkSystems.clear();
    
-   // Make sure, every used criterion exists and has at least one min and max set
-   for( unsigned i=0; i<_criteriaNames.size(); i++ ){
+   if( _trkSystemName == "DDKalTest" ){
       
-      std::string critName = _criteriaNames[i];
+      for( int i=0; i < _nThreads; i++ ) _trkSystems.push_back( createTrkSystem() );
       
-      ICriterion* crit = Criteria::createCriterion( critName ); //throws an exception if the criterion is non existent
-      delete crit;
+   }
+   else{
       
-      assert( !_critMinima[ critName ].empty() );
-      assert( !_critMaxima[ critName ].empty() );
+      if( _nThreads > 1 ){
+         
+         streamlog_out( WARNING ) << "ForwardTracking: no private track system can be created for type " << _trkSystemName 
+                                  << ", so the threads can't fit at the same time. NumberOfThreads is set to 1.\n";
+         
+         _nThreads = 1;
+         
+      }
+      
+      _trkSystems.push_back( _trkSystem );
+      
+   }
+   
+   if( _nThreads > 1 ){
+      
+      streamlog_out( MESSAGE ) << "Fitting track candidates with " << _nThreads << " threads\n";
+      
+      // KalTest creates ROOT objects while fitting, so the global state of ROOT must be guarded before the
+      // threads of the engine start
+      ROOT::EnableThreadSafety();
       
    }
    
    
+   /**********************************************************************************************/
+   /*       The reconstruction itself                                                            */
+   /**********************************************************************************************/
+   
+   // checks the parameters, so an unknown criterion throws here
+   _engine = new ForwardTrackingEngine( _config, _sectorSystemFTD, _nSectors, _trkSystems );
+   
    
 
 }
@@ -325,11 +446,15 @@ void ForwardTracking::processRunHeader( LCRunHeader* ) {
 void ForwardTracking::processEvent( LCEvent * evt ) { 
 
   // set the correct configuration for the tracking system for this event 
+  // (the fits use the private track systems of init() for DDKalTest, so this doesn't change them while other events fit)
   MarlinTrk::TrkSysConfig< MarlinTrk::IMarlinTrkSystem::CFG::useQMS>       mson( _trkSystem,  _MSOn ) ;
   MarlinTrk::TrkSysConfig< MarlinTrk::IMarlinTrkSystem::CFG::usedEdx>      elosson( _trkSystem,_ElossOn) ;
   MarlinTrk::TrkSysConfig< MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing> smoothon( _trkSystem,_SmoothOn) ;
- 
-   streamlog_out( DEBUG4 ) << "processing event number " << _nEvt << "\n";
+   
+   // (events may be processed at the same time, every one gets its own number)
+   int nEvt = _nEvt++;
+   
+   streamlog_out( DEBUG4 ) << "processing event number " << nEvt << "\n";
    
    //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
    //                                                                                                              //
@@ -345,7 +470,7 @@ void ForwardTracking::processEvent( LCEvent * evt ) {
 //--CED (only used for debugging )---------------------------------------
 // Reset drawing buffer and START drawing collection
 
-   if( _useCED ){
+   if( _config.useCED ){
       
       MarlinCED::newEvent(this , 0) ; 
       
@@ -357,21 +482,14 @@ void ForwardTracking::processEvent( LCEvent * evt ) {
 
 //-----------------------------------------------------------------------
   
-  
-   // Reset the quality flag of the output track collection (we start with the assumption that our results are good.
-   // If anything happens along the way, we modify this value )
-   _output_track_col_quality = _output_track_col_quality_GOOD;
-
-   std::vector< IHit* > hitsTBD; //Hits to be deleted at the end
-   _map_sector_hits.clear();
-
    
    /**********************************************************************************************/
-   /*    Read in the collections, create hits from the TrackerHits and store them in a map       */
+   /*    Read in the collections                                                                 */
    /**********************************************************************************************/
    
    streamlog_out( DEBUG4 ) << "\t\t---Reading in Collections---\n" ;
    
+   std::vector< ForwardTrackingEngine::Hit > hits;
    
    for( unsigned iCol=0; iCol < _FTDHitCollections.size(); iCol++ ){ //read in all input collections
       
@@ -408,488 +526,38 @@ void ForwardTracking::processEvent( LCEvent * evt ) {
             
          }
          
-         streamlog_out(DEBUG1) << "hit" << i << " " << KiTrackMarlin::getCellID0Info( trackerHit->getCellID0() ) 
-         << " " << KiTrackMarlin::getPositionInfo( trackerHit )<< "\n";
+         // the engine takes the hit directly, so the tracks point to the hits of the collection
+         ForwardTrackingEngine::Hit hit;
+         hit.trackerHit = trackerHit;
          
-         //Make an FTDHit01 from the TrackerHit 
-         FTDHit01* ftdHit = new FTDHit01 ( trackerHit , _sectorSystemFTD );
-         hitsTBD.push_back(ftdHit); //so we can easily delete every created hit afterwards
-         
-         _map_sector_hits[ ftdHit->getSector() ].push_back( ftdHit );         
+         hits.push_back( hit );
          
       }
       
    }
-  
-
-
    
-   if( !_map_sector_hits.empty() ){
-      
-      
-      /**********************************************************************************************/
-      /*                Check if no sector is overflowing with hits                                 */
-      /**********************************************************************************************/
-      
-      
-      std::map< int , std::vector< IHit* > >::iterator it;
-      
-      for( it=_map_sector_hits.begin(); it != _map_sector_hits.end(); it++ ){
-       
-         
-         int nHits = it->second.size();
-         streamlog_out( DEBUG2 ) << "Number of hits in sector " << it->first << " = " << nHits << "\n";
-         
-         if( nHits > _maxHitsPerSector ){
-            
-            it->second.clear(); //delete the hits in this sector, it will be dropped
-            
-            streamlog_out(ERROR)  << " ### EVENT " << evt->getEventNumber() << " :: RUN " << evt->getRunNumber() << " \n ### Number of Hits in FTD Sector " << it->first << ": " << nHits << " > " << _maxHitsPerSector << " (MaxHitsPerSector)\n : This sector will be dropped from track search, and QualityCode set to \"Poor\" " << std::endl;
-           
-            _output_track_col_quality = _output_track_col_quality_POOR; // We had to drop hits, so the quality of the result is decreased
-            
-         }
-         
-      }
-      
-      /**********************************************************************************************/
-      /*                Check the possible connections of hits on overlapping petals                */
-      /**********************************************************************************************/
-      
-      streamlog_out( DEBUG4 ) << "\t\t---Overlapping Hits---\n" ;
-      
-      std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack = getOverlapConnectionMap( _map_sector_hits, _sectorSystemFTD, _overlappingHitsDistMax);
-      
-      
-     
-      /**********************************************************************************************/
-      /*                Add the IP as virtual hit for forward and backward                          */
-      /**********************************************************************************************/
-      
-      IHit* virtualIPHitForward = createVirtualIPHit(1 , _sectorSystemFTD );
-      hitsTBD.push_back( virtualIPHitForward );
-      _map_sector_hits[ virtualIPHitForward->getSector() ].push_back( virtualIPHitForward );
-      
-      IHit* virtualIPHitBackward = createVirtualIPHit(-1 , _sectorSystemFTD );
-      hitsTBD.push_back( virtualIPHitBackward );
-      _map_sector_hits[ virtualIPHitBackward->getSector() ].push_back( virtualIPHitBackward );
-     
-      
-      /**********************************************************************************************/
-      /*                SegmentBuilder and Cellular Automaton                                       */
-      /**********************************************************************************************/
-      
-      unsigned round = 0; // the round we are in
-      std::vector < RawTrack > rawTracks;
-      
-      // The following while loop ideally only runs once. (So we do round 0 and everything works)
-      // It will repeat as long as the Automaton creates too many connections and as long as there are new criteria
-      // parameters to use to cut down the problem.
-      // Ideally already in round 0, there is a reasonable number of connections (not more than _maxConnectionsAutomaton), 
-      // so the loop will be left. If however there are too many connections we stay in the loop and use 
-      // (hopefully) tighter cut offs (if provided in the steering). This should prevent combinatorial breakdown
-      // for very evil events.
-      while( setCriteria( round ) ){
-         
-         
-         round++; // count up the round we are in
-         
-         
-         /**********************************************************************************************/
-         /*                Build the segments                                                          */
-         /**********************************************************************************************/
-         
-         streamlog_out( DEBUG4 ) << "\t\t---SegementBuilder---\n" ;
-         
-         //Create a segmentbuilder
-         SegmentBuilder segBuilder( _map_sector_hits );
-         
-         segBuilder.addCriteria ( _crit2Vec ); // Add the criteria on when to connect two hits. The vector has been filled by the method setCriteria
-         
-         //Also load hit connectors
-         unsigned layerStepMax = 1; // how many layers to go at max
-         unsigned petalStepMax = 1; // how many petals to go at max
-         unsigned lastLayerToIP = 5;// layer 1,2,3 and 4 get connected directly to the IP
-         FTDSectorConnector secCon( _sectorSystemFTD , layerStepMax , petalStepMax , lastLayerToIP );
-         
-         
-         segBuilder.addSectorConnector ( & secCon ); // Add the sector connector (so the SegmentBuilder knows what hits from different sectors it is allowed to look for connections)
-         
-         
-         // And get out the Cellular Automaton with the 1-segments 
-         Automaton automaton = segBuilder.get1SegAutomaton();
-         
-         // Check if there are not too many connections
-         if( automaton.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
-            
-            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
-            << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
-            continue;
-            
-         }
-         
-         
-         
-         /**********************************************************************************************/
-         /*                Automaton                                                                   */
-         /**********************************************************************************************/
-         
-         
-         
-         streamlog_out( DEBUG4 ) << "\t\t---Automaton---\n" ;
-         
-         if( _useCED ) KiTrackMarlin::drawAutomatonSegments( automaton ); // draws the 1-segments (i.e. hits)
-         
-         
-         /*******************************/
-         /*      2-hit segments         */
-         /*******************************/
-         
-         streamlog_out( DEBUG4 ) << "\t\t--2-hit-Segments--\n" ;
-         
-         streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
-         
-         automaton.clearCriteria();
-         automaton.addCriteria( _crit3Vec );  // Add the criteria for 3 hits (i.e. 2 2-hit segments )
-         
-         
-         // Let the automaton lengthen its 1-hit-segments to 2-hit-segments
-         automaton.lengthenSegments();
-        
-         
-         // So now we have 2-hit-segments and are ready to perform the Cellular Automaton.
-         
-         // Perform the automaton
-         automaton.doAutomaton();
-         
-         
-         // Clean segments with bad states
-         automaton.cleanBadStates();
-         
-        
-         // Reset the states of all segments
-         automaton.resetStates();
-        
-         streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
-         
-         
-         // Check if there are not too many connections
-         if( automaton.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
-            
-            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
-            << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
-            continue;
-            
-         }
-         
-         /*******************************/
-         /*      3-hit segments         */
-         /*******************************/
-         streamlog_out( DEBUG4 ) << "\t\t--3-hit-Segments--\n" ;
-         
-         
-         automaton.clearCriteria();
-         automaton.addCriteria( _crit4Vec );      
-         
-         
-         // Lengthen the 2-hit-segments to 3-hits-segments
-         automaton.lengthenSegments();
-         
-         
-         // Perform the Cellular Automaton
-         automaton.doAutomaton();
-         
-         //Clean segments with bad states
-         automaton.cleanBadStates();
-         
-         
-         //Reset the states of all segments
-         automaton.resetStates();
-         
-         
-         streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
-         
-         
-         // Check if there are not too many connections
-         if( automaton.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
-            
-            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
-            << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
-            continue;
-            
-         }
-         
-         // get the raw tracks (raw track = just a vector of hits, the most rudimentary form of a track)
-         rawTracks = automaton.getTracks( 3 );
-         
-         break; // if we reached this place all went well and we don't need another round --> exit the loop
-         
-      }
-      
-      streamlog_out( DEBUG4 ) << "Automaton returned " << rawTracks.size() << " raw tracks \n";
-      
-      
-      /**********************************************************************************************/
-      /*                Add the overlapping hits                                                    */
-      /**********************************************************************************************/
-      
-      
-      streamlog_out( DEBUG4 ) << "\t\t---Add hits from overlapping petals + fit + helix and Kalman cuts---\n" ;
-      
-      
-      std::vector <ITrack*> trackCandidates;
-      
-      
-      // for all raw tracks we got from the automaton
-      for( unsigned i=0; i < rawTracks.size(); i++){
-         
-         
-         RawTrack rawTrack = rawTracks[i];
-         
-         _nTrackCandidates++;
-         
-         
-         // get all versions of the track plus hits from overlapping petals
-         std::vector < RawTrack > rawTracksPlus = getRawTracksPlusOverlappingHits( rawTrack, map_hitFront_hitsBack );
-         
-         streamlog_out( DEBUG2 ) << "For raw track number " << i << " there are " << rawTracksPlus.size() << " versions\n";
-         
-         
-         /**********************************************************************************************/
-         /*                Make track candidates, fit them and throw away bad ones                     */
-         /**********************************************************************************************/
-         
-         std::vector< ITrack* > overlappingTrackCands;
-         
-         for( unsigned j=0; j < rawTracksPlus.size(); j++ ){
-            
-            _nTrackCandidatesPlus++;
-            
-            RawTrack rawTrackPlus = rawTracksPlus[j];
-            
-            if( rawTrackPlus.size() < unsigned( _hitsPerTrackMin ) ){
-               
-               streamlog_out( DEBUG1 ) << "Trackversion discarded, too few hits: only " << rawTrackPlus.size() << " < " << _hitsPerTrackMin << "(hitsPerTrackMin)\n";
-               continue;
-               
-            }
-            
-            FTDTrack* trackCand = new FTDTrack( _trkSystem );
-            
-            // add the hits to the track
-            for( unsigned k=0; k<rawTrackPlus.size(); k++ ){
-               
-               IFTDHit* ftdHit = dynamic_cast< IFTDHit* >( rawTrackPlus[k] ); // cast to IFTDHits, as needed for an FTDTrack
-               if( ftdHit != NULL ) trackCand->addHit( ftdHit );
-               else streamlog_out( DEBUG4 ) << "Hit " << rawTrackPlus[k] << " could not be casted to IFTDHit\n";
-               
-            }
-            
-            std::vector< IHit* > trackCandHits = trackCand->getHits();
-            streamlog_out( DEBUG2 ) << "Fitting track candidate with " << trackCandHits.size() << " hits\n";
-            
-            for( unsigned k=0; k < trackCandHits.size(); k++ ) streamlog_out( DEBUG1 ) << trackCandHits[k]->getPositionInfo();
-            streamlog_out( DEBUG1 ) << "\n";
-            
-            /*-----------------------------------------------*/
-            /*                Helix Fit                      */
-            /*-----------------------------------------------*/
-            
-            streamlog_out( DEBUG2 ) << "Fitting with Helix Fit\n";
-            try{
-               
-               FTDHelixFitter helixFitter( trackCand->getLcioTrack() );
-               float chi2OverNdf = helixFitter.getChi2() / float( helixFitter.getNdf() );
-               streamlog_out( DEBUG2 ) << "chi2OverNdf = " << chi2OverNdf << "\n";
-               
-               if( chi2OverNdf > _helixFitMax ){
-                  
-                  streamlog_out( DEBUG2 ) << "Discarding track because of bad helix fit: chi2/ndf = " << chi2OverNdf << "\n";
-                  delete trackCand;
-                  continue;
-                  
-               }
-               else streamlog_out( DEBUG2 ) << "Keeping track because of good helix fit: chi2/ndf = " << chi2OverNdf << "\n";
-               
-            }
-            catch( FTDHelixFitterException e ){
-               
-               
-               streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
-               delete trackCand;
-               continue;
-               
-            }
-            
-            /*-----------------------------------------------*/
-            /*                Kalman Fit                      */
-            /*-----------------------------------------------*/
-            
-            streamlog_out( DEBUG2 ) << "Fitting with Kalman Filter\n";
-            try{
-                  
-               trackCand->fit();
-                  
-               streamlog_out( DEBUG2 ) << " Track " << trackCand 
-                                       << " chi2Prob = " << trackCand->getChi2Prob() 
-                                       << "( chi2=" << trackCand->getChi2() 
-                                       <<", Ndf=" << trackCand->getNdf() << " )\n";
-                  
-                  
-               if ( trackCand->getChi2Prob() >= _chi2ProbCut ){
-                  
-                  streamlog_out( DEBUG2 ) << "Track accepted (chi2prob " << trackCand->getChi2Prob() << " >= " << _chi2ProbCut << "\n";
-                  
-               }
-               else{
-                  
-                  streamlog_out( DEBUG2 ) << "Track rejected (chi2prob " << trackCand->getChi2Prob() << " < " << _chi2ProbCut << "\n";
-                  delete trackCand;
-                  
-                  continue;
-                  
-               }
-               
-               
-            }
-            catch( FitterException e ){
-               
-               
-               streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
-               delete trackCand;
-               continue;
-               
-            }
-            
-            // If we reach this point than the track got accepted by all cuts
-            overlappingTrackCands.push_back( trackCand );
-            
-         }
-         
-         /**********************************************************************************************/
-         /*                Take the best version of the track                                          */
-         /**********************************************************************************************/
-        // Now we have all versions of one track, coming from adding possible hits from overlapping petals.
-         
-         if( _takeBestVersionOfTrack ){ // we want to take only the best version
-            
-            
-            streamlog_out( DEBUG2 ) << "Take the version of the track with best quality from " << overlappingTrackCands.size() << " track candidates\n";
-            
-            if( !overlappingTrackCands.empty() ){
-               
-               ITrack* bestTrack = overlappingTrackCands[0];
-               
-               for( unsigned j=1; j < overlappingTrackCands.size(); j++ ){
-                  
-                  if( overlappingTrackCands[j]->getChi2Prob() > bestTrack->getChi2Prob() ){
-                     
-                     delete bestTrack; //delete the old one, not needed anymore
-                     bestTrack = overlappingTrackCands[j];
-                  }
-                  else{
-                     
-                     delete overlappingTrackCands[j]; //delete this one
-                     
-                  }
-                  
-               }
-               streamlog_out( DEBUG2 ) << "Adding best track candidate with " << bestTrack->getHits().size() << " hits\n";
-               
-               trackCandidates.push_back( bestTrack );
-               
-            }
-            
-         }
-         else{ // we take all versions
-            
-            streamlog_out( DEBUG2 ) << "Taking all " << overlappingTrackCands.size() << " versions of the track\n";
-            trackCandidates.insert( trackCandidates.end(), overlappingTrackCands.begin(), overlappingTrackCands.end() );
-            
-         }
-         
-      }
-      
-      if( _useCED ){
-//          for( unsigned i=0; i < trackCandidates.size(); i++ ) KiTrackMarlin::drawTrackRandColor( trackCandidates[i] );
-      }
-      
-      /**********************************************************************************************/
-      /*               Get the best subset of tracks                                                */
-      /**********************************************************************************************/
-      
-      streamlog_out(DEBUG3) << "The track candidates so far: \n";
-      for( unsigned iTrack=0; iTrack < trackCandidates.size(); iTrack++ ){
-         
-         streamlog_out(DEBUG3) << "track " << iTrack << ": " << trackCandidates[iTrack] << "\t" << KiTrackMarlin::getTrackHitInfo( trackCandidates[iTrack] ) << "\n";
-         
-      }
-      
-      streamlog_out( DEBUG4 ) << "\t\t---Get best subset of tracks---\n" ;
-      
-      std::vector< ITrack* > tracks;
-      std::vector< ITrack* > rejected;
-      
-      TrackCompatibilityShare1SP comp;
-//       TrackQIChi2Prob trackQI;
-      TrackQIChi2ProbSpecial trackQIChi2ProbSpecial;
-      
-      
-      
-      if( _bestSubsetFinder == "SubsetHopfieldNN" ){
-         
-         streamlog_out( DEBUG3 ) << "Use SubsetHopfieldNN for getting the best subset\n" ;
-         
-         SubsetHopfieldNN< ITrack* > subset;
-         subset.setOmega( _HNN_Omega );
-         subset.setActivationThreshold( _HNN_ActivationThreshold );
-         subset.setTInf( _HNN_TInf );
-         subset.add( trackCandidates );
-         
-         
-         subset.calculateBestSet( comp, trackQIChi2ProbSpecial );
-         
-         tracks = subset.getAccepted();
-         rejected = subset.getRejected();
-         
-      }
-      else if( _bestSubsetFinder == "SubsetSimple" ){
-         
-         streamlog_out( DEBUG3 ) << "Use SubsetSimple for getting the best subset\n" ;
-         
-         SubsetSimple< ITrack* > subset;
-         subset.add( trackCandidates );
-         subset.calculateBestSet( comp, trackQIChi2ProbSpecial );
-         tracks = subset.getAccepted();
-         rejected = subset.getRejected();
-         
-      }
-      else { // in any other case take all tracks
-         
-         streamlog_out( DEBUG3 ) << "Input for subset = \"" << _bestSubsetFinder << "\". All tracks are kept\n" ;
-         
-         tracks = trackCandidates;
-         
-      }
-      
-      
-      if( _useCED ){
-//          for( unsigned i=0; i < tracks.size(); i++ ) KiTrackMarlin::drawTrack( tracks[i] , 0x00ff00 );
-//          for( unsigned i=0; i < rejected.size(); i++ ) KiTrackMarlin::drawTrack( rejected[i] , 0xff0000 );
-      }
-      
-      
-      for ( unsigned i=0; i<rejected.size(); i++){
-         
-         delete rejected[i];
-         
-      }
+   
+   /**********************************************************************************************/
+   /*                Reconstruct the tracks                                                      */
+   /**********************************************************************************************/
+   
+   ForwardTrackingEngine::Result result;
+   
+   _engine->reconstruct( hits, result );
+   
+   for( unsigned i=0; i < result.droppedSectors.size(); i++ ){
       
+      streamlog_out(ERROR)  << " ### EVENT " << evt->getEventNumber() << " :: RUN " << evt->getRunNumber() << " \n ### Number of Hits in FTD Sector " << result.droppedSectors[i] << " > " << _config.maxHitsPerSector << " (MaxHitsPerSector)\n : This sector will be dropped from track search, and QualityCode set to \"Poor\" " << std::endl;
       
+   }
+   
+   
+   /**********************************************************************************************/
+   /*               Finally: Save the tracks                                                     */
+   /**********************************************************************************************/
+   
+   if( !hits.empty() ){
       
-      /**********************************************************************************************/
-      /*               Finally: Finalise and save the tracks                                        */
-      /**********************************************************************************************/
       
       streamlog_out( DEBUG4 ) << "\t\t---Save Tracks---\n" ;
       
@@ -900,42 +568,16 @@ void ForwardTracking::processEvent( LCEvent * evt ) {
       hitFlag.setBit( LCIO::TRBIT_HITS ) ;
       trkCol->setFlag( hitFlag.getFlag()  ) ;
       
+      for( unsigned i=0; i < result.tracks.size(); i++ ) trkCol->addElement( result.tracks[i] );
       
-      for (unsigned int i=0; i < tracks.size(); i++){
-         
-         FTDTrack* myTrack = dynamic_cast< FTDTrack* >( tracks[i] );
-         
-         if( myTrack != NULL ){
-            
-            
-            TrackImpl* trackImpl = new TrackImpl( *(myTrack->getLcioTrack()) );
-            
-            try{
-               
-               finaliseTrack( trackImpl );
-               trkCol->addElement( trackImpl );
-               
-            }
-            catch( FitterException e ){
-               
-               streamlog_out( DEBUG4 ) << "ForwardTracking: track couldn't be finalized due to fitter error: " << e.what() << "\n";
-               delete trackImpl;
-            }
-            
-            
-         }
-         
-         
-      }
-     
       // set the quality of the output collection
-      switch (_output_track_col_quality) {
+      switch ( result.quality ) {
          
-         case _output_track_col_quality_FAIR:
+         case ForwardTrackingEngine::QUALITY_FAIR:
             trkCol->parameters().setValue( "QualityCode" , "Fair"  ) ;
             break;
             
-         case _output_track_col_quality_POOR:
+         case ForwardTrackingEngine::QUALITY_POOR:
             trkCol->parameters().setValue( "QualityCode" , "Poor"  ) ;
             break;
             
@@ -943,36 +585,40 @@ void ForwardTracking::processEvent( LCEvent * evt ) {
             trkCol->parameters().setValue( "QualityCode" , "Good"  ) ;
             break;
       }
-
-      evt->addCollection(trkCol,_ForwardTrackCollection.c_str());
-      
-      
       
-      streamlog_out (DEBUG5) << "Forward Tracking found and saved " << tracks.size() << " tracks in event " << _nEvt << "\n\n"; 
+      const StageTimer* stageTimer = _engine->getStageTimer();
       
+      if( stageTimer != NULL && _timeStagesInCollection ){
+         
+         std::vector< std::string > stageNames;
+         
+         for( unsigned i=0; i < stageTimer->getNumberOfStages(); i++ ) stageNames.push_back( stageTimer->getStageName( i ) );
+         
+         trkCol->parameters().setValues( "StageNames" , stageNames );
+         trkCol->parameters().setValues( "StageTimesMs" , result.stageTimesMs );
+         
+      }
+
+      evt->addCollection(trkCol,_ForwardTrackCollection.c_str());
       
-      /**********************************************************************************************/
-      /*                Clean up                                                                    */
-      /**********************************************************************************************/
       
-      // delete all the created IHits
-      for ( unsigned i=0; i<hitsTBD.size(); i++ )  delete hitsTBD[i];
       
-      // delete the FTracks
-      for (unsigned int i=0; i < tracks.size(); i++){ delete tracks[i];}
+      streamlog_out (DEBUG5) << "Forward Tracking found and saved " << result.tracks.size() << " tracks in event " << nEvt << "\n\n"; 
       
       
+   }
+   
+   if( result.isOverTime ){
       
+      streamlog_out( WARNING ) << "Event " << evt->getEventNumber() << " of run " << evt->getRunNumber() << " took longer than "
+                               << _config.maxEventTimeMs << " ms (MaxEventTimeMs), its reconstruction was cut short\n";
       
    }
 
 
 
 
-   if( _useCED ) MarlinCED::draw(this);
-
-
-   _nEvt ++ ;
+   if( _config.useCED ) MarlinCED::draw(this);
    
 }
 
@@ -985,386 +631,39 @@ void ForwardTracking::check( LCEvent * ) {}
 
 void ForwardTracking::end(){
    
- 
-   for ( unsigned i=0; i< _crit2Vec.size(); i++) delete _crit2Vec[i];
-   for ( unsigned i=0; i< _crit3Vec.size(); i++) delete _crit3Vec[i];
-   for ( unsigned i=0; i< _crit4Vec.size(); i++) delete _crit4Vec[i];
-   _crit2Vec.clear();
-   _crit3Vec.clear();
-   _crit4Vec.clear();
+   
+   if( _engine != NULL ) _engine->printSummary( name() );
+   delete _engine;
+   _engine = NULL;
    
    delete _sectorSystemFTD;
    _sectorSystemFTD = NULL;
    
-   streamlog_out( DEBUG3 ) << "There are " << _nTrackCandidates << "track candidates from CA and "<<  _nTrackCandidatesPlus
-      << " track Candidates with hits from overlapping hits\n"
-      << "The ratio is " << float( _nTrackCandidatesPlus )/_nTrackCandidates;
-
-   
-}
-
-
-
-
-std::map< IHit* , std::vector< IHit* > > ForwardTracking::getOverlapConnectionMap( 
-            const std::map< int , std::vector< IHit* > > & map_sector_hits, 
-            const SectorSystemFTD* secSysFTD,
-            float distMax){
-   
-   
-   unsigned nConnections=0;
-
-   
-   std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack;
-   std::map< int , std::vector< IHit* > >::const_iterator it;
-   
-   //for every sector
-   for ( it= map_sector_hits.begin() ; it != map_sector_hits.end(); it++ ){
-      
-     
-      std::vector< IHit* > hitVecA = it->second;
-      int sector = it->first;
-      
-      // get the neighbouring petals
-      FTDNeighborPetalSecCon secCon( secSysFTD );
-      std::set< int > targetSectors = secCon.getTargetSectors( sector );
-      
-      
-      //for all neighbouring petals
-      for ( std::set<int>::iterator itTarg = targetSectors.begin(); itTarg!=targetSectors.end(); itTarg++ ){
-         
-         
-        //fg: this blows up the map with empty vectors ! 
-	//	std::vector< IHit* > hitVecB = map_sector_hits[ *itTarg ];
-         
-	 std::map< int , std::vector< IHit* > >::const_iterator itB = map_sector_hits.find( *itTarg ) ; 
-
-	 if( itB == map_sector_hits.end() ){
-	   continue ;
-	 }
-	 std::vector< IHit* > hitVecB = itB->second ;
-	 
-
-         for ( unsigned j=0; j < hitVecA.size(); j++ ){
-            
-            
-            IHit* hitA = hitVecA[j];
-            
-            for ( unsigned k=0; k < hitVecB.size(); k++ ){
-               
-               
-               IHit* hitB = hitVecB[k];
-               
-               
-               float dx = hitA->getX() - hitB->getX();
-               float dy = hitA->getY() - hitB->getY();
-               float dz = hitA->getZ() - hitB->getZ();
-               float dist = sqrt( dx*dx + dy*dy + dz*dz );
-               
-               if (( dist < distMax )&& ( fabs( hitB->getZ() ) > fabs( hitA->getZ() ) )  ){ // if they are close enough and B is behind A
-                  
-                  
-                  streamlog_out( DEBUG2 ) << "Connected: (" << hitA->getX() << "," << hitA->getY() << "," << hitA->getZ() << ")-->("
-                                          << hitB->getX() << "," << hitB->getY() << "," << hitB->getZ() << ")\n";
-                  
-                  map_hitFront_hitsBack[ hitA ].push_back( hitB );
-                  nConnections++;
-                  
-               }
-               
-            }
-            
-         } 
-         
-      }
-     
-   }
-   
-   streamlog_out( DEBUG3 ) << "Connected " << map_hitFront_hitsBack.size() << " hits with " << nConnections << " possible overlapping hits\n";
-   
-   
-   return map_hitFront_hitsBack;
-   
-   
-   
-}
-
-
-std::string ForwardTracking::getInfo_map_sector_hits(){
-   
-   
-   std::stringstream s;
-   
-   std::map< int , std::vector< IHit* > >::iterator it;
-   
-   for( it = _map_sector_hits.begin(); it != _map_sector_hits.end(); it++ ){
-      
-      
-      std::vector<IHit*> hits = it->second;
-      int sector = it->first;
-      
-      int side = _sectorSystemFTD->getSide( sector );
-      unsigned layer = _sectorSystemFTD->getLayer( sector );
-      unsigned module = _sectorSystemFTD->getModule( sector );
-      unsigned sensor = _sectorSystemFTD->getSensor( sector );
-      
-      s << "sector " << sector  << " (si"
-      << side << ",la"
-      << layer << ",mo"
-      << module << "se,"
-      << sensor << ") has "
-      << hits.size() << " hits\n";
-      
-      
-   }  
-   
-   
-   return s.str();   
-   
-}
-
-std::vector < RawTrack > ForwardTracking::getRawTracksPlusOverlappingHits( RawTrack rawTrack , std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack ){
-   
-   
-   
-   // So we have a raw track (a vector of hits, that is) and a map, that tells us
-   // for every hit, if there is another hit in the overlapping region behind it very close,
-   // so that it could be part of the same track.
-   //
-   // We now want to find for a given track all possible tracks, when hits from the overlapping regions are added
-   //
-   // The method is this: start with pure track.
-   // Make a vector of rawTracks and fill in the pure track.
-   // For every hit on the original track do the following:
-   // Check if there are overlapping hits.
-   // For every overlapping hit take all the created tracks so far and make another version
-   // with the overlapping hit added to it and add them to the vector of rawTracks.
-   //
-   //
-   // Let's do an example: 
-   // the original hits in the track are calles A,B and C.
-   // A has one overlapping hit A1
-   // and B has two overlapping hits B1 and B2.
-   //
-   // So we start with a vector containing only the original track: {(A,B,C)}
-   //
-   // We start with the first hit: A. It has one overlapping hit A1.
-   // We take all tracks (which is the original one so far) and make another version containing A1 as well.
-   // Then we add it to the vector of tracks:
-   //
-   // {(A,B,C)(A,A1,B,C)}
-   //
-   // On to the next hit from the original track: B. Here we have overlapping hits B1 and B2.
-   // We take all the tracks so far and add versions with B1: (A,B,B1,C) and (A,A1,B,B1,C)
-   // We don't immediately add them or otherwise, we would create a track containing B1 as well as B2, which is plainly wrong
-   //
-   // So instead we make the combinations with B2: (A,B,B2,C) and (A,A1,B,B2,C)
-   // And now having gone through all overlapping hits of B, we add all the new versions to the vector:
-   //
-   // {(A,B,C)(A,A1,B,C)(A,B,B1,C)(A,A1,B,B1,C)(A,B,B2,C)(A,A1,B,B2,C)}
-   //
-   // So now we have all possible versions of the track with overlapping hits
-   
-   std::vector < RawTrack > rawTracksPlus;
-   
-   rawTracksPlus.push_back( rawTrack ); //add the original one
-   
-   // for every hit in the original track
-   for( unsigned i=0; i < rawTrack.size(); i++ ){
-      
-     
-      IHit* frontHit = rawTrack[i];
-      
-      // get the hits that are behind frontHit
-      std::map< IHit* , std::vector< IHit* > >::iterator it;
-      it = map_hitFront_hitsBack.find( frontHit );
-      if( it == map_hitFront_hitsBack.end() ) continue; // if there are no hits on the back skip this one
-      std::vector< IHit* > backHits = it->second; 
-      
-      
-      // Create the different versions of the tracks so far with the hits from the back
-      
-      std::vector< RawTrack > newVersions; //here we store all the versions with overlapping hits from the different back hits at this frontHit
-      
-      // for every hit in back of the frontHit
-      for( unsigned j=0; j<backHits.size(); j++ ){
-         
-         
-         IHit* backHit = backHits[j];
-         
-         // for all tracks we have so far
-         for( unsigned k=0; k<rawTracksPlus.size(); k++ ){
-            
-            
-            RawTrack newVersion = rawTracksPlus[k];     // exact copy of the track
-            newVersion.push_back( backHit );          // add the backHit to it   
-            newVersions.push_back( newVersion );         // store it
-            
-         }
-         
-      }
-      
-      // Now put all the new versions of the tracks into the rawTracksPlus vector before we go on to the next
-      // hit of the original track
-      rawTracksPlus.insert( rawTracksPlus.end(), newVersions.begin(), newVersions.end() );
+   // all but the shared one from the factory are ours
+   for( unsigned i=0; i < _trkSystems.size(); i++ ){
       
+      if( _trkSystems[i] != _trkSystem ) delete _trkSystems[i];
       
    }
-   
-   
-   
-   return rawTracksPlus;
+   _trkSystems.clear();
    
 }
 
 
-bool ForwardTracking::setCriteria( unsigned round ){
- 
-   // delete the old ones
-   for ( unsigned i=0; i< _crit2Vec.size(); i++) delete _crit2Vec[i];
-   for ( unsigned i=0; i< _crit3Vec.size(); i++) delete _crit3Vec[i];
-   for ( unsigned i=0; i< _crit4Vec.size(); i++) delete _crit4Vec[i];
-   _crit2Vec.clear();
-   _crit3Vec.clear();
-   _crit4Vec.clear();
-   
-   
+MarlinTrk::IMarlinTrkSystem* ForwardTracking::createTrkSystem(){
    
-   bool newValuesGotUsed = false; // if new values are used
-   
-   for( unsigned i=0; i<_criteriaNames.size(); i++ ){
-      
-      std::string critName = _criteriaNames[i];
-      
-      
-      float min = _critMinima[critName].back();
-      float max = _critMaxima[critName].back();
-      
-      
-      
-      // use the value corresponding to the round, if there are no new ones for this criterion, just do nothing (the previous value stays in place)
-      if( round + 1 <= _critMinima[critName].size() ){
-         
-         min =  _critMinima[critName][round];
-         newValuesGotUsed = true;
-         
-      }
-      
-      if( round + 1 <= _critMaxima[critName].size() ){
-         
-         max =  _critMaxima[critName][round];
-         newValuesGotUsed = true;
-         
-      }
-      
-      ICriterion* crit = Criteria::createCriterion( critName, min , max );
-      
-      // Some debug output about the created criterion
-      std::string type = crit->getType();
-      
-      streamlog_out( DEBUG3 ) <<  "Added: Criterion " << critName << " (type =  " << type 
-      << " ). Min = " << min
-      << ", Max = " << max
-      << ", round " << round << "\n";
-      
-      
-      // Add the new criterion to the corresponding vector
-      if( type == "2Hit" ){
-         
-         _crit2Vec.push_back( crit );
-         
-      }
-      else if( type == "3Hit" ){
-         
-         _crit3Vec.push_back( crit );
-         
-      }
-      else if( type == "4Hit" ){
-         
-         _crit4Vec.push_back( crit );
-         
-      }
-      else delete crit;
-      
-      
-   }
-   
-   return newValuesGotUsed;
-   
-   
-}
-
-
-void ForwardTracking::finaliseTrack( TrackImpl* trackImpl ){
-   
-   
-   Fitter fitter( trackImpl , _trkSystem );
-   
-   trackImpl->trackStates().clear();
-   
-
-   TrackStateImpl* trkStateIP = new TrackStateImpl( *fitter.getTrackState( lcio::TrackState::AtIP ) ) ;
-   trkStateIP->setLocation( TrackState::AtIP );
-   trackImpl->addTrackState( trkStateIP );
-   
-   TrackStateImpl* trkStateFirstHit = new TrackStateImpl( *fitter.getTrackState( TrackState::AtFirstHit ) ) ;
-   trkStateFirstHit->setLocation( TrackState::AtFirstHit );
-   trackImpl->addTrackState( trkStateFirstHit );
-   
-   TrackStateImpl* trkStateLastHit = new TrackStateImpl( *fitter.getTrackState( TrackState::AtLastHit ) ) ;
-   trkStateLastHit->setLocation( TrackState::AtLastHit );
-   trackImpl->addTrackState( trkStateLastHit );
-   
-   if( _getTrackStateAtCaloFace ) {
-     TrackStateImpl* trkStateAtCalo = new TrackStateImpl( *fitter.getTrackState( TrackState::AtCalorimeter ) ) ;
-     trkStateAtCalo->setLocation( TrackState::AtCalorimeter );
-     trackImpl->addTrackState( trkStateAtCalo );
-   }
-
-   trackImpl->setChi2( fitter.getChi2( TrackState::AtIP ) );
-   trackImpl->setNdf(  fitter.getNdf ( TrackState::AtIP ) );
-   
-   const float* p = trkStateFirstHit->getReferencePoint();
-   trackImpl->setRadiusOfInnermostHit( sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] ) );
-   
-   std::map<int, int> hitNumbers; 
-   
-   hitNumbers[lcio::ILDDetID::VXD] = 0;
-   hitNumbers[lcio::ILDDetID::SIT] = 0;
-   hitNumbers[lcio::ILDDetID::FTD] = 0;
-   hitNumbers[lcio::ILDDetID::TPC] = 0;
-   hitNumbers[lcio::ILDDetID::SET] = 0;
-   hitNumbers[lcio::ILDDetID::ETD] = 0;
-   
-   std::vector< TrackerHit* > trackerHits = trackImpl->getTrackerHits();
-   for( unsigned j=0; j < trackerHits.size(); j++ ){
-      
-      UTIL::BitField64 encoder( LCTrackerCellID::encoding_string() );
-      encoder.setValue( trackerHits[j]->getCellID0() );
-      int subdet =  encoder[lcio::LCTrackerCellID::subdet()];
-     
-      
-      ++hitNumbers[ subdet ];
-      
-   }
    
-   trackImpl->subdetectorHitNumbers().resize(2 * lcio::ILDDetID::ETD);
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::VXD - 2 ] = hitNumbers[lcio::ILDDetID::VXD];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::FTD - 2 ] = hitNumbers[lcio::ILDDetID::FTD];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SIT - 2 ] = hitNumbers[lcio::ILDDetID::SIT];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::TPC - 2 ] = hitNumbers[lcio::ILDDetID::TPC];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SET - 2 ] = hitNumbers[lcio::ILDDetID::SET];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::ETD - 2 ] = hitNumbers[lcio::ILDDetID::ETD];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::VXD - 1 ] = hitNumbers[lcio::ILDDetID::VXD];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::FTD - 1 ] = hitNumbers[lcio::ILDDetID::FTD];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SIT - 1 ] = hitNumbers[lcio::ILDDetID::SIT];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::TPC - 1 ] = hitNumbers[lcio::ILDDetID::TPC];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SET - 1 ] = hitNumbers[lcio::ILDDetID::SET];
-   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::ETD - 1 ] = hitNumbers[lcio::ILDDetID::ETD];
+   MarlinTrk::IMarlinTrkSystem* trkSystem = new MarlinTrk::MarlinDDKalTest();
    
+   // This instance is not shared with anyone else, so the options can be set once here and don't need
+   // to be set again for every event.
+   trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useQMS,        _MSOn ) ;       //multiple scattering
+   trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::usedEdx,       _ElossOn) ;     //energy loss
+   trkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing,  _SmoothOn) ;    //smoothing
    
-   return;
+   trkSystem->init() ;
    
+   return trkSystem;
    
 }
 
@@ -0,0 +1,1965 @@
+#include "ForwardTrackingEngine.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <sstream>
+
+#include "EVENT/TrackerHit.h"
+#include "EVENT/Track.h"
+#include "IMPL/TrackStateImpl.h"
+#include "IMPL/TrackerHitPlaneImpl.h"
+#include "UTIL/LCTrackerConf.h"
+#include <UTIL/ILDConf.h>
+
+#include "marlin/VerbosityLevels.h"
+
+//----From KiTrack-----------------------------
+#include "KiTrack/SubsetHopfieldNN.h"
+#include "KiTrack/SubsetSimple.h"
+#include "KiTrack/SegmentBuilder.h"
+#include "KiTrack/Automaton.h"
+
+//----From KiTrackMarlin-----------------------
+#include "Criteria/Criteria.h"
+#include "AutomatonRunner.h"
+#include "FTDFittedTrack.h"
+#include "HitConnectionGraph.h"
+#include "SectorLocalCriterion.h"
+#include "SparseHopfieldNN.h"
+#include "TrackConflictGraph.h"
+#include "ILDImpl/FTDHit01.h"
+#include "ILDImpl/FTDHitSimple.h"
+#include "ILDImpl/FTDNeighborPetalSecCon.h"
+#include "ILDImpl/FTDSectorConnector.h"
+#include "Tools/KiTrackMarlinTools.h"
+#include "Tools/KiTrackMarlinCEDTools.h"
+#include "Tools/FTDHelixFitter.h"
+
+#include "TMath.h"
+
+
+using namespace lcio ;
+using namespace KiTrack;
+using namespace KiTrackMarlin;
+
+
+namespace{
+   
+   
+   /** Releases the Kalman fit a track candidate keeps for the output, when it is clear that it won't be in the output */
+   void releaseFitters( const std::vector< ITrack* >& tracks ){
+      
+      for( unsigned i=0; i < tracks.size(); i++ ){
+         
+         FTDFittedTrack* fittedTrack = dynamic_cast< FTDFittedTrack* >( tracks[i] );
+         if( fittedTrack != NULL ) fittedTrack->releaseFitter();
+         
+      }
+      
+   }
+   
+   
+}
+
+
+ForwardTrackingEngine::ForwardTrackingEngine( const Config& config, const SectorSystemFTD* sectorSystemFTD, unsigned nSectors,
+                                              const std::vector< MarlinTrk::IMarlinTrkSystem* >& trkSystems ):
+_config( config ),
+_sectorSystemFTD( sectorSystemFTD ),
+_nSectors( nSectors ),
+_trkSystems( trkSystems ),
+_trkSystemPool( NULL ),
+_threadPool( NULL ),
+_criteriaRounds( NULL ),
+_subsetExactHybrid( NULL ),
+_connectionPredictor( NULL ),
+_stageTimer( NULL ),
+_eventContextPool( NULL ),
+_nEvents( 0 ),
+_nEventsOverTime( 0 ),
+_nAutomatonStoppedOverTime( 0 ),
+_nVersionsSkippedOverTime( 0 ),
+_nRawTracksSkippedOverTime( 0 ),
+_nSubsetsSimplifiedOverTime( 0 ),
+_nHelixAccepted( 0 ),
+_nKalmanFits( 0 ),
+_nTrackCandidates( 0 ),
+_nTrackCandidatesPlus( 0 ),
+_arenaBytesMax( 0 ),
+_arenaBytesSum( 0 ){
+   
+   
+   /**********************************************************************************************/
+   /*       Do a few checks, if the set parameters are right                                     */
+   /**********************************************************************************************/
+   
+   assert( !_trkSystems.empty() );
+   
+   // Only use allowed methods to find subsets. 
+   assert( ( _config.bestSubsetFinder == "None" ) || ( _config.bestSubsetFinder == "SubsetHopfieldNN" ) || ( _config.bestSubsetFinder == "SubsetHopfieldNNComponents" )
+           || ( _config.bestSubsetFinder == "SubsetExactHybrid" ) || ( _config.bestSubsetFinder == "SubsetSimple" ) );
+   
+   // Only use allowed methods to add hits from overlapping petals
+   assert( ( _config.overlappingHitsAssignment == "Combinations" ) || ( _config.overlappingHitsAssignment == "HelixPrediction" ) );
+   
+   // Use a sensible chi2prob cut. (chi squared probability, like any probability must range from 0 to 1)
+   assert( _config.chi2ProbCut >= 0. );
+   assert( _config.chi2ProbCut <= 1. );
+   
+   
+   // Make sure, every used criterion exists and has at least one min and max set
+   for( unsigned i=0; i<_config.criteriaNames.size(); i++ ){
+      
+      std::string critName = _config.criteriaNames[i];
+      
+      ICriterion* crit = Criteria::createCriterion( critName ); //throws an exception if the criterion is non existent
+      delete crit;
+      
+      assert( !_config.critMinima[ critName ].empty() );
+      assert( !_config.critMaxima[ critName ].empty() );
+      
+   }
+   
+   
+   /**********************************************************************************************/
+   /*       Threads for fitting the track candidates                                             */
+   /**********************************************************************************************/
+   
+   unsigned nThreads = _trkSystems.size();
+   
+   if( nThreads > 1 && _config.threadsWithinEvent ) _threadPool = new WorkStealingThreadPool( nThreads );
+   
+   // the fits check a track system out for as long as they need it, so the threads of all events can share them
+   _trkSystemPool = new TrkSystemPool( _trkSystems );
+   
+   // the criteria of all rounds are made once here and only read during the events
+   // (local cut tightening needs the single criteria for its levels, so there are no chains then)
+   CriteriaChainSet chainSet = _config.criteriaChains && !_config.localCutTightening ? CRITERIA_CHAIN_FTD : CRITERIA_CHAIN_NONE;
+   _criteriaRounds = new CriteriaRounds( _config.criteriaNames, _config.critMinima, _config.critMaxima, chainSet );
+   
+   // (local cut tightening needs the criteria of all rounds in one order, that doesn't change during the event)
+   if( _config.criteriaReorderInterval > 0 && !_config.localCutTightening ) _criteriaRounds->monitorCriteria( _config.criteriaReorderInterval );
+   
+   if( _config.bestSubsetFinder == "SubsetExactHybrid" ){
+      
+      ExactSubsetSolver exactSolver( _config.subsetExactMaxTracks, _config.subsetExactMaxNodes );
+      SparseHopfieldNN hopfieldNN( _config.HNN_Omega, _config.HNN_ActivationThreshold, _config.HNN_TInf );
+      
+      _subsetExactHybrid = new SubsetExactHybrid( exactSolver, hopfieldNN, _config.subsetExactCompareHNN );
+      
+   }
+   
+   // (with local cut tightening there is no global round to start in)
+   if( _config.predictStartRound && !_config.localCutTightening ){
+      
+      // the number of rounds of criteria is the longest list of values of a criterion
+      unsigned nRounds = 1;
+      
+      for( unsigned i=0; i < _config.criteriaNames.size(); i++ ){
+         
+         nRounds = std::max( nRounds, unsigned( _config.critMinima[ _config.criteriaNames[i] ].size() ) );
+         nRounds = std::max( nRounds, unsigned( _config.critMaxima[ _config.criteriaNames[i] ].size() ) );
+         
+      }
+      
+      _connectionPredictor = new ConnectionPredictor( nRounds );
+      
+   }
+   
+   if( _config.timeStages ){
+      
+      // the names must be in the order of the enum Stage
+      std::vector< std::string > stageNames;
+      stageNames.push_back( "ReadHits" );
+      stageNames.push_back( "OverlapMap" );
+      stageNames.push_back( "SegmentBuilder" );
+      stageNames.push_back( "Automaton2Hit" );
+      stageNames.push_back( "Automaton3Hit" );
+      stageNames.push_back( "HelixFit" );
+      stageNames.push_back( "KalmanFit" );
+      stageNames.push_back( "BestSubset" );
+      stageNames.push_back( "FinaliseTrack" );
+      
+      _stageTimer = new StageTimer( stageNames );
+      
+   }
+   
+   _eventContextPool = new EventContextPool( _stageTimer != NULL ? _stageTimer->getNumberOfStages() : 0 );
+   
+}
+
+
+ForwardTrackingEngine::~ForwardTrackingEngine(){
+   
+   
+   delete _criteriaRounds;
+   _criteriaRounds = NULL;
+   
+   delete _trkSystemPool;
+   _trkSystemPool = NULL;
+   
+   delete _threadPool;
+   _threadPool = NULL;
+   
+   delete _subsetExactHybrid;
+   _subsetExactHybrid = NULL;
+   
+   delete _stageTimer;
+   _stageTimer = NULL;
+   
+   delete _eventContextPool;
+   _eventContextPool = NULL;
+   
+   delete _connectionPredictor;
+   _connectionPredictor = NULL;
+   
+}
+
+
+void ForwardTrackingEngine::reconstruct( const std::vector< Hit >& hits, Result& result ){
+   
+   
+   result = Result();
+   
+   unsigned nEvent = _nEvents++;
+   
+   // All the state of this event lives in its context: the hits by sector, the quality (we start with the assumption
+   // that our results are good, if anything happens along the way, it gets lowered), the time budget and the times of
+   // the stages. All hits and track candidates are created in the arenas of the context and get destroyed, when
+   // the context is given back at the end of the event. (Its memory is kept for the next events.)
+   EventContextPool::Lease ctxLease( *_eventContextPool, QUALITY_GOOD, _config.maxEventTimeMs );
+   EventContext& ctx = ctxLease.get();
+   
+   SectorHitStore& sectorHitStore = ctx.getSectorHitStore();
+   sectorHitStore.reset( _nSectors );
+   unsigned nFTDHits = 0;
+   
+   EventArena& eventArena = ctx.getArena();
+   
+   
+   /**********************************************************************************************/
+   /*    Create hits from the TrackerHits and store them by sector                               */
+   /**********************************************************************************************/
+   
+   StageTimer::Scope timeReadHits( ctx.getStageTimes(), STAGE_READ_HITS );
+   
+   for( unsigned i=0; i < hits.size(); i++ ){
+      
+      
+      TrackerHit* trackerHit = hits[i].trackerHit;
+      
+      if( trackerHit == NULL && hits[i].du > 0. ){
+         
+         // (the covariance matrix of a planar hit follows from u, v and their resolutions)
+         TrackerHitPlaneImpl* trackerHitPlane = new TrackerHitPlaneImpl();
+         trackerHitPlane->setPosition( hits[i].position );
+         trackerHitPlane->setU( hits[i].u[0], hits[i].u[1] );
+         trackerHitPlane->setV( hits[i].v[0], hits[i].v[1] );
+         trackerHitPlane->setdU( hits[i].du );
+         trackerHitPlane->setdV( hits[i].dv );
+         trackerHitPlane->setType( hits[i].type );
+         trackerHitPlane->setCellID0( hits[i].cellID0 );
+         
+         result.trackerHits.push_back( std::unique_ptr< TrackerHit >( trackerHitPlane ) );
+         trackerHit = trackerHitPlane;
+         
+      }
+      else if( trackerHit == NULL ){
+         
+         TrackerHitImpl* trackerHitImpl = new TrackerHitImpl();
+         trackerHitImpl->setPosition( hits[i].position );
+         trackerHitImpl->setCovMatrix( hits[i].covMatrix );
+         trackerHitImpl->setType( hits[i].type );
+         trackerHitImpl->setCellID0( hits[i].cellID0 );
+         
+         result.trackerHits.push_back( std::unique_ptr< TrackerHit >( trackerHitImpl ) );
+         trackerHit = trackerHitImpl;
+         
+      }
+      
+      streamlog_out(DEBUG1) << "hit" << i << " " << KiTrackMarlin::getCellID0Info( trackerHit->getCellID0() ) 
+      << " " << KiTrackMarlin::getPositionInfo( trackerHit )<< "\n";
+      
+      //Make an FTDHit01 from the TrackerHit 
+      FTDHit01* ftdHit = eventArena.create< FTDHit01 >( trackerHit , _sectorSystemFTD );
+      
+      sectorHitStore.addHit( ftdHit );
+      nFTDHits++;
+      
+   }
+   
+   timeReadHits.stop();
+   
+   
+   if( nFTDHits > 0 ){
+      
+      
+      /**********************************************************************************************/
+      /*                Add the IP as virtual hit for forward and backward                          */
+      /**********************************************************************************************/
+      
+      // (They are not taken into account when looking for hits on overlapping petals)
+      sectorHitStore.addHit( createVirtualIPHit( 1 , eventArena ) );
+      sectorHitStore.addHit( createVirtualIPHit( -1 , eventArena ) );
+      
+      // sort all hits into their sectors
+      sectorHitStore.build();
+      
+      
+      /**********************************************************************************************/
+      /*                Check if no sector is overflowing with hits                                 */
+      /**********************************************************************************************/
+      
+      
+      const std::vector< int >& occupiedSectors = sectorHitStore.getOccupiedSectors();
+      
+      for( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
+         
+         int sector = occupiedSectors[iSec];
+         
+         int nHits = sectorHitStore.getNumberOfHits( sector );
+         streamlog_out( DEBUG2 ) << "Number of hits in sector " << sector << " = " << nHits << "\n";
+         
+         if( nHits > _config.maxHitsPerSector && _config.localCutTightening && _criteriaRounds->getNumberOfRounds() > 1 ){
+            
+            // keep the hits, but start the sector with the cut off values of the next round
+            // (with only one round there are no tighter cuts, so the sector gets dropped like without local cut tightening)
+            ctx.getHotSectors().push_back( sector );
+            
+            streamlog_out( DEBUG4 ) << "Number of hits in FTD sector " << sector << ": " << nHits << " > " << _config.maxHitsPerSector
+                                    << " (MaxHitsPerSector): the sector gets tighter cuts, QualityCode set to \"Fair\"\n";
+            
+            ctx.degradeQuality( QUALITY_FAIR );
+            
+         }
+         else if( nHits > _config.maxHitsPerSector ){
+            
+            sectorHitStore.clearSector( sector ); //delete the hits in this sector, it will be dropped
+            
+            // (the caller reports it, it knows which event this is)
+            result.droppedSectors.push_back( sector );
+            
+            ctx.degradeQuality( QUALITY_POOR ); // We had to drop hits, so the quality of the result is decreased
+            
+         }
+         
+      }
+      
+      /**********************************************************************************************/
+      /*                Check the possible connections of hits on overlapping petals                */
+      /**********************************************************************************************/
+      
+      streamlog_out( DEBUG4 ) << "\t\t---Overlapping Hits---\n" ;
+      
+      StageTimer::Scope timeOverlapMap( ctx.getStageTimes(), STAGE_OVERLAP_MAP );
+      
+      // (the finder keeps buffers while connecting, so every event needs its own)
+      OverlapHitFinder overlapHitFinder( _config.overlappingHitsDistMax );
+      
+      std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack = getOverlapConnectionMap( sectorHitStore, _sectorSystemFTD, overlapHitFinder );
+      
+      timeOverlapMap.stop();
+      
+      
+     
+      /**********************************************************************************************/
+      /*                Reconstruct the tracks                                                      */
+      /**********************************************************************************************/
+      
+      std::vector< ITrack* > tracks;
+      
+      if( !_config.splitSides ){
+         
+         tracks = reconstructTracks( sectorHitStore, occupiedSectors, map_hitFront_hitsBack, ctx );
+         
+      }
+      else{
+         
+         // No segment can connect hits from the forward and the backward side of the FTD, so both halves are
+         // completely independent problems. They get reconstructed separately (and in parallel if we have threads),
+         // each with its own virtual IP hit.
+         const int sides[2] = { 1, -1 };
+         
+         std::vector< int > sectorsSide[2];
+         std::vector< ITrack* > tracksSide[2];
+         
+         for( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
+            
+            int sector = occupiedSectors[iSec];
+            
+            unsigned nHits = sectorHitStore.getNumberOfHits( sector );
+            if( nHits == 0 ) continue;
+            
+            int iSide = ( _sectorSystemFTD->getSide( sector ) > 0 ) ? 0 : 1;
+            
+            sectorsSide[iSide].push_back( sector );
+            
+         }
+         
+         std::function< void( unsigned ) > reconstructSide = [&]( unsigned iSide ){
+            
+            streamlog_out( DEBUG4 ) << "\t\t---Reconstructing side " << sides[iSide] << "---\n" ;
+            
+            tracksSide[iSide] = reconstructTracks( sectorHitStore, sectorsSide[iSide], map_hitFront_hitsBack, ctx );
+            
+         };
+         
+         if( _threadPool != NULL ) _threadPool->parallelFor( 2, reconstructSide );
+         else for( unsigned iSide=0; iSide < 2; iSide++ ) reconstructSide( iSide );
+         
+         // merge: forward first, then backward
+         tracks = tracksSide[0];
+         tracks.insert( tracks.end(), tracksSide[1].begin(), tracksSide[1].end() );
+         
+      }
+      
+      
+      /**********************************************************************************************/
+      /*               Finally: Finalise the tracks                                                 */
+      /**********************************************************************************************/
+      
+      streamlog_out( DEBUG4 ) << "\t\t---Finalise Tracks---\n" ;
+      
+      StageTimer::Scope timeFinalise( ctx.getStageTimes(), STAGE_FINALISE );
+      
+      for (unsigned int i=0; i < tracks.size(); i++){
+         
+         FTDTrack* myTrack = dynamic_cast< FTDTrack* >( tracks[i] );
+         
+         if( myTrack != NULL ){
+            
+            
+            TrackImpl* trackImpl = new TrackImpl( *(myTrack->getLcioTrack()) );
+            
+            try{
+               
+               // the Kalman fit of the track candidate is reused
+               FTDFittedTrack* fittedTrack = dynamic_cast< FTDFittedTrack* >( myTrack );
+               
+               if( fittedTrack != NULL ) finaliseTrack( trackImpl, fittedTrack->getFitter(), fittedTrack->getTrkSystem() );
+               else finaliseTrack( trackImpl, NULL, NULL );
+               result.tracks.push_back( trackImpl );
+               
+            }
+            catch( FitterException& e ){
+               
+               streamlog_out( DEBUG4 ) << "ForwardTrackingEngine: track couldn't be finalized due to fitter error: " << e.what() << "\n";
+               delete trackImpl;
+            }
+            
+            
+         }
+         
+         
+      }
+      
+      timeFinalise.stop();
+      
+      streamlog_out (DEBUG5) << "Forward Tracking found " << result.tracks.size() << " tracks in event " << nEvent << "\n\n"; 
+      
+      
+   }
+   
+   // the hot sectors that had to be dropped after all
+   std::vector< int > droppedSectors = ctx.getDroppedSectors();
+   result.droppedSectors.insert( result.droppedSectors.end(), droppedSectors.begin(), droppedSectors.end() );
+   
+   result.quality = Quality( ctx.getQuality() );
+   result.isOverTime = ctx.wasOverTime();
+   
+   if( _stageTimer != NULL ){
+      
+      for( unsigned i=0; i < _stageTimer->getNumberOfStages(); i++ ) result.stageTimesMs.push_back( ctx.getStageTimes()->get( i ) );
+      
+      _stageTimer->addEvent( *ctx.getStageTimes() );
+      
+   }
+   
+   
+   /**********************************************************************************************/
+   /*                Statistics                                                                  */
+   /**********************************************************************************************/
+   
+   // (the hits and tracks of this event get destroyed, when the context is given back)
+   std::size_t arenaBytes = ctx.getArenaBytesUsed();
+   
+   streamlog_out( DEBUG4 ) << "Event arenas held " << ctx.getArenaObjects() << " objects in " << arenaBytes << " bytes\n";
+   
+   std::size_t arenaBytesMax = _arenaBytesMax;
+   while( arenaBytes > arenaBytesMax && !_arenaBytesMax.compare_exchange_weak( arenaBytesMax, arenaBytes ) ){}
+   
+   _arenaBytesSum += arenaBytes;
+   
+   if( ctx.wasOverTime() ) _nEventsOverTime++;
+   
+   _criteriaRounds->countEvent();
+   
+}
+
+
+void ForwardTrackingEngine::printSummary( const std::string& name ) const {
+   
+   
+   if( _subsetExactHybrid != NULL ) _subsetExactHybrid->printSummary( name );
+   
+   if( _config.maxEventTimeMs > 0. ){
+      
+      streamlog_out( MESSAGE ) << _nEventsOverTime << " events took longer than " << _config.maxEventTimeMs << " ms (MaxEventTimeMs): "
+                               << _nAutomatonStoppedOverTime << " times the automaton was stopped, "
+                               << _nVersionsSkippedOverTime << " versions with overlapping hits and "
+                               << _nRawTracksSkippedOverTime << " raw tracks were not fitted, "
+                               << _nSubsetsSimplifiedOverTime << " times SubsetSimple was used instead of the Hopfield Neural Network\n";
+      
+   }
+   
+   streamlog_out( DEBUG4 ) << _nKalmanFits << " Kalman fits were done for " << _nHelixAccepted << " track candidates passing the helix fit\n";
+   
+   if( _stageTimer != NULL ) _stageTimer->printSummary( name );
+   
+   if( _connectionPredictor != NULL ) _connectionPredictor->printSummary();
+   
+   _criteriaRounds->printCriteriaOrder( name );
+   
+   if( _nEvents > 0 ){
+      
+      streamlog_out( MESSAGE ) << "Event arenas: maximum of " << _arenaBytesMax << " bytes used in one event, mean " 
+                               << double( _arenaBytesSum ) / _nEvents << " bytes per event\n";
+      
+   }
+   
+   streamlog_out( DEBUG3 ) << "There are " << _nTrackCandidates << "track candidates from CA and "<<  _nTrackCandidatesPlus
+      << " track Candidates with hits from overlapping hits\n"
+      << "The ratio is " << float( _nTrackCandidatesPlus )/_nTrackCandidates;
+   
+}
+
+
+std::map< IHit* , std::vector< IHit* > > ForwardTrackingEngine::getOverlapConnectionMap( 
+            const SectorHitStore& sectorHitStore, 
+            const SectorSystemFTD* secSysFTD,
+            OverlapHitFinder& overlapHitFinder){
+   
+   
+   unsigned nConnections=0;
+
+   
+   std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack;
+   
+   const std::vector< int >& occupiedSectors = sectorHitStore.getOccupiedSectors();
+   
+   // gets the neighbouring petals
+   FTDNeighborPetalSecCon secCon( secSysFTD );
+   
+   //for every sector
+   for ( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
+      
+     
+      int sector = occupiedSectors[iSec];
+      
+      unsigned nHitsA = sectorHitStore.getNumberOfHits( sector );
+      if( nHitsA == 0 ) continue;
+      
+      IHit* const* hitsA = sectorHitStore.getHits( sector );
+      
+      std::set< int > targetSectors = secCon.getTargetSectors( sector );
+      
+      
+      //for all neighbouring petals
+      for ( std::set<int>::iterator itTarg = targetSectors.begin(); itTarg!=targetSectors.end(); itTarg++ ){
+         
+         
+         unsigned nHitsB = sectorHitStore.getNumberOfHits( *itTarg );
+         if( nHitsB == 0 ) continue;
+         
+         IHit* const* hitsB = sectorHitStore.getHits( *itTarg );
+         
+         // connect the hits that are close enough and where B is behind A
+         nConnections += overlapHitFinder.connect( hitsA, nHitsA, hitsB, nHitsB, map_hitFront_hitsBack );
+         
+      }
+     
+   }
+   
+   streamlog_out( DEBUG3 ) << "Connected " << map_hitFront_hitsBack.size() << " hits with " << nConnections << " possible overlapping hits\n";
+   
+   
+   return map_hitFront_hitsBack;
+   
+   
+   
+}
+
+
+std::string ForwardTrackingEngine::getInfo_map_sector_hits( const SectorHitStore& sectorHitStore ) const {
+   
+   
+   std::stringstream s;
+   
+   const std::vector< int >& occupiedSectors = sectorHitStore.getOccupiedSectors();
+   
+   for( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
+      
+      
+      int sector = occupiedSectors[iSec];
+      
+      int side = _sectorSystemFTD->getSide( sector );
+      unsigned layer = _sectorSystemFTD->getLayer( sector );
+      unsigned module = _sectorSystemFTD->getModule( sector );
+      unsigned sensor = _sectorSystemFTD->getSensor( sector );
+      
+      s << "sector " << sector  << " (si"
+      << side << ",la"
+      << layer << ",mo"
+      << module << "se,"
+      << sensor << ") has "
+      << sectorHitStore.getNumberOfHits( sector ) << " hits\n";
+      
+      
+   }  
+   
+   
+   return s.str();   
+   
+}
+
+std::vector < RawTrack > ForwardTrackingEngine::getRawTracksPlusOverlappingHits( RawTrack rawTrack , std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack ){
+   
+   
+   
+   // So we have a raw track (a vector of hits, that is) and a map, that tells us
+   // for every hit, if there is another hit in the overlapping region behind it very close,
+   // so that it could be part of the same track.
+   //
+   // We now want to find for a given track all possible tracks, when hits from the overlapping regions are added
+   //
+   // The method is this: start with pure track.
+   // Make a vector of rawTracks and fill in the pure track.
+   // For every hit on the original track do the following:
+   // Check if there are overlapping hits.
+   // For every overlapping hit take all the created tracks so far and make another version
+   // with the overlapping hit added to it and add them to the vector of rawTracks.
+   //
+   //
+   // Let's do an example: 
+   // the original hits in the track are calles A,B and C.
+   // A has one overlapping hit A1
+   // and B has two overlapping hits B1 and B2.
+   //
+   // So we start with a vector containing only the original track: {(A,B,C)}
+   //
+   // We start with the first hit: A. It has one overlapping hit A1.
+   // We take all tracks (which is the original one so far) and make another version containing A1 as well.
+   // Then we add it to the vector of tracks:
+   //
+   // {(A,B,C)(A,A1,B,C)}
+   //
+   // On to the next hit from the original track: B. Here we have overlapping hits B1 and B2.
+   // We take all the tracks so far and add versions with B1: (A,B,B1,C) and (A,A1,B,B1,C)
+   // We don't immediately add them or otherwise, we would create a track containing B1 as well as B2, which is plainly wrong
+   //
+   // So instead we make the combinations with B2: (A,B,B2,C) and (A,A1,B,B2,C)
+   // And now having gone through all overlapping hits of B, we add all the new versions to the vector:
+   //
+   // {(A,B,C)(A,A1,B,C)(A,B,B1,C)(A,A1,B,B1,C)(A,B,B2,C)(A,A1,B,B2,C)}
+   //
+   // So now we have all possible versions of the track with overlapping hits
+   
+   std::vector < RawTrack > rawTracksPlus;
+   
+   rawTracksPlus.push_back( rawTrack ); //add the original one
+   
+   // for every hit in the original track
+   for( unsigned i=0; i < rawTrack.size(); i++ ){
+      
+     
+      IHit* frontHit = rawTrack[i];
+      
+      // get the hits that are behind frontHit
+      std::map< IHit* , std::vector< IHit* > >::iterator it;
+      it = map_hitFront_hitsBack.find( frontHit );
+      if( it == map_hitFront_hitsBack.end() ) continue; // if there are no hits on the back skip this one
+      std::vector< IHit* > backHits = it->second; 
+      
+      
+      // Create the different versions of the tracks so far with the hits from the back
+      
+      std::vector< RawTrack > newVersions; //here we store all the versions with overlapping hits from the different back hits at this frontHit
+      
+      // for every hit in back of the frontHit
+      for( unsigned j=0; j<backHits.size(); j++ ){
+         
+         
+         IHit* backHit = backHits[j];
+         
+         // for all tracks we have so far
+         for( unsigned k=0; k<rawTracksPlus.size(); k++ ){
+            
+            
+            RawTrack newVersion = rawTracksPlus[k];     // exact copy of the track
+            newVersion.push_back( backHit );          // add the backHit to it   
+            newVersions.push_back( newVersion );         // store it
+            
+         }
+         
+      }
+      
+      // Now put all the new versions of the tracks into the rawTracksPlus vector before we go on to the next
+      // hit of the original track
+      rawTracksPlus.insert( rawTracksPlus.end(), newVersions.begin(), newVersions.end() );
+      
+      
+   }
+   
+   
+   
+   return rawTracksPlus;
+   
+}
+
+
+std::vector < RawTrack > ForwardTrackingEngine::getRawTracksPlusPredictedOverlappingHits( const RawTrack& rawTrack , std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack ){
+   
+   
+   // Instead of trying every combination of hits from overlapping petals, the raw track gets fitted with a helix
+   // once. For every hit of the raw track with hits behind it, the helix is extrapolated to the z of each of the
+   // hits behind and the one closest to the prediction (in terms of chi2) is taken, if it is good enough.
+   // So there are at most two versions: the raw track and the raw track with the best matching overlapping hits.
+   
+   std::vector < RawTrack > rawTracksPlus;
+   
+   rawTracksPlus.push_back( rawTrack ); //add the original one
+   
+   
+   // check if there are any overlapping hits at all, before fitting
+   bool hasOverlappingHits = false;
+   
+   for( unsigned i=0; i < rawTrack.size(); i++ ){
+      
+      if( map_hitFront_hitsBack.find( rawTrack[i] ) != map_hitFront_hitsBack.end() ){
+         
+         hasOverlappingHits = true;
+         break;
+         
+      }
+      
+   }
+   
+   if( !hasOverlappingHits ) return rawTracksPlus;
+   
+   
+   /*-----------------------------------------------*/
+   /*                Helix Fit                      */
+   /*-----------------------------------------------*/
+   
+   std::vector< TrackerHit* > trackerHits;
+   
+   for( unsigned i=0; i < rawTrack.size(); i++ ){
+      
+      IFTDHit* ftdHit = dynamic_cast< IFTDHit* >( rawTrack[i] );
+      if( ftdHit != NULL && !ftdHit->isVirtual() && ftdHit->getTrackerHit() != NULL ) trackerHits.push_back( ftdHit->getTrackerHit() );
+      
+   }
+   
+   float omega = 0.;
+   float tanLambda = 0.;
+   float phi0 = 0.;
+   float d0 = 0.;
+   float z0 = 0.;
+   
+   try{
+      
+      FTDHelixFitter helixFitter( trackerHits );
+      
+      omega = helixFitter.getOmega();
+      tanLambda = helixFitter.getTanLambda();
+      phi0 = helixFitter.getPhi0();
+      d0 = helixFitter.getD0();
+      z0 = helixFitter.getZ0();
+      
+   }
+   catch( FTDHelixFitterException& e ){
+      
+      
+      streamlog_out( DEBUG2 ) << "Helix fit for predicting overlapping hits failed: " << e.what() << ". Only the raw track is used.\n";
+      return rawTracksPlus;
+      
+   }
+   
+   if( omega == 0. || tanLambda == 0. ) return rawTracksPlus;
+   
+   // the centre of the circle in xy (reference point is the origin)
+   double radius = 1. / omega; // signed
+   double xCentre = -d0*sin( phi0 ) - radius*sin( phi0 );
+   double yCentre =  d0*cos( phi0 ) + radius*cos( phi0 );
+   
+   
+   /*-----------------------------------------------*/
+   /*    Best matching hit behind every hit         */
+   /*-----------------------------------------------*/
+   
+   RawTrack rawTrackPlus = rawTrack;
+   
+   for( unsigned i=0; i < rawTrack.size(); i++ ){
+      
+      
+      std::map< IHit* , std::vector< IHit* > >::const_iterator it = map_hitFront_hitsBack.find( rawTrack[i] );
+      if( it == map_hitFront_hitsBack.end() ) continue;
+      
+      const std::vector< IHit* >& backHits = it->second;
+      
+      IHit* bestHit = NULL;
+      double bestChi2 = _config.overlappingHitsChi2Max;
+      
+      for( unsigned j=0; j < backHits.size(); j++ ){
+         
+         
+         IHit* backHit = backHits[j];
+         
+         // the predicted position at the z of the hit
+         double s = ( backHit->getZ() - z0 ) / tanLambda; // path length in xy
+         double phi = phi0 + omega*s;
+         double xPredicted = xCentre + radius*sin( phi );
+         double yPredicted = yCentre - radius*cos( phi );
+         
+         double dx = backHit->getX() - xPredicted;
+         double dy = backHit->getY() - yPredicted;
+         
+         double chi2 = getChi2XY( backHit, dx, dy );
+         
+         streamlog_out( DEBUG1 ) << "Overlapping hit " << backHit->getPositionInfo() << ": residual (" << dx << "," << dy << "), chi2 = " << chi2 << "\n";
+         
+         if( chi2 < bestChi2 ){
+            
+            bestChi2 = chi2;
+            bestHit = backHit;
+            
+         }
+         
+      }
+      
+      if( bestHit != NULL ){
+         
+         streamlog_out( DEBUG2 ) << "Adding overlapping hit " << bestHit->getPositionInfo() << " with chi2 = " << bestChi2 << "\n";
+         rawTrackPlus.push_back( bestHit );
+         
+      }
+      
+   }
+   
+   if( rawTrackPlus.size() > rawTrack.size() ) rawTracksPlus.push_back( rawTrackPlus );
+   
+   
+   return rawTracksPlus;
+   
+}
+
+
+void ForwardTrackingEngine::addToHelixFitter( IncrementalHelixFitter& helixFitter, IHit* hit ){
+   
+   
+   if( hit->isVirtual() ) return;
+   
+   IFTDHit* ftdHit = dynamic_cast< IFTDHit* >( hit );
+   
+   if( ftdHit != NULL && ftdHit->getTrackerHit() != NULL ) helixFitter.addHit( ftdHit->getTrackerHit() );
+   
+}
+
+
+double ForwardTrackingEngine::getChi2XY( IHit* hit, double dx, double dy ){
+   
+   
+   IFTDHit* ftdHit = dynamic_cast< IFTDHit* >( hit );
+   
+   if( ftdHit == NULL || ftdHit->getTrackerHit() == NULL ) return getChi2XY( EVENT::FloatVec(), dx, dy );
+   
+   return getChi2XY( ftdHit->getTrackerHit()->getCovMatrix(), dx, dy );
+   
+}
+
+
+double ForwardTrackingEngine::getChi2XY( const EVENT::FloatVec& cov, double dx, double dy ){
+   
+   
+   double covXX = 0.;
+   double covXY = 0.;
+   double covYY = 0.;
+   
+   if( cov.size() >= 3 ){ // (xx, yx, yy, zx, zy, zz)
+      
+      covXX = cov[0];
+      covXY = cov[1];
+      covYY = cov[2];
+      
+   }
+   
+   double det = covXX*covYY - covXY*covXY;
+   
+   if( det > 0. ) return ( dx*dx*covYY - 2.*dx*dy*covXY + dy*dy*covXX ) / det;
+   
+   // no usable covariance: fall back to the bigger of the two variances
+   double var = std::max( covXX, covYY );
+   if( var > 0. ) return ( dx*dx + dy*dy ) / var;
+   
+   // Not even that: we can't tell how good the hit matches, so it must never be chosen
+   return std::numeric_limits< double >::max();
+   
+}
+
+
+std::vector< ITrack* > ForwardTrackingEngine::fitRawTrack( const RawTrack& rawTrack, 
+                                                    std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack,
+                                                    MarlinTrk::IMarlinTrkSystem* trkSystem,
+                                                    unsigned& nVersions,
+                                                    EventContext& ctx ){
+   
+   
+   std::vector< ITrack* > trackCandidates;
+   
+   // get all versions of the track plus hits from overlapping petals
+   std::vector < RawTrack > rawTracksPlus;
+   
+   if( _config.overlappingHitsAssignment == "HelixPrediction" ) rawTracksPlus = getRawTracksPlusPredictedOverlappingHits( rawTrack, map_hitFront_hitsBack );
+   else rawTracksPlus = getRawTracksPlusOverlappingHits( rawTrack, map_hitFront_hitsBack );
+   
+   streamlog_out( DEBUG2 ) << "For the raw track there are " << rawTracksPlus.size() << " versions\n";
+   
+   
+   /**********************************************************************************************/
+   /*                Make track candidates, fit them and throw away bad ones                     */
+   /**********************************************************************************************/
+   
+   std::vector< ITrack* > overlappingTrackCands;
+   std::vector< double > overlappingHelixChi2Probs;
+   
+   nVersions = rawTracksPlus.size();
+   
+   // All versions start with the hits of the raw track, so with the incremental helix fit the raw track is
+   // fitted once here and every version only adds its additional hits.
+   IncrementalHelixFitter rawTrackHelixFitter;
+   if( _config.incrementalHelixFit ) for( unsigned k=0; k < rawTrack.size(); k++ ) addToHelixFitter( rawTrackHelixFitter, rawTrack[k] );
+   
+   for( unsigned j=0; j < rawTracksPlus.size(); j++ ){
+      
+      // The first version is the raw track itself, the others only get fitted if there is time
+      if( j > 0 && ctx.isOverTime() ){
+         
+         streamlog_out( DEBUG3 ) << "Out of time: " << rawTracksPlus.size() - j << " versions with overlapping hits are skipped\n";
+         
+         _nVersionsSkippedOverTime += rawTracksPlus.size() - j;
+         ctx.degradeQuality( QUALITY_FAIR );
+         break;
+         
+      }
+      
+      RawTrack rawTrackPlus = rawTracksPlus[j];
+      
+      if( rawTrackPlus.size() < unsigned( _config.hitsPerTrackMin ) ){
+         
+         streamlog_out( DEBUG1 ) << "Trackversion discarded, too few hits: only " << rawTrackPlus.size() << " < " << _config.hitsPerTrackMin << "(hitsPerTrackMin)\n";
+         continue;
+         
+      }
+      
+      FTDFittedTrack* trackCand = ctx.getArena().create< FTDFittedTrack >( trkSystem );
+      
+      // add the hits to the track
+      for( unsigned k=0; k<rawTrackPlus.size(); k++ ){
+         
+         IFTDHit* ftdHit = dynamic_cast< IFTDHit* >( rawTrackPlus[k] ); // cast to IFTDHits, as needed for an FTDTrack
+         if( ftdHit != NULL ) trackCand->addHit( ftdHit );
+         else streamlog_out( DEBUG4 ) << "Hit " << rawTrackPlus[k] << " could not be casted to IFTDHit\n";
+         
+      }
+      
+      std::vector< IHit* > trackCandHits = trackCand->getHits();
+      streamlog_out( DEBUG2 ) << "Fitting track candidate with " << trackCandHits.size() << " hits\n";
+      
+      for( unsigned k=0; k < trackCandHits.size(); k++ ) streamlog_out( DEBUG1 ) << trackCandHits[k]->getPositionInfo();
+      streamlog_out( DEBUG1 ) << "\n";
+      
+      /*-----------------------------------------------*/
+      /*                Helix Fit                      */
+      /*-----------------------------------------------*/
+      
+      streamlog_out( DEBUG2 ) << "Fitting with Helix Fit\n";
+      
+      double helixChi2Prob = 0.;
+      
+      // The chi2 of the helix fit is far above the ndf even for good tracks (they may have a chi2/ndf up to HelixFitMax),
+      // so its plain probability is about 0 for nearly all of them. For the quality of the tracks it is scaled so that
+      // HelixFitMax becomes a chi2/ndf of 1.
+      double helixChi2Scale = ( _config.helixFitMax > 0. ) ? 1. / _config.helixFitMax : 1.;
+      
+      try{
+         
+         StageTimer::Scope timeHelixFit( ctx.getStageTimes(), STAGE_HELIX_FIT );
+         
+         float chi2OverNdf = 0.;
+         
+         if( _config.incrementalHelixFit ){
+            
+            IncrementalHelixFitter helixFitter( rawTrackHelixFitter );
+            for( unsigned k=rawTrack.size(); k < rawTrackPlus.size(); k++ ) addToHelixFitter( helixFitter, rawTrackPlus[k] );
+            
+            helixFitter.fit();
+            chi2OverNdf = helixFitter.getChi2() / float( helixFitter.getNdf() );
+            helixChi2Prob = TMath::Prob( helixChi2Scale*helixFitter.getChi2(), helixFitter.getNdf() );
+            
+         }
+         else{
+            
+            FTDHelixFitter helixFitter( trackCand->getLcioTrack() );
+            chi2OverNdf = helixFitter.getChi2() / float( helixFitter.getNdf() );
+            helixChi2Prob = TMath::Prob( helixChi2Scale*helixFitter.getChi2(), helixFitter.getNdf() );
+            
+         }
+         
+         streamlog_out( DEBUG2 ) << "chi2OverNdf = " << chi2OverNdf << "\n";
+         
+         if( chi2OverNdf > _config.helixFitMax ){
+            
+            streamlog_out( DEBUG2 ) << "Discarding track because of bad helix fit: chi2/ndf = " << chi2OverNdf << "\n";
+            continue;
+            
+         }
+         else streamlog_out( DEBUG2 ) << "Keeping track because of good helix fit: chi2/ndf = " << chi2OverNdf << "\n";
+         
+      }
+      catch( FTDHelixFitterException& e ){
+         
+         
+         streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
+         continue;
+         
+      }
+      catch( IncrementalHelixFitterException& e ){
+         
+         
+         streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
+         continue;
+         
+      }
+      
+      /*-----------------------------------------------*/
+      /*                Kalman Fit                      */
+      /*-----------------------------------------------*/
+      
+      _nHelixAccepted++;
+      
+      trackCand->setHelixChi2Prob( helixChi2Prob );
+      
+      // With the helix QI preselection only the tracks surviving a first best subset get a Kalman fit (later)
+      if( !_config.helixQIPreselection && !kalmanFit( trackCand, ctx ) ) continue;
+      
+      // If we reach this point than the track got accepted by all cuts
+      overlappingTrackCands.push_back( trackCand );
+      overlappingHelixChi2Probs.push_back( helixChi2Prob );
+      
+   }
+   
+   /**********************************************************************************************/
+   /*                Take the best version of the track                                          */
+   /**********************************************************************************************/
+     // Now we have all versions of one track, coming from adding possible hits from overlapping petals.
+   
+   if( _config.takeBestVersionOfTrack ){ // we want to take only the best version
+      
+      
+      streamlog_out( DEBUG2 ) << "Take the version of the track with best quality from " << overlappingTrackCands.size() << " track candidates\n";
+      
+      if( !overlappingTrackCands.empty() ){
+         
+         unsigned best = 0;
+         
+         for( unsigned j=1; j < overlappingTrackCands.size(); j++ ){
+            
+            // the versions not taken stay in the event arena until the end of the event
+            // (without a Kalman fit yet, the helix fit decides)
+            if( _config.helixQIPreselection ){
+               
+               if( overlappingHelixChi2Probs[j] > overlappingHelixChi2Probs[best] ) best = j;
+               
+            }
+            else if( overlappingTrackCands[j]->getChi2Prob() > overlappingTrackCands[best]->getChi2Prob() ) best = j;
+            
+         }
+         streamlog_out( DEBUG2 ) << "Adding best track candidate with " << overlappingTrackCands[best]->getHits().size() << " hits\n";
+         
+         trackCandidates.push_back( overlappingTrackCands[best] );
+         
+         overlappingTrackCands.erase( overlappingTrackCands.begin() + best );
+         releaseFitters( overlappingTrackCands );
+         
+      }
+      
+   }
+   else{ // we take all versions
+      
+      streamlog_out( DEBUG2 ) << "Taking all " << overlappingTrackCands.size() << " versions of the track\n";
+      trackCandidates.insert( trackCandidates.end(), overlappingTrackCands.begin(), overlappingTrackCands.end() );
+      
+   }
+   
+   return trackCandidates;
+   
+}
+
+
+bool ForwardTrackingEngine::kalmanFit( FTDFittedTrack* trackCand, EventContext& ctx ){
+   
+   
+   streamlog_out( DEBUG2 ) << "Fitting with Kalman Filter\n";
+   
+   _nKalmanFits++;
+   
+   try{
+      
+      StageTimer::Scope timeKalmanFit( ctx.getStageTimes(), STAGE_KALMAN_FIT );
+         
+      trackCand->fit();
+         
+      streamlog_out( DEBUG2 ) << " Track " << trackCand 
+                              << " chi2Prob = " << trackCand->getChi2Prob() 
+                              << "( chi2=" << trackCand->getChi2() 
+                              <<", Ndf=" << trackCand->getNdf() << " )\n";
+         
+         
+      if ( trackCand->getChi2Prob() >= _config.chi2ProbCut ){
+         
+         streamlog_out( DEBUG2 ) << "Track accepted (chi2prob " << trackCand->getChi2Prob() << " >= " << _config.chi2ProbCut << "\n";
+         
+      }
+      else{
+         
+         streamlog_out( DEBUG2 ) << "Track rejected (chi2prob " << trackCand->getChi2Prob() << " < " << _config.chi2ProbCut << "\n";
+         
+         trackCand->releaseFitter();
+         return false;
+         
+      }
+      
+      
+   }
+   catch( FitterException& e ){
+      
+      
+      streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
+      return false;
+      
+   }
+   
+   return true;
+   
+}
+
+
+template< class TrackQI >
+void ForwardTrackingEngine::getBestSubset( const TrackConflictGraph& conflictGraph,
+                                     TrackQI& trackQI,
+                                     const std::string& bestSubsetFinder,
+                                     std::vector< ITrack* >& tracks,
+                                     std::vector< ITrack* >& rejected ) const {
+   
+   
+   // the conflicts between the tracks are looked up in the graph, instead of comparing the hits of every pair
+   const std::vector< ITrack* >& trackCandidates = conflictGraph.getTracks();
+   TrackCompatibilityConflictGraph comp( &conflictGraph );
+   
+   streamlog_out( DEBUG3 ) << conflictGraph.getNumberOfConflicts() << " conflicts between " << trackCandidates.size() << " track candidates\n";
+   
+   if( bestSubsetFinder == "SubsetHopfieldNN" ){
+      
+      streamlog_out( DEBUG3 ) << "Use SubsetHopfieldNN for getting the best subset\n" ;
+      
+      SubsetHopfieldNN< ITrack* > subset;
+      subset.setOmega( _config.HNN_Omega );
+      subset.setActivationThreshold( _config.HNN_ActivationThreshold );
+      subset.setTInf( _config.HNN_TInf );
+      subset.add( trackCandidates );
+      
+      
+      subset.calculateBestSet( comp, trackQI );
+      
+      tracks = subset.getAccepted();
+      rejected = subset.getRejected();
+      
+   }
+   else if( bestSubsetFinder == "SubsetHopfieldNNComponents" ){
+      
+      streamlog_out( DEBUG3 ) << "Use SubsetHopfieldNNComponents for getting the best subset\n" ;
+      
+      std::vector< double > QIs( trackCandidates.size() );
+      for( unsigned i=0; i < trackCandidates.size(); i++ ) QIs[i] = trackQI( trackCandidates[i] );
+      
+      SparseHopfieldNN hopfieldNN( _config.HNN_Omega, _config.HNN_ActivationThreshold, _config.HNN_TInf );
+      std::vector< bool > accepted = hopfieldNN.calculateBestSet( conflictGraph, QIs, _threadPool );
+      
+      for( unsigned i=0; i < trackCandidates.size(); i++ ){
+         
+         if( accepted[i] ) tracks.push_back( trackCandidates[i] );
+         else rejected.push_back( trackCandidates[i] );
+         
+      }
+      
+   }
+   else if( bestSubsetFinder == "SubsetExactHybrid" ){
+      
+      streamlog_out( DEBUG3 ) << "Use SubsetExactHybrid for getting the best subset\n" ;
+      
+      std::vector< double > QIs( trackCandidates.size() );
+      for( unsigned i=0; i < trackCandidates.size(); i++ ) QIs[i] = trackQI( trackCandidates[i] );
+      
+      std::vector< bool > accepted = _subsetExactHybrid->calculateBestSet( conflictGraph, QIs, _threadPool );
+      
+      for( unsigned i=0; i < trackCandidates.size(); i++ ){
+         
+         if( accepted[i] ) tracks.push_back( trackCandidates[i] );
+         else rejected.push_back( trackCandidates[i] );
+         
+      }
+      
+   }
+   else if( bestSubsetFinder == "SubsetSimple" ){
+      
+      streamlog_out( DEBUG3 ) << "Use SubsetSimple for getting the best subset\n" ;
+      
+      SubsetSimple< ITrack* > subset;
+      subset.add( trackCandidates );
+      subset.calculateBestSet( comp, trackQI );
+      tracks = subset.getAccepted();
+      rejected = subset.getRejected();
+      
+   }
+   else { // in any other case take all tracks
+      
+      streamlog_out( DEBUG3 ) << "Input for subset = \"" << bestSubsetFinder << "\". All tracks are kept\n" ;
+      
+      tracks = trackCandidates;
+      
+   }
+   
+}
+
+
+template< class AutomatonType >
+bool ForwardTrackingEngine::runAutomaton( AutomatonType& automaton,
+                                          const std::vector< ICriterion* >& crit3Vec,
+                                          const std::vector< ICriterion* >& crit4Vec,
+                                          const BatchedCriteria* crit3Batch,
+                                          const BatchedCriteria* crit4Batch,
+                                          std::vector< RawTrack >& rawTracks,
+                                          std::vector< unsigned >& sectorConnections,
+                                          unsigned& nConnectionsTooMany,
+                                          EventContext& ctx ){
+   
+   
+   AutomatonSettings settings;
+   settings.maxConnections = unsigned( _config.maxConnectionsAutomaton );
+   settings.drawSegments = _config.useCED;
+   settings.stopOverTime = true;
+   settings.stage2Hit = STAGE_AUTOMATON_2HIT;
+   settings.stage3Hit = STAGE_AUTOMATON_3HIT;
+   
+   AutomatonResult result = runCellularAutomaton( automaton, crit3Vec, crit4Vec, crit3Batch, crit4Batch, settings, ctx, rawTracks );
+   
+   if( result == AUTOMATON_TOO_MANY_CONNECTIONS ){
+      
+      if( _config.localCutTightening ) nConnectionsTooMany = countConnectionsPerSector( automaton, sectorConnections );
+      
+      return false;
+      
+   }
+   
+   if( result == AUTOMATON_STOPPED_OVER_TIME ){
+      
+      _nAutomatonStoppedOverTime++;
+      ctx.degradeQuality( QUALITY_POOR );
+      
+   }
+   
+   return true;
+   
+}
+
+
+std::vector< ITrack* > ForwardTrackingEngine::reconstructTracks( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                                                          std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack,
+                                                          EventContext& ctx ){
+   
+   
+   /**********************************************************************************************/
+   /*                SegmentBuilder and Cellular Automaton                                       */
+   /**********************************************************************************************/
+   
+   unsigned round = 0; // the round we are in
+   unsigned nRoundsDone = 0; // the rounds started in this event (the first one may be a later round than 0)
+   std::vector < RawTrack > rawTracks;
+   
+   // The criteria of the round. Without local cut tightening they are the shared ones of _criteriaRounds, 
+   // with it they are made for this call and deleted at its end.
+   std::vector< ICriterion* > crit2Vec;
+   std::vector< ICriterion* > crit3Vec;
+   std::vector< ICriterion* > crit4Vec;
+   
+   // The connections of the hits, kept over the rounds if the cuts are redone incrementally
+   HitConnectionGraph hitConnectionGraph;
+   
+   // The graph is needed to keep the connections, for the flat automaton, the batched criteria and to connect the sectors in parallel.
+   // Else the KiTrack::SegmentBuilder makes the segments directly.
+   bool useHitConnectionGraph = _config.reuseHitConnections || _config.flatAutomaton || _config.batchedCriteria || _threadPool != NULL;
+   
+   //Load hit connectors
+   unsigned layerStepMax = 1; // how many layers to go at max
+   unsigned petalStepMax = 1; // how many petals to go at max
+   unsigned lastLayerToIP = 5;// layer 1,2,3 and 4 get connected directly to the IP
+   FTDSectorConnector secCon( _sectorSystemFTD , layerStepMax , petalStepMax , lastLayerToIP );
+   
+   // Start directly in the first round that is expected to have not too many connections
+   double nHitPairs = 0.;
+   
+   if( _connectionPredictor != NULL ){
+      
+      nHitPairs = ConnectionPredictor::countHitPairs( sectorHitStore, sectors, &secCon );
+      
+      round = _connectionPredictor->getStartRound( nHitPairs, unsigned( _config.maxConnectionsAutomaton ) );
+      _connectionPredictor->countSkippedRounds( round );
+      
+      streamlog_out( DEBUG4 ) << nHitPairs << " possible hit pairs, starting in round " << round << "\n";
+      
+   }
+   
+   // With local cut tightening every sector has its own round of cut off values (its level). The criteria look
+   // at the sectors of the segments they check, so a new round only raises the levels of the sectors with the
+   // most connections, while the rest of the detector keeps its cuts.
+   std::vector< unsigned > sectorLevels;
+   std::vector< unsigned > sectorConnections;
+   unsigned nConnectionsTooMany = 0;
+   unsigned nLevels = 0;
+   
+   if( _config.localCutTightening ){
+      
+      sectorLevels.assign( _nSectors, 0 );
+      
+      // the sectors with too many hits start with the next level
+      const std::vector< int >& hotSectors = ctx.getHotSectors();
+      for( unsigned i=0; i < hotSectors.size(); i++ ) sectorLevels[ hotSectors[i] ] = 1;
+      
+      nLevels = createLocalCriteria( &sectorLevels, crit2Vec, crit3Vec, crit4Vec );
+      
+   }
+   
+   // The following while loop ideally only runs once. (So we do round 0 and everything works)
+   // It will repeat as long as the Automaton creates too many connections and as long as there are new criteria
+   // parameters to use to cut down the problem.
+   // Ideally already in round 0, there is a reasonable number of connections (not more than _config.maxConnectionsAutomaton), 
+   // so the loop will be left. If however there are too many connections we stay in the loop and use 
+   // (hopefully) tighter cut offs (if provided in the steering). This should prevent combinatorial breakdown
+   // for very evil events.
+   //
+   // With local cut tightening, the hot sectors that are still too busy with the tightest cuts get dropped in the end,
+   // as it is done right away without local cut tightening. They are dropped from a copy of the sectors.
+   const std::vector< int >* sectorsUsed = &sectors;
+   std::vector< int > sectorsKept;
+   
+   // the hits as a map, only for the KiTrack::SegmentBuilder
+   std::map< int , std::vector< IHit* > > map_sector_hits;
+   
+   std::function< bool() > dropHotSectorsFromCopy = [&](){
+      
+      if( sectorsUsed != &sectorsKept ) sectorsKept = sectors;
+      
+      if( !dropHotSectors( sectorLevels, nLevels, sectorsKept, ctx ) ) return false;
+      
+      sectorsUsed = &sectorsKept;
+      hitConnectionGraph.clear(); // the connections of the dropped hits must go as well
+      map_sector_hits.clear();
+      
+      return true;
+      
+   };
+   
+   while( _config.localCutTightening ? ( round == 0 || tightenHotSectors( sectorConnections, nConnectionsTooMany, sectorLevels, nLevels )
+                                         || dropHotSectorsFromCopy() )
+                              : getCriteria( round, crit2Vec, crit3Vec, crit4Vec ) ){
+      
+      
+      round++; // count up the round we are in
+      
+      // The same criteria checking many pairs at once. Not with local cut tightening, whose criteria depend on the sectors.
+      const BatchedCriteria* crit2Batch = NULL;
+      const BatchedCriteria* crit3Batch = NULL;
+      const BatchedCriteria* crit4Batch = NULL;
+      
+      if( _config.batchedCriteria && !_config.localCutTightening ){
+         
+         crit2Batch = _criteriaRounds->getCrit2Batch( round - 1 );
+         crit3Batch = _criteriaRounds->getCrit3Batch( round - 1 );
+         crit4Batch = _criteriaRounds->getCrit4Batch( round - 1 );
+         
+      }
+      
+      // A rerun only makes sense if there is time left. The first round is always done, else an event that is
+      // already over time here would end up without any tracks.
+      if( nRoundsDone > 0 && ctx.isOverTime() ){
+         
+         streamlog_out( DEBUG4 ) << "Out of time: round " << round - 1 << " of the automaton is not done, no tracks are reconstructed\n";
+         
+         _nAutomatonStoppedOverTime++;
+         ctx.degradeQuality( QUALITY_POOR );
+         break;
+         
+      }
+      
+      nRoundsDone++;
+      
+      
+      /**********************************************************************************************/
+      /*                Build the segments                                                          */
+      /**********************************************************************************************/
+      
+      streamlog_out( DEBUG4 ) << "\t\t---SegementBuilder---\n" ;
+      
+      StageTimer::Scope timeSegmentBuilder( ctx.getStageTimes(), STAGE_SEGMENT_BUILDER );
+      
+      if( useHitConnectionGraph ){
+         
+         // The cuts of a later round are tighter, so only the connections that survived the last round need to be checked again
+         // (without ReuseHitConnections the graph is built anew)
+         if( !_config.reuseHitConnections || !hitConnectionGraph.isBuilt() ){
+            
+            if( crit2Batch != NULL ) hitConnectionGraph.build( sectorHitStore, *sectorsUsed, &secCon, *crit2Batch, _threadPool );
+            else hitConnectionGraph.build( sectorHitStore, *sectorsUsed, &secCon, crit2Vec, _threadPool );
+            
+         }
+         else if( crit2Batch != NULL ) hitConnectionGraph.filter( *crit2Batch );
+         else hitConnectionGraph.filter( crit2Vec );
+         
+         if( _connectionPredictor != NULL ) _connectionPredictor->update( round - 1, nHitPairs, hitConnectionGraph.getNumberOfConnections() );
+         
+         // Check if there are not too many connections, before bothering to create the segments
+         // (with local cut tightening the segments are needed to find out where the connections are)
+         if( hitConnectionGraph.getNumberOfConnections() > unsigned( _config.maxConnectionsAutomaton ) && !_config.localCutTightening ){
+            
+            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
+            << "\tconnections( " << hitConnectionGraph.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _config.maxConnectionsAutomaton << " )\n";
+            continue;
+            
+         }
+         
+      }
+      
+      if( _config.flatAutomaton ){
+         
+         FlatAutomaton automaton( hitConnectionGraph );
+         
+         timeSegmentBuilder.stop();
+         
+         if( runAutomaton( automaton, crit3Vec, crit4Vec, crit3Batch, crit4Batch, rawTracks, sectorConnections, nConnectionsTooMany, ctx ) ) break;
+         
+         continue;
+         
+      }
+      
+      //Create a segmentbuilder (with no hits, if the segments come from the hit connection graph).
+      // Only it needs the hits as a map, which is made once and again after hot sectors got dropped.
+      if( !useHitConnectionGraph && map_sector_hits.empty() ) map_sector_hits = sectorHitStore.getMap( *sectorsUsed );
+      
+      const std::map< int , std::vector< IHit* > > noHits;
+      SegmentBuilder segBuilder( useHitConnectionGraph ? noHits : map_sector_hits );
+      
+      segBuilder.addCriteria ( crit2Vec ); // Add the criteria on when to connect two hits. The vector has been filled by the method createCriteria
+      
+      segBuilder.addSectorConnector ( & secCon ); // Add the sector connector (so the SegmentBuilder knows what hits from different sectors it is allowed to look for connections)
+      
+      
+      // And get out the Cellular Automaton with the 1-segments 
+      Automaton automaton = segBuilder.get1SegAutomaton();
+      
+      if( useHitConnectionGraph ) hitConnectionGraph.fillAutomaton( automaton );
+      else if( _connectionPredictor != NULL ) _connectionPredictor->update( round - 1, nHitPairs, automaton.getNumberOfConnections() );
+      
+      timeSegmentBuilder.stop();
+      
+      if( runAutomaton( automaton, crit3Vec, crit4Vec, crit3Batch, crit4Batch, rawTracks, sectorConnections, nConnectionsTooMany, ctx ) ) break;
+      
+   }
+   
+   streamlog_out( DEBUG4 ) << "Automaton returned " << rawTracks.size() << " raw tracks \n";
+   
+   
+   /**********************************************************************************************/
+   /*                Add the overlapping hits                                                    */
+   /**********************************************************************************************/
+   
+   
+   streamlog_out( DEBUG4 ) << "\t\t---Add hits from overlapping petals + fit + helix and Kalman cuts---\n" ;
+   
+   
+   std::vector <ITrack*> trackCandidates;
+   
+   // The raw tracks are independent of each other, so they are fitted in parallel. Every raw track writes
+   // into its own slot and the slots are joined in the original order afterwards, so the result is the same
+   // as when running serially.
+   std::vector< std::vector< ITrack* > > trackCandidatesPerRawTrack( rawTracks.size() );
+   std::vector< unsigned > nVersionsPerRawTrack( rawTracks.size(), 0 );
+   
+   std::function< void( unsigned ) > fitOne = [&]( unsigned i ){
+      
+      // Far over time: stop fitting
+      if( ctx.isOverTime( 2. ) ){
+         
+         _nRawTracksSkippedOverTime++;
+         ctx.degradeQuality( QUALITY_POOR );
+         return;
+         
+      }
+      
+      // (the track system stays checked out until all versions of the raw track are fitted)
+      TrkSystemPool::Lease trkSystem( *_trkSystemPool );
+      
+      trackCandidatesPerRawTrack[i] = fitRawTrack( rawTracks[i], map_hitFront_hitsBack, trkSystem.get(), nVersionsPerRawTrack[i], ctx );
+      
+   };
+   
+   if( _threadPool != NULL ) _threadPool->parallelFor( rawTracks.size(), fitOne );
+   else for( unsigned i=0; i < rawTracks.size(); i++ ) fitOne( i );
+   
+   
+   for( unsigned i=0; i < rawTracks.size(); i++){
+      
+      _nTrackCandidates++;
+      _nTrackCandidatesPlus += nVersionsPerRawTrack[i];
+      
+      trackCandidates.insert( trackCandidates.end(), trackCandidatesPerRawTrack[i].begin(), trackCandidatesPerRawTrack[i].end() );
+      
+   }
+   
+   
+   if( _config.useCED ){
+//          for( unsigned i=0; i < trackCandidates.size(); i++ ) KiTrackMarlin::drawTrackRandColor( trackCandidates[i] );
+   }
+   
+   /**********************************************************************************************/
+   /*               Get the best subset of tracks                                                */
+   /**********************************************************************************************/
+   
+   streamlog_out(DEBUG3) << "The track candidates so far: \n";
+   for( unsigned iTrack=0; iTrack < trackCandidates.size(); iTrack++ ){
+      
+      streamlog_out(DEBUG3) << "track " << iTrack << ": " << trackCandidates[iTrack] << "\t" << KiTrackMarlin::getTrackHitInfo( trackCandidates[iTrack] ) << "\n";
+      
+   }
+   
+   streamlog_out( DEBUG4 ) << "\t\t---Get best subset of tracks---\n" ;
+   
+   StageTimer::Scope timeBestSubset( ctx.getStageTimes(), STAGE_BEST_SUBSET );
+   
+   std::vector< ITrack* > tracks;
+   std::vector< ITrack* > rejected;
+   
+//       TrackQIChi2Prob trackQI;
+   TrackQIChi2ProbSpecial trackQIChi2ProbSpecial;
+   
+   
+   
+   // The Hopfield Neural Network takes much longer than SubsetSimple
+   std::string bestSubsetFinder = _config.bestSubsetFinder;
+   
+   if( ( bestSubsetFinder == "SubsetHopfieldNN" || bestSubsetFinder == "SubsetHopfieldNNComponents" ) && ctx.isOverTime() ){
+      
+      streamlog_out( DEBUG4 ) << "Out of time: SubsetSimple is used instead of SubsetHopfieldNN\n";
+      
+      bestSubsetFinder = "SubsetSimple";
+      _nSubsetsSimplifiedOverTime++;
+      ctx.degradeQuality( QUALITY_FAIR );
+      
+   }
+   
+   // the conflicts between the track candidates, built once for all subset passes
+   TrackConflictGraph conflictGraph( trackCandidates );
+   
+   if( !_config.helixQIPreselection ) getBestSubset( conflictGraph, trackQIChi2ProbSpecial, bestSubsetFinder, tracks, rejected );
+   else{
+      
+      
+      // First a best subset with the quality from the helix fits
+      TrackQIHelixChi2ProbSpecial trackQIHelixChi2ProbSpecial;
+      
+      std::vector< ITrack* > preselected;
+      std::vector< ITrack* > preRejected;
+      
+      getBestSubset( conflictGraph, trackQIHelixChi2ProbSpecial, bestSubsetFinder, preselected, preRejected );
+      
+      
+      // The Kalman fit may change the ranking between a track and the ones it is in conflict with, so these get fitted as well
+      std::vector< bool > isPreselected( trackCandidates.size(), false );
+      for( unsigned i=0; i < preselected.size(); i++ ) isPreselected[ conflictGraph.getIndex( preselected[i] ) ] = true;
+      
+      std::vector< ITrack* > tracksToFit = preselected;
+      
+      for( unsigned i=0; i < preRejected.size(); i++ ){
+         
+         const std::vector< unsigned >& conflicts = conflictGraph.getConflicts( conflictGraph.getIndex( preRejected[i] ) );
+         
+         for( unsigned j=0; j < conflicts.size(); j++ ){
+            
+            if( isPreselected[ conflicts[j] ] ){
+               
+               tracksToFit.push_back( preRejected[i] );
+               break;
+               
+            }
+            
+         }
+         
+      }
+      
+      streamlog_out( DEBUG3 ) << "Helix QI preselection: " << preselected.size() << " of " << trackCandidates.size() << " tracks accepted, "
+                              << tracksToFit.size() << " tracks get a Kalman fit\n";
+      
+      
+      // The tracks hold the track system they were created with, so for fitting in parallel every fit checks out
+      // a track system and makes a new track with it.
+      std::vector< ITrack* > fittedTracks( tracksToFit.size(), NULL );
+      
+      std::function< void( unsigned ) > kalmanFitOne = [&]( unsigned i ){
+         
+         TrkSystemPool::Lease trkSystem( *_trkSystemPool );
+         
+         FTDFittedTrack* trackCand = ctx.getArena().create< FTDFittedTrack >( trkSystem.get() );
+         
+         std::vector< IHit* > hits = tracksToFit[i]->getHits();
+         
+         for( unsigned k=0; k < hits.size(); k++ ){
+            
+            IFTDHit* ftdHit = dynamic_cast< IFTDHit* >( hits[k] );
+            if( ftdHit != NULL ) trackCand->addHit( ftdHit );
+            
+         }
+         
+         if( kalmanFit( trackCand, ctx ) ) fittedTracks[i] = trackCand;
+         
+      };
+      
+      if( _threadPool != NULL ) _threadPool->parallelFor( tracksToFit.size(), kalmanFitOne );
+      else for( unsigned i=0; i < tracksToFit.size(); i++ ) kalmanFitOne( i );
+      
+      
+      // Then the best subset again, from the tracks that survived the Kalman fit. They have the hits of the tracks
+      // they were fitted from, so their conflicts are taken from the graph.
+      std::vector< unsigned > kalmanIndices;
+      std::vector< ITrack* > kalmanTracks;
+      
+      for( unsigned i=0; i < fittedTracks.size(); i++ ){
+         
+         if( fittedTracks[i] == NULL ) continue;
+         
+         kalmanIndices.push_back( conflictGraph.getIndex( tracksToFit[i] ) );
+         kalmanTracks.push_back( fittedTracks[i] );
+         
+      }
+      
+      TrackConflictGraph kalmanConflictGraph( conflictGraph, kalmanIndices, kalmanTracks );
+      
+      getBestSubset( kalmanConflictGraph, trackQIChi2ProbSpecial, bestSubsetFinder, tracks, rejected );
+      
+      
+   }
+   
+   
+   if( _config.useCED ){
+//          for( unsigned i=0; i < tracks.size(); i++ ) KiTrackMarlin::drawTrack( tracks[i] , 0x00ff00 );
+//          for( unsigned i=0; i < rejected.size(); i++ ) KiTrackMarlin::drawTrack( rejected[i] , 0xff0000 );
+   }
+   
+   
+   // the rejected tracks get destroyed with the event arena, their fits are not needed until then
+   releaseFitters( rejected );
+   
+   // the local criteria belong to this call, the others to _criteriaRounds
+   if( _config.localCutTightening ){
+      
+      for ( unsigned i=0; i< crit2Vec.size(); i++) delete crit2Vec[i];
+      for ( unsigned i=0; i< crit3Vec.size(); i++) delete crit3Vec[i];
+      for ( unsigned i=0; i< crit4Vec.size(); i++) delete crit4Vec[i];
+      
+   }
+   
+   return tracks;
+   
+}
+
+unsigned ForwardTrackingEngine::createLocalCriteria( const std::vector< unsigned >* sectorLevels,
+                                               std::vector< ICriterion* >& crit2Vec,
+                                               std::vector< ICriterion* >& crit3Vec,
+                                               std::vector< ICriterion* >& crit4Vec ) const {
+   
+   
+   unsigned nLevels = _criteriaRounds->getNumberOfRounds();
+   
+   // the criteria of all rounds: [criterion][round]. Every round has the criteria in the same order.
+   std::vector< std::vector< ICriterion* > > crit2Levels( _criteriaRounds->getCrit2Vec( 0 ).size() );
+   std::vector< std::vector< ICriterion* > > crit3Levels( _criteriaRounds->getCrit3Vec( 0 ).size() );
+   std::vector< std::vector< ICriterion* > > crit4Levels( _criteriaRounds->getCrit4Vec( 0 ).size() );
+   
+   for( unsigned level=0; level < nLevels; level++ ){
+      
+      for( unsigned i=0; i < crit2Levels.size(); i++ ) crit2Levels[i].push_back( _criteriaRounds->getCrit2Vec( level )[i] );
+      for( unsigned i=0; i < crit3Levels.size(); i++ ) crit3Levels[i].push_back( _criteriaRounds->getCrit3Vec( level )[i] );
+      for( unsigned i=0; i < crit4Levels.size(); i++ ) crit4Levels[i].push_back( _criteriaRounds->getCrit4Vec( level )[i] );
+      
+   }
+   
+   // (the criteria of the levels stay with _criteriaRounds)
+   for( unsigned i=0; i < crit2Levels.size(); i++ ) crit2Vec.push_back( new SectorLocalCriterion( crit2Levels[i], sectorLevels, false ) );
+   for( unsigned i=0; i < crit3Levels.size(); i++ ) crit3Vec.push_back( new SectorLocalCriterion( crit3Levels[i], sectorLevels, false ) );
+   for( unsigned i=0; i < crit4Levels.size(); i++ ) crit4Vec.push_back( new SectorLocalCriterion( crit4Levels[i], sectorLevels, false ) );
+   
+   return nLevels;
+   
+}
+
+
+unsigned ForwardTrackingEngine::countConnectionsPerSector( Automaton& automaton, std::vector< unsigned >& sectorConnections ) const {
+   
+   
+   sectorConnections.assign( _nSectors, 0 );
+   
+   std::vector< const Segment* > segments = automaton.getSegments();
+   
+   for( unsigned i=0; i < segments.size(); i++ ){
+      
+      Segment* segment = const_cast< Segment* >( segments[i] );
+      
+      unsigned nChildren = segment->getChildren().size();
+      if( nChildren == 0 ) continue;
+      
+      // the connections count for all (real) hits of the parent segment
+      std::vector< IHit* > hits = segment->getHits();
+      
+      for( unsigned j=0; j < hits.size(); j++ ){
+         
+         if( hits[j]->isVirtual() ) continue;
+         
+         int sector = hits[j]->getSector();
+         if( sector >= 0 && unsigned( sector ) < _nSectors ) sectorConnections[sector] += nChildren;
+         
+      }
+      
+   }
+   
+   return automaton.getNumberOfConnections();
+   
+}
+
+
+unsigned ForwardTrackingEngine::countConnectionsPerSector( FlatAutomaton& automaton, std::vector< unsigned >& sectorConnections ) const {
+   
+   
+   sectorConnections.assign( _nSectors, 0 );
+   
+   automaton.countConnectionsPerSector( sectorConnections );
+   
+   return automaton.getNumberOfConnections();
+   
+}
+
+
+bool ForwardTrackingEngine::tightenHotSectors( const std::vector< unsigned >& sectorConnections, unsigned nConnections,
+                                         std::vector< unsigned >& sectorLevels, unsigned nLevels ) const {
+   
+   
+   // the sectors that can still get tighter cuts, the ones with the most connections first
+   std::vector< std::pair< unsigned , unsigned > > connections_sector;
+   double sum = 0.;
+   
+   for( unsigned sector=0; sector < sectorConnections.size(); sector++ ){
+      
+      sum += sectorConnections[sector];
+      
+      if( sectorConnections[sector] > 0 && sectorLevels[sector] + 1 < nLevels ) connections_sector.push_back( std::make_pair( sectorConnections[sector], sector ) );
+      
+   }
+   
+   if( connections_sector.empty() ) return false;
+   
+   std::sort( connections_sector.rbegin(), connections_sector.rend() );
+   
+   
+   // the share of the connections that has to go
+   double toCut = 0.;
+   if( nConnections > 0 ) toCut = sum * ( 1. - double( _config.maxConnectionsAutomaton ) / nConnections );
+   
+   double raised = 0.;
+   
+   for( unsigned i=0; i < connections_sector.size(); i++ ){
+      
+      unsigned sector = connections_sector[i].second;
+      
+      sectorLevels[sector]++;
+      raised += connections_sector[i].first;
+      
+      streamlog_out( DEBUG4 ) << "Sector " << sector << " has " << connections_sector[i].first << " connections, it gets the cut off values of round "
+                              << sectorLevels[sector] << "\n";
+      
+      if( raised >= toCut ) break;
+      
+   }
+   
+   return true;
+   
+}
+
+
+bool ForwardTrackingEngine::dropHotSectors( const std::vector< unsigned >& sectorLevels, unsigned nLevels,
+                                      std::vector< int >& sectors, EventContext& ctx ) const {
+   
+   
+   bool dropped = false;
+   
+   const std::vector< int >& hotSectors = ctx.getHotSectors();
+   
+   for( unsigned i=0; i < hotSectors.size(); i++ ){
+      
+      int sector = hotSectors[i];
+      
+      if( sectorLevels[sector] + 1 < nLevels ) continue;
+      
+      std::vector< int >::iterator it = std::find( sectors.begin(), sectors.end(), sector );
+      if( it == sectors.end() ) continue; // dropped before or on the other side
+      
+      streamlog_out( DEBUG4 ) << "Sector " << sector << " still has too many connections with the cut off values of the last round, "
+                              << "it gets dropped\n";
+      
+      sectors.erase( it );
+      
+      ctx.addDroppedSector( sector );
+      ctx.degradeQuality( QUALITY_POOR );
+      
+      dropped = true;
+      
+   }
+   
+   return dropped;
+   
+}
+
+
+IHit* ForwardTrackingEngine::createVirtualIPHit( int side , EventArena& eventArena ){
+   
+   // The hit comes from the heap, but the arena owns it, so it gets deleted with the other hits of the event
+   // (it is only two hits per event, so this costs nothing worth mentioning)
+   std::unique_ptr< IHit >* virtualIPHit = eventArena.create< std::unique_ptr< IHit > >( KiTrackMarlin::createVirtualIPHit( side , _sectorSystemFTD ) );
+   
+   return virtualIPHit->get();
+   
+}
+
+bool ForwardTrackingEngine::getCriteria( unsigned round,
+                                   std::vector< ICriterion* >& crit2Vec,
+                                   std::vector< ICriterion* >& crit3Vec,
+                                   std::vector< ICriterion* >& crit4Vec ) const {
+   
+   
+   // no new values, no new round
+   if( round >= _criteriaRounds->getNumberOfRounds() ) return false;
+   
+   crit2Vec = _criteriaRounds->getCrit2Vec( round );
+   crit3Vec = _criteriaRounds->getCrit3Vec( round );
+   crit4Vec = _criteriaRounds->getCrit4Vec( round );
+   
+   return true;
+   
+}
+
+
+void ForwardTrackingEngine::finaliseTrack( TrackImpl* trackImpl, Fitter* fitter, MarlinTrk::IMarlinTrkSystem* trkSystem ){
+   
+   
+   // The fitter uses the track system it was made with, so that one is needed. Without the fit of the track 
+   // candidate any track system will do, the track gets fitted here.
+   std::unique_ptr< TrkSystemPool::Lease > lease( fitter != NULL ? new TrkSystemPool::Lease( *_trkSystemPool, trkSystem )
+                                                                 : new TrkSystemPool::Lease( *_trkSystemPool ) );
+   
+   std::unique_ptr< Fitter > ownFitter;
+   
+   if( fitter == NULL ){
+      
+      ownFitter.reset( new Fitter( trackImpl , lease->get() ) );
+      fitter = ownFitter.get();
+      
+   }
+   
+   trackImpl->trackStates().clear();
+   
+
+   TrackStateImpl* trkStateIP = new TrackStateImpl( *fitter->getTrackState( lcio::TrackState::AtIP ) ) ;
+   trkStateIP->setLocation( TrackState::AtIP );
+   trackImpl->addTrackState( trkStateIP );
+   
+   TrackStateImpl* trkStateFirstHit = new TrackStateImpl( *fitter->getTrackState( TrackState::AtFirstHit ) ) ;
+   trkStateFirstHit->setLocation( TrackState::AtFirstHit );
+   trackImpl->addTrackState( trkStateFirstHit );
+   
+   TrackStateImpl* trkStateLastHit = new TrackStateImpl( *fitter->getTrackState( TrackState::AtLastHit ) ) ;
+   trkStateLastHit->setLocation( TrackState::AtLastHit );
+   trackImpl->addTrackState( trkStateLastHit );
+   
+   if( _config.getTrackStateAtCaloFace ) {
+     TrackStateImpl* trkStateAtCalo = new TrackStateImpl( *fitter->getTrackState( TrackState::AtCalorimeter ) ) ;
+     trkStateAtCalo->setLocation( TrackState::AtCalorimeter );
+     trackImpl->addTrackState( trkStateAtCalo );
+   }
+
+   trackImpl->setChi2( fitter->getChi2( TrackState::AtIP ) );
+   trackImpl->setNdf(  fitter->getNdf ( TrackState::AtIP ) );
+   
+   const float* p = trkStateFirstHit->getReferencePoint();
+   trackImpl->setRadiusOfInnermostHit( sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] ) );
+   
+   std::map<int, int> hitNumbers; 
+   
+   hitNumbers[lcio::ILDDetID::VXD] = 0;
+   hitNumbers[lcio::ILDDetID::SIT] = 0;
+   hitNumbers[lcio::ILDDetID::FTD] = 0;
+   hitNumbers[lcio::ILDDetID::TPC] = 0;
+   hitNumbers[lcio::ILDDetID::SET] = 0;
+   hitNumbers[lcio::ILDDetID::ETD] = 0;
+   
+   std::vector< TrackerHit* > trackerHits = trackImpl->getTrackerHits();
+   for( unsigned j=0; j < trackerHits.size(); j++ ){
+      
+      UTIL::BitField64 encoder( LCTrackerCellID::encoding_string() );
+      encoder.setValue( trackerHits[j]->getCellID0() );
+      int subdet =  encoder[lcio::LCTrackerCellID::subdet()];
+     
+      
+      ++hitNumbers[ subdet ];
+      
+   }
+   
+   trackImpl->subdetectorHitNumbers().resize(2 * lcio::ILDDetID::ETD);
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::VXD - 2 ] = hitNumbers[lcio::ILDDetID::VXD];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::FTD - 2 ] = hitNumbers[lcio::ILDDetID::FTD];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SIT - 2 ] = hitNumbers[lcio::ILDDetID::SIT];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::TPC - 2 ] = hitNumbers[lcio::ILDDetID::TPC];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SET - 2 ] = hitNumbers[lcio::ILDDetID::SET];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::ETD - 2 ] = hitNumbers[lcio::ILDDetID::ETD];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::VXD - 1 ] = hitNumbers[lcio::ILDDetID::VXD];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::FTD - 1 ] = hitNumbers[lcio::ILDDetID::FTD];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SIT - 1 ] = hitNumbers[lcio::ILDDetID::SIT];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::TPC - 1 ] = hitNumbers[lcio::ILDDetID::TPC];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::SET - 1 ] = hitNumbers[lcio::ILDDetID::SET];
+   trackImpl->subdetectorHitNumbers()[ 2 * lcio::ILDDetID::ETD - 1 ] = hitNumbers[lcio::ILDDetID::ETD];
+   
+   
+   return;
+   
+   
+}
+
+
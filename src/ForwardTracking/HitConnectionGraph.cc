@@ -0,0 +1,285 @@
+#include "HitConnectionGraph.h"
+
+#include <functional>
+#include <set>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+HitConnectionGraph::HitConnectionGraph(): _isBuilt( false ){}
+
+
+HitConnectionGraph::~HitConnectionGraph(){
+
+   clear();
+
+}
+
+
+void HitConnectionGraph::clear(){
+
+
+   for( unsigned i=0; i < _segments.size(); i++ ) delete _segments[i];
+
+   _segments.clear();
+   _hits.clear();
+   _layers.clear();
+   _parents.clear();
+   _children.clear();
+
+   _isBuilt = false;
+
+}
+
+
+void HitConnectionGraph::build( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                                ISectorConnector* sectorConnector,
+                                const std::vector< ICriterion* >& criteria,
+                                WorkStealingThreadPool* threadPool ){
+
+   build( sectorHitStore, sectors, sectorConnector, BatchedCriteria( criteria ), threadPool );
+
+}
+
+
+void HitConnectionGraph::build( const SectorHitStore& sectorHitStore, const std::vector< int >& sectors,
+                                ISectorConnector* sectorConnector,
+                                const BatchedCriteria& criteria,
+                                WorkStealingThreadPool* threadPool ){
+
+
+   clear();
+
+
+   // a segment for every hit. The hits of a sector are contiguous, so remember where each sector starts
+   // (-1 for the sectors that are left out).
+   std::vector< int > sectorFirstIndex( sectorHitStore.getNumberOfSectors(), -1 );
+
+   for( unsigned iSec=0; iSec < sectors.size(); iSec++ ){
+
+      int sector = sectors[iSec];
+
+      unsigned nHits = sectorHitStore.getNumberOfHits( sector );
+      if( nHits == 0 ) continue;
+
+      sectorFirstIndex[ sector ] = _segments.size();
+
+      IHit* const* hits = sectorHitStore.getHits( sector );
+
+      for( unsigned i=0; i < nHits; i++ ){
+
+         IHit* hit = hits[i];
+
+         std::vector< IHit* > segmentHits;
+         segmentHits.push_back( hit );
+
+         _segments.push_back( new Segment( segmentHits ) );
+         _hits.push_back( hit );
+         _layers.push_back( hit->getSectorSystem()->getLayer( sector ) );
+
+      }
+
+   }
+
+
+   // The sectors with hits, and for each the hits of its target sectors (as first index and number of hits).
+   // The targets are looked up before, so the sector connector is only used by this thread.
+   std::vector< unsigned > sectorFirst;
+   std::vector< unsigned > sectorSize;
+   std::vector< std::vector< std::pair< unsigned , unsigned > > > sectorTargets;
+
+   for( unsigned iSec=0; iSec < sectors.size(); iSec++ ){
+
+
+      int sector = sectors[iSec];
+
+      unsigned nHits = sectorHitStore.getNumberOfHits( sector );
+      if( nHits == 0 ) continue;
+
+      sectorFirst.push_back( sectorFirstIndex[ sector ] );
+      sectorSize.push_back( nHits );
+      sectorTargets.push_back( std::vector< std::pair< unsigned , unsigned > >() );
+
+      std::set< int > targetSectors = sectorConnector->getTargetSectors( sector );
+
+      for( std::set< int >::const_iterator itTarg = targetSectors.begin(); itTarg != targetSectors.end(); itTarg++ ){
+
+         if( *itTarg < 0 || unsigned( *itTarg ) >= sectorFirstIndex.size() || sectorFirstIndex[ *itTarg ] < 0 ) continue;
+
+         sectorTargets.back().push_back( std::make_pair( unsigned( sectorFirstIndex[ *itTarg ] ), sectorHitStore.getNumberOfHits( *itTarg ) ) );
+
+      }
+
+   }
+
+   unsigned nSectors = sectorFirst.size();
+
+
+   // Connect the hits of every sector with the hits of its target sectors. Every sector writes its connections into
+   // a buffer of its own, so the sectors can be done in parallel without locking.
+   std::vector< std::vector< unsigned > > sectorParents( nSectors );
+   std::vector< std::vector< unsigned > > sectorChildren( nSectors );
+
+   std::function< void( unsigned ) > connectSector = [&]( unsigned iSec ){
+
+
+      const std::vector< std::pair< unsigned , unsigned > >& targets = sectorTargets[iSec];
+
+      // the possible children of a hit, checked by the kernels all at once
+      std::vector< unsigned > candidates;
+      std::vector< unsigned char > accepted;
+      SegmentPairBatch batch( 2 );
+
+      bool useKernels = criteria.getNumberOfKernels() > 0;
+
+      for( unsigned i=0; i < sectorSize[iSec]; i++ ){
+
+
+         unsigned parent = sectorFirst[iSec] + i;
+
+         candidates.clear();
+         batch.clear();
+
+         for( unsigned t=0; t < targets.size(); t++ ){
+
+            for( unsigned j=0; j < targets[t].second; j++ ){
+
+               unsigned child = targets[t].first + j;
+
+               candidates.push_back( child );
+
+               if( useKernels ){
+
+                  IHit* pairHits[2] = { _hits[child], _hits[parent] };
+                  batch.add( pairHits );
+
+               }
+
+            }
+
+         }
+
+         accepted.assign( candidates.size(), 1 );
+         criteria.evaluateKernels( batch, accepted );
+
+         for( unsigned k=0; k < candidates.size(); k++ ){
+
+            if( accepted[k] && criteria.areCompatible( _segments[parent], _segments[ candidates[k] ] ) ){
+
+               sectorParents[iSec].push_back( parent );
+               sectorChildren[iSec].push_back( candidates[k] );
+
+            }
+
+         }
+
+      }
+
+   };
+
+   if( threadPool != NULL ) threadPool->parallelFor( nSectors, connectSector );
+   else for( unsigned iSec=0; iSec < nSectors; iSec++ ) connectSector( iSec );
+
+
+   // join the buffers in the order of the sectors, which is the order of the serial build
+   unsigned nConnections = 0;
+   for( unsigned iSec=0; iSec < nSectors; iSec++ ) nConnections += sectorParents[iSec].size();
+
+   _parents.reserve( nConnections );
+   _children.reserve( nConnections );
+
+   for( unsigned iSec=0; iSec < nSectors; iSec++ ){
+
+      _parents.insert( _parents.end(), sectorParents[iSec].begin(), sectorParents[iSec].end() );
+      _children.insert( _children.end(), sectorChildren[iSec].begin(), sectorChildren[iSec].end() );
+
+   }
+
+   _isBuilt = true;
+
+   streamlog_out( DEBUG3 ) << "HitConnectionGraph: " << _segments.size() << " hits with " << _parents.size() << " connections\n";
+
+}
+
+
+unsigned HitConnectionGraph::filter( const std::vector< ICriterion* >& criteria ){
+
+   return filter( BatchedCriteria( criteria ) );
+
+}
+
+
+unsigned HitConnectionGraph::filter( const BatchedCriteria& criteria ){
+
+
+   std::vector< unsigned char > accepted( _parents.size(), 1 );
+
+   if( criteria.getNumberOfKernels() > 0 ){
+
+      SegmentPairBatch batch( 2 );
+
+      for( unsigned k=0; k < _parents.size(); k++ ){
+
+         IHit* pairHits[2] = { _hits[ _children[k] ], _hits[ _parents[k] ] };
+         batch.add( pairHits );
+
+      }
+
+      criteria.evaluateKernels( batch, accepted );
+
+   }
+
+   // remove the connections that fail, keeping the order of the others
+   unsigned nKept = 0;
+
+   for( unsigned k=0; k < _parents.size(); k++ ){
+
+      if( !accepted[k] || !criteria.areCompatible( _segments[ _parents[k] ], _segments[ _children[k] ] ) ) continue;
+
+      _parents[nKept] = _parents[k];
+      _children[nKept] = _children[k];
+      nKept++;
+
+   }
+
+   unsigned nRemoved = _parents.size() - nKept;
+
+   _parents.resize( nKept );
+   _children.resize( nKept );
+
+   streamlog_out( DEBUG3 ) << "HitConnectionGraph: removed " << nRemoved << " connections, " << nKept << " are left\n";
+
+   return nRemoved;
+
+}
+
+
+void HitConnectionGraph::fillAutomaton( Automaton& automaton ) const {
+
+
+   std::vector< Segment* > segments( _segments.size() );
+
+   for( unsigned i=0; i < _segments.size(); i++ ){
+
+      segments[i] = new Segment( _segments[i]->getHits() );
+      segments[i]->setLayer( _layers[i] );
+
+   }
+
+   for( unsigned k=0; k < _parents.size(); k++ ){
+
+      Segment* parent = segments[ _parents[k] ];
+      Segment* child = segments[ _children[k] ];
+
+      parent->addChild( child );
+      child->addParent( parent );
+
+   }
+
+   for( unsigned i=0; i < segments.size(); i++ ) automaton.addSegment( segments[i] );
+
+}
@@ -0,0 +1,219 @@
+#include "IncrementalHelixFitter.h"
+
+#include <sstream>
+#include <cmath>
+#include <algorithm>
+
+#include "EVENT/TrackerHitPlane.h"
+#include "UTIL/ILDConf.h"
+
+
+using namespace KiTrackMarlin;
+
+
+IncrementalHelixFitter::IncrementalHelixFitter():
+_nHits( 0 ),
+_hasReference( false ),
+_x0( 0. ), _y0( 0. ), _z0( 0. ),
+_sw( 0. ), _su( 0. ), _sv( 0. ), _suu( 0. ), _suv( 0. ), _svv( 0. ), _sq( 0. ), _suq( 0. ), _svq( 0. ), _sqq( 0. ),
+_szw( 0. ), _sr( 0. ), _sr2( 0. ), _sr3( 0. ), _sr4( 0. ), _sr6( 0. ), _sz( 0. ), _srz( 0. ), _sr3z( 0. ), _szz( 0. ),
+_chi2( 0. ), _Ndf( 0 ), _chi2Circle( 0. ), _chi2Z( 0. ), _radius( 0. ), _centreX( 0. ), _centreY( 0. ), _tanLambda( 0. ){}
+
+
+void IncrementalHelixFitter::addHit( TrackerHit* hit ){
+
+
+   double x, y, z, sigmaRPhi2, sigmaZ2;
+   getPointOfHit( hit, x, y, z, sigmaRPhi2, sigmaZ2 );
+
+   add( x, y, z, sigmaRPhi2, sigmaZ2, 1. );
+
+}
+
+
+void IncrementalHelixFitter::removeHit( TrackerHit* hit ){
+
+
+   double x, y, z, sigmaRPhi2, sigmaZ2;
+   getPointOfHit( hit, x, y, z, sigmaRPhi2, sigmaZ2 );
+
+   add( x, y, z, sigmaRPhi2, sigmaZ2, -1. );
+
+}
+
+
+void IncrementalHelixFitter::add( double x, double y, double z, double sigmaRPhi2, double sigmaZ2, double sign ){
+
+
+   if( !_hasReference ){
+
+      _x0 = x;
+      _y0 = y;
+      _z0 = z;
+      _hasReference = true;
+
+   }
+
+   if( sign > 0. ) _nHits++;
+   else if( _nHits > 0 ) _nHits--;
+
+
+   // circle
+   double w = ( sigmaRPhi2 > 0. ) ? sign / sigmaRPhi2 : sign;
+   double u = x - _x0;
+   double v = y - _y0;
+   double q = u*u + v*v;
+
+   _sw  += w;
+   _su  += w*u;
+   _sv  += w*v;
+   _suu += w*u*u;
+   _suv += w*u*v;
+   _svv += w*v*v;
+   _sq  += w*q;
+   _suq += w*u*q;
+   _svq += w*v*q;
+   _sqq += w*q*q;
+
+
+   // line in z: rho is the distance to the z axis (not relative to the reference point)
+   double wz = ( sigmaZ2 > 0. ) ? sign / sigmaZ2 : sign;
+   double r = sqrt( x*x + y*y );
+   double r3 = r*r*r;
+   double dz = z - _z0;
+
+   _szw  += wz;
+   _sr   += wz*r;
+   _sr2  += wz*r*r;
+   _sr3  += wz*r3;
+   _sr4  += wz*r3*r;
+   _sr6  += wz*r3*r3;
+   _sz   += wz*dz;
+   _srz  += wz*r*dz;
+   _sr3z += wz*r3*dz;
+   _szz  += wz*dz*dz;
+
+}
+
+
+void IncrementalHelixFitter::fit(){
+
+
+   if( _nHits < 3 ){
+
+      std::stringstream s;
+      s << "IncrementalHelixFitter::fit(): Cannot fit with less than 3 hits. Number of hits =  " << _nHits << "\n";
+
+      throw IncrementalHelixFitterException( s.str() );
+
+   }
+
+
+   /**********************************************************************************************/
+   /*                Circle: minimise sum w*( q + A*u + B*v + C )^2                             */
+   /**********************************************************************************************/
+
+   // normal equations M * (A,B,C) = -(suq, svq, sq), solved with Cramer's rule
+   double m11 = _suu, m12 = _suv, m13 = _su;
+   double m22 = _svv, m23 = _sv;
+   double m33 = _sw;
+
+   double b1 = -_suq, b2 = -_svq, b3 = -_sq;
+
+   double det = m11*( m22*m33 - m23*m23 ) - m12*( m12*m33 - m23*m13 ) + m13*( m12*m23 - m22*m13 );
+
+   if( std::fabs( det ) < 1e-30 ) throw IncrementalHelixFitterException( "IncrementalHelixFitter::fit(): the hits don't define a circle\n" );
+
+   double A = ( b1*( m22*m33 - m23*m23 ) - m12*( b2*m33 - m23*b3 ) + m13*( b2*m23 - m22*b3 ) ) / det;
+   double B = ( m11*( b2*m33 - b3*m23 ) - b1*( m12*m33 - m23*m13 ) + m13*( m12*b3 - b2*m13 ) ) / det;
+   double C = ( m11*( m22*b3 - m23*b2 ) - m12*( m12*b3 - b2*m13 ) + b1*( m12*m23 - m22*m13 ) ) / det;
+
+   double radius2 = 0.25*( A*A + B*B ) - C;
+
+   if( radius2 <= 0. ) throw IncrementalHelixFitterException( "IncrementalHelixFitter::fit(): the hits don't define a circle\n" );
+
+   _radius = sqrt( radius2 );
+   _centreX = _x0 - 0.5*A;
+   _centreY = _y0 - 0.5*B;
+
+   // at the minimum the algebraic chi2 is sqq + A*suq + B*svq + C*sq. An algebraic residual is about 2R times the
+   // distance to the circle.
+   double chi2Algebraic = _sqq + A*_suq + B*_svq + C*_sq;
+   _chi2Circle = std::max( chi2Algebraic, 0. ) / ( 4.*radius2 );
+
+
+   /**********************************************************************************************/
+   /*                z = a + tanLambda*s                                                        */
+   /**********************************************************************************************/
+
+   // For a track from the IP the path length in xy is s = 2R*asin( rho/2R ) = rho + rho^3/(24R^2) + ...
+   // With the first two terms the sums for s can be put together from the sums in rho.
+   double k = 1. / ( 24.*radius2 );
+
+   double ss  = _sr + k*_sr3;
+   double sss = _sr2 + 2.*k*_sr4 + k*k*_sr6;
+   double ssz = _srz + k*_sr3z;
+
+   double detZ = _szw*sss - ss*ss;
+
+   double a = 0.;
+   double b = 0.;
+
+   if( std::fabs( detZ ) > 1e-30 ){
+
+      a = ( sss*_sz - ss*ssz ) / detZ;
+      b = ( _szw*ssz - ss*_sz ) / detZ;
+
+   }
+   else if( _szw > 0. ) a = _sz / _szw;
+
+   _tanLambda = b;
+
+   double chi2Z = _szz - 2.*a*_sz - 2.*b*ssz + a*a*_szw + 2.*a*b*ss + b*b*sss;
+   _chi2Z = std::max( chi2Z, 0. );
+
+
+   _chi2 = _chi2Circle + _chi2Z;
+   _Ndf = 2*int( _nHits ) - 5;
+
+}
+
+
+void IncrementalHelixFitter::getPointOfHit( TrackerHit* hit, double& x, double& y, double& z, double& sigmaRPhi2, double& sigmaZ2 ){
+
+
+   const double* pos = hit->getPosition();
+
+   x = pos[0];
+   y = pos[1];
+   z = pos[2];
+
+   sigmaRPhi2 = 0.;
+   sigmaZ2 = 0.;
+
+   if( BitSet32( hit->getType() )[ UTIL::ILDTrkHitTypeBit::COMPOSITE_SPACEPOINT ] ){
+
+      const EVENT::FloatVec& cov = hit->getCovMatrix();
+
+      if( cov.size() >= 6 ){
+
+         sigmaRPhi2 = cov[0] + cov[2];
+         sigmaZ2 = cov[5];
+
+      }
+
+   }
+   else{
+
+      TrackerHitPlane* hitPlane = dynamic_cast< TrackerHitPlane* >( hit );
+
+      if( hitPlane != NULL ){
+
+         sigmaRPhi2 = hitPlane->getdU()*hitPlane->getdU() + hitPlane->getdV()*hitPlane->getdV();
+         sigmaZ2 = sigmaRPhi2;
+
+      }
+
+   }
+
+}
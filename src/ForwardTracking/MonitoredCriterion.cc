@@ -0,0 +1,63 @@
+#include "MonitoredCriterion.h"
+
+#include <chrono>
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+namespace{
+
+
+   /** @return whether this check is measured. A random choice per thread (xorshift), so the samples are spread over
+    * all criteria, whatever order they are called in. */
+   bool isSampled(){
+
+      static thread_local unsigned state = 2463534242u;
+
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+
+      return state % MonitoredCriterion::SAMPLING == 0;
+
+   }
+
+
+}
+
+
+MonitoredCriterion::MonitoredCriterion( ICriterion* criterion ):
+_criterion( criterion ),
+_nSamples( 0 ),
+_nRejected( 0 ),
+_timeNs( 0 ){
+
+
+   _name = _criterion->getName();
+   _type = _criterion->getType();
+
+   _saveValues = false;
+
+}
+
+
+bool MonitoredCriterion::areCompatible( Segment* parent , Segment* child ){
+
+
+   if( !isSampled() ) return _criterion->areCompatible( parent, child );
+
+   std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+   bool compatible = _criterion->areCompatible( parent, child );
+
+   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+   _timeNs.fetch_add( std::chrono::duration_cast< std::chrono::nanoseconds >( end - start ).count(), std::memory_order_relaxed );
+   _nSamples.fetch_add( 1, std::memory_order_relaxed );
+   if( !compatible ) _nRejected.fetch_add( 1, std::memory_order_relaxed );
+
+   return compatible;
+
+}
@@ -0,0 +1,283 @@
+#include "OverlapHitFinder.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+OverlapHitFinder::OverlapHitFinder( float distMax ):
+_distMax( distMax ),
+_xMin( 0. ),
+_yMin( 0. ),
+_cellSize( distMax ),
+_nCellsX( 0 ),
+_nCellsY( 0 ){}
+
+
+unsigned OverlapHitFinder::connect( IHit* const* hitsFront, unsigned nHitsFront,
+                                    IHit* const* hitsBack, unsigned nHitsBack,
+                                    std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack ){
+
+
+   if( nHitsFront == 0 || nHitsBack == 0 || _distMax <= 0. ) return 0;
+
+   // for a handful of hits setting up the grid doesn't pay off
+   if( nHitsFront*nHitsBack <= 64 ) return connectAllPairs( hitsFront, nHitsFront, hitsBack, nHitsBack, map_hitFront_hitsBack );
+
+   fillGrid( hitsBack, nHitsBack );
+
+   if( _x.empty() ) return 0;
+
+
+   unsigned nConnections = 0;
+
+   for( unsigned i=0; i < nHitsFront; i++ ){
+
+
+      IHit* hitA = hitsFront[i];
+
+      if( hitA->isVirtual() ) continue;
+
+      float x = hitA->getX();
+      float y = hitA->getY();
+      float z = hitA->getZ();
+
+      // the cell of the hit and the range of neighbouring cells (the hit itself may lie outside the grid)
+      int ix = int( std::floor( ( x - _xMin ) / _cellSize ) );
+      int iy = int( std::floor( ( y - _yMin ) / _cellSize ) );
+
+      int ixLow = std::max( ix - 1, 0 );
+      int ixHigh = std::min( ix + 1, _nCellsX - 1 );
+      int iyLow = std::max( iy - 1, 0 );
+      int iyHigh = std::min( iy + 1, _nCellsY - 1 );
+
+      if( ixLow > ixHigh || iyLow > iyHigh ) continue;
+
+      _matches.clear();
+
+      // the cells ixLow ... ixHigh of a row are next to each other in the sorted arrays
+      for( int jy=iyLow; jy <= iyHigh; jy++ ){
+
+         unsigned begin = _cellStart[ jy*_nCellsX + ixLow ];
+         unsigned end = _cellStart[ jy*_nCellsX + ixHigh + 1 ];
+
+         compare( x, y, z, std::fabs( z ), begin, end );
+
+      }
+
+      if( _matches.empty() ) continue;
+
+      // keep the order of the hits behind
+      std::sort( _matches.begin(), _matches.end() );
+
+      std::vector< IHit* >& hitsConnected = map_hitFront_hitsBack[ hitA ];
+
+      for( unsigned j=0; j < _matches.size(); j++ ){
+
+         IHit* hitB = hitsBack[ _matches[j] ];
+
+         streamlog_out( DEBUG2 ) << "Connected: (" << hitA->getX() << "," << hitA->getY() << "," << hitA->getZ() << ")-->("
+                                 << hitB->getX() << "," << hitB->getY() << "," << hitB->getZ() << ")\n";
+
+         hitsConnected.push_back( hitB );
+         nConnections++;
+
+      }
+
+   }
+
+
+   return nConnections;
+
+}
+
+
+unsigned OverlapHitFinder::connectAllPairs( IHit* const* hitsFront, unsigned nHitsFront,
+                                            IHit* const* hitsBack, unsigned nHitsBack,
+                                            std::map< IHit* , std::vector< IHit* > >& map_hitFront_hitsBack ) const {
+
+
+   unsigned nConnections = 0;
+
+   float distMax2 = _distMax*_distMax;
+
+   for( unsigned i=0; i < nHitsFront; i++ ){
+
+
+      IHit* hitA = hitsFront[i];
+
+      if( hitA->isVirtual() ) continue;
+
+      for( unsigned j=0; j < nHitsBack; j++ ){
+
+
+         IHit* hitB = hitsBack[j];
+
+         if( hitB->isVirtual() ) continue;
+
+         float dx = hitA->getX() - hitB->getX();
+         float dy = hitA->getY() - hitB->getY();
+         float dz = hitA->getZ() - hitB->getZ();
+
+         if( ( dx*dx + dy*dy + dz*dz < distMax2 ) && ( std::fabs( hitB->getZ() ) > std::fabs( hitA->getZ() ) ) ){
+
+            streamlog_out( DEBUG2 ) << "Connected: (" << hitA->getX() << "," << hitA->getY() << "," << hitA->getZ() << ")-->("
+                                    << hitB->getX() << "," << hitB->getY() << "," << hitB->getZ() << ")\n";
+
+            map_hitFront_hitsBack[ hitA ].push_back( hitB );
+            nConnections++;
+
+         }
+
+      }
+
+   }
+
+
+   return nConnections;
+
+}
+
+
+void OverlapHitFinder::fillGrid( IHit* const* hitsBack, unsigned nHitsBack ){
+
+
+   _cellOfHit.clear();
+   _index.clear();
+
+
+   // the extent of the hits
+   float xMax = 0.;
+   float yMax = 0.;
+   bool first = true;
+
+   for( unsigned j=0; j < nHitsBack; j++ ){
+
+      IHit* hit = hitsBack[j];
+
+      if( hit->isVirtual() ) continue;
+
+      float x = hit->getX();
+      float y = hit->getY();
+
+      if( first ){
+
+         _xMin = xMax = x;
+         _yMin = yMax = y;
+         first = false;
+
+      }
+
+      _xMin = std::min( _xMin, x );
+      _yMin = std::min( _yMin, y );
+      xMax = std::max( xMax, x );
+      yMax = std::max( yMax, y );
+
+      _index.push_back( j );
+
+   }
+
+   unsigned nHits = _index.size();
+
+   _x.resize( nHits );
+   _y.resize( nHits );
+   _z.resize( nHits );
+   _absZ.resize( nHits );
+
+   if( nHits == 0 ) return;
+
+
+   // The cells must not be smaller than distMax, otherwise the 3x3 neighbourhood would not cover everything.
+   // They may be bigger though: make sure there are not (many) more cells than hits.
+   _cellSize = _distMax;
+
+   while( true ){
+
+      _nCellsX = int( ( xMax - _xMin ) / _cellSize ) + 1;
+      _nCellsY = int( ( yMax - _yMin ) / _cellSize ) + 1;
+
+      if( double( _nCellsX )*_nCellsY <= 2.*nHits + 1 ) break;
+
+      _cellSize *= 2.;
+
+   }
+
+   unsigned nCells = _nCellsX*_nCellsY;
+
+
+   // counting sort of the hits into the cells
+   _cellStart.assign( nCells + 1, 0 );
+   _cellOfHit.resize( nHits );
+
+   for( unsigned k=0; k < nHits; k++ ){
+
+      IHit* hit = hitsBack[ _index[k] ];
+
+      int ix = std::min( int( ( hit->getX() - _xMin ) / _cellSize ), _nCellsX - 1 );
+      int iy = std::min( int( ( hit->getY() - _yMin ) / _cellSize ), _nCellsY - 1 );
+
+      _cellOfHit[k] = iy*_nCellsX + ix;
+      _cellStart[ _cellOfHit[k] + 1 ]++;
+
+   }
+
+   for( unsigned c=0; c < nCells; c++ ) _cellStart[c+1] += _cellStart[c];
+
+   std::vector< unsigned > index( _index );
+   std::vector< unsigned > fill( _cellStart.begin(), _cellStart.end() - 1 );
+
+   for( unsigned k=0; k < nHits; k++ ){
+
+      unsigned pos = fill[ _cellOfHit[k] ]++;
+
+      IHit* hit = hitsBack[ index[k] ];
+
+      _x[pos] = hit->getX();
+      _y[pos] = hit->getY();
+      _z[pos] = hit->getZ();
+      _absZ[pos] = std::fabs( _z[pos] );
+      _index[pos] = index[k];
+
+   }
+
+
+}
+
+
+void OverlapHitFinder::compare( float x, float y, float z, float absZ, unsigned begin, unsigned end ){
+
+
+   unsigned n = end - begin;
+
+   if( n == 0 ) return;
+
+   if( _pass.size() < n ) _pass.resize( n );
+
+   const float* xs = _x.data() + begin;
+   const float* ys = _y.data() + begin;
+   const float* zs = _z.data() + begin;
+   const float* absZs = _absZ.data() + begin;
+   unsigned char* pass = _pass.data();
+
+   float distMax2 = _distMax*_distMax;
+
+   // branch free, so this loop gets vectorised
+   for( unsigned k=0; k < n; k++ ){
+
+      float dx = x - xs[k];
+      float dy = y - ys[k];
+      float dz = z - zs[k];
+
+      pass[k] = ( dx*dx + dy*dy + dz*dz < distMax2 ) & ( absZs[k] > absZ );
+
+   }
+
+   for( unsigned k=0; k < n; k++ ) if( pass[k] ) _matches.push_back( _index[ begin + k ] );
+
+
+}
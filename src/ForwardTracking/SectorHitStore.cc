@@ -0,0 +1,121 @@
+#include "SectorHitStore.h"
+
+#include <sstream>
+
+#include "KiTrack/KiTrackExceptions.h"
+
+
+using namespace KiTrackMarlin;
+
+
+SectorHitStore::SectorHitStore(){}
+
+
+void SectorHitStore::reset( unsigned nSectors ){
+
+
+   _hits.clear();
+   _staged.clear();
+   _occupiedSectors.clear();
+
+   _offsets.assign( nSectors, 0 );
+   _counts.assign( nSectors, 0 );
+   _occupied.assign( ( nSectors + 63 ) / 64, 0 );
+
+}
+
+
+void SectorHitStore::addHit( KiTrack::IHit* hit ){
+
+
+   int sector = hit->getSector();
+
+   if( sector < 0 ){
+
+      std::stringstream s;
+      s << "SectorHitStore: negative sector " << sector << " can't be stored";
+      throw KiTrack::OutOfRange( s.str() );
+
+   }
+
+   _staged.push_back( std::make_pair( sector, hit ) );
+
+}
+
+
+void SectorHitStore::build(){
+
+
+   // make room for sectors beyond the expected ones
+   unsigned nSectors = _counts.size();
+   for( unsigned i=0; i < _staged.size(); i++ ) if( unsigned( _staged[i].first ) >= nSectors ) nSectors = _staged[i].first + 1;
+
+   if( nSectors > _counts.size() ){
+
+      _offsets.resize( nSectors, 0 );
+      _counts.resize( nSectors, 0 );
+      _occupied.resize( ( nSectors + 63 ) / 64, 0 );
+
+   }
+
+
+   // counting sort: count, prefix sum, place (stable, so the order within a sector is kept)
+   for( unsigned i=0; i < _staged.size(); i++ ) _counts[ _staged[i].first ]++;
+
+   unsigned offset = 0;
+
+   for( unsigned sector=0; sector < nSectors; sector++ ){
+
+      _offsets[sector] = offset;
+      offset += _counts[sector];
+
+      if( _counts[sector] > 0 ){
+
+         _occupied[ sector / 64 ] |= std::uint64_t( 1 ) << ( sector % 64 );
+         _occupiedSectors.push_back( sector );
+
+      }
+
+   }
+
+   _hits.resize( _staged.size() );
+
+   std::vector< unsigned > fill( _offsets );
+   for( unsigned i=0; i < _staged.size(); i++ ) _hits[ fill[ _staged[i].first ]++ ] = _staged[i].second;
+
+   _staged.clear();
+
+}
+
+
+void SectorHitStore::clearSector( int sector ){
+
+
+   if( !isInRange( sector ) ) return;
+
+   _counts[sector] = 0;
+   _occupied[ sector / 64 ] &= ~( std::uint64_t( 1 ) << ( sector % 64 ) );
+
+}
+
+
+std::map< int , std::vector< KiTrack::IHit* > > SectorHitStore::getMap( const std::vector< int >& sectors ) const {
+
+
+   std::map< int , std::vector< KiTrack::IHit* > > map_sector_hits;
+
+   for( unsigned i=0; i < sectors.size(); i++ ){
+
+      int sector = sectors[i];
+
+      unsigned nHits = getNumberOfHits( sector );
+      if( nHits == 0 ) continue;
+
+      KiTrack::IHit* const* hits = getHits( sector );
+      map_sector_hits[sector].assign( hits, hits + nHits );
+
+   }
+
+   return map_sector_hits;
+
+}
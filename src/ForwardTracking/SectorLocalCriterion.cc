@@ -0,0 +1,63 @@
+#include "SectorLocalCriterion.h"
+
+#include <algorithm>
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+SectorLocalCriterion::SectorLocalCriterion( const std::vector< ICriterion* >& levels, const std::vector< unsigned >* sectorLevels,
+                                            bool ownsLevels ):
+_levels( levels ),
+_sectorLevels( sectorLevels ),
+_ownsLevels( ownsLevels ){
+
+
+   _name = _levels.front()->getName();
+   _type = _levels.front()->getType();
+
+   _saveValues = false;
+
+}
+
+
+SectorLocalCriterion::~SectorLocalCriterion(){
+
+
+   if( _ownsLevels ) for( unsigned i=0; i < _levels.size(); i++ ) delete _levels[i];
+   _levels.clear();
+
+}
+
+
+bool SectorLocalCriterion::areCompatible( Segment* parent , Segment* child ){
+
+
+   unsigned level = std::max( getLevel( parent ), getLevel( child ) );
+
+   if( level >= _levels.size() ) level = _levels.size() - 1;
+
+   return _levels[level]->areCompatible( parent, child );
+
+}
+
+
+unsigned SectorLocalCriterion::getLevel( Segment* segment ) const {
+
+
+   unsigned level = 0;
+
+   const std::vector< IHit* >& hits = segment->getHits();
+
+   for( unsigned i=0; i < hits.size(); i++ ){
+
+      int sector = hits[i]->getSector();
+
+      if( sector >= 0 && unsigned( sector ) < _sectorLevels->size() ) level = std::max( level, (*_sectorLevels)[sector] );
+
+   }
+
+   return level;
+
+}
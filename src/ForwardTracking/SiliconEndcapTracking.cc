@@ -1,6 +1,7 @@
 #include "SiliconEndcapTracking.h"
 
 #include <algorithm>
+#include <memory>
 
 #include "EVENT/TrackerHit.h"
 #include "EVENT/Track.h"
@@ -19,6 +20,10 @@
 #include "DD4hep/Detector.h"
 #include "DD4hep/DD4hepUnits.h"
 
+//----From MarlinTrk---------------------------
+#include "MarlinTrk/Factory.h"
+#include "MarlinTrk/MarlinDDKalTest.h"
+
 
 //----From KiTrack-----------------------------
 #include "KiTrack/SubsetHopfieldNN.h"
@@ -36,7 +41,9 @@
 #include "Tools/FTDHelixFitter.h"
 
 
+#include "AutomatonRunner.h"
 #include "EndcapTrack.h"
+#include "TrackConflictGraph.h"
 #include "EndcapHit01.h"
 #include "EndcapHitSimple.h"
 // #include "EndcapNeighborSecCon.h" // FIXME: TO BE IMPLEMENTED!!
@@ -112,6 +119,11 @@ SiliconEndcapTracking::SiliconEndcapTracking() : Processor("SiliconEndcapTrackin
                               _helixFitMax,
                               double( 500 ) );
    
+   registerProcessorParameter("IncrementalHelixFit",
+                              "Whether the helix fit of all versions of a track is done incrementally from the fit of the raw track",
+                              _incrementalHelixFit,
+                              bool( false ) );
+   
 
    registerProcessorParameter("OverlappingHitsDistMax",
                               "The maximum distance of hits from overlapping petals belonging to one track",
@@ -127,7 +139,7 @@ SiliconEndcapTracking::SiliconEndcapTracking() : Processor("SiliconEndcapTrackin
    
    
    registerProcessorParameter( "BestSubsetFinder",
-                               "The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN, SubsetSimple and None",
+                               "The method used to find the best non overlapping subset of tracks. Available are: SubsetHopfieldNN, SubsetHopfieldNNComponents, SubsetExactHybrid, SubsetSimple and None",
                                _bestSubsetFinder,
                                std::string( "SubsetHopfieldNN" ) );
    
@@ -155,6 +167,21 @@ SiliconEndcapTracking::SiliconEndcapTracking() : Processor("SiliconEndcapTrackin
                               _HNN_TInf,
                               double( 0.1 ) );
    
+   registerProcessorParameter("SubsetExactMaxTracks",
+                              "For SubsetExactHybrid: the components with at most this many tracks are solved exactly (at most 64)",
+                              _subsetExactMaxTracks,
+                              int( 32 ) );
+   
+   registerProcessorParameter("SubsetExactMaxNodes",
+                              "For SubsetExactHybrid: the most nodes the exact search may visit in a component, else the Hopfield Neural Network is used",
+                              _subsetExactMaxNodes,
+                              int( 100000 ) );
+   
+   registerProcessorParameter("SubsetExactCompareHNN",
+                              "For SubsetExactHybrid: whether to solve the exactly solved components also with the Hopfield Neural Network to compare time and quality",
+                              _subsetExactCompareHNN,
+                              bool( false ) );
+   
    
    
    // Security checks to prevent combinatorial disasters
@@ -165,6 +192,47 @@ SiliconEndcapTracking::SiliconEndcapTracking() : Processor("SiliconEndcapTrackin
                                //int( 100000 ) );
                                int( 920 ) );
    
+   registerProcessorParameter( "ReuseHitConnections",
+                               "Whether on a rerun of the automaton the connections between single hits of the round before are kept and only checked with the new 2-hit cut off parameters",
+                               _reuseHitConnections,
+                               bool( false ) );
+   
+   registerProcessorParameter( "FlatAutomaton",
+                               "Whether to use the automaton of this package with a flat segment graph instead of the one of KiTrack",
+                               _flatAutomaton,
+                               bool( false ) );
+   
+   registerProcessorParameter( "BatchedCriteria",
+                               "Whether the criteria check many segment pairs at once, with vectorised kernels for the simple criteria (needs the FlatAutomaton for the 3 and 4 hit criteria)",
+                               _batchedCriteria,
+                               bool( false ) );
+   
+   registerProcessorParameter( "CriteriaChains",
+                               "Whether the criteria of a type are checked by one compiled chain, if they are the standard set",
+                               _criteriaChains,
+                               bool( false ) );
+   
+   registerProcessorParameter( "CriteriaReorderInterval",
+                               "After how many events the criteria are reordered by their measured time and rejection rate (0 = keep the order of the steering)",
+                               _criteriaReorderInterval,
+                               int( 0 ) );
+   
+   
+   registerProcessorParameter( "TimeStages",
+                               "Whether to measure the time of the stages of the reconstruction (summary at the end)",
+                               _timeStages,
+                               bool( false ) );
+   
+   registerProcessorParameter( "TimeStagesInCollection",
+                               "Whether to store the times of the stages of every event as parameters of the output track collection (needs TimeStages)",
+                               _timeStagesInCollection,
+                               bool( false ) );
+   
+   registerProcessorParameter("NumberOfThreads",
+                              "The number of threads used for SubsetHopfieldNNComponents. 1 = serial",
+                              _nThreads,
+                              int(1));
+   
    
    registerProcessorParameter("MaxHitsPerSector",
                               "Maximal number of hits allowed on a sector. More will cause drop of hits in sector",
@@ -200,6 +268,11 @@ SiliconEndcapTracking::SiliconEndcapTracking() : Processor("SiliconEndcapTrackin
                               "Set to false if no track state at the calorimeter is needed",
                               _getTrackStateAtCaloFace,
                               bool(true));
+   
+   registerProcessorParameter("ReuseCandidateFit",
+                              "Whether the track states of the output tracks are taken from the Kalman fit of the track candidates (done with the VXD flag of the Fitter) instead of fitting the tracks again",
+                              _reuseCandidateFit,
+                              bool(false));
   
 
    // The Criteria for the Cellular Automaton:
@@ -252,6 +325,9 @@ void SiliconEndcapTracking::init() {
 
    _nRun = 0 ;
    _nEvt = 0 ;
+   
+   _arenaBytesMax = 0;
+   _arenaBytesSum = 0;
 
    _useCED = false; // Setting this to on will initialise CED in the processor and tracks or segments (from the CA)
                     // can be printed. As this is mainly used for debugging it is not a steerable parameter.
@@ -280,6 +356,9 @@ void SiliconEndcapTracking::init() {
    streamlog_out( DEBUG2 ) << " nDivisionsInTheta = " << _nDivisionsInTheta << " \n";
 
    _sectorSystemEndcap = new SectorSystemEndcap( nLayers, _nDivisionsInPhi , _nDivisionsInTheta );
+   
+   // the highest sector number, needed for storing the hits by sector
+   _nSectors = _sectorSystemEndcap->getSector( nLayers - 1, _nDivisionsInPhi - 1, _nDivisionsInTheta - 1 ) + 1;
  
    
    // Get the B Field in z direction
@@ -315,6 +394,70 @@ void SiliconEndcapTracking::init() {
    // initialise the tracking system
    _trkSystem->init() ;
    
+   // The shared instance of the factory is used by the other processors as well and its options get set for every
+   // event in processEvent(). So for DDKalTest the fits use a private track system, whose options are set once.
+   // (There is only the one track system for the fits, so the fits of events processed at the same time take turns.)
+   _fitTrkSystem = _trkSystem;
+   
+   if( _trkSystemName == "DDKalTest" ){
+      
+      _fitTrkSystem = new MarlinTrk::MarlinDDKalTest();
+      
+      _fitTrkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useQMS,        _MSOn ) ;       //multiple scattering
+      _fitTrkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::usedEdx,       _ElossOn) ;     //energy loss
+      _fitTrkSystem->setOption( MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing,  _SmoothOn) ;    //smoothing
+      
+      _fitTrkSystem->init() ;
+      
+   }
+   
+   _trkSystemPool = new TrkSystemPool( std::vector< MarlinTrk::IMarlinTrkSystem* >( 1, _fitTrkSystem ) );
+   
+   
+   // the names must be in the order of the enum Stage
+   _stageTimer = NULL;
+   
+   if( _timeStages ){
+      
+      std::vector< std::string > stageNames;
+      stageNames.push_back( "ReadHits" );
+      stageNames.push_back( "OverlapMap" );
+      stageNames.push_back( "SegmentBuilder" );
+      stageNames.push_back( "Automaton2Hit" );
+      stageNames.push_back( "Automaton3Hit" );
+      stageNames.push_back( "HelixFit" );
+      stageNames.push_back( "KalmanFit" );
+      stageNames.push_back( "BestSubset" );
+      stageNames.push_back( "FinaliseTrack" );
+      
+      _stageTimer = new StageTimer( stageNames );
+      
+   }
+   
+   _eventContextPool = new EventContextPool( _stageTimer != NULL ? _stageTimer->getNumberOfStages() : 0 );
+   
+   
+   if( _nThreads < 1 ) _nThreads = 1;
+   
+   _threadPool = NULL;
+   
+   if( _nThreads > 1 ){
+      
+      streamlog_out( MESSAGE ) << "Finding the best subset with " << _nThreads << " threads\n";
+      
+      _threadPool = new WorkStealingThreadPool( _nThreads );
+      
+   }
+   
+   if( _bestSubsetFinder == "SubsetExactHybrid" ){
+      
+      ExactSubsetSolver exactSolver( _subsetExactMaxTracks, _subsetExactMaxNodes );
+      SparseHopfieldNN hopfieldNN( _HNN_Omega, _HNN_ActivationThreshold, _HNN_TInf );
+      
+      _subsetExactHybrid = new SubsetExactHybrid( exactSolver, hopfieldNN, _subsetExactCompareHNN );
+      
+   }
+   
    
    
    /**********************************************************************************************/
@@ -323,7 +466,8 @@ void SiliconEndcapTracking::init() {
 
    
    // Only use allowed methods to find subsets. 
-   assert( ( _bestSubsetFinder == "None" ) || ( _bestSubsetFinder == "SubsetHopfieldNN" ) || ( _bestSubsetFinder == "SubsetSimple" ) );
+   assert( ( _bestSubsetFinder == "None" ) || ( _bestSubsetFinder == "SubsetHopfieldNN" ) || ( _bestSubsetFinder == "SubsetHopfieldNNComponents" )
+           || ( _bestSubsetFinder == "SubsetExactHybrid" ) || ( _bestSubsetFinder == "SubsetSimple" ) );
    
    // Use a sensible chi2prob cut. (chi squared probability, like any probability must range from 0 to 1)
    assert( _chi2ProbCut >= 0. );
@@ -343,6 +487,11 @@ void SiliconEndcapTracking::init() {
       
    }
    
+   // the criteria of all rounds are made once here and only read during the events
+   _criteriaRounds = new CriteriaRounds( _criteriaNames, _critMinima, _critMaxima,
+                                         _criteriaChains ? CRITERIA_CHAIN_ENDCAP : CRITERIA_CHAIN_NONE );
+   
+   if( _criteriaReorderInterval > 0 ) _criteriaRounds->monitorCriteria( _criteriaReorderInterval );
    
    
 
@@ -359,11 +508,15 @@ void SiliconEndcapTracking::processRunHeader( LCRunHeader* ) {
 void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
 
   // set the correct configuration for the tracking system for this event 
+  // (the fits use the private track system of init() for DDKalTest, so this doesn't change it while other events fit)
   MarlinTrk::TrkSysConfig< MarlinTrk::IMarlinTrkSystem::CFG::useQMS>       mson( _trkSystem,  _MSOn ) ;
   MarlinTrk::TrkSysConfig< MarlinTrk::IMarlinTrkSystem::CFG::usedEdx>      elosson( _trkSystem,_ElossOn) ;
   MarlinTrk::TrkSysConfig< MarlinTrk::IMarlinTrkSystem::CFG::useSmoothing> smoothon( _trkSystem,_SmoothOn) ;
 
-  streamlog_out( DEBUG4 ) << "processing event number " << _nEvt << "\n";
+  // (events may be processed at the same time, every one gets its own number)
+  int nEvt = _nEvt++;
+
+  streamlog_out( DEBUG4 ) << "processing event number " << nEvt << "\n";
    
    //////////////////////////////////////////////////////////////////////////////////////////////////////////////////
    //                                                                                                              //
@@ -392,20 +545,29 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
 //-----------------------------------------------------------------------
   
   
-   // Reset the quality flag of the output track collection (we start with the assumption that our results are good.
-   // If anything happens along the way, we modify this value )
-   _output_track_col_quality = _output_track_col_quality_GOOD;
+   // Everything of this event lives in its context. The quality of the output track collection starts with the
+   // assumption that our results are good. If anything happens along the way, we modify this value.
+   // (the contexts of earlier events are reused, so their arenas and hit store keep their memory)
+   EventContextPool::Lease ctxLease( *_eventContextPool, _output_track_col_quality_GOOD, 0. );
+   EventContext& ctx = ctxLease.get();
 
-   std::vector< IHit* > hitsTBD; //Hits to be deleted at the end
-   _map_sector_hits.clear();
+   SectorHitStore& sectorHitStore = ctx.getSectorHitStore();
+   sectorHitStore.reset( _nSectors );
+   unsigned nEndcapHits = 0;
+   
+   // All hits and track candidates of this event are created in the event arena.
+   // They get destroyed all at once at the end of the event, when the context is given back.
+   EventArena& eventArena = ctx.getArena();
 
    
    /**********************************************************************************************/
-   /*    Read in the collections, create hits from the TrackerHits and store them in a map       */
+   /*    Read in the collections, create hits from the TrackerHits and store them by sector      */
    /**********************************************************************************************/
    
    streamlog_out( DEBUG4 ) << "\t\t---Reading in Collections---\n" ;
    
+   StageTimer::Scope timeReadHits( ctx.getStageTimes(), STAGE_READ_HITS );
+   
    
    for( unsigned iCol=0; iCol < _FTDHitCollections.size(); iCol++ ){ //read in all input collections
       
@@ -445,42 +607,57 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
          }       
 
 	 //Make a EndcapHit01 from the TrackerHit
-	 EndcapHit01* endcapHit = new EndcapHit01 ( trackerHit , _sectorSystemEndcap );
-	 hitsTBD.push_back(endcapHit);
-	 _map_sector_hits[ endcapHit->getSector() ].push_back( endcapHit );
+	 EndcapHit01* endcapHit = eventArena.create< EndcapHit01 >( trackerHit , _sectorSystemEndcap );
+	 sectorHitStore.addHit( endcapHit );
+	 nEndcapHits++;
 	 
       }
       
    }
+   
+   timeReadHits.stop();
   
 
    //just for debug
-   //std::string info = getInfo_map_sector_hits(); 
+   //std::string info = getInfo_map_sector_hits( sectorHitStore ); 
    //streamlog_out( DEBUG2 ) << info.c_str() << std::endl;
    
    
-   if( !_map_sector_hits.empty() ){
+   if( nEndcapHits > 0 ){
 
       
+      /**********************************************************************************************/
+      /*                Add the IP as virtual hit                                                   */
+      /**********************************************************************************************/
+
+      // (It is not taken into account when looking for overlapping hits)
+      sectorHitStore.addHit( createVirtualIPHit( _sectorSystemEndcap, eventArena ) );
+      
+      // sort all hits into their sectors
+      sectorHitStore.build();
+      
+      
       /**********************************************************************************************/
       /*                Check if no sector is overflowing with hits                                 */
       /**********************************************************************************************/
       
       
-      std::map< int , std::vector< IHit* > >::iterator it;
+      const std::vector< int >& occupiedSectors = sectorHitStore.getOccupiedSectors();
       
-      for( it=_map_sector_hits.begin(); it != _map_sector_hits.end(); it++ ){
-       	  
-	int nHits = it->second.size();
-         streamlog_out( DEBUG2 ) << "Number of hits in sector " << it->first << " = " << nHits << "\n";
+      for( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
+         
+         int sector = occupiedSectors[iSec];
+         
+         int nHits = sectorHitStore.getNumberOfHits( sector );
+         streamlog_out( DEBUG2 ) << "Number of hits in sector " << sector << " = " << nHits << "\n";
          
          if( nHits > _maxHitsPerSector ){
             
-            it->second.clear(); //delete the hits in this sector, it will be dropped
+            sectorHitStore.clearSector( sector ); //delete the hits in this sector, it will be dropped
             
-            streamlog_out(ERROR)  << " ### EVENT " << evt->getEventNumber() << " :: RUN " << evt->getRunNumber() << " \n ### Number of Hits in FTD Sector " << it->first << ": " << nHits << " > " << _maxHitsPerSector << " (MaxHitsPerSector)\n : This sector will be dropped from track search, and QualityCode set to \"Poor\" " << std::endl;
+            streamlog_out(ERROR)  << " ### EVENT " << evt->getEventNumber() << " :: RUN " << evt->getRunNumber() << " \n ### Number of Hits in FTD Sector " << sector << ": " << nHits << " > " << _maxHitsPerSector << " (MaxHitsPerSector)\n : This sector will be dropped from track search, and QualityCode set to \"Poor\" " << std::endl;
            
-            _output_track_col_quality = _output_track_col_quality_POOR; // We had to drop hits, so the quality of the result is decreased
+            ctx.degradeQuality( _output_track_col_quality_POOR ); // We had to drop hits, so the quality of the result is decreased
             
          }
          
@@ -498,21 +675,13 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
 
       streamlog_out( DEBUG4 ) << "\t\t---Overlapping Hits---\n" ;
       
-      std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack = getOverlapConnectionMap( _map_sector_hits, _sectorSystemEndcap, _overlappingHitsDistMax);
+      StageTimer::Scope timeOverlapMap( ctx.getStageTimes(), STAGE_OVERLAP_MAP );
       
+      std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack = getOverlapConnectionMap( sectorHitStore, _sectorSystemEndcap, _overlappingHitsDistMax);
+      
+      timeOverlapMap.stop();
       
-     
-
-      /**********************************************************************************************/
-      /*                Add the IP as virtual hit for forward and backward                          */
-      /**********************************************************************************************/
-
-      IHit* virtualIPHitForward = createVirtualIPHit( _sectorSystemEndcap );
-      hitsTBD.push_back( virtualIPHitForward );
-      _map_sector_hits[ virtualIPHitForward->getSector() ].push_back( virtualIPHitForward );
- 
       
-     
       
       /**********************************************************************************************/
       /*                SegmentBuilder and Cellular Automaton                                       */
@@ -521,6 +690,23 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
       unsigned round = 0; // the round we are in
       std::vector < RawTrack > rawTracks;
       
+      // The connections of the hits, kept over the rounds if the cuts are redone incrementally
+      HitConnectionGraph hitConnectionGraph;
+      
+      AutomatonSettings automatonSettings;
+      automatonSettings.maxConnections = unsigned( _maxConnectionsAutomaton );
+      automatonSettings.drawSegments = _useCED;
+      automatonSettings.stage2Hit = STAGE_AUTOMATON_2HIT;
+      automatonSettings.stage3Hit = STAGE_AUTOMATON_3HIT;
+      
+      // The hits as a map, only made when a KiTrack::SegmentBuilder needs them
+      std::map< int , std::vector< IHit* > > map_sector_hits;
+      
+      // The criteria of the round. They belong to _criteriaRounds.
+      std::vector< ICriterion* > crit2Vec;
+      std::vector< ICriterion* > crit3Vec;
+      std::vector< ICriterion* > crit4Vec;
+      
       // The following while loop ideally only runs once. (So we do round 0 and everything works)
       // It will repeat as long as the Automaton creates too many connections and as long as there are new criteria
       // parameters to use to cut down the problem.
@@ -528,11 +714,28 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
       // so the loop will be left. If however there are too many connections we stay in the loop and use 
       // (hopefully) tighter cut offs (if provided in the steering). This should prevent combinatorial breakdown
       // for very evil events.
-      while( setCriteria( round ) ){
+      while( round < _criteriaRounds->getNumberOfRounds() ){
+         
          
+         crit2Vec = _criteriaRounds->getCrit2Vec( round );
+         crit3Vec = _criteriaRounds->getCrit3Vec( round );
+         crit4Vec = _criteriaRounds->getCrit4Vec( round );
          
          round++; // count up the round we are in
          
+         // The same criteria checking many pairs at once
+         const BatchedCriteria* crit2Batch = NULL;
+         const BatchedCriteria* crit3Batch = NULL;
+         const BatchedCriteria* crit4Batch = NULL;
+         
+         if( _batchedCriteria ){
+            
+            crit2Batch = _criteriaRounds->getCrit2Batch( round - 1 );
+            crit3Batch = _criteriaRounds->getCrit3Batch( round - 1 );
+            crit4Batch = _criteriaRounds->getCrit4Batch( round - 1 );
+            
+         }
+         
          
          /**********************************************************************************************/
          /*                Build the segments                                                          */
@@ -540,149 +743,70 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
          
          streamlog_out( DEBUG4 ) << "\t\t---SegementBuilder---\n" ;
          
-         //Create a segmentbuilder
-         SegmentBuilder segBuilder( _map_sector_hits );
-         
-         segBuilder.addCriteria ( _crit2Vec ); // Add the criteria on when to connect two hits. The vector has been filled by the method setCriteria
+         StageTimer::Scope timeSegmentBuilder( ctx.getStageTimes(), STAGE_SEGMENT_BUILDER );
          
-         //Also load hit connectors
+         //Load hit connectors
          unsigned layerStepMax = 1; // how many layers to go at max
          //unsigned layerStepMax = 2; // how many layers to go at max
          //unsigned lastLayerToIP = 9;// layer 1,2,3 and 4 get connected directly to the IP
          unsigned lastLayerToIP = 4;// layer 1,2,3 and 4 get connected directly to the IP
          EndcapSectorConnector secCon( _sectorSystemEndcap , layerStepMax, lastLayerToIP ) ;
          
-         segBuilder.addSectorConnector ( & secCon ); // Add the sector connector (so the SegmentBuilder knows what hits from different sectors it is allowed to look for connections)
-         
-         
-         // And get out the Cellular Automaton with the 1-segments 
-         Automaton automaton = segBuilder.get1SegAutomaton();
-         
-         // Check if there are not too many connections
-         if( automaton.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
+         if( _reuseHitConnections || _flatAutomaton || _batchedCriteria ){
             
-            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
-            << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
-            continue;
+            // The cuts of a later round are tighter, so only the connections that survived the last round need to be checked again
+            // (the flat automaton and the batched criteria always take the connections from the graph, without ReuseHitConnections the graph is built anew)
+            if( !_reuseHitConnections || !hitConnectionGraph.isBuilt() ){
+               
+               if( crit2Batch != NULL ) hitConnectionGraph.build( sectorHitStore, occupiedSectors, &secCon, *crit2Batch );
+               else hitConnectionGraph.build( sectorHitStore, occupiedSectors, &secCon, crit2Vec );
+               
+            }
+            else if( crit2Batch != NULL ) hitConnectionGraph.filter( *crit2Batch );
+            else hitConnectionGraph.filter( crit2Vec );
+            
+            // Check if there are not too many connections, before bothering to create the segments
+            if( hitConnectionGraph.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
+               
+               streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
+               << "\tconnections( " << hitConnectionGraph.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
+               continue;
+               
+            }
             
          }
          
-         
-         
-         /**********************************************************************************************/
-         /*                Automaton                                                                   */
-         /**********************************************************************************************/
-         
-         
-         
-         streamlog_out( DEBUG4 ) << "\t\t---Automaton---\n" ;
-         
-         if( _useCED ) KiTrackMarlin::drawAutomatonSegments( automaton ); // draws the 1-segments (i.e. hits)
-         
-         
-         /*******************************/
-         /*      2-hit segments         */
-         /*******************************/
-         
-         streamlog_out( DEBUG4 ) << "\t\t--2-hit-Segments--\n" ;
-         
-         streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
-         
-         automaton.clearCriteria();
-         automaton.addCriteria( _crit3Vec );  // Add the criteria for 3 hits (i.e. 2 2-hit segments )
-         
-         
-         // Let the automaton lengthen its 1-hit-segments to 2-hit-segments
-         automaton.lengthenSegments();
-        
-	 
-	 // std::vector<const KiTrack::Segment* > vec_seg_2hits = automaton.getSegments();
-	 // for(size_t is=0; is<vec_seg_2hits.size(); is++){
-	 //   streamlog_out( DEBUG2 ) << "-- segment " << is << " has nhits " << vec_seg_2hits.at(is)->getHits().size() << std::endl ;  
-	 //   KiTrack::Segment* test_segment = const_cast<KiTrack::Segment* >(vec_seg_2hits.at(is));
-	 //   streamlog_out( DEBUG2 ) << "-- segment " << is << " has nchildren " << test_segment->getChildren().size() << std::endl ;  
-	 // }
-
-         
-         // So now we have 2-hit-segments and are ready to perform the Cellular Automaton.
-         
-         // Perform the automaton
-         automaton.doAutomaton();
-         
-         
-         // Clean segments with bad states
-         automaton.cleanBadStates();
-         
-        
-         // Reset the states of all segments
-         automaton.resetStates();
-        
-         streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
-         
-         
-         // Check if there are not too many connections
-         if( automaton.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
+         if( _flatAutomaton ){
+            
+            FlatAutomaton automaton( hitConnectionGraph );
+            
+            timeSegmentBuilder.stop();
+            
+            if( runCellularAutomaton( automaton, crit3Vec, crit4Vec, crit3Batch, crit4Batch, automatonSettings, ctx, rawTracks ) == AUTOMATON_DONE ) break;
             
-            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
-            << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
             continue;
             
          }
          
-         /*******************************/
-         /*      3-hit segments         */
-         /*******************************/
-         streamlog_out( DEBUG4 ) << "\t\t--3-hit-Segments--\n" ;
-         
-         
-         automaton.clearCriteria();
-         automaton.addCriteria( _crit4Vec );      
-         
-         
-         // Lengthen the 2-hit-segments to 3-hits-segments
-         automaton.lengthenSegments();
- 
-	 
-	 // std::vector<const KiTrack::Segment* > vec_seg_3hits = automaton.getSegments();
-	 // for(size_t is=0; is<vec_seg_3hits.size(); is++){
-	 //   streamlog_out( DEBUG2 ) << "-- segment " << is << " has nhits " << vec_seg_3hits.at(is)->getHits().size() << std::endl ;  
-	 //   KiTrack::Segment* test_segment_3 = const_cast<KiTrack::Segment* >(vec_seg_3hits.at(is));
-	 //   streamlog_out( DEBUG2 ) << "-- segment " << is << " has nchildren " << test_segment_3->getChildren().size() << std::endl ;  
-	 //   std::string info_seg = test_segment_3->getInfo();
-	 //   streamlog_out( DEBUG2 ) << "-- info segment = " << info_seg.c_str() << std::endl ; 
-	 // }
-	 // //std::vector < std::vector< IHit* > > test_tracks_segment = getTracksOfSegment();
-        
-         
-         // Perform the Cellular Automaton
-         automaton.doAutomaton();
+         //Create a segmentbuilder (with no hits, if the segments come from the hit connection graph)
+         const std::map< int , std::vector< IHit* > > noHits;
+         bool useHitConnectionGraph = _reuseHitConnections || _batchedCriteria;
+         if( !useHitConnectionGraph && map_sector_hits.empty() ) map_sector_hits = sectorHitStore.getMap();
+         SegmentBuilder segBuilder( useHitConnectionGraph ? noHits : map_sector_hits );
          
-         //Clean segments with bad states
-         automaton.cleanBadStates();
+         segBuilder.addCriteria ( crit2Vec ); // Add the criteria on when to connect two hits. The vector has been filled from _criteriaRounds
          
+         segBuilder.addSectorConnector ( & secCon ); // Add the sector connector (so the SegmentBuilder knows what hits from different sectors it is allowed to look for connections)
          
-         //Reset the states of all segments
-         automaton.resetStates();
-         
-
-
-      
-         streamlog_out(DEBUG4) << "Automaton has " << automaton.getTracks( 3 ).size() << " track candidates\n"; //should be commented out, because it takes time
          
+         // And get out the Cellular Automaton with the 1-segments 
+         Automaton automaton = segBuilder.get1SegAutomaton();
          
-         // Check if there are not too many connections
-         if( automaton.getNumberOfConnections() > unsigned( _maxConnectionsAutomaton ) ){
-            
-            streamlog_out( DEBUG4 ) << "Redo the Automaton with different parameters, because there are too many connections:\n"
-            << "\tconnections( " << automaton.getNumberOfConnections() << " ) > MaxConnectionsAutomaton( " << _maxConnectionsAutomaton << " )\n";
-            continue;
-            
-         }
+         if( useHitConnectionGraph ) hitConnectionGraph.fillAutomaton( automaton );
          
-         // get the raw tracks (raw track = just a vector of hits, the most rudimentary form of a track)
-         rawTracks = automaton.getTracks( 3 );
+         timeSegmentBuilder.stop();
          
-         break; // if we reached this place all went well and we don't need another round --> exit the loop
+         if( runCellularAutomaton( automaton, crit3Vec, crit4Vec, crit3Batch, crit4Batch, automatonSettings, ctx, rawTracks ) == AUTOMATON_DONE ) break;
          
       }
       
@@ -724,6 +848,11 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
 
          std::vector< ITrack* > overlappingTrackCands;
          
+         // All versions start with the hits of the raw track, so with the incremental helix fit the raw track is
+         // fitted once here and every version only adds its additional hits.
+         IncrementalHelixFitter rawTrackHelixFitter;
+         if( _incrementalHelixFit ) for( unsigned k=0; k < rawTrack.size(); k++ ) addToHelixFitter( rawTrackHelixFitter, rawTrack[k] );
+         
 
          for( unsigned j=0; j < rawTracksPlus.size(); j++ ){
             
@@ -739,7 +868,7 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
             }
             
 
-            EndcapTrack* trackCand = new EndcapTrack( _trkSystem );
+            EndcapTrack* trackCand = eventArena.create< EndcapTrack >( _fitTrkSystem );
             
             // add the hits to the track
             for( unsigned k=0; k<rawTrackPlus.size(); k++ ){
@@ -752,7 +881,7 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
 
             
             std::vector< IHit* > trackCandHits = trackCand->getHits();
-            streamlog_out( DEBUG2 ) << "-- Evt " << _nEvt <<" -- Fitting track candidate with " << trackCandHits.size() << " hits\n";
+            streamlog_out( DEBUG2 ) << "-- Evt " << nEvt <<" -- Fitting track candidate with " << trackCandHits.size() << " hits\n";
             
             for( unsigned k=0; k < trackCandHits.size(); k++ ) streamlog_out( DEBUG1 ) << trackCandHits[k]->getPositionInfo();
             streamlog_out( DEBUG1 ) << "\n";
@@ -764,14 +893,31 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
             streamlog_out( DEBUG2 ) << "Fitting with Helix Fit\n";
             try{
                
-               EndcapHelixFitter helixFitter( trackCand->getLcioTrack() );
-               float chi2OverNdf = helixFitter.getChi2() / float( helixFitter.getNdf() );
+               StageTimer::Scope timeHelixFit( ctx.getStageTimes(), STAGE_HELIX_FIT );
+               
+               float chi2OverNdf = 0.;
+               
+               if( _incrementalHelixFit ){
+                  
+                  IncrementalHelixFitter helixFitter( rawTrackHelixFitter );
+                  for( unsigned k=rawTrack.size(); k < rawTrackPlus.size(); k++ ) addToHelixFitter( helixFitter, rawTrackPlus[k] );
+                  
+                  helixFitter.fit();
+                  chi2OverNdf = helixFitter.getChi2() / float( helixFitter.getNdf() );
+                  
+               }
+               else{
+                  
+                  EndcapHelixFitter helixFitter( trackCand->getLcioTrack() );
+                  chi2OverNdf = helixFitter.getChi2() / float( helixFitter.getNdf() );
+                  
+               }
+               
                streamlog_out( DEBUG2 ) << "chi2OverNdf = " << chi2OverNdf << "\n";
                
                if( chi2OverNdf > _helixFitMax ){
                   
                   streamlog_out( DEBUG2 ) << "Discarding track because of bad helix fit: chi2/ndf = " << chi2OverNdf << "\n";
-                  delete trackCand;
                   continue;
                   
                }
@@ -782,7 +928,13 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
                
                
                streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
-               delete trackCand;
+               continue;
+               
+            }
+            catch( IncrementalHelixFitterException& e ){
+               
+               
+               streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
                continue;
                
             }
@@ -793,6 +945,10 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
             
             streamlog_out( DEBUG2 ) << "Fitting with Kalman Filter\n";
             try{
+               
+               StageTimer::Scope timeKalmanFit( ctx.getStageTimes(), STAGE_KALMAN_FIT );
+               
+               TrkSystemPool::Lease trkSystem( *_trkSystemPool, trackCand->getTrkSystem() );
                   
                trackCand->fit();
                   
@@ -810,8 +966,8 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
                else{
                   
                   streamlog_out( DEBUG2 ) << "Track rejected (chi2prob " << trackCand->getChi2Prob() << " < " << _chi2ProbCut << "\n";
-                  delete trackCand;
                   
+                  trackCand->releaseFitter();
                   continue;
                   
                }
@@ -822,12 +978,13 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
                
                
                streamlog_out( DEBUG3 ) << "Track rejected, because fit failed: " <<  e.what() << "\n";
-               delete trackCand;
                continue;
                
             }
             
             // If we reach this point than the track got accepted by all cuts
+            // (its fit is only kept, if the output tracks take their states from it)
+            if( !_reuseCandidateFit ) trackCand->releaseFitter();
             overlappingTrackCands.push_back( trackCand );
             
          }
@@ -855,14 +1012,9 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
 		 //bool muchBetterChi2 = (diffChi2<-0.1);
 		 //bool moreHits = (overlappingTrackCands[j]->getHits().size() > bestTrack->getHits().size());
 		 //if (muchBetterChi2 || moreHits){
-                     delete bestTrack; //delete the old one, not needed anymore
+                     // the versions not taken stay in the event arena until the end of the event
                      bestTrack = overlappingTrackCands[j];
                   }
-                  else{
-                     
-                     delete overlappingTrackCands[j]; //delete this one
-                     
-                  }
                   
                }
                streamlog_out( DEBUG2 ) << "Adding best track candidate with " << bestTrack->getHits().size() << " hits\n";
@@ -898,10 +1050,17 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
       
       streamlog_out( DEBUG4 ) << "\t\t---Get best subset of tracks---\n" ;
       
+      StageTimer::Scope timeBestSubset( ctx.getStageTimes(), STAGE_BEST_SUBSET );
+      
       std::vector< ITrack* > tracks;
       std::vector< ITrack* > rejected;
       
-      TrackCompatibilityShare1SP comp;
+      // the conflicts between the tracks are looked up in a graph built once, instead of comparing the hits of every pair
+      TrackConflictGraph conflictGraph( trackCandidates );
+      TrackCompatibilityConflictGraph comp( &conflictGraph );
+      
+      streamlog_out( DEBUG3 ) << conflictGraph.getNumberOfConflicts() << " conflicts between " << trackCandidates.size() << " track candidates\n";
+      
       // TrackQIChi2Prob trackQI;
       // TrackQIChi2ProbSpecial trackQIChi2ProbSpecial;
       TrackNHits trackNHits;
@@ -925,6 +1084,41 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
          tracks = subset.getAccepted();
          rejected = subset.getRejected();
          
+      }
+      else if( _bestSubsetFinder == "SubsetHopfieldNNComponents" ){
+         
+         streamlog_out( DEBUG3 ) << "Use SubsetHopfieldNNComponents for getting the best subset\n" ;
+         
+         std::vector< double > QIs( trackCandidates.size() );
+         for( unsigned i=0; i < trackCandidates.size(); i++ ) QIs[i] = trackNHits( trackCandidates[i] );
+         
+         SparseHopfieldNN hopfieldNN( _HNN_Omega, _HNN_ActivationThreshold, _HNN_TInf );
+         std::vector< bool > accepted = hopfieldNN.calculateBestSet( conflictGraph, QIs, _threadPool );
+         
+         for( unsigned i=0; i < trackCandidates.size(); i++ ){
+            
+            if( accepted[i] ) tracks.push_back( trackCandidates[i] );
+            else rejected.push_back( trackCandidates[i] );
+            
+         }
+         
+      }
+      else if( _bestSubsetFinder == "SubsetExactHybrid" ){
+         
+         streamlog_out( DEBUG3 ) << "Use SubsetExactHybrid for getting the best subset\n" ;
+         
+         std::vector< double > QIs( trackCandidates.size() );
+         for( unsigned i=0; i < trackCandidates.size(); i++ ) QIs[i] = trackNHits( trackCandidates[i] );
+         
+         std::vector< bool > accepted = _subsetExactHybrid->calculateBestSet( conflictGraph, QIs, _threadPool );
+         
+         for( unsigned i=0; i < trackCandidates.size(); i++ ){
+            
+            if( accepted[i] ) tracks.push_back( trackCandidates[i] );
+            else rejected.push_back( trackCandidates[i] );
+            
+         }
+         
       }
       else if( _bestSubsetFinder == "SubsetSimple" ){
          
@@ -953,12 +1147,16 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
       }
       
       
-      for ( unsigned i=0; i<rejected.size(); i++){
+      // the rejected tracks get destroyed with the event arena, their fits are not needed until then
+      for( unsigned i=0; i < rejected.size(); i++ ){
          
-         delete rejected[i];
+         EndcapTrack* rejectedTrack = dynamic_cast< EndcapTrack* >( rejected[i] );
+         if( rejectedTrack != NULL ) rejectedTrack->releaseFitter();
          
       }
       
+      timeBestSubset.stop();
+      
       
       
       /**********************************************************************************************/
@@ -967,6 +1165,8 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
       
       streamlog_out( DEBUG4 ) << "\t\t---Save Tracks---\n" ;
       
+      StageTimer::Scope timeFinalise( ctx.getStageTimes(), STAGE_FINALISE );
+      
       LCCollectionVec * trkCol = new LCCollectionVec(LCIO::TRACK);
       
       // Set the flags
@@ -987,7 +1187,8 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
             
             try{
                
-               finaliseTrack( trackImpl );
+               // with ReuseCandidateFit the Kalman fit of the track candidate is reused, else the track gets fitted again
+               finaliseTrack( trackImpl, _reuseCandidateFit ? myTrack->getFitter() : NULL, myTrack->getTrkSystem() );
                trkCol->addElement( trackImpl );
                
             }
@@ -1002,9 +1203,11 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
          
          
       }
+      
+      timeFinalise.stop();
      
       // set the quality of the output collection
-      switch (_output_track_col_quality) {
+      switch ( ctx.getQuality() ) {
          
          case _output_track_col_quality_FAIR:
             trkCol->parameters().setValue( "QualityCode" , "Fair"  ) ;
@@ -1019,11 +1222,28 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
             break;
       }
 
+      if( _stageTimer != NULL && _timeStagesInCollection ){
+         
+         std::vector< std::string > stageNames;
+         std::vector< float > stageTimes;
+         
+         for( unsigned i=0; i < _stageTimer->getNumberOfStages(); i++ ){
+            
+            stageNames.push_back( _stageTimer->getStageName( i ) );
+            stageTimes.push_back( ctx.getStageTimes()->get( i ) );
+            
+         }
+         
+         trkCol->parameters().setValues( "StageNames" , stageNames );
+         trkCol->parameters().setValues( "StageTimesMs" , stageTimes );
+         
+      }
+
       evt->addCollection(trkCol,_ForwardTrackCollection.c_str());
       
       
       
-      streamlog_out (DEBUG5) << "Forward Tracking found and saved " << tracks.size() << " tracks in event " << _nEvt << "\n"; 
+      streamlog_out (DEBUG5) << "Forward Tracking found and saved " << tracks.size() << " tracks in event " << nEvt << "\n"; 
       for (size_t itrack=0; itrack<tracks.size(); itrack++){
 	streamlog_out (DEBUG5) << " track " << itrack << " has nhits " << tracks.at(itrack)->getHits().size() << "\n";
 	for (size_t ihit=0; ihit<tracks.at(itrack)->getHits().size(); ihit++){
@@ -1032,28 +1252,31 @@ void SiliconEndcapTracking::processEvent( LCEvent * evt ) {
       }
       streamlog_out (DEBUG5) << "\n"; 
       
-      /**********************************************************************************************/
-      /*                Clean up                                                                    */
-      /**********************************************************************************************/
-      
-      // delete all the created IHits
-      for ( unsigned i=0; i<hitsTBD.size(); i++ )  delete hitsTBD[i];
-      
-      // delete the FTracks
-      for (unsigned int i=0; i < tracks.size(); i++){ delete tracks[i];}
-      
-      
-      
-      
    }
+   
+   
+   /**********************************************************************************************/
+   /*                Statistics                                                                  */
+   /**********************************************************************************************/
+   
+   // (the hits and tracks of this event get destroyed, when the context is given back)
+   std::size_t arenaBytes = ctx.getArenaBytesUsed();
+   
+   streamlog_out( DEBUG4 ) << "Event arena held " << ctx.getArenaObjects() << " objects in " << arenaBytes << " bytes\n";
+   
+   std::size_t arenaBytesMax = _arenaBytesMax;
+   while( arenaBytes > arenaBytesMax && !_arenaBytesMax.compare_exchange_weak( arenaBytesMax, arenaBytes ) ){}
+   
+   _arenaBytesSum += arenaBytes;
+   
+   _criteriaRounds->countEvent();
+   
+   if( _stageTimer != NULL ) _stageTimer->addEvent( *ctx.getStageTimes() );
 
 
 
 
    if( _useCED ) MarlinCED::draw(this);
-
-
-   _nEvt ++ ;
    
 }
 
@@ -1067,15 +1290,40 @@ void SiliconEndcapTracking::check( LCEvent* ) {}
 void SiliconEndcapTracking::end(){
    
  
-   for ( unsigned i=0; i< _crit2Vec.size(); i++) delete _crit2Vec[i];
-   for ( unsigned i=0; i< _crit3Vec.size(); i++) delete _crit3Vec[i];
-   for ( unsigned i=0; i< _crit4Vec.size(); i++) delete _crit4Vec[i];
-   _crit2Vec.clear();
-   _crit3Vec.clear();
-   _crit4Vec.clear();
+   if( _criteriaRounds != NULL ) _criteriaRounds->printCriteriaOrder( name() );
+   delete _criteriaRounds;
+   _criteriaRounds = NULL;
+   
+   delete _trkSystemPool;
+   _trkSystemPool = NULL;
+   
+   delete _eventContextPool;
+   _eventContextPool = NULL;
+   
+   // the shared instance of the factory is not ours
+   if( _fitTrkSystem != _trkSystem ) delete _fitTrkSystem;
+   _fitTrkSystem = NULL;
    
    delete _sectorSystemEndcap;
    _sectorSystemEndcap = NULL;
+   
+   if( _stageTimer != NULL ) _stageTimer->printSummary( name() );
+   delete _stageTimer;
+   _stageTimer = NULL;
+   
+   delete _threadPool;
+   _threadPool = NULL;
+   
+   if( _subsetExactHybrid != NULL ) _subsetExactHybrid->printSummary( name() );
+   delete _subsetExactHybrid;
+   _subsetExactHybrid = NULL;
+   
+   if( _nEvt > 0 ){
+      
+      streamlog_out( MESSAGE ) << "Event arena: maximum of " << _arenaBytesMax << " bytes used in one event, mean " 
+                               << double( _arenaBytesSum ) / _nEvt << " bytes per event\n";
+      
+   }
 
    // delete _sectorSystemFTD;
    // _sectorSystemFTD = NULL;
@@ -1091,7 +1339,7 @@ void SiliconEndcapTracking::end(){
 
 
 std::map< IHit* , std::vector< IHit* > > SiliconEndcapTracking::getOverlapConnectionMap(
-            const std::map< int , std::vector< IHit* > > & map_sector_hits, 
+            const SectorHitStore& sectorHitStore, 
             const SectorSystemEndcap*,
             float distMax){
    
@@ -1100,19 +1348,24 @@ std::map< IHit* , std::vector< IHit* > > SiliconEndcapTracking::getOverlapConnec
 
    
    std::map< IHit* , std::vector< IHit* > > map_hitFront_hitsBack;
-   std::map< int , std::vector< IHit* > >::const_iterator it;
+   
+   const std::vector< int >& occupiedSectors = sectorHitStore.getOccupiedSectors();
    
 
    //for every sector
-   for ( it= map_sector_hits.begin() ; it != map_sector_hits.end(); it++ ){
+   for ( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
            
-     std::vector< IHit* > hitVecA = it->second;
-     //int sector = it->first;
+     int sector = occupiedSectors[iSec];
+     
+     unsigned nHits = sectorHitStore.getNumberOfHits( sector );
+     IHit* const* hitVecA = sectorHitStore.getHits( sector );
 
-     for ( unsigned j=0; j < hitVecA.size(); j++ ){
-       for ( unsigned k=j+1; k < hitVecA.size(); k++ ){
+     for ( unsigned j=0; j < nHits; j++ ){
+       for ( unsigned k=j+1; k < nHits; k++ ){
 	 IHit* hitA = hitVecA[j];
 	 IHit* hitB = hitVecA[k];
+	 
+	 if( hitA->isVirtual() || hitB->isVirtual() ) continue;
 
 	 // float dx = hitA->getX() - hitB->getX();
 	 // float dy = hitA->getY() - hitB->getY();
@@ -1234,18 +1487,17 @@ std::map< IHit* , std::vector< IHit* > > SiliconEndcapTracking::getOverlapConnec
 }
 
 
-std::string SiliconEndcapTracking::getInfo_map_sector_hits(){
+std::string SiliconEndcapTracking::getInfo_map_sector_hits( const SectorHitStore& sectorHitStore ) const {
    
    
    std::stringstream s;
    
-   std::map< int , std::vector< IHit* > >::iterator it;
+   const std::vector< int >& occupiedSectors = sectorHitStore.getOccupiedSectors();
    
-   for( it = _map_sector_hits.begin(); it != _map_sector_hits.end(); it++ ){
+   for( unsigned iSec=0; iSec < occupiedSectors.size(); iSec++ ){
       
       
-      std::vector<IHit*> hits = it->second;
-      int sector = it->first;
+      int sector = occupiedSectors[iSec];
       
       //int side = _sectorSystemEndcap->getSide( sector );
       unsigned layer = _sectorSystemEndcap->getLayer( sector );
@@ -1256,7 +1508,7 @@ std::string SiliconEndcapTracking::getInfo_map_sector_hits(){
       << layer << ", theta "
       << theta << ", phi "
       << phi << ") has "
-      << hits.size() << " hits\n";  
+      << sectorHitStore.getNumberOfHits( sector ) << " hits\n";  
       
    }  
    
@@ -1361,111 +1613,45 @@ std::vector < RawTrack > SiliconEndcapTracking::getRawTracksPlusOverlappingHits(
 }
 
 
-bool SiliconEndcapTracking::setCriteria( unsigned round ){
- 
-   // delete the old ones
-   for ( unsigned i=0; i< _crit2Vec.size(); i++) delete _crit2Vec[i];
-   for ( unsigned i=0; i< _crit3Vec.size(); i++) delete _crit3Vec[i];
-   for ( unsigned i=0; i< _crit4Vec.size(); i++) delete _crit4Vec[i];
-   _crit2Vec.clear();
-   _crit3Vec.clear();
-   _crit4Vec.clear();
+void SiliconEndcapTracking::finaliseTrack( TrackImpl* trackImpl, Fitter* fitter, MarlinTrk::IMarlinTrkSystem* trkSystem ){
    
    
+   // The fitter uses the track system it was made with, so that one is needed. Without the fit of the track 
+   // candidate the track gets fitted here.
+   TrkSystemPool::Lease lease( *_trkSystemPool, fitter != NULL ? trkSystem : _fitTrkSystem );
    
-   bool newValuesGotUsed = false; // if new values are used
+   std::unique_ptr< Fitter > ownFitter;
    
-   for( unsigned i=0; i<_criteriaNames.size(); i++ ){
-      
-      std::string critName = _criteriaNames[i];
-      
-      
-      float min = _critMinima[critName].back();
-      float max = _critMaxima[critName].back();
-      
-      
-      
-      // use the value corresponding to the round, if there are no new ones for this criterion, just do nothing (the previous value stays in place)
-      if( round + 1 <= _critMinima[critName].size() ){
-         
-         min =  _critMinima[critName][round];
-         newValuesGotUsed = true;
-         
-      }
-      
-      if( round + 1 <= _critMaxima[critName].size() ){
-         
-         max =  _critMaxima[critName][round];
-         newValuesGotUsed = true;
-         
-      }
-      
-      ICriterion* crit = Criteria::createCriterion( critName, min , max );
-      
-      // Some debug output about the created criterion
-      std::string type = crit->getType();
-      
-      streamlog_out( DEBUG3 ) <<  "Added: Criterion " << critName << " (type =  " << type 
-      << " ). Min = " << min
-      << ", Max = " << max
-      << ", round " << round << "\n";
-      
-      
-      // Add the new criterion to the corresponding vector
-      if( type == "2Hit" ){
-         
-         _crit2Vec.push_back( crit );
-         
-      }
-      else if( type == "3Hit" ){
-         
-         _crit3Vec.push_back( crit );
-         
-      }
-      else if( type == "4Hit" ){
-         
-         _crit4Vec.push_back( crit );
-         
-      }
-      else delete crit;
+   if( fitter == NULL ){
       
+      ownFitter.reset( new Fitter( trackImpl , lease.get() ) );
+      fitter = ownFitter.get();
       
    }
    
-   return newValuesGotUsed;
-   
-   
-}
-
-
-void SiliconEndcapTracking::finaliseTrack( TrackImpl* trackImpl ){
-   
-   
-   Fitter fitter( trackImpl , _trkSystem );
-   
    trackImpl->trackStates().clear();
    
 
-   TrackStateImpl* trkStateIP = new TrackStateImpl( *fitter.getTrackState( lcio::TrackState::AtIP ) ) ;
+   TrackStateImpl* trkStateIP = new TrackStateImpl( *fitter->getTrackState( lcio::TrackState::AtIP ) ) ;
    trkStateIP->setLocation( TrackState::AtIP );
    trackImpl->addTrackState( trkStateIP );
    
-   TrackStateImpl* trkStateFirstHit = new TrackStateImpl( *fitter.getTrackState( TrackState::AtFirstHit ) ) ;
+   TrackStateImpl* trkStateFirstHit = new TrackStateImpl( *fitter->getTrackState( TrackState::AtFirstHit ) ) ;
    trkStateFirstHit->setLocation( TrackState::AtFirstHit );
    trackImpl->addTrackState( trkStateFirstHit );
    
-   TrackStateImpl* trkStateLastHit = new TrackStateImpl( *fitter.getTrackState( TrackState::AtLastHit ) ) ;
+   TrackStateImpl* trkStateLastHit = new TrackStateImpl( *fitter->getTrackState( TrackState::AtLastHit ) ) ;
    trkStateLastHit->setLocation( TrackState::AtLastHit );
    trackImpl->addTrackState( trkStateLastHit );
    
    if( _getTrackStateAtCaloFace ) {
-     TrackStateImpl* trkStateAtCalo = new TrackStateImpl( *fitter.getTrackState( TrackState::AtCalorimeter ) ) ;
+     TrackStateImpl* trkStateAtCalo = new TrackStateImpl( *fitter->getTrackState( TrackState::AtCalorimeter ) ) ;
      trkStateAtCalo->setLocation( TrackState::AtCalorimeter );
      trackImpl->addTrackState( trkStateAtCalo );
    }
 
-   trackImpl->setChi2( fitter.getChi2( TrackState::AtIP ) );
-   trackImpl->setNdf(  fitter.getNdf ( TrackState::AtIP ) );
+   trackImpl->setChi2( fitter->getChi2( TrackState::AtIP ) );
+   trackImpl->setNdf(  fitter->getNdf ( TrackState::AtIP ) );
    
    const float* p = trkStateFirstHit->getReferencePoint();
    trackImpl->setRadiusOfInnermostHit( sqrt( p[0]*p[0] + p[1]*p[1] + p[2]*p[2] ) );
@@ -1564,13 +1750,25 @@ void SiliconEndcapTracking::getCellID0AndPositionInfo(LCCollection*& col ){
 
 
 
-EndcapHitSimple* SiliconEndcapTracking::createVirtualIPHit( const SectorSystemEndcap* sectorSystemEndcap ){
+void SiliconEndcapTracking::addToHelixFitter( IncrementalHelixFitter& helixFitter, IHit* hit ){
+   
+   
+   if( hit->isVirtual() ) return;
+   
+   IEndcapHit* endcapHit = dynamic_cast< IEndcapHit* >( hit );
+   
+   if( endcapHit != NULL && endcapHit->getTrackerHit() != NULL ) helixFitter.addHit( endcapHit->getTrackerHit() );
+   
+}
+
+
+EndcapHitSimple* SiliconEndcapTracking::createVirtualIPHit( const SectorSystemEndcap* sectorSystemEndcap, EventArena& eventArena ){
    
    int layer = 0 ;
    int phi = 0 ;
    int theta = 0 ;
 
-   EndcapHitSimple* virtualIPHit = new EndcapHitSimple( 0.,0.,0., layer, phi, theta, sectorSystemEndcap );
+   EndcapHitSimple* virtualIPHit = eventArena.create< EndcapHitSimple >( 0.,0.,0., layer, phi, theta, sectorSystemEndcap );
 
    virtualIPHit->setIsVirtual ( true );
    
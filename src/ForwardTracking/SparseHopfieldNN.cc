@@ -0,0 +1,129 @@
+#include "SparseHopfieldNN.h"
+
+#include <cmath>
+#include <functional>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+
+
+SparseHopfieldNN::SparseHopfieldNN( double omega, double activationThreshold, double TInf ):
+_omega( omega ),
+_activationThreshold( activationThreshold ),
+_TInf( TInf ),
+_T( 2.1 ),
+_limitForConvergence( 0.01 ),
+_maxIterations( 1000 ){}
+
+
+std::vector< bool > SparseHopfieldNN::calculateBestSet( const std::vector< std::vector< unsigned > >& conflicts,
+                                                        const std::vector< double >& QIs ) const {
+
+
+   unsigned nNeurons = QIs.size();
+
+   std::vector< double > states( nNeurons, 0. );
+
+   double T = _T;
+
+   bool isStable = false;
+   unsigned nIterations = 0;
+
+   while( !isStable && nIterations < _maxIterations ){
+
+
+      isStable = true;
+      nIterations++;
+
+      for( unsigned i=0; i < nNeurons; i++ ){
+
+
+         double sumConflicts = 0.;
+         for( unsigned j=0; j < conflicts[i].size(); j++ ) sumConflicts += states[ conflicts[i][j] ];
+
+         double y = _omega * QIs[i] - ( 1. - _omega ) * sumConflicts;
+
+         double state = 0.5 * ( 1. + std::tanh( y / T ) );
+
+         if( std::fabs( state - states[i] ) > _limitForConvergence ) isStable = false;
+
+         states[i] = state;
+
+      }
+
+      T = 0.5 * ( T + _TInf );
+
+   }
+
+   if( !isStable ) streamlog_out( DEBUG3 ) << "SparseHopfieldNN: net with " << nNeurons << " neurons not stable after "
+                                           << nIterations << " iterations\n";
+
+
+   std::vector< bool > accepted( nNeurons );
+
+   for( unsigned i=0; i < nNeurons; i++ ) accepted[i] = ( states[i] >= _activationThreshold );
+
+   return accepted;
+
+}
+
+
+std::vector< bool > SparseHopfieldNN::calculateBestSet( const TrackConflictGraph& conflictGraph,
+                                                        const std::vector< double >& QIs,
+                                                        WorkStealingThreadPool* threadPool ) const {
+
+
+   unsigned nTracks = conflictGraph.getNumberOfTracks();
+
+   std::vector< std::vector< unsigned > > components = conflictGraph.getComponents();
+
+   // the components with conflicts, tracks without any are accepted right away
+   std::vector< unsigned > componentsToSolve;
+
+   // char and not bool: the components are written from different threads
+   std::vector< char > accepted( nTracks, 0 );
+
+   for( unsigned c=0; c < components.size(); c++ ){
+
+
+      if( components[c].size() == 1 ){
+
+         accepted[ components[c][0] ] = 1;
+         continue;
+
+      }
+
+      componentsToSolve.push_back( c );
+
+   }
+
+   streamlog_out( DEBUG3 ) << "SparseHopfieldNN: " << nTracks << " tracks in " << components.size() << " components, "
+                           << componentsToSolve.size() << " of them with conflicts\n";
+
+
+   std::function< void( unsigned ) > solveComponent = [&]( unsigned k ){
+
+
+      const std::vector< unsigned >& component = components[ componentsToSolve[k] ];
+
+      std::vector< std::vector< unsigned > > conflicts;
+      conflictGraph.getComponentConflicts( component, conflicts );
+
+      std::vector< double > componentQIs( component.size() );
+      for( unsigned i=0; i < component.size(); i++ ) componentQIs[i] = QIs[ component[i] ];
+
+      std::vector< bool > componentAccepted = calculateBestSet( conflicts, componentQIs );
+
+      for( unsigned i=0; i < component.size(); i++ ) accepted[ component[i] ] = componentAccepted[i];
+
+   };
+
+   if( threadPool != NULL ) threadPool->parallelFor( componentsToSolve.size(), solveComponent );
+   else for( unsigned k=0; k < componentsToSolve.size(); k++ ) solveComponent( k );
+
+
+   return std::vector< bool >( accepted.begin(), accepted.end() );
+
+}
@@ -0,0 +1,122 @@
+#include "StageTimer.h"
+
+#include <algorithm>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+
+
+void StageTimer::EventTimes::add( unsigned stage, double milliseconds ){
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   _times[stage] += milliseconds;
+
+}
+
+
+double StageTimer::EventTimes::get( unsigned stage ) const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   return _times[stage];
+
+}
+
+
+void StageTimer::EventTimes::reset(){
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   _times.assign( _times.size(), 0. );
+
+}
+
+
+StageTimer::StageTimer( const std::vector< std::string >& stageNames ):
+_stageNames( stageNames ),
+_eventTimes( stageNames.size() ){}
+
+
+void StageTimer::addEvent( const EventTimes& eventTimes ){
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   for( unsigned stage=0; stage < _stageNames.size(); stage++ ){
+
+      double time = stage < eventTimes.getNumberOfStages() ? eventTimes.get( stage ) : 0.;
+
+      _eventTimes[stage].push_back( time );
+
+   }
+
+}
+
+
+void StageTimer::printSummary( const std::string& name ) const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   if( _stageNames.empty() || _eventTimes[0].empty() ) return;
+
+   streamlog_out( MESSAGE ) << name << ": time per event in ms for " << _eventTimes[0].size() << " events "
+                            << "(mean, median, 95%, 99%, max):\n";
+
+   for( unsigned stage=0; stage < _stageNames.size(); stage++ ){
+
+
+      std::vector< float > times = _eventTimes[stage];
+      std::sort( times.begin(), times.end() );
+
+      double sum = 0.;
+      for( unsigned i=0; i < times.size(); i++ ) sum += times[i];
+
+      unsigned n = times.size();
+
+      streamlog_out( MESSAGE ) << "   " << _stageNames[stage] << ": "
+                               << sum / n << ", "
+                               << times[ ( n - 1 ) / 2 ] << ", "
+                               << times[ unsigned( 0.95*( n - 1 ) ) ] << ", "
+                               << times[ unsigned( 0.99*( n - 1 ) ) ] << ", "
+                               << times.back() << "\n";
+
+   }
+
+}
+
+
+StageTimer::Scope::Scope( EventTimes* eventTimes, unsigned stage ):
+_eventTimes( eventTimes ),
+_stage( stage ){
+
+   if( _eventTimes != NULL ) _start = std::chrono::steady_clock::now();
+
+}
+
+
+StageTimer::Scope::~Scope(){
+
+   stop();
+
+}
+
+
+void StageTimer::Scope::stop(){
+
+
+   if( _eventTimes == NULL ) return;
+
+   std::chrono::duration< double, std::milli > time = std::chrono::steady_clock::now() - _start;
+
+   _eventTimes->add( _stage, time.count() );
+
+   _eventTimes = NULL;
+
+}
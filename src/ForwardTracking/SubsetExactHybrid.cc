@@ -0,0 +1,181 @@
+#include "SubsetExactHybrid.h"
+
+#include <chrono>
+#include <functional>
+
+#include "marlin/VerbosityLevels.h"
+
+
+using namespace KiTrackMarlin;
+
+
+SubsetExactHybrid::SubsetExactHybrid( const ExactSubsetSolver& exactSolver, const SparseHopfieldNN& hopfieldNN, bool compareHopfield ):
+_exactSolver( exactSolver ),
+_hopfieldNN( hopfieldNN ),
+_compareHopfield( compareHopfield ),
+_nOutOfNodes( 0 ){}
+
+
+void SubsetExactHybrid::Statistics::add( const Statistics& statistics ){
+
+
+   nComponents += statistics.nComponents;
+   nTracks += statistics.nTracks;
+   timeMs += statistics.timeMs;
+   quality += statistics.quality;
+
+}
+
+
+double SubsetExactHybrid::getQuality( const std::vector< double >& QIs, const std::vector< bool >& accepted ){
+
+
+   double quality = 0.;
+
+   for( unsigned i=0; i < QIs.size(); i++ ) if( accepted[i] ) quality += QIs[i];
+
+   return quality;
+
+}
+
+
+std::vector< bool > SubsetExactHybrid::calculateBestSet( const TrackConflictGraph& conflictGraph,
+                                                         const std::vector< double >& QIs,
+                                                         WorkStealingThreadPool* threadPool ){
+
+
+   unsigned nTracks = conflictGraph.getNumberOfTracks();
+
+   std::vector< std::vector< unsigned > > components = conflictGraph.getComponents();
+
+   // the components with conflicts, tracks without any are accepted right away
+   std::vector< unsigned > componentsToSolve;
+
+   // char and not bool: the components are written from different threads
+   std::vector< char > accepted( nTracks, 0 );
+
+   for( unsigned c=0; c < components.size(); c++ ){
+
+      if( components[c].size() == 1 ) accepted[ components[c][0] ] = 1;
+      else componentsToSolve.push_back( c );
+
+   }
+
+
+   std::function< void( unsigned ) > solveComponent = [&]( unsigned k ){
+
+
+      const std::vector< unsigned >& component = components[ componentsToSolve[k] ];
+
+      std::vector< std::vector< unsigned > > conflicts;
+      conflictGraph.getComponentConflicts( component, conflicts );
+
+      std::vector< double > componentQIs( component.size() );
+      for( unsigned i=0; i < component.size(); i++ ) componentQIs[i] = QIs[ component[i] ];
+
+
+      Statistics exact;
+      Statistics hopfield;
+      Statistics hopfieldOnExact;
+      bool isOutOfNodes = false;
+
+      std::vector< bool > componentAccepted;
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      bool isSolvedExactly = false;
+
+      if( component.size() <= _exactSolver.getMaxSize() ){
+
+         isSolvedExactly = _exactSolver.calculateBestSet( conflicts, componentQIs, componentAccepted );
+         isOutOfNodes = !isSolvedExactly;
+
+      }
+
+      std::chrono::duration< double, std::milli > time = std::chrono::steady_clock::now() - start;
+
+      if( isSolvedExactly ){
+
+
+         exact.nComponents = 1;
+         exact.nTracks = component.size();
+         exact.timeMs = time.count();
+         exact.quality = getQuality( componentQIs, componentAccepted );
+
+         if( _compareHopfield ){
+
+            start = std::chrono::steady_clock::now();
+
+            std::vector< bool > hopfieldAccepted = _hopfieldNN.calculateBestSet( conflicts, componentQIs );
+
+            time = std::chrono::steady_clock::now() - start;
+
+            hopfieldOnExact.nComponents = 1;
+            hopfieldOnExact.nTracks = component.size();
+            hopfieldOnExact.timeMs = time.count();
+            hopfieldOnExact.quality = getQuality( componentQIs, hopfieldAccepted );
+
+         }
+
+      }
+      else{
+
+
+         // the time of an unsuccessful exact search counts for the Hopfield Neural Network
+         start -= std::chrono::duration_cast< std::chrono::steady_clock::duration >( time );
+
+         componentAccepted = _hopfieldNN.calculateBestSet( conflicts, componentQIs );
+
+         time = std::chrono::steady_clock::now() - start;
+
+         hopfield.nComponents = 1;
+         hopfield.nTracks = component.size();
+         hopfield.timeMs = time.count();
+         hopfield.quality = getQuality( componentQIs, componentAccepted );
+
+      }
+
+      for( unsigned i=0; i < component.size(); i++ ) accepted[ component[i] ] = componentAccepted[i];
+
+
+      std::lock_guard< std::mutex > lock( _mutex );
+
+      _exact.add( exact );
+      _hopfield.add( hopfield );
+      _hopfieldOnExact.add( hopfieldOnExact );
+      if( isOutOfNodes ) _nOutOfNodes++;
+
+   };
+
+   if( threadPool != NULL ) threadPool->parallelFor( componentsToSolve.size(), solveComponent );
+   else for( unsigned k=0; k < componentsToSolve.size(); k++ ) solveComponent( k );
+
+
+   return std::vector< bool >( accepted.begin(), accepted.end() );
+
+}
+
+
+void SubsetExactHybrid::printSummary( const std::string& name ) const {
+
+
+   std::lock_guard< std::mutex > lock( _mutex );
+
+   streamlog_out( MESSAGE ) << name << ": SubsetExactHybrid solved " << _exact.nComponents << " components ("
+                            << _exact.nTracks << " tracks) exactly in " << _exact.timeMs << " ms, summed quality "
+                            << _exact.quality << "\n";
+
+   streamlog_out( MESSAGE ) << name << ": SubsetExactHybrid solved " << _hopfield.nComponents << " components ("
+                            << _hopfield.nTracks << " tracks) with the Hopfield Neural Network in " << _hopfield.timeMs
+                            << " ms, summed quality " << _hopfield.quality << " (" << _nOutOfNodes
+                            << " of them because the exact search ran out of nodes)\n";
+
+   if( _compareHopfield ){
+
+      streamlog_out( MESSAGE ) << name << ": the Hopfield Neural Network on the exactly solved components took "
+                               << _hopfieldOnExact.timeMs << " ms, summed quality " << _hopfieldOnExact.quality
+                               << " (exact: " << _exact.quality << ")\n";
+
+   }
+
+}
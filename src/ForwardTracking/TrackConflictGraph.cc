@@ -0,0 +1,213 @@
+#include "TrackConflictGraph.h"
+
+#include <algorithm>
+
+
+using namespace KiTrackMarlin;
+using namespace KiTrack;
+
+
+TrackConflictGraph::TrackConflictGraph( const std::vector< ITrack* >& tracks ):
+_tracks( tracks ),
+_conflicts( tracks.size() ),
+_nConflicts( 0 ){
+
+
+   _map_track_index.reserve( _tracks.size() );
+
+   // the inverted index: for every hit the tracks using it
+   std::unordered_map< IHit* , std::vector< unsigned > > map_hit_tracks;
+
+   for( unsigned i=0; i < _tracks.size(); i++ ){
+
+
+      _map_track_index[ _tracks[i] ] = i;
+
+      std::vector< IHit* > hits = _tracks[i]->getHits();
+
+      for( unsigned j=0; j < hits.size(); j++ ) map_hit_tracks[ hits[j] ].push_back( i );
+
+   }
+
+
+   // all tracks at the same hit are in conflict with each other
+   std::unordered_map< IHit* , std::vector< unsigned > >::const_iterator it;
+
+   for( it = map_hit_tracks.begin(); it != map_hit_tracks.end(); it++ ){
+
+
+      const std::vector< unsigned >& hitTracks = it->second;
+
+      for( unsigned a=0; a < hitTracks.size(); a++ ){
+
+         for( unsigned b=a+1; b < hitTracks.size(); b++ ){
+
+            _conflicts[ hitTracks[a] ].push_back( hitTracks[b] );
+            _conflicts[ hitTracks[b] ].push_back( hitTracks[a] );
+
+         }
+
+      }
+
+   }
+
+
+   // tracks sharing more than one hit got listed more than once
+   for( unsigned i=0; i < _conflicts.size(); i++ ){
+
+      std::sort( _conflicts[i].begin(), _conflicts[i].end() );
+      _conflicts[i].erase( std::unique( _conflicts[i].begin(), _conflicts[i].end() ), _conflicts[i].end() );
+
+      // a track using a hit twice is not in conflict with itself
+      _conflicts[i].erase( std::remove( _conflicts[i].begin(), _conflicts[i].end(), i ), _conflicts[i].end() );
+
+      _nConflicts += _conflicts[i].size();
+
+   }
+
+   _nConflicts /= 2;
+
+}
+
+
+TrackConflictGraph::TrackConflictGraph( const TrackConflictGraph& graph, const std::vector< unsigned >& indices,
+                                        const std::vector< ITrack* >& tracks ):
+_tracks( tracks ),
+_conflicts( tracks.size() ),
+_nConflicts( 0 ){
+
+
+   _map_track_index.reserve( _tracks.size() );
+
+   // the new index of every kept track of graph, -1 for the others
+   std::vector< int > newIndex( graph.getNumberOfTracks(), -1 );
+
+   for( unsigned i=0; i < _tracks.size(); i++ ){
+
+      _map_track_index[ _tracks[i] ] = i;
+      newIndex[ indices[i] ] = i;
+
+   }
+
+   // the conflicts among the kept tracks, with their new indices
+   for( unsigned i=0; i < _conflicts.size(); i++ ){
+
+      const std::vector< unsigned >& conflicts = graph.getConflicts( indices[i] );
+
+      for( unsigned j=0; j < conflicts.size(); j++ ) if( newIndex[ conflicts[j] ] >= 0 ) _conflicts[i].push_back( newIndex[ conflicts[j] ] );
+
+      std::sort( _conflicts[i].begin(), _conflicts[i].end() );
+
+      _nConflicts += _conflicts[i].size();
+
+   }
+
+   _nConflicts /= 2;
+
+}
+
+
+std::vector< std::vector< unsigned > > TrackConflictGraph::getComponents() const {
+
+
+   std::vector< std::vector< unsigned > > components;
+
+   std::vector< bool > isVisited( _tracks.size(), false );
+
+   for( unsigned start=0; start < _tracks.size(); start++ ){
+
+
+      if( isVisited[start] ) continue;
+
+      // breadth first search from the track
+      std::vector< unsigned > component( 1, start );
+      isVisited[start] = true;
+
+      for( unsigned i=0; i < component.size(); i++ ){
+
+         const std::vector< unsigned >& conflicts = _conflicts[ component[i] ];
+
+         for( unsigned j=0; j < conflicts.size(); j++ ){
+
+            if( isVisited[ conflicts[j] ] ) continue;
+
+            isVisited[ conflicts[j] ] = true;
+            component.push_back( conflicts[j] );
+
+         }
+
+      }
+
+      std::sort( component.begin(), component.end() );
+      components.push_back( component );
+
+   }
+
+   return components;
+
+}
+
+
+void TrackConflictGraph::getComponentConflicts( const std::vector< unsigned >& component,
+                                                std::vector< std::vector< unsigned > >& conflicts ) const {
+
+
+   conflicts.assign( component.size(), std::vector< unsigned >() );
+
+   for( unsigned i=0; i < component.size(); i++ ){
+
+
+      const std::vector< unsigned >& trackConflicts = _conflicts[ component[i] ];
+
+      for( unsigned j=0; j < trackConflicts.size(); j++ ){
+
+         std::vector< unsigned >::const_iterator it = std::lower_bound( component.begin(), component.end(), trackConflicts[j] );
+
+         if( it != component.end() && *it == trackConflicts[j] ) conflicts[i].push_back( it - component.begin() );
+
+      }
+
+   }
+
+}
+
+
+int TrackConflictGraph::getIndex( ITrack* track ) const {
+
+
+   std::unordered_map< ITrack* , unsigned >::const_iterator it = _map_track_index.find( track );
+
+   if( it == _map_track_index.end() ) return -1;
+
+   return it->second;
+
+}
+
+
+bool TrackConflictGraph::areInConflict( unsigned indexA, unsigned indexB ) const {
+
+
+   // look in the shorter list
+   const std::vector< unsigned >& conflictsA = _conflicts[indexA];
+   const std::vector< unsigned >& conflictsB = _conflicts[indexB];
+
+   if( conflictsA.size() <= conflictsB.size() ) return std::binary_search( conflictsA.begin(), conflictsA.end(), indexB );
+   else return std::binary_search( conflictsB.begin(), conflictsB.end(), indexA );
+
+}
+
+
+bool TrackConflictGraph::areCompatible( ITrack* trackA, ITrack* trackB ) const {
+
+
+   int indexA = getIndex( trackA );
+   int indexB = getIndex( trackB );
+
+   if( indexA < 0 || indexB < 0 ) return true;
+
+   // like in TrackCompatibilityShare1SP a track shares its hits with itself
+   if( indexA == indexB ) return false;
+
+   return !areInConflict( indexA, indexB );
+
+}
@@ -0,0 +1,91 @@
+#include "TrkSystemPool.h"
+
+
+using namespace KiTrackMarlin;
+
+
+TrkSystemPool::TrkSystemPool( const std::vector< MarlinTrk::IMarlinTrkSystem* >& trkSystems ):
+_trkSystems( trkSystems ),
+_isFree( trkSystems.size(), true ){}
+
+
+MarlinTrk::IMarlinTrkSystem* TrkSystemPool::checkout(){
+
+
+   std::unique_lock< std::mutex > lock( _mutex );
+
+   while( true ){
+
+      for( unsigned i=0; i < _trkSystems.size(); i++ ){
+
+         if( _isFree[i] ){
+
+            _isFree[i] = false;
+            return _trkSystems[i];
+
+         }
+
+      }
+
+      _givenBack.wait( lock );
+
+   }
+
+}
+
+
+MarlinTrk::IMarlinTrkSystem* TrkSystemPool::checkout( MarlinTrk::IMarlinTrkSystem* trkSystem ){
+
+
+   std::unique_lock< std::mutex > lock( _mutex );
+
+   // the same track system may be in the pool more than once (the shared instance of the MarlinTrk::Factory)
+   bool isInPool = false;
+
+   while( true ){
+
+      for( unsigned i=0; i < _trkSystems.size(); i++ ){
+
+         if( _trkSystems[i] != trkSystem ) continue;
+
+         isInPool = true;
+
+         if( _isFree[i] ){
+
+            _isFree[i] = false;
+            return trkSystem;
+
+         }
+
+      }
+
+      if( !isInPool ) return trkSystem;
+
+      _givenBack.wait( lock );
+
+   }
+
+}
+
+
+void TrkSystemPool::giveBack( MarlinTrk::IMarlinTrkSystem* trkSystem ){
+
+
+   {
+      std::lock_guard< std::mutex > lock( _mutex );
+
+      for( unsigned i=0; i < _trkSystems.size(); i++ ){
+
+         if( _trkSystems[i] == trkSystem && !_isFree[i] ){
+
+            _isFree[i] = true;
+            break;
+
+         }
+
+      }
+   }
+
+   _givenBack.notify_all();
+
+}
@@ -0,0 +1,213 @@
+#include "WorkStealingThreadPool.h"
+
+#include <algorithm>
+#include <exception>
+
+
+using namespace KiTrackMarlin;
+
+
+namespace{
+
+   // The pool a thread is a worker of and its index there
+   thread_local const WorkStealingThreadPool* t_pool = nullptr;
+   thread_local unsigned t_index = 0;
+
+}
+
+
+WorkStealingThreadPool::WorkStealingThreadPool( unsigned nThreads ): _nQueued( 0 ), _stop( false ){
+
+   if( nThreads == 0 ) nThreads = 1;
+
+   for( unsigned i=0; i < nThreads; i++ ) _queues.push_back( std::unique_ptr< TaskQueue >( new TaskQueue() ) );
+
+   // thread 0 is whoever calls parallelFor, so only start the others
+   for( unsigned i=1; i < nThreads; i++ ) _workers.push_back( std::thread( &WorkStealingThreadPool::workerLoop, this, i ) );
+
+}
+
+
+WorkStealingThreadPool::~WorkStealingThreadPool(){
+
+   {
+      std::lock_guard< std::mutex > lock( _sleepMutex );
+      _stop = true;
+   }
+   _wakeUp.notify_all();
+
+   for( unsigned i=0; i < _workers.size(); i++ ) _workers[i].join();
+
+}
+
+
+void WorkStealingThreadPool::parallelFor( unsigned n, const std::function< void( unsigned ) >& body ){
+
+
+   if( n == 0 ) return;
+
+   unsigned nThreads = getNumberOfThreads();
+
+   if( nThreads == 1 || n == 1 ){
+
+      for( unsigned i=0; i < n; i++ ) body( i );
+      return;
+
+   }
+
+   unsigned self = ( t_pool == this ) ? t_index : 0;
+
+   // Split the range in chunks: enough of them so that stealing can balance the load, but not one task per
+   // index for very large ranges.
+   unsigned nChunks = std::min( n, 8*nThreads );
+   unsigned chunkSize = ( n + nChunks - 1 ) / nChunks;
+   nChunks = ( n + chunkSize - 1 ) / chunkSize;
+
+   std::atomic< unsigned > nRemaining( nChunks );
+   std::exception_ptr firstException;
+   std::mutex exceptionMutex;
+
+
+   {
+      std::lock_guard< std::mutex > lock( _queues[self]->mutex );
+
+      for( unsigned c=0; c < nChunks; c++ ){
+
+         unsigned begin = c*chunkSize;
+         unsigned end = std::min( n, begin + chunkSize );
+
+         Task task;
+         task.work = [ this, begin, end, &body, &nRemaining, &firstException, &exceptionMutex ](){
+
+            try{
+
+               for( unsigned i=begin; i < end; i++ ) body( i );
+
+            }
+            catch( ... ){
+
+               std::lock_guard< std::mutex > exLock( exceptionMutex );
+               if( !firstException ) firstException = std::current_exception();
+
+            }
+
+            // The last task wakes the caller, in case it sleeps. (After the decrement the locals of the
+            // call may be gone already, only the pool itself may be used.)
+            if( --nRemaining == 0 ){
+
+               {
+                  std::lock_guard< std::mutex > sleepLock( _sleepMutex );
+               }
+               _wakeUp.notify_all();
+
+            }
+
+         };
+
+         _queues[self]->tasks.push_back( std::move( task ) );
+
+      }
+
+      _nQueued += nChunks;
+
+   }
+
+   {
+      std::lock_guard< std::mutex > lock( _sleepMutex );
+   }
+   _wakeUp.notify_all();
+
+
+   // Work on the tasks as well until all of this call are done. These don't have to be our own ones: if
+   // others have stolen ours, we help out elsewhere. If there is nothing to take, the remaining tasks of this
+   // call are running on other threads: sleep until they are done or there is new work.
+   while( nRemaining > 0 ){
+
+      if( runOneTask( self ) ) continue;
+
+      std::unique_lock< std::mutex > lock( _sleepMutex );
+      _wakeUp.wait( lock, [ this, &nRemaining ](){ return nRemaining == 0 || _nQueued > 0; } );
+
+   }
+
+   if( firstException ) std::rethrow_exception( firstException );
+
+}
+
+
+void WorkStealingThreadPool::workerLoop( unsigned index ){
+
+
+   t_pool = this;
+   t_index = index;
+
+   while( true ){
+
+      if( runOneTask( index ) ) continue;
+
+      std::unique_lock< std::mutex > lock( _sleepMutex );
+      _wakeUp.wait( lock, [ this ](){ return _stop || _nQueued > 0; } );
+
+      if( _stop ) return;
+
+   }
+
+}
+
+
+bool WorkStealingThreadPool::runOneTask( unsigned index ){
+
+
+   Task task;
+
+   if( !popOwn( index, task ) && !steal( index, task ) ) return false;
+
+   task.work();
+
+   return true;
+
+}
+
+
+bool WorkStealingThreadPool::popOwn( unsigned index, Task& task ){
+
+
+   TaskQueue& queue = *_queues[index];
+
+   std::lock_guard< std::mutex > lock( queue.mutex );
+
+   if( queue.tasks.empty() ) return false;
+
+   task = std::move( queue.tasks.back() );
+   queue.tasks.pop_back();
+   _nQueued--;
+
+   return true;
+
+}
+
+
+bool WorkStealingThreadPool::steal( unsigned index, Task& task ){
+
+
+   unsigned nThreads = getNumberOfThreads();
+
+   for( unsigned i=1; i < nThreads; i++ ){
+
+      TaskQueue& queue = *_queues[ ( index + i ) % nThreads ];
+
+      std::lock_guard< std::mutex > lock( queue.mutex );
+
+      if( queue.tasks.empty() ) continue;
+
+      task = std::move( queue.tasks.front() );
+      queue.tasks.pop_front();
+      _nQueued--;
+
+      return true;
+
+   }
+
+   return false;
+
+}
@@ -0,0 +1,238 @@
+////////////////////////
+// batched_criteria test
+////////////////////////
+
+#include "ilctest/ILCTest.h"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <vector>
+#include <random>
+
+#include "KiTrack/Segment.h"
+#include "Criteria/Criteria.h"
+#include "ILDImpl/FTDHitSimple.h"
+#include "ILDImpl/SectorSystemFTD.h"
+
+#include "BatchedCriteria.h"
+
+using namespace std ;
+using namespace KiTrack;
+using namespace KiTrackMarlin;
+
+// this should be the first line in your test
+static ILCTest ilctest = ILCTest( "batched_criteria" , std::cout );
+
+
+/** @return the value the criterion cuts on, in double, for the hits of a segment pair (sorted from the inner to the outer one) */
+double criterionValue( const std::string& name, const std::vector< IHit* >& hits ){
+
+
+   if( name == "Crit2_RZRatio" ){
+
+      double dx = hits[1]->getX() - hits[0]->getX();
+      double dy = hits[1]->getY() - hits[0]->getY();
+      double dz = hits[1]->getZ() - hits[0]->getZ();
+
+      return sqrt( ( dx*dx + dy*dy + dz*dz ) / ( dz*dz ) );
+
+   }
+
+   if( name == "Crit2_StraightTrackRatio" ){
+
+      double rhoParent = sqrt( hits[1]->getX()*hits[1]->getX() + hits[1]->getY()*hits[1]->getY() );
+      double rhoChild = sqrt( hits[0]->getX()*hits[0]->getX() + hits[0]->getY()*hits[0]->getY() );
+
+      return ( rhoParent / hits[1]->getZ() ) / ( rhoChild / hits[0]->getZ() );
+
+   }
+
+   if( name == "Crit3_3DAngle" ){
+
+      double ux = hits[1]->getX() - hits[0]->getX();
+      double uy = hits[1]->getY() - hits[0]->getY();
+      double uz = hits[1]->getZ() - hits[0]->getZ();
+
+      double vx = hits[2]->getX() - hits[1]->getX();
+      double vy = hits[2]->getY() - hits[1]->getY();
+      double vz = hits[2]->getZ() - hits[1]->getZ();
+
+      double angleCos = ( ux*vx + uy*vy + uz*vz ) / sqrt( ( ux*ux + uy*uy + uz*uz ) * ( vx*vx + vy*vy + vz*vz ) );
+
+      return acos( std::min( angleCos, 1. ) ) * 180. / M_PI;
+
+   }
+
+   return 0.;
+
+}
+
+
+/** Checks random pairs of segments with the kernel of a criterion and with the KiTrack criterion itself.
+ *
+ * Only pairs whose value is more than epsilon away from both cut off values are compared: the kernels calculate in float
+ * instead of double, so right at the cut off values they may decide differently.
+ *
+ * @return the number of compared pairs where they disagree
+ */
+unsigned countDifferences( const std::string& name, float min, float max, double epsilon, unsigned nHits, unsigned nPairs ){
+
+
+   SectorSystemFTD secSys( 8, 16, 1 );
+
+   std::mt19937 random( 1 );
+   std::uniform_real_distribution< float > radius( 40., 300. );
+   std::uniform_real_distribution< float > phi( 0., 2*M_PI );
+   std::uniform_real_distribution< float > z( 200., 2000. );
+
+   ICriterion* criterion = Criteria::createCriterion( name, min, max );
+
+   std::vector< ICriterion* > criteria( 1, criterion );
+   BatchedCriteria batchedCriteria( criteria, std::vector< float >( 1, min ), std::vector< float >( 1, max ) );
+
+   if( batchedCriteria.getNumberOfKernels() != 1 ) return nPairs;
+
+   SegmentPairBatch batch( nHits );
+   std::vector< bool > acceptedKiTrack;
+   std::vector< bool > awayFromCut;
+   std::vector< IHit* > allHits;
+
+   for( unsigned i=0; i < nPairs; i++ ){
+
+
+      // hits along a rough straight line from the IP, sorted from the inner to the outer one
+      std::vector< IHit* > hits;
+
+      float r = radius( random );
+      float p = phi( random );
+      float zInner = z( random );
+
+      for( unsigned k=0; k < nHits; k++ ){
+
+         float scale = 1. + 0.3*k;
+         float rk = r * scale * ( 0.9 + 0.2 * radius( random ) / 300. );
+         float pk = p + 0.05 * ( phi( random ) - M_PI );
+
+         hits.push_back( new FTDHitSimple( rk*cos( pk ), rk*sin( pk ), zInner*scale, 1, k+1, 0, 0, &secSys ) );
+
+      }
+
+      batch.add( &hits[0] );
+
+      // the child has the inner hits, the parent the outer ones
+      Segment child( std::vector< IHit* >( hits.begin(), hits.end() - 1 ) );
+      Segment parent( std::vector< IHit* >( hits.begin() + 1, hits.end() ) );
+
+      acceptedKiTrack.push_back( criterion->areCompatible( &parent, &child ) );
+
+      double value = criterionValue( name, hits );
+      awayFromCut.push_back( fabs( value - min ) > epsilon && fabs( value - max ) > epsilon );
+
+      allHits.insert( allHits.end(), hits.begin(), hits.end() );
+
+   }
+
+   std::vector< unsigned char > accepted( nPairs, 1 );
+   batchedCriteria.evaluateKernels( batch, accepted );
+
+   unsigned nDifferences = 0;
+   unsigned nAccepted = 0;
+   unsigned nCompared = 0;
+
+   for( unsigned i=0; i < nPairs; i++ ){
+
+      if( acceptedKiTrack[i] ) nAccepted++;
+
+      if( !awayFromCut[i] ) continue;
+
+      nCompared++;
+      if( bool( accepted[i] ) != acceptedKiTrack[i] ) nDifferences++;
+
+   }
+
+   std::stringstream s;
+   s << name << ": " << nAccepted << " of " << nPairs << " pairs accepted by KiTrack, " << nCompared
+     << " compared away from the cut off values, " << nDifferences << " differences";
+   ilctest.log( s.str() );
+
+   for( unsigned i=0; i < allHits.size(); i++ ) delete allHits[i];
+   delete criterion;
+
+   return nDifferences;
+
+}
+
+//=============================================================================
+
+int main(int , char** ){
+
+    try{
+
+        // ----- write your tests in here -------------------------------------
+
+        ilctest.log( "testing class BatchedCriteria" );
+
+        const unsigned nPairs = 10000;
+
+        // cut off values that accept a part of the random pairs, so both decisions get tested. The margins around the
+        // cut off values are far bigger than the rounding of float.
+        if( countDifferences( "Crit2_RZRatio", 1.01, 1.1, 1e-4, 2, nPairs ) == 0 )
+        {
+            ilctest.pass( "the kernel of Crit2_RZRatio decides like KiTrack" );
+        }
+        else
+        {
+            ilctest.error( "the kernel of Crit2_RZRatio decides differently from KiTrack" );
+        }
+
+        if( countDifferences( "Crit2_StraightTrackRatio", 0.95, 1.05, 1e-4, 2, nPairs ) == 0 )
+        {
+            ilctest.pass( "the kernel of Crit2_StraightTrackRatio decides like KiTrack" );
+        }
+        else
+        {
+            ilctest.error( "the kernel of Crit2_StraightTrackRatio decides differently from KiTrack" );
+        }
+
+        if( countDifferences( "Crit3_3DAngle", 0., 2., 0.01, 3, nPairs ) == 0 )
+        {
+            ilctest.pass( "the kernel of Crit3_3DAngle decides like KiTrack" );
+        }
+        else
+        {
+            ilctest.error( "the kernel of Crit3_3DAngle decides differently from KiTrack" );
+        }
+
+
+        ilctest.log( "testing the criteria without kernel" );
+
+        std::vector< ICriterion* > criteria( 1, Criteria::createCriterion( "Crit4_3DAngleChange", 0.5, 2. ) );
+        BatchedCriteria batchedCriteria( criteria, std::vector< float >( 1, 0.5 ), std::vector< float >( 1, 2. ) );
+
+        if( batchedCriteria.getNumberOfKernels() == 0 && batchedCriteria.getOtherCriteria().size() == 1 )
+        {
+            ilctest.pass( "Crit4_3DAngleChange is left to KiTrack" );
+        }
+        else
+        {
+            ilctest.error( "expecting no kernel for Crit4_3DAngleChange" );
+        }
+
+        delete criteria[0];
+
+        // --------------------------------------------------------------------
+
+
+    //} catch( ... ){
+    } catch( exception &e ){
+        ilctest.log( "exception caught" );
+        ilctest.fatal_error( e.what() );
+    }
+
+
+    return 0;
+}
+
+//=============================================================================
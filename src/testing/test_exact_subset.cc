@@ -0,0 +1,107 @@
+////////////////////////
+// exact_subset test
+////////////////////////
+
+#include "ilctest/ILCTest.h"
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include "ExactSubsetSolver.h"
+
+using namespace std ;
+
+// this should be the first line in your test
+static ILCTest ilctest = ILCTest( "exact_subset" , std::cout );
+
+//=============================================================================
+
+int main(int , char** ){
+    
+    try{
+    
+        // ----- write your tests in here -------------------------------------
+
+        ilctest.log( "testing class ExactSubsetSolver" );
+
+
+        ilctest.log( "testing a chain of 3 tracks with qualities 0.6, 0.9, 0.6" );
+
+        // track 1 is in conflict with 0 and 2: the two outer ones together are better than the middle one
+        std::vector< std::vector< unsigned > > conflicts( 3 );
+        conflicts[0].push_back( 1 );
+        conflicts[1].push_back( 0 );
+        conflicts[1].push_back( 2 );
+        conflicts[2].push_back( 1 );
+
+        std::vector< double > QIs( 3 );
+        QIs[0] = 0.6;
+        QIs[1] = 0.9;
+        QIs[2] = 0.6;
+
+        KiTrackMarlin::ExactSubsetSolver solver( 64, 1000 );
+        std::vector< bool > accepted;
+
+        if( solver.calculateBestSet( conflicts, QIs, accepted ) && accepted[0] && !accepted[1] && accepted[2] )
+        {
+            ilctest.pass( "tracks 0 and 2 accepted, track 1 rejected" );
+        }
+        else
+        {
+            ilctest.error( "expecting tracks 0 and 2 to be accepted and track 1 to be rejected" );
+        }
+
+
+        ilctest.log( "testing a chain of 3 tracks with qualities 0.4, 0.9, 0.4" );
+
+        QIs[0] = 0.4;
+        QIs[2] = 0.4;
+
+        if( solver.calculateBestSet( conflicts, QIs, accepted ) && !accepted[0] && accepted[1] && !accepted[2] )
+        {
+            ilctest.pass( "track 1 accepted, tracks 0 and 2 rejected" );
+        }
+        else
+        {
+            ilctest.error( "expecting track 1 to be accepted and tracks 0 and 2 to be rejected" );
+        }
+
+
+        ilctest.log( "testing the limits" );
+
+        KiTrackMarlin::ExactSubsetSolver smallSolver( 2, 1000 );
+
+        if( !smallSolver.calculateBestSet( conflicts, QIs, accepted ) )
+        {
+            ilctest.pass( "3 tracks are too many for a maximum of 2" );
+        }
+        else
+        {
+            ilctest.error( "not expecting a result for more tracks than the maximum" );
+        }
+
+        KiTrackMarlin::ExactSubsetSolver budgetSolver( 64, 1 );
+
+        if( !budgetSolver.calculateBestSet( conflicts, QIs, accepted ) )
+        {
+            ilctest.pass( "no result with a budget of 1 node" );
+        }
+        else
+        {
+            ilctest.error( "not expecting a result with a budget of 1 node" );
+        }
+
+        // --------------------------------------------------------------------
+
+
+    //} catch( ... ){
+    } catch( exception &e ){
+        ilctest.log( "exception caught" );
+        ilctest.fatal_error( e.what() );
+    }
+
+
+    return 0;
+}
+
+//=============================================================================
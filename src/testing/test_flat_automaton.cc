@@ -0,0 +1,320 @@
+////////////////////////
+// flat_automaton test
+////////////////////////
+
+#include "ilctest/ILCTest.h"
+#include <algorithm>
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include "KiTrack/Automaton.h"
+#include "KiTrack/SegmentBuilder.h"
+#include "Criteria/Criteria.h"
+#include "ILDImpl/FTDHitSimple.h"
+#include "ILDImpl/FTDSectorConnector.h"
+#include "ILDImpl/SectorSystemFTD.h"
+
+#include "FlatAutomaton.h"
+#include "HitConnectionGraph.h"
+#include "SectorHitStore.h"
+
+using namespace std ;
+using namespace KiTrack;
+using namespace KiTrackMarlin;
+
+// this should be the first line in your test
+static ILCTest ilctest = ILCTest( "flat_automaton" , std::cout );
+
+//=============================================================================
+
+namespace{
+
+    typedef std::vector< IHit* > RawTrack;
+
+    /** the z positions of the FTD disks (layer 1 to 7) in mm */
+    const float diskZ[] = { 220., 371., 645., 1020., 1350., 1686., 2000. };
+    const unsigned nDisks = sizeof( diskZ ) / sizeof( diskZ[0] );
+
+    const unsigned nPetals = 16;
+
+    const float rMin = 40.;
+    const float rMax = 300.;
+
+
+    IHit* createHit( float r, float phi, unsigned layer, const SectorSystemFTD* secSys ){
+
+        if( phi < 0. ) phi += 2*M_PI;
+
+        unsigned module = unsigned( phi / ( 2*M_PI ) * nPetals ) % nPetals;
+
+        return new FTDHitSimple( r*cos( phi ), r*sin( phi ), diskZ[ layer - 1 ], 1, layer, module, 0, secSys );
+
+    }
+
+
+    /** Straight tracks from the IP on the forward side of the FTD, slightly smeared, and noise hits. The virtual IP hit comes first. */
+    std::vector< IHit* > createEvent( unsigned nTracks, unsigned nNoiseHits, const SectorSystemFTD* secSys, std::mt19937& random ){
+
+        std::vector< IHit* > hits;
+
+        IHit* virtualIPHit = new FTDHitSimple( 0., 0., 0., 1, 0, 0, 0, secSys );
+        virtualIPHit->setIsVirtual( true );
+        hits.push_back( virtualIPHit );
+
+        std::uniform_real_distribution< float > slope( rMin / diskZ[0], rMax / diskZ[ nDisks - 1 ] * 3. );
+        std::uniform_real_distribution< float > phi( 0., 2*M_PI );
+        std::normal_distribution< float > smear( 0., 0.002 );
+
+        for( unsigned i=0; i < nTracks; i++ ){
+
+            float s = slope( random );
+            float p = phi( random );
+
+            for( unsigned layer=1; layer <= nDisks; layer++ ){
+
+                float r = s * diskZ[ layer - 1 ] * ( 1. + smear( random ) );
+
+                if( r >= rMin && r <= rMax ) hits.push_back( createHit( r, p + smear( random ), layer, secSys ) );
+
+            }
+
+        }
+
+        std::uniform_real_distribution< float > radius( rMin, rMax );
+        std::uniform_int_distribution< unsigned > layer( 1, nDisks );
+
+        for( unsigned i=0; i < nNoiseHits; i++ ) hits.push_back( createHit( radius( random ), phi( random ), layer( random ), secSys ) );
+
+        return hits;
+
+    }
+
+
+    /** The segments of an automaton, by their (sorted) hits, and whether a segment has a chain of children down to the IP */
+    typedef std::map< RawTrack , bool > SegmentStates;
+
+
+    /** Segments of the KiTrack automaton with a chain to the IP have their inner state equal to their layer */
+    SegmentStates getStates( const Automaton& automaton ){
+
+        SegmentStates states;
+
+        std::vector< const Segment* > segments = automaton.getSegments();
+
+        for( unsigned i=0; i < segments.size(); i++ ){
+
+            Segment* segment = const_cast< Segment* >( segments[i] );
+
+            RawTrack hits = segment->getHits();
+            std::sort( hits.begin(), hits.end() );
+
+            states[ hits ] = ( segment->getInnerState() == int( segment->getLayer() ) );
+
+        }
+
+        return states;
+
+    }
+
+
+    /** Segments of the flat automaton with a chain to the IP have their state equal to their layer */
+    SegmentStates getStates( const FlatAutomaton& automaton ){
+
+        SegmentStates states;
+
+        for( unsigned i=0; i < automaton.getNumberOfSegments(); i++ ){
+
+            RawTrack hits = automaton.getSegmentHits( i );
+            std::sort( hits.begin(), hits.end() );
+
+            states[ hits ] = ( automaton.getState( i ) == int( automaton.getLayer( i ) ) );
+
+        }
+
+        return states;
+
+    }
+
+
+    /** @return the tracks with their hits sorted, in a sorted order, so tracks of different automata can be compared */
+    std::vector< RawTrack > normalise( std::vector< RawTrack > tracks ){
+
+        for( unsigned i=0; i < tracks.size(); i++ ) std::sort( tracks[i].begin(), tracks[i].end() );
+
+        std::sort( tracks.begin(), tracks.end() );
+
+        return tracks;
+
+    }
+
+
+    /** Checks, that both automata have the same segments with the same states and the same number of connections */
+    bool compare( const std::string& step, Automaton& automaton, const FlatAutomaton& flatAutomaton ){
+
+        SegmentStates states = getStates( automaton );
+        SegmentStates flatStates = getStates( flatAutomaton );
+
+        bool same = ( states == flatStates ) && ( automaton.getNumberOfConnections() == flatAutomaton.getNumberOfConnections() );
+
+        if( !same ){
+
+            std::stringstream s;
+            s << step << ": KiTrack has " << states.size() << " segments with " << automaton.getNumberOfConnections()
+              << " connections, the flat automaton " << flatStates.size() << " with " << flatAutomaton.getNumberOfConnections();
+            ilctest.log( s.str() );
+
+        }
+
+        return same;
+
+    }
+
+
+    /** Runs both automata step by step on the same hits and compares them after every step.
+     *
+     * @return whether all steps gave the same segments, states, connections and tracks
+     */
+    bool runBoth( const SectorHitStore& sectorHitStore, ISectorConnector* secCon,
+                  const std::vector< ICriterion* >& crit2Vec,
+                  const std::vector< ICriterion* >& crit3Vec,
+                  const std::vector< ICriterion* >& crit4Vec ){
+
+        SegmentBuilder segBuilder( sectorHitStore.getMap() );
+        segBuilder.addCriteria( crit2Vec );
+        segBuilder.addSectorConnector( secCon );
+
+        Automaton automaton = segBuilder.get1SegAutomaton();
+
+        HitConnectionGraph hitConnectionGraph;
+        hitConnectionGraph.build( sectorHitStore, sectorHitStore.getOccupiedSectors(), secCon, crit2Vec );
+
+        FlatAutomaton flatAutomaton( hitConnectionGraph );
+
+        bool same = compare( "1-hit segments", automaton, flatAutomaton );
+
+        const std::vector< ICriterion* >* criteria[2] = { &crit3Vec, &crit4Vec };
+        const char* names[2] = { "2-hit segments", "3-hit segments" };
+
+        for( unsigned i=0; i < 2; i++ ){
+
+            automaton.clearCriteria();
+            automaton.addCriteria( *criteria[i] );
+            flatAutomaton.clearCriteria();
+            flatAutomaton.addCriteria( *criteria[i] );
+
+            automaton.lengthenSegments();
+            flatAutomaton.lengthenSegments();
+
+            automaton.doAutomaton();
+            flatAutomaton.doAutomaton();
+
+            same = compare( std::string( names[i] ) + " after doAutomaton", automaton, flatAutomaton ) && same;
+
+            automaton.cleanBadStates();
+            flatAutomaton.cleanBadStates();
+
+            same = compare( std::string( names[i] ) + " after cleanBadStates", automaton, flatAutomaton ) && same;
+
+            automaton.resetStates();
+            flatAutomaton.resetStates();
+
+        }
+
+        if( normalise( automaton.getTracks( 3 ) ) != normalise( flatAutomaton.getTracks( 3 ) ) ){
+
+            ilctest.log( "the tracks differ" );
+            same = false;
+
+        }
+
+        return same;
+
+    }
+
+}
+
+int main(int , char** ){
+
+    try{
+
+        // ----- write your tests in here -------------------------------------
+
+        ilctest.log( "testing class FlatAutomaton against KiTrack::Automaton" );
+
+        std::mt19937 random( 1 );
+
+        SectorSystemFTD secSys( nDisks + 1, nPetals, 1 );
+        FTDSectorConnector secCon( &secSys, 1, 1, 5 );
+
+        // loose cuts for straight tracks from the IP
+        std::vector< ICriterion* > crit2Vec;
+        std::vector< ICriterion* > crit3Vec;
+        std::vector< ICriterion* > crit4Vec;
+
+        crit2Vec.push_back( Criteria::createCriterion( "Crit2_RZRatio", 0.9, 1.1 ) );
+        crit2Vec.push_back( Criteria::createCriterion( "Crit2_StraightTrackRatio", 0.9, 1.1 ) );
+        crit3Vec.push_back( Criteria::createCriterion( "Crit3_3DAngle", 0., 10. ) );
+        crit4Vec.push_back( Criteria::createCriterion( "Crit4_3DAngleChange", 0.5, 2. ) );
+
+        const unsigned occupancies[] = { 5, 30, 100 };
+
+        for( unsigned iOcc=0; iOcc < sizeof( occupancies ) / sizeof( occupancies[0] ); iOcc++ ){
+
+            unsigned nTracks = occupancies[iOcc];
+
+            std::stringstream s;
+            s << "testing 5 events with " << nTracks << " tracks and " << 2*nTracks << " noise hits";
+            ilctest.log( s.str() );
+
+            unsigned nDifferent = 0;
+
+            for( unsigned iEvent=0; iEvent < 5; iEvent++ ){
+
+                std::vector< IHit* > hits = createEvent( nTracks, 2*nTracks, &secSys, random );
+
+                // the store makes room for the sectors of the hits
+                SectorHitStore sectorHitStore;
+                sectorHitStore.reset( 0 );
+                for( unsigned i=0; i < hits.size(); i++ ) sectorHitStore.addHit( hits[i] );
+                sectorHitStore.build();
+
+                if( !runBoth( sectorHitStore, &secCon, crit2Vec, crit3Vec, crit4Vec ) ) nDifferent++;
+
+                for( unsigned i=0; i < hits.size(); i++ ) delete hits[i];
+
+            }
+
+            if( nDifferent == 0 )
+            {
+                ilctest.pass( "the same segments, states, connections and tracks in all events" );
+            }
+            else
+            {
+                ilctest.error( "expecting the same segments, states, connections and tracks as KiTrack::Automaton" );
+            }
+
+        }
+
+        for( unsigned i=0; i < crit2Vec.size(); i++ ) delete crit2Vec[i];
+        for( unsigned i=0; i < crit3Vec.size(); i++ ) delete crit3Vec[i];
+        for( unsigned i=0; i < crit4Vec.size(); i++ ) delete crit4Vec[i];
+
+        // --------------------------------------------------------------------
+
+
+    //} catch( ... ){
+    } catch( exception &e ){
+        ilctest.log( "exception caught" );
+        ilctest.fatal_error( e.what() );
+    }
+
+
+    return 0;
+}
+
+//=============================================================================
@@ -0,0 +1,137 @@
+////////////////////////
+// overlap_chi2 test
+////////////////////////
+
+#include "ilctest/ILCTest.h"
+#include <cmath>
+#include <exception>
+#include <iostream>
+#include <vector>
+
+#include "ForwardTrackingEngine.h"
+
+using namespace std ;
+
+// this should be the first line in your test
+static ILCTest ilctest = ILCTest( "overlap_chi2" , std::cout );
+
+//=============================================================================
+
+namespace{
+
+    /** A covariance matrix (xx, yx, yy, zx, zy, zz) */
+    std::vector< float > covariance( float xx, float yx, float yy ){
+
+        std::vector< float > cov( 6, 0.f );
+        cov[0] = xx;
+        cov[1] = yx;
+        cov[2] = yy;
+
+        return cov;
+
+    }
+
+}
+
+int main(int , char** ){
+
+    try{
+
+        // ----- write your tests in here -------------------------------------
+
+        ilctest.log( "testing ForwardTrackingEngine::getChi2XY" );
+
+        double chi2Max = KiTrackMarlin::ForwardTrackingEngine::Config().overlappingHitsChi2Max;
+
+
+        ilctest.log( "testing a diagonal covariance matrix" );
+
+        // residual of 2 sigma in x and 1 sigma in y: chi2 = 4 + 1
+        double chi2 = KiTrackMarlin::ForwardTrackingEngine::getChi2XY( covariance( 0.01f, 0.f, 0.04f ), 0.2, 0.2 );
+
+        if( fabs( chi2 - 5. ) < 1e-4 )
+        {
+            ilctest.pass( "chi2 = 5" );
+        }
+        else
+        {
+            ilctest.error( "expecting chi2 = 5" );
+        }
+
+
+        ilctest.log( "testing a singular covariance matrix with a positive variance" );
+
+        // det = 0: the bigger variance is used for both directions
+        chi2 = KiTrackMarlin::ForwardTrackingEngine::getChi2XY( covariance( 0.04f, 0.f, 0.f ), 0.2, 0.2 );
+
+        if( fabs( chi2 - 2. ) < 1e-4 )
+        {
+            ilctest.pass( "chi2 = 2" );
+        }
+        else
+        {
+            ilctest.error( "expecting chi2 = 2" );
+        }
+
+
+        ilctest.log( "testing the choice of the overlapping hit, when one hit behind has a degenerate covariance matrix" );
+
+        // The degenerate hit is right on the prediction, the other one is 1 sigma off in x and y. Only the other one
+        // may be chosen.
+        std::vector< std::vector< float > > covs;
+        std::vector< double > residuals;
+
+        covs.push_back( covariance( 0.f, 0.f, 0.f ) );
+        residuals.push_back( 0.001 );
+
+        covs.push_back( covariance( 0.01f, 0.f, 0.01f ) );
+        residuals.push_back( 0.1 );
+
+        int bestHit = -1;
+        double bestChi2 = chi2Max;
+
+        for( unsigned i=0; i < covs.size(); i++ ){
+
+            chi2 = KiTrackMarlin::ForwardTrackingEngine::getChi2XY( covs[i], residuals[i], residuals[i] );
+
+            if( chi2 < bestChi2 ){
+
+                bestChi2 = chi2;
+                bestHit = i;
+
+            }
+
+        }
+
+        if( bestHit == 1 )
+        {
+            ilctest.pass( "the hit with the usable covariance matrix is chosen" );
+        }
+        else
+        {
+            ilctest.error( "expecting the hit with the usable covariance matrix to be chosen" );
+        }
+
+        if( KiTrackMarlin::ForwardTrackingEngine::getChi2XY( std::vector< float >(), 0., 0. ) >= chi2Max )
+        {
+            ilctest.pass( "a hit without a covariance matrix is never chosen" );
+        }
+        else
+        {
+            ilctest.error( "expecting a hit without a covariance matrix to be above the chi2 cut" );
+        }
+
+        // --------------------------------------------------------------------
+
+
+    //} catch( ... ){
+    } catch( exception &e ){
+        ilctest.log( "exception caught" );
+        ilctest.fatal_error( e.what() );
+    }
+
+
+    return 0;
+}
+
+//=============================================================================